@@ -0,0 +1,81 @@
+// Compares moving every proxy of a candybox::BVH with move() one at a time to
+// BVH::moveBatch(), serial and on the TaskScheduler. Most proxies drift out of their fat
+// boxes every frame and a few teleport. The area ratio shows what the refits cost in tree
+// quality.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+#include "candybox/BVH.hpp"
+#include "candybox/TaskScheduler.hpp"
+
+namespace {
+
+using namespace candybox;
+
+template <typename Move>
+void
+Run(const char* name_, uint32_t numProxies_, uint32_t numFrames_, Move move_)
+{
+	std::mt19937 rng(1);
+	std::uniform_real_distribution<float> position(-5000.0f, 5000.0f);
+	std::uniform_real_distribution<float> extent(1.0f, 20.0f);
+	std::uniform_real_distribution<float> step(-1.0f, 1.0f);
+	BVH tree;
+	std::vector<int32_t> ids(numProxies_);
+	std::vector<Box> boxes(numProxies_);
+	for (uint32_t i = 0; i < numProxies_; ++i)
+	{
+		boxes[i].l = {position(rng), position(rng)};
+		boxes[i].u = {boxes[i].l.x + extent(rng), boxes[i].l.y + extent(rng)};
+		ids[i] = tree.add(boxes[i], BVH::BVH_DefaultCategory, (void*)(uintptr_t)(i + 1));
+	}
+
+	std::chrono::duration<double, std::milli> total(0);
+	for (uint32_t frame = 0; frame < numFrames_; ++frame)
+	{
+		for (Box& box : boxes)
+		{
+			glm::vec2 delta = {step(rng), step(rng)};
+			if (rng() % 100 == 0) delta = {position(rng) * 0.1f, position(rng) * 0.1f};
+			box.l = m::addv(box.l, delta);
+			box.u = m::addv(box.u, delta);
+		}
+		auto start = std::chrono::high_resolution_clock::now();
+		move_(tree, ids, boxes);
+		total += std::chrono::high_resolution_clock::now() - start;
+		for (int32_t id : ids) tree.clearMoved(id);
+	}
+	printf("%-20s %8.2f ms per frame, area ratio %.1f, height %d\n", name_,
+	    total.count() / numFrames_, tree.getAreaRatio(), tree.getHeight());
+}
+
+} // namespace
+
+int
+main(int argc, char** argv)
+{
+	uint32_t numProxies = argc > 1 ? (uint32_t)atoi(argv[1]) : 100000;
+	uint32_t numFrames = argc > 2 ? (uint32_t)atoi(argv[2]) : 20;
+	TaskScheduler ts;
+	ts.Initialize();
+	printf("%u proxies, %u frames, %u threads\n", numProxies, numFrames,
+	    ts.GetNumTaskThreads());
+
+	Run("move", numProxies, numFrames,
+	    [](BVH& tree, const std::vector<int32_t>& ids, const std::vector<Box>& boxes) {
+		    for (size_t i = 0; i < ids.size(); ++i) tree.move(ids[i], boxes[i]);
+	    });
+	Run("moveBatch", numProxies, numFrames,
+	    [](BVH& tree, const std::vector<int32_t>& ids, const std::vector<Box>& boxes) {
+		    tree.moveBatch(ids.data(), boxes.data(), (int32_t)ids.size());
+	    });
+	Run("moveBatch parallel", numProxies, numFrames,
+	    [&](BVH& tree, const std::vector<int32_t>& ids, const std::vector<Box>& boxes) {
+		    tree.moveBatch(ids.data(), boxes.data(), (int32_t)ids.size(), &ts);
+	    });
+	ts.WaitforAllAndShutdown();
+	return 0;
+}
@@ -0,0 +1,109 @@
+// Reports the build time and the quality (BVH::getAreaRatio, lower is better) of a
+// candybox::BVH built by insertion, by rebuildTopDownSAH() serial and on the TaskScheduler,
+// and by rebuildIncremental() with a time budget per frame while the proxies move.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+#include "candybox/BVH.hpp"
+#include "candybox/TaskScheduler.hpp"
+
+namespace {
+
+using namespace candybox;
+
+struct Scene
+{
+	BVH tree;
+	std::vector<int32_t> ids;
+	std::vector<Box> boxes;
+	std::mt19937 rng{1};
+
+	explicit Scene(uint32_t numProxies_)
+	{
+		std::uniform_real_distribution<float> position(-5000.0f, 5000.0f);
+		std::uniform_real_distribution<float> extent(1.0f, 20.0f);
+		ids.resize(numProxies_);
+		boxes.resize(numProxies_);
+		for (uint32_t i = 0; i < numProxies_; ++i)
+		{
+			boxes[i].l = {position(rng), position(rng)};
+			boxes[i].u = {boxes[i].l.x + extent(rng), boxes[i].l.y + extent(rng)};
+			ids[i] = tree.add(boxes[i], BVH::BVH_DefaultCategory, (void*)(uintptr_t)(i + 1));
+		}
+	}
+
+	// every proxy drifts, moveBatch() refits the tree and degrades it.
+	void step()
+	{
+		std::uniform_real_distribution<float> delta(-1.0f, 1.0f);
+		for (Box& box : boxes)
+		{
+			glm::vec2 d = {delta(rng), delta(rng)};
+			box.l = m::addv(box.l, d);
+			box.u = m::addv(box.u, d);
+		}
+		tree.moveBatch(ids.data(), boxes.data(), (int32_t)ids.size());
+	}
+};
+
+double
+Elapsed(std::chrono::high_resolution_clock::time_point start_)
+{
+	return std::chrono::duration<double, std::milli>(
+	           std::chrono::high_resolution_clock::now() - start_)
+	    .count();
+}
+
+void
+RunFull(const char* name_, uint32_t numProxies_, TaskScheduler* ts_)
+{
+	Scene scene(numProxies_);
+	std::vector<BVH::ProxyMap> map(numProxies_);
+	auto start = std::chrono::high_resolution_clock::now();
+	scene.tree.rebuildTopDownSAH(map.data(), (int32_t)numProxies_, ts_);
+	printf("%-24s %8.2f ms, area ratio %7.1f, height %d\n", name_, Elapsed(start),
+	    scene.tree.getAreaRatio(), scene.tree.getHeight());
+}
+
+} // namespace
+
+int
+main(int argc, char** argv)
+{
+	uint32_t numProxies = argc > 1 ? (uint32_t)atoi(argv[1]) : 100000;
+	TaskScheduler ts;
+	ts.Initialize();
+	printf("%u proxies, %u threads\n", numProxies, ts.GetNumTaskThreads());
+
+	{
+		Scene scene(numProxies);
+		printf("%-24s %8s    area ratio %7.1f, height %d\n", "insertion", "",
+		    scene.tree.getAreaRatio(), scene.tree.getHeight());
+	}
+	RunFull("rebuildTopDownSAH", numProxies, nullptr);
+	RunFull("rebuildTopDownSAH ts", numProxies, &ts);
+
+	// the same motion with and without 1 ms of incremental rebuild per frame.
+	const uint32_t numFrames = 60;
+	Scene refit(numProxies), incremental(numProxies);
+	double rebuildMs = 0.0;
+	int32_t subtrees = 0;
+	for (uint32_t frame = 0; frame < numFrames; ++frame)
+	{
+		refit.step();
+		incremental.step();
+		auto start = std::chrono::high_resolution_clock::now();
+		subtrees += incremental.tree.rebuildIncremental(1.0f);
+		rebuildMs += Elapsed(start);
+	}
+	printf("%-24s %8s    area ratio %7.1f after %u frames\n", "moveBatch", "",
+	    refit.tree.getAreaRatio(), numFrames);
+	printf("%-24s %8.2f ms, area ratio %7.1f after %u frames, %d subtrees\n",
+	    "rebuildIncremental 1ms", rebuildMs / numFrames, incremental.tree.getAreaRatio(),
+	    numFrames, subtrees);
+	ts.WaitforAllAndShutdown();
+	return 0;
+}
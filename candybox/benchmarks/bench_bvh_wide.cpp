@@ -0,0 +1,109 @@
+// Compares candybox::BVH queries and raycasts through the callback pointers, the inlined
+// visitors and the 4-wide SIMD tree built by BVH::updateWide().
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+#include "candybox/BVH.hpp"
+
+namespace {
+
+using namespace candybox;
+
+bool
+CountQuery(int32_t, void*, void* context_)
+{
+	++*static_cast<size_t*>(context_);
+	return true;
+}
+
+float
+CountRaycast(const BVH::RayCast* input_, int32_t, void*, void* context_)
+{
+	++*static_cast<size_t*>(context_);
+	return input_->maxFraction;
+}
+
+template <typename Func>
+void
+Run(const char* name_, size_t count_, Func func_)
+{
+	size_t results = 0;
+	auto start = std::chrono::high_resolution_clock::now();
+	for (size_t i = 0; i < count_; ++i) func_(i, results);
+	std::chrono::duration<double, std::micro> us =
+	    std::chrono::high_resolution_clock::now() - start;
+	printf("%-16s %8.3f us, %zu results\n", name_, us.count() / count_, results);
+}
+
+} // namespace
+
+int
+main(int argc, char** argv)
+{
+	uint32_t numProxies = argc > 1 ? (uint32_t)atoi(argv[1]) : 100000;
+	uint32_t numQueries = argc > 2 ? (uint32_t)atoi(argv[2]) : 10000;
+
+	std::mt19937 rng(1);
+	std::uniform_real_distribution<float> position(-5000.0f, 5000.0f);
+	std::uniform_real_distribution<float> extent(1.0f, 20.0f);
+	BVH tree;
+	for (uint32_t i = 0; i < numProxies; ++i)
+	{
+		Box box;
+		box.l = {position(rng), position(rng)};
+		box.u = {box.l.x + extent(rng), box.l.y + extent(rng)};
+		tree.add(box, BVH::BVH_DefaultCategory, (void*)(uintptr_t)(i + 1));
+	}
+
+	auto start = std::chrono::high_resolution_clock::now();
+	tree.updateWide();
+	std::chrono::duration<double, std::milli> flattenMs =
+	    std::chrono::high_resolution_clock::now() - start;
+	start = std::chrono::high_resolution_clock::now();
+	tree.updateWide();
+	std::chrono::duration<double, std::milli> refitMs =
+	    std::chrono::high_resolution_clock::now() - start;
+
+	std::vector<Box> queries(numQueries);
+	std::vector<BVH::RayCast> rays(numQueries);
+	for (uint32_t i = 0; i < numQueries; ++i)
+	{
+		queries[i].l = {position(rng), position(rng)};
+		queries[i].u = {queries[i].l.x + 100.0f, queries[i].l.y + 100.0f};
+		rays[i].p1 = {position(rng), position(rng)};
+		rays[i].p2 = {rays[i].p1.x + 500.0f, rays[i].p1.y - 300.0f};
+		rays[i].maxFraction = 1.0f;
+	}
+
+	printf("%u proxies, height %d, flatten %.2f ms, refit %.2f ms\n", numProxies,
+	    tree.getHeight(), flattenMs.count(), refitMs.count());
+	Run("query", numQueries, [&](size_t i, size_t& results) {
+		tree.queryFiltered(queries[i], BVH::BVH_DefaultMask, CountQuery, &results);
+	});
+	Run("query visitor", numQueries, [&](size_t i, size_t& results) {
+		tree.query(queries[i], BVH::BVH_DefaultMask, [&](int32_t, void*) {
+			++results;
+			return true;
+		});
+	});
+	Run("queryWide", numQueries, [&](size_t i, size_t& results) {
+		tree.queryWide(queries[i], BVH::BVH_DefaultMask, CountQuery, &results);
+	});
+	Run("raycast", numQueries, [&](size_t i, size_t& results) {
+		tree.raycast(&rays[i], BVH::BVH_DefaultMask, CountRaycast, &results);
+	});
+	Run("raycast visitor", numQueries, [&](size_t i, size_t& results) {
+		auto count = [&](const BVH::RayCast& input, int32_t, void*) {
+			++results;
+			return input.maxFraction;
+		};
+		tree.raycast(rays[i], BVH::BVH_DefaultMask, count);
+	});
+	Run("raycastWide", numQueries, [&](size_t i, size_t& results) {
+		tree.raycastWide(&rays[i], BVH::BVH_DefaultMask, CountRaycast, &results);
+	});
+	return 0;
+}
@@ -0,0 +1,188 @@
+// Compares computing the manifolds of candybox::gjk pairs one by one with GJK_Collide() to
+// GJK_Batch(), serial and on the TaskScheduler, for a scene of stacked boxes and for a pile
+// of circles and boxes. The distance caches are kept between the frames as a solver would.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+#include "candybox/GJK.hpp"
+#include "candybox/TaskScheduler.hpp"
+
+namespace {
+
+using namespace candybox;
+using namespace candybox::gjk;
+
+struct Scene
+{
+	std::vector<Polygon> polygons;
+	std::vector<Circle> circles;
+	std::vector<Xf2d> xfs;
+	std::vector<ManifoldPair> pairs;
+	std::vector<DistanceCache> caches;
+
+	void addPair(ShapeType typeA_, const void *shapeA_, int32_t a_, ShapeType typeB_,
+	    const void *shapeB_, int32_t b_)
+	{
+		ManifoldPair pair;
+		pair.shapeA = shapeA_;
+		pair.shapeB = shapeB_;
+		pair.xfA = xfs[a_];
+		pair.xfB = xfs[b_];
+		pair.cache = nullptr;
+		pair.typeA = typeA_;
+		pair.typeB = typeB_;
+		pairs.push_back(pair);
+	}
+
+	// sorts the pairs by type for GJK_Batch() and gives each one a cache.
+	void finish()
+	{
+		auto key = [](const ManifoldPair &pair) {
+			return (int32_t)pair.typeA * 4 + (int32_t)pair.typeB;
+		};
+		std::stable_sort(pairs.begin(), pairs.end(),
+		    [&](const ManifoldPair &a, const ManifoldPair &b) { return key(a) < key(b); });
+		caches.assign(pairs.size(), DistanceCache());
+		for (size_t i = 0; i < pairs.size(); ++i) pairs[i].cache = &caches[i];
+	}
+};
+
+// columns of boxes resting on each other, every box touches the one above and the
+// neighbouring columns.
+Scene
+Stacks(int32_t columns_, int32_t rows_)
+{
+	std::mt19937 rng(1);
+	std::uniform_real_distribution<float> jitter(-0.01f, 0.01f);
+	Scene scene;
+	scene.polygons.push_back(MakeBox(0.5f, 0.5f));
+	for (int32_t x = 0; x < columns_; ++x)
+	{
+		for (int32_t y = 0; y < rows_; ++y)
+		{
+			glm::vec2 p = {x * 1.005f + jitter(rng), y * 1.0f + 0.5f + jitter(rng)};
+			scene.xfs.push_back(Xf2d(p, Rot2d(jitter(rng))));
+		}
+	}
+	const Polygon *box = &scene.polygons[0];
+	for (int32_t x = 0; x < columns_; ++x)
+	{
+		for (int32_t y = 0; y < rows_; ++y)
+		{
+			int32_t i = x * rows_ + y;
+			if (y + 1 < rows_)
+			{
+				scene.addPair(ShapeType::kPolygon, box, i, ShapeType::kPolygon, box, i + 1);
+			}
+			if (x + 1 < columns_)
+			{
+				scene.addPair(
+				    ShapeType::kPolygon, box, i, ShapeType::kPolygon, box, i + rows_);
+			}
+		}
+	}
+	scene.finish();
+	return scene;
+}
+
+// circles and boxes of different sizes on a jittered grid, each touches its neighbours.
+Scene
+Pile(int32_t side_)
+{
+	std::mt19937 rng(1);
+	std::uniform_real_distribution<float> jitter(-0.05f, 0.05f);
+	std::uniform_real_distribution<float> angle(-3.14f, 3.14f);
+	Scene scene;
+	for (int32_t i = 0; i < 8; ++i)
+	{
+		float size = 0.4f + 0.02f * i;
+		scene.polygons.push_back(MakeBox(size, size * 0.8f));
+		scene.circles.push_back({{0.0f, 0.0f}, size});
+	}
+	std::vector<int32_t> shapes;
+	for (int32_t i = 0; i < side_ * side_; ++i)
+	{
+		glm::vec2 p = {(i % side_) * 0.9f + jitter(rng), (i / side_) * 0.9f + jitter(rng)};
+		scene.xfs.push_back(Xf2d(p, Rot2d(angle(rng))));
+		shapes.push_back((int32_t)(rng() % 16));
+	}
+	for (int32_t i = 0; i < side_ * side_; ++i)
+	{
+		int32_t neighbours[3] = {i + 1, i + side_, i + side_ + 1};
+		for (int32_t j : neighbours)
+		{
+			if (j >= side_ * side_ || (j % side_ == 0 && j != i + side_)) { continue; }
+
+			// circles have index 8 to 15, a polygon is always shape A.
+			int32_t a = i, b = j;
+			if (shapes[a] >= 8 && shapes[b] < 8) { std::swap(a, b); }
+			bool circleA = shapes[a] >= 8, circleB = shapes[b] >= 8;
+			scene.addPair(circleA ? ShapeType::kCircle : ShapeType::kPolygon,
+			    circleA ? (const void *)&scene.circles[shapes[a] - 8]
+			            : (const void *)&scene.polygons[shapes[a]],
+			    a, circleB ? ShapeType::kCircle : ShapeType::kPolygon,
+			    circleB ? (const void *)&scene.circles[shapes[b] - 8]
+			            : (const void *)&scene.polygons[shapes[b]],
+			    b);
+		}
+	}
+	scene.finish();
+	return scene;
+}
+
+template <typename Func>
+void
+Run(const char *name_, Scene &scene_, uint32_t numFrames_, Func func_)
+{
+	std::vector<Manifold> manifolds(scene_.pairs.size());
+	scene_.caches.assign(scene_.pairs.size(), DistanceCache());
+	int32_t points = 0;
+	auto start = std::chrono::high_resolution_clock::now();
+	for (uint32_t frame = 0; frame < numFrames_; ++frame) func_(scene_, manifolds);
+	std::chrono::duration<double, std::milli> ms =
+	    std::chrono::high_resolution_clock::now() - start;
+	for (const Manifold &manifold : manifolds) points += manifold.pointCount;
+	printf("  %-20s %8.3f ms per frame, %d points\n", name_, ms.count() / numFrames_,
+	    points);
+}
+
+void
+Compare(const char *name_, Scene &scene_, uint32_t numFrames_, TaskScheduler &ts_)
+{
+	const float maxd = 4.0f * LINEAR_SLOP;
+	printf("%s, %zu pairs\n", name_, scene_.pairs.size());
+	Run("GJK_Collide", scene_, numFrames_, [&](Scene &scene, std::vector<Manifold> &manifolds) {
+		for (size_t i = 0; i < scene.pairs.size(); ++i)
+			manifolds[i] = GJK_Collide(&scene.pairs[i], maxd);
+	});
+	Run("GJK_Batch", scene_, numFrames_, [&](Scene &scene, std::vector<Manifold> &manifolds) {
+		GJK_Batch(scene.pairs.data(), (int32_t)scene.pairs.size(), maxd, manifolds.data());
+	});
+	Run("GJK_Batch parallel", scene_, numFrames_,
+	    [&](Scene &scene, std::vector<Manifold> &manifolds) {
+		    GJK_Batch(scene.pairs.data(), (int32_t)scene.pairs.size(), maxd, manifolds.data(),
+		        &ts_);
+	    });
+}
+
+} // namespace
+
+int
+main(int argc, char **argv)
+{
+	uint32_t numFrames = argc > 1 ? (uint32_t)atoi(argv[1]) : 20;
+	TaskScheduler ts;
+	ts.Initialize();
+	printf("%u frames, %u threads\n", numFrames, ts.GetNumTaskThreads());
+
+	Scene stacks = Stacks(100, 100);
+	Compare("stacks", stacks, numFrames, ts);
+	Scene pile = Pile(150);
+	Compare("pile", pile, numFrames, ts);
+	ts.WaitforAllAndShutdown();
+	return 0;
+}
@@ -0,0 +1,145 @@
+// Compares the GJK iterations and the time of the distance and time of impact queries of
+// persistent pairs, i.e. proximity sensors, started from scratch every frame and warm
+// started by a candybox::gjk::DistanceCacheTable.
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+#include "candybox/GJKCache.hpp"
+
+namespace {
+
+using namespace candybox;
+using namespace candybox::gjk;
+
+// pairs of convex polygons which drift and spin slowly around each other.
+struct Pairs
+{
+	std::vector<DistanceProxy> proxies;
+	std::vector<Sweep> sweeps;
+
+	explicit Pairs(uint32_t numPairs_)
+	{
+		std::mt19937 rng(1);
+		std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+		for (uint32_t i = 0; i < 2 * numPairs_; ++i)
+		{
+			glm::vec2 points[MAX_POLY_VERTS];
+			int32_t count = 5 + i % (MAX_POLY_VERTS - 4);
+			for (int32_t k = 0; k < count; ++k)
+			{
+				float a = 6.2831853f * k / count + 0.2f * unit(rng);
+				points[k] = {std::cos(a), std::sin(a)};
+			}
+			proxies.push_back(MakeProxy(points, count, 0.0f));
+
+			Sweep sweep;
+			sweep.localCenter = {0.0f, 0.0f};
+			sweep.c1 = {i % 2 ? 3.0f + unit(rng) : 0.0f, unit(rng)};
+			sweep.c2 = {sweep.c1.x + 0.02f * unit(rng), sweep.c1.y + 0.02f * unit(rng)};
+			sweep.a1 = 3.0f * unit(rng);
+			sweep.a2 = sweep.a1 + 0.02f * unit(rng);
+			sweeps.push_back(sweep);
+		}
+	}
+
+	void step()
+	{
+		for (Sweep &sweep : sweeps)
+		{
+			glm::vec2 velocity = m::subv(sweep.c2, sweep.c1);
+			float spin = sweep.a2 - sweep.a1;
+			sweep.c1 = sweep.c2;
+			sweep.c2 = m::addv(sweep.c2, velocity);
+			sweep.a1 = sweep.a2;
+			sweep.a2 += spin;
+		}
+	}
+};
+
+template <typename Query>
+void
+Run(const char *name_, uint32_t numPairs_, uint32_t numFrames_, Query query_)
+{
+	Pairs pairs(numPairs_);
+	DistanceCacheTable table;
+	int64_t iterations = 0;
+	std::chrono::duration<double, std::milli> total(0);
+	for (uint32_t frame = 0; frame < numFrames_; ++frame)
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		for (uint32_t i = 0; i < numPairs_; ++i)
+			iterations += query_(pairs, table, 2 * i, 2 * i + 1);
+		table.nextFrame();
+		total += std::chrono::high_resolution_clock::now() - start;
+		pairs.step();
+	}
+	if (iterations > 0)
+	{
+		printf("%-20s %8.3f ms per frame, %.2f GJK iterations per query\n", name_,
+		    total.count() / numFrames_, (double)iterations / (numPairs_ * numFrames_));
+	}
+	else { printf("%-20s %8.3f ms per frame\n", name_, total.count() / numFrames_); }
+}
+
+DistanceInput
+Input(const Pairs &pairs_, uint32_t a_, uint32_t b_)
+{
+	DistanceInput input;
+	input.proxyA = pairs_.proxies[a_];
+	input.proxyB = pairs_.proxies[b_];
+	input.transformA = GetSweepTransform(&pairs_.sweeps[a_], 0.0f);
+	input.transformB = GetSweepTransform(&pairs_.sweeps[b_], 0.0f);
+	input.useRadii = false;
+	return input;
+}
+
+TOIInput
+SweepInput(const Pairs &pairs_, uint32_t a_, uint32_t b_)
+{
+	TOIInput input;
+	input.proxyA = pairs_.proxies[a_];
+	input.proxyB = pairs_.proxies[b_];
+	input.sweepA = pairs_.sweeps[a_];
+	input.sweepB = pairs_.sweeps[b_];
+	input.tMax = 1.0f;
+	return input;
+}
+
+} // namespace
+
+int
+main(int argc, char **argv)
+{
+	uint32_t numPairs = argc > 1 ? (uint32_t)atoi(argv[1]) : 10000;
+	uint32_t numFrames = argc > 2 ? (uint32_t)atoi(argv[2]) : 60;
+	printf("%u pairs, %u frames\n", numPairs, numFrames);
+
+	Run("ShapeDistance", numPairs, numFrames,
+	    [](Pairs &pairs, DistanceCacheTable &, uint32_t a, uint32_t b) {
+		    DistanceInput input = Input(pairs, a, b);
+		    DistanceCache cache;
+		    return ShapeDistance(&cache, &input).iterations;
+	    });
+	Run("table.distance", numPairs, numFrames,
+	    [](Pairs &pairs, DistanceCacheTable &table, uint32_t a, uint32_t b) {
+		    DistanceInput input = Input(pairs, a, b);
+		    return table.distance(a, b, &input).iterations;
+	    });
+	Run("TimeOfImpact", numPairs, numFrames,
+	    [](Pairs &pairs, DistanceCacheTable &, uint32_t a, uint32_t b) {
+		    TOIInput input = SweepInput(pairs, a, b);
+		    TimeOfImpact(&input);
+		    return 0;
+	    });
+	Run("table.timeOfImpact", numPairs, numFrames,
+	    [](Pairs &pairs, DistanceCacheTable &table, uint32_t a, uint32_t b) {
+		    TOIInput input = SweepInput(pairs, a, b);
+		    table.timeOfImpact(a, b, &input);
+		    return 0;
+	    });
+	return 0;
+}
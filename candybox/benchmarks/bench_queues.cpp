@@ -0,0 +1,123 @@
+// Compares the throughput of LockLessMPMCQueue and LockLessSegmentedQueue with
+// LockLessMultiReadPipe under contention. The pipe only supports a single writer, so it is
+// measured with one writer and several readers, the queues also with several writers.
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+#include "candybox/LockLessMultiReadPipe.hpp"
+#include "candybox/LockLessMPMCQueue.hpp"
+
+namespace {
+
+using namespace candybox;
+
+const uint8_t cQueueSizeLog2 = 8;
+
+// Adapters giving the containers the same interface, TryWrite() and TryRead().
+struct PipeAdapter
+{
+	bool TryWrite(uint32_t value_) { return m_Pipe.WriterTryWriteFront(value_); }
+	bool TryRead(uint32_t* pValue_) { return m_Pipe.ReaderTryReadBack(pValue_); }
+	LockLessMultiReadPipe<cQueueSizeLog2, uint32_t> m_Pipe;
+};
+
+struct MPMCAdapter
+{
+	bool TryWrite(uint32_t value_) { return m_Queue.TryWriteBack(value_); }
+	bool TryRead(uint32_t* pValue_) { return m_Queue.TryReadFront(pValue_); }
+	LockLessMPMCQueue<cQueueSizeLog2, uint32_t> m_Queue;
+};
+
+struct SegmentedAdapter
+{
+	bool TryWrite(uint32_t value_)
+	{
+		m_Queue.WriteBack(value_);
+		return true;
+	}
+	bool TryRead(uint32_t* pValue_) { return m_Queue.TryReadFront(pValue_); }
+	LockLessSegmentedQueue<uint32_t, cQueueSizeLog2> m_Queue;
+};
+
+// Returns items per second moved from numWriters_ to numReaders_ threads.
+template <typename Adapter>
+double
+Run(uint32_t numWriters_, uint32_t numReaders_, uint32_t numItems_)
+{
+	Adapter adapter;
+	std::atomic<uint32_t> numRead = {0};
+	std::atomic<uint64_t> sum = {0};
+	std::atomic<bool> bStart = {false};
+	std::vector<std::thread> threads;
+
+	uint32_t itemsPerWriter = numItems_ / numWriters_;
+	uint32_t total = itemsPerWriter * numWriters_;
+	for (uint32_t writer = 0; writer < numWriters_; ++writer)
+	{
+		threads.emplace_back([&]() {
+			while (!bStart.load(std::memory_order_acquire)) { std::this_thread::yield(); }
+			for (uint32_t i = 0; i < itemsPerWriter; ++i)
+			{
+				while (!adapter.TryWrite(i)) { std::this_thread::yield(); }
+			}
+		});
+	}
+	for (uint32_t reader = 0; reader < numReaders_; ++reader)
+	{
+		threads.emplace_back([&]() {
+			while (!bStart.load(std::memory_order_acquire)) { std::this_thread::yield(); }
+			uint64_t localSum = 0;
+			uint32_t value;
+			while (numRead.load(std::memory_order_relaxed) < total)
+			{
+				if (adapter.TryRead(&value))
+				{
+					localSum += value;
+					numRead.fetch_add(1, std::memory_order_relaxed);
+				}
+				else
+				{
+					std::this_thread::yield();
+				}
+			}
+			sum.fetch_add(localSum);
+		});
+	}
+
+	auto start = std::chrono::high_resolution_clock::now();
+	bStart.store(true, std::memory_order_release);
+	for (std::thread& thread : threads) { thread.join(); }
+	std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+
+	uint64_t expected = (uint64_t)numWriters_ * itemsPerWriter * (itemsPerWriter - 1) / 2;
+	if (sum.load() != expected) { printf("error: lost or duplicated items\n"); }
+	return total / elapsed.count();
+}
+
+} // namespace
+
+int
+main(int argc, char** argv)
+{
+	uint32_t numThreads = argc > 1 ? (uint32_t)atoi(argv[1]) : std::thread::hardware_concurrency();
+	uint32_t numItems = argc > 2 ? (uint32_t)atoi(argv[2]) : 2000000;
+	if (numThreads < 2) { numThreads = 2; }
+	uint32_t numReaders = numThreads - 1;
+
+	printf("%u items, queue size %u\n", numItems, 1u << cQueueSizeLog2);
+	printf("1 writer, %u readers\n", numReaders);
+	printf("  LockLessMultiReadPipe:  %12.0f items/s\n", Run<PipeAdapter>(1, numReaders, numItems));
+	printf("  LockLessMPMCQueue:      %12.0f items/s\n", Run<MPMCAdapter>(1, numReaders, numItems));
+	printf("  LockLessSegmentedQueue: %12.0f items/s\n", Run<SegmentedAdapter>(1, numReaders, numItems));
+
+	uint32_t numWriters = numThreads / 2;
+	numReaders = numThreads - numWriters;
+	printf("%u writers, %u readers\n", numWriters, numReaders);
+	printf("  LockLessMPMCQueue:      %12.0f items/s\n", Run<MPMCAdapter>(numWriters, numReaders, numItems));
+	printf("  LockLessSegmentedQueue: %12.0f items/s\n", Run<SegmentedAdapter>(numWriters, numReaders, numItems));
+	return 0;
+}
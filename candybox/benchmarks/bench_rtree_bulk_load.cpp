@@ -0,0 +1,101 @@
+// Compares building a candybox::RTree by insertion with the STR and Hilbert bulk loads, see
+// detail::BulkLoadMode. Reports the build time, the query time and the number of nodes a
+// query visits, which shows how tightly the nodes are packed.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+#include "candybox/spatial.hpp"
+
+namespace {
+
+using namespace candybox;
+
+struct LevelBox
+{
+	glm::vec<2, float> l, u;
+};
+
+typedef RTree<float, LevelBox, 2, 16> Tree;
+typedef detail::Node<LevelBox, Tree::bbox_type, 16> Node;
+
+// nodes entered by a query, the root included.
+size_t
+CountVisits(const Node* node_, const Tree::bbox_type& query_)
+{
+	size_t visits = 1;
+	for (uint32_t index = 0; node_->isBranch() && index < node_->count; ++index)
+	{
+		if (query_.overlaps(node_->bboxes[index]))
+			visits += CountVisits(node_->children[index], query_);
+	}
+	return visits;
+}
+
+template <typename Build>
+void
+Run(const char* name_, const std::vector<Tree::bbox_type>& queries_, Build build_)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	Tree tree = build_();
+	std::chrono::duration<double, std::milli> buildMs =
+	    std::chrono::high_resolution_clock::now() - start;
+
+	std::vector<LevelBox> results;
+	size_t numResults = 0;
+	start = std::chrono::high_resolution_clock::now();
+	for (const Tree::bbox_type& query : queries_)
+	{
+		results.clear();
+		numResults += tree.query(intersects(query), std::back_inserter(results));
+	}
+	std::chrono::duration<double, std::micro> queryUs =
+	    std::chrono::high_resolution_clock::now() - start;
+
+	size_t visits = 0;
+	for (const Tree::bbox_type& query : queries_)
+		visits += CountVisits(detail::getRootNode(tree), query);
+
+	printf(
+	    "%-12s build %8.1f ms, query %6.2f us, %6.1f nodes visited, %zu results, %zu levels\n",
+	    name_, buildMs.count(), queryUs.count() / queries_.size(),
+	    (double)visits / queries_.size(), numResults, tree.levels());
+}
+
+} // namespace
+
+int
+main(int argc, char** argv)
+{
+	uint32_t numBoxes = argc > 1 ? (uint32_t)atoi(argv[1]) : 100000;
+	uint32_t numQueries = argc > 2 ? (uint32_t)atoi(argv[2]) : 10000;
+
+	// level objects: mostly small, spread over a large map.
+	std::mt19937 rng(1);
+	std::uniform_real_distribution<float> position(0.0f, 10000.0f);
+	std::uniform_real_distribution<float> extent(1.0f, 20.0f);
+	std::vector<LevelBox> boxes(numBoxes);
+	for (LevelBox& box : boxes)
+	{
+		box.l = {position(rng), position(rng)};
+		box.u = {box.l[0] + extent(rng), box.l[1] + extent(rng)};
+	}
+	std::vector<Tree::bbox_type> queries(numQueries);
+	for (Tree::bbox_type& query : queries)
+	{
+		query.l = {position(rng), position(rng)};
+		query.u = {query.l[0] + 100.0f, query.l[1] + 100.0f};
+	}
+	printf("%u boxes, %u queries of 100x100\n", numBoxes, numQueries);
+
+	Run("insertion", queries, [&]() { return Tree(boxes.begin(), boxes.end()); });
+	Run("STR", queries, [&]() {
+		return Tree(boxes.begin(), boxes.end(), detail::eSortTileRecursive);
+	});
+	Run("Hilbert", queries, [&]() {
+		return Tree(boxes.begin(), boxes.end(), detail::eHilbertSort);
+	});
+	return 0;
+}
@@ -0,0 +1,172 @@
+// Compares the continuous collision of fast projectiles against a field of static boxes
+// done as a query of the box swept by each projectile followed by a time of impact against
+// every candidate, with candybox::gjk::ShapeSweep(), which clips the ray at each hit, and
+// with ShapeSweepBatch() on a scheduler.
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+#include "candybox/ShapeSweep.hpp"
+#include "candybox/TaskScheduler.hpp"
+
+namespace {
+
+using namespace candybox;
+using namespace candybox::gjk;
+
+struct World
+{
+	BVH tree;
+	std::vector<Polygon> boxes;
+	std::vector<Xf2d> xfs;
+	std::atomic<int64_t> numShapes{0};
+
+	explicit World(uint32_t numBoxes_)
+	{
+		std::mt19937 rng(1);
+		std::uniform_real_distribution<float> position(-200.0f, 200.0f);
+		std::uniform_real_distribution<float> size(0.25f, 1.0f);
+		std::uniform_real_distribution<float> angle(-3.14f, 3.14f);
+		for (uint32_t i = 0; i < numBoxes_; ++i)
+		{
+			boxes.push_back(MakeBox(size(rng), size(rng)));
+			xfs.push_back(Xf2d({position(rng), position(rng)}, Rot2d(angle(rng))));
+			Box aabb = ComputePolygonAABB(&boxes.back(), xfs.back());
+			tree.add(aabb, 1u, (void *)(uintptr_t)(i + 1));
+		}
+	}
+
+	static bool Shape(int32_t, void *userData_, DistanceProxy *proxy_, Sweep *sweep_,
+	    void *context_)
+	{
+		World *world = static_cast<World *>(context_);
+		size_t index = (uintptr_t)userData_ - 1;
+		const Polygon &box = world->boxes[index];
+		*proxy_ = MakeProxy(box.vertices, box.count, box.radius);
+		sweep_->localCenter = {0.0f, 0.0f};
+		sweep_->c1 = sweep_->c2 = world->xfs[index].p;
+		sweep_->a1 = sweep_->a2 = world->xfs[index].q.getAngle();
+		world->numShapes.fetch_add(1, std::memory_order_relaxed);
+		return true;
+	}
+};
+
+// bullets flying 30 to 60 units during the step in random directions.
+std::vector<SweepInput>
+Projectiles(uint32_t count_, uint32_t seed_)
+{
+	std::mt19937 rng(seed_);
+	std::uniform_real_distribution<float> position(-200.0f, 200.0f);
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+	std::vector<SweepInput> inputs(count_);
+	for (SweepInput &input : inputs)
+	{
+		Polygon box = MakeBox(0.1f, 0.05f);
+		input.proxy = MakeProxy(box.vertices, box.count, 0.0f);
+		input.sweep.localCenter = {0.0f, 0.0f};
+		input.sweep.c1 = {position(rng), position(rng)};
+		float a = 3.14f * unit(rng), length = 45.0f + 15.0f * unit(rng);
+		input.sweep.c2 = {input.sweep.c1.x + length * std::cos(a),
+		    input.sweep.c1.y + length * std::sin(a)};
+		input.sweep.a1 = a;
+		input.sweep.a2 = a + unit(rng);
+		input.tMax = 1.0f;
+		input.maskBits = 1u;
+	}
+	return inputs;
+}
+
+// the box covered by the bounding circle of the projectile along its path.
+SweepHit
+SweptBoxSweep(World &world_, const SweepInput &input_)
+{
+	const Sweep &sweep = input_.sweep;
+	float radius = input_.proxy.radius;
+	for (int32_t i = 0; i < input_.proxy.count; ++i)
+		radius = m::max(radius, m::distv(input_.proxy.vertices[i], sweep.localCenter));
+	glm::vec2 extent = {radius, radius};
+	Box aabb(m::subv(m::minv(sweep.c1, sweep.c2), extent),
+	    m::addv(m::maxv(sweep.c1, sweep.c2), extent));
+
+	SweepHit hit;
+	TOIInput toiInput;
+	toiInput.proxyA = input_.proxy;
+	toiInput.sweepA = sweep;
+	toiInput.tMax = input_.tMax;
+	world_.tree.query(aabb, input_.maskBits, [&](int32_t proxyId, void *userData) {
+		World::Shape(proxyId, userData, &toiInput.proxyB, &toiInput.sweepB, &world_);
+		TOIOutput output = TimeOfImpact(&toiInput);
+		if (output.state != TOIState::kHit && output.state != TOIState::kOverlapped)
+			return true;
+		float t = output.state == TOIState::kOverlapped ? 0.0f : output.t;
+		if (hit.proxyId == BVH::BVH_NullIndex || t < hit.t)
+		{
+			hit.proxyId = proxyId;
+			hit.state = output.state;
+			hit.t = t;
+		}
+		return true;
+	});
+	return hit;
+}
+
+template <typename Frame>
+void
+Run(const char *name_, World &world_, uint32_t numProjectiles_, uint32_t numFrames_,
+    Frame frame_)
+{
+	std::vector<SweepHit> hits(numProjectiles_);
+	int64_t numHits = 0;
+	world_.numShapes = 0;
+	std::chrono::duration<double, std::milli> total(0);
+	for (uint32_t frame = 0; frame < numFrames_; ++frame)
+	{
+		std::vector<SweepInput> inputs = Projectiles(numProjectiles_, frame);
+		auto start = std::chrono::high_resolution_clock::now();
+		frame_(inputs, hits);
+		total += std::chrono::high_resolution_clock::now() - start;
+		for (const SweepHit &hit : hits) numHits += hit.proxyId != BVH::BVH_NullIndex;
+	}
+	printf("%-20s %8.3f ms per frame, %.1f shapes per projectile, %.1f%% hit\n", name_,
+	    total.count() / numFrames_,
+	    (double)world_.numShapes / ((double)numProjectiles_ * numFrames_),
+	    100.0 * numHits / ((double)numProjectiles_ * numFrames_));
+}
+
+} // namespace
+
+int
+main(int argc, char **argv)
+{
+	uint32_t numBoxes = argc > 1 ? (uint32_t)atoi(argv[1]) : 10000;
+	uint32_t numProjectiles = argc > 2 ? (uint32_t)atoi(argv[2]) : 500;
+	uint32_t numFrames = argc > 3 ? (uint32_t)atoi(argv[3]) : 60;
+	printf("%u boxes, %u projectiles, %u frames\n", numBoxes, numProjectiles, numFrames);
+
+	World world(numBoxes);
+	TaskScheduler ts;
+	ts.Initialize();
+
+	Run("swept box + TOI", world, numProjectiles, numFrames,
+	    [&](std::vector<SweepInput> &inputs, std::vector<SweepHit> &hits) {
+		    for (size_t i = 0; i < inputs.size(); ++i)
+			    hits[i] = SweptBoxSweep(world, inputs[i]);
+	    });
+	Run("ShapeSweep", world, numProjectiles, numFrames,
+	    [&](std::vector<SweepInput> &inputs, std::vector<SweepHit> &hits) {
+		    for (size_t i = 0; i < inputs.size(); ++i)
+			    hits[i] = ShapeSweep(world.tree, &inputs[i], World::Shape, &world);
+	    });
+	Run("ShapeSweepBatch(ts)", world, numProjectiles, numFrames,
+	    [&](std::vector<SweepInput> &inputs, std::vector<SweepHit> &hits) {
+		    ShapeSweepBatch(world.tree, inputs.data(), (int32_t)inputs.size(), hits.data(),
+		        World::Shape, &world, &ts);
+	    });
+
+	ts.WaitforAllAndShutdown();
+	return 0;
+}
@@ -0,0 +1,132 @@
+// Compares the step time of a physics-like workload with unpinned and pinned task threads,
+// see TaskSchedulerConfig::threadAffinity. Each step integrates a set of islands, each island
+// owning its own bodies, so the step time depends on how much of the island data is still in
+// the caches of the thread which runs it.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "candybox/TaskScheduler.hpp"
+
+namespace {
+
+using namespace candybox;
+
+struct Body
+{
+	float position[2];
+	float velocity[2];
+};
+
+struct StepTask : public ITaskSet
+{
+	StepTask(std::vector<std::vector<Body> >& islands_)
+	    : ITaskSet((uint32_t)islands_.size(), 1), m_Islands(islands_)
+	{
+	}
+
+	void ExecuteRange(TaskSetPartition range_, uint32_t threadnum_) override
+	{
+		(void)threadnum_;
+		const float dt = 1.0f / 60.0f;
+		for (uint32_t island = range_.start; island < range_.end; ++island)
+		{
+			for (uint32_t iteration = 0; iteration < 4; ++iteration)
+			{
+				for (Body& body : m_Islands[island])
+				{
+					body.velocity[1] -= 9.81f * dt;
+					body.position[0] += body.velocity[0] * dt;
+					body.position[1] += body.velocity[1] * dt;
+					if (body.position[1] < 0.0f)
+					{
+						body.position[1] = -body.position[1];
+						body.velocity[1] = -0.9f * body.velocity[1];
+					}
+				}
+			}
+		}
+	}
+
+	std::vector<std::vector<Body> >& m_Islands;
+};
+
+struct StepTimes
+{
+	double meanUs;
+	double p99Us;
+};
+
+StepTimes
+Run(ThreadAffinity threadAffinity_, uint32_t numIslands_, uint32_t bodiesPerIsland_, uint32_t steps_)
+{
+	TaskScheduler ts;
+	TaskSchedulerConfig config;
+	config.threadAffinity = threadAffinity_;
+	ts.Initialize(config);
+
+	std::vector<std::vector<Body> > islands(numIslands_);
+	for (uint32_t island = 0; island < numIslands_; ++island)
+	{
+		islands[island].resize(bodiesPerIsland_);
+		for (uint32_t body = 0; body < bodiesPerIsland_; ++body)
+		{
+			islands[island][body] = {{(float)body, 10.0f + island}, {1.0f, 0.0f}};
+		}
+	}
+
+	std::vector<double> times;
+	for (uint32_t step = 0; step < steps_; ++step)
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		StepTask task(islands);
+		ts.AddTaskSetToPipe(&task);
+		ts.WaitforTask(&task);
+		std::chrono::duration<double, std::micro> elapsed =
+		    std::chrono::high_resolution_clock::now() - start;
+		times.push_back(elapsed.count());
+	}
+	ts.WaitforAllAndShutdown();
+
+	StepTimes result = {0.0, 0.0};
+	for (double time : times) { result.meanUs += time; }
+	result.meanUs /= times.size();
+	std::sort(times.begin(), times.end());
+	result.p99Us = times[(size_t)(0.99 * (times.size() - 1))];
+	return result;
+}
+
+} // namespace
+
+int
+main(int argc, char** argv)
+{
+	uint32_t numIslands = argc > 1 ? (uint32_t)atoi(argv[1]) : 256;
+	uint32_t bodiesPerIsland = argc > 2 ? (uint32_t)atoi(argv[2]) : 2048;
+	uint32_t steps = argc > 3 ? (uint32_t)atoi(argv[3]) : 500;
+
+	uint32_t numCpus = GetCpuTopology(nullptr, 0);
+	std::vector<CpuInfo> cpus(numCpus);
+	GetCpuTopology(cpus.data(), numCpus);
+	uint32_t numCores = 0;
+	uint32_t numCacheGroups = 0;
+	for (uint32_t index = 0; index < numCpus; ++index)
+	{
+		if (0 == cpus[index].smtIndex) { ++numCores; }
+		if (cpus[index].cacheGroup == cpus[index].cpu) { ++numCacheGroups; }
+	}
+	printf("%u cpus, %u cores, %u last level caches\n", numCpus, numCores, numCacheGroups);
+	printf("%u islands of %u bodies, %u steps\n", numIslands, bodiesPerIsland, steps);
+
+	StepTimes unpinned = Run(THREAD_AFFINITY_NONE, numIslands, bodiesPerIsland, steps);
+	printf("unpinned: mean %8.1f us, p99 %8.1f us\n", unpinned.meanUs, unpinned.p99Us);
+#if IE_TS_AFFINITY_SUPPORTED
+	StepTimes pinned = Run(THREAD_AFFINITY_CORES, numIslands, bodiesPerIsland, steps);
+	printf("pinned:   mean %8.1f us, p99 %8.1f us\n", pinned.meanUs, pinned.p99Us);
+#else
+	printf("pinned:   not supported on this platform\n");
+#endif
+	return 0;
+}
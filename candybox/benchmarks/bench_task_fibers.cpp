@@ -0,0 +1,86 @@
+// Compares the throughput of nested waits with and without TaskSchedulerConfig::useFibers.
+// Each task spawns children and waits for them, so workers spend most of their time in
+// TaskScheduler::WaitforTask().
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include "candybox/TaskScheduler.hpp"
+
+namespace {
+
+using namespace candybox;
+
+struct NestedTask : public ITaskSet
+{
+	NestedTask() : ITaskSet(1) { }
+
+	void ExecuteRange(TaskSetPartition range_, uint32_t threadnum_) override
+	{
+		(void)range_;
+		(void)threadnum_;
+		if (m_Depth == 0)
+		{
+			volatile uint32_t work = 0;
+			for (uint32_t i = 0; i < 2000; ++i) { work = work + i; }
+			m_pLeaves->fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+
+		NestedTask children[4];
+		for (NestedTask& child : children)
+		{
+			child.m_pTS = m_pTS;
+			child.m_pLeaves = m_pLeaves;
+			child.m_Depth = m_Depth - 1;
+			m_pTS->AddTaskSetToPipe(&child);
+		}
+		for (NestedTask& child : children) { m_pTS->WaitforTask(&child); }
+	}
+
+	TaskScheduler* m_pTS = nullptr;
+	std::atomic<uint32_t>* m_pLeaves = nullptr;
+	uint32_t m_Depth = 0;
+};
+
+double
+Run(bool useFibers_, uint32_t depth_, uint32_t runs_)
+{
+	TaskScheduler ts;
+	TaskSchedulerConfig config;
+	config.useFibers = useFibers_;
+	ts.Initialize(config);
+
+	std::atomic<uint32_t> leaves = {0};
+	auto start = std::chrono::high_resolution_clock::now();
+	for (uint32_t run = 0; run < runs_; ++run)
+	{
+		NestedTask root;
+		root.m_pTS = &ts;
+		root.m_pLeaves = &leaves;
+		root.m_Depth = depth_;
+		ts.AddTaskSetToPipe(&root);
+		ts.WaitforTask(&root);
+	}
+	std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+	ts.WaitforAllAndShutdown();
+	return leaves.load() / elapsed.count();
+}
+
+} // namespace
+
+int
+main(int argc, char** argv)
+{
+	uint32_t depth = argc > 1 ? (uint32_t)atoi(argv[1]) : 6;
+	uint32_t runs = argc > 2 ? (uint32_t)atoi(argv[2]) : 20;
+
+	printf("nested fork-join, depth %u, %u runs\n", depth, runs);
+	printf("WaitForTaskCompletion: %12.0f leaves/s\n", Run(false, depth, runs));
+#if IE_TS_FIBERS_SUPPORTED
+	printf("fibers:                %12.0f leaves/s\n", Run(true, depth, runs));
+#else
+	printf("fibers:                not supported on this platform\n");
+#endif
+	return 0;
+}
@@ -93,7 +93,7 @@ public:
 	{
 		// allow the case where the point is on the boundary
 		for (int i = 0; i < D; ++i)
-			if (l[i] < p[i] || u[i] > p[i]) return false;
+			if (p[i] < l[i] || p[i] > u[i]) return false;
 		return true;
 	}
 
@@ -2,9 +2,11 @@
 #define CANDYBOX_BVH_HPP__
 
 #include <cstdint>
+#include <cassert>
 #include "candybox/AABB.hpp"
 
 namespace candybox {
+class TaskScheduler;
 
 //! \defgroup BVH
 //! @{
@@ -31,6 +33,8 @@ public:
 	/// This is in meters.
 	const float AABB_EXTENSION = 0.1f * LEN_UNITS_PER_METER;
 
+	/// Depth of the fixed stack of the queries, deeper nodes are skipped.
+	static const int32_t QUERY_STACK_SIZE = 256;
 
 
 	enum Flags : int64_t
@@ -120,10 +124,35 @@ public:
 	/// \return true if the proxy was re-inserted and the moved flag was previously false
 	bool move(int32_t proxyId, Box aabb1);
 
+	/// Move count distinct proxies. The proxies are classified in parallel. A proxy whose
+	/// new fat Box still overlaps its tree Box gets the new fat Box in place, and the
+	/// ancestors are refit bottom up, one level of the tree at a time in parallel. The
+	/// other proxies are removed and re-inserted like move() does. The tree quality degrades
+	/// slowly with the refits, see rebuildTopDownSAH().
+	/// \return the number of proxies whose moved flag was previously false.
+	int32_t moveBatch(
+	    const int32_t *proxyIds,
+	    const Box *aabbs,
+	    int32_t count,
+	    TaskScheduler *ts = nullptr);
+
 	/// Query an Box for overlapping proxies. The callback class
 	/// is called for each proxy that overlaps the supplied Box.
 	void queryFiltered(Box aabb, uint32_t maskBits, TreeQueryCallback callback, void *context);
 
+	/// Query an Box for overlapping proxies with a category in maskBits. The visitor is any
+	/// callable bool(int32_t proxyId, void *userData), it is inlined in the traversal and
+	/// returns false to stop the query.
+	template <typename Visitor>
+	void query(Box aabb, uint32_t maskBits, Visitor &&visitor) const;
+
+	/// Write the ids of the proxies overlapping the Box into ids, until capacity is reached.
+	/// \return the number of ids written.
+	int32_t queryIds(Box aabb, uint32_t maskBits, int32_t *ids, int32_t capacity) const;
+
+	/// \return true if any proxy overlaps the Box, stops at the first one.
+	bool queryAny(Box aabb, uint32_t maskBits) const;
+
 	/// Query an Box for overlapping proxies. The callback class
 	/// is called for each proxy that overlaps the supplied Box.
 	void query(Box aabb, TreeQueryCallback callback, void *context);
@@ -142,6 +171,11 @@ public:
 	    TreeRaycastCallback callback,
 	    void *context);
 
+	/// raycast() with any callable float(const RayCast &input, int32_t proxyId,
+	/// void *userData) returning the new fraction of the ray, it is inlined in the traversal.
+	template <typename Visitor>
+	void raycast(const RayCast &input, uint32_t maskBits, Visitor &&visitor) const;
+
 	/// Validate this tree. For testing.
 	void validate();
 
@@ -166,7 +200,16 @@ public:
 	/// must have length equal to the proxy count. This map allows you to update your proxy
 	/// indices since this operation invalidates the original indices. See
 	/// nvgTreeGetProxyCount.
-	void rebuildTopDownSAH(ProxyMap *mapArray, int32_t mapCount);
+	/// With a scheduler the two sides of the large splits are built as tasks and the
+	/// binning of the largest nodes is split in blocks.
+	void rebuildTopDownSAH(ProxyMap *mapArray, int32_t mapCount, TaskScheduler *ts = nullptr);
+
+	/// Rebuild the subtrees of height subtreeHeight with the surface area heuristic, round
+	/// robin through the tree, until budgetMs is spent. The top of the tree above them is
+	/// rebuilt at the end of each round. Unlike rebuildTopDownSAH() the proxy ids stay valid,
+	/// call it every frame to undo the refits of moveBatch().
+	/// \return the number of subtrees rebuilt.
+	int32_t rebuildIncremental(float budgetMs, int32_t subtreeHeight = 8);
 
 	/// Shift the world origin. Useful for large worlds.
 	/// The shift formula is: position -= newOrigin
@@ -184,6 +227,26 @@ public:
 	/// Render the enlarged (fat) Box for a proxy.
 	Box getFatAABB(int32_t proxyId);
 
+	/// Flatten the tree into the 4-wide tree used by queryWide() and raycastWide(), or only
+	/// refit its bounds if no proxy was added, removed or reinserted since the last call.
+	/// The wide tree is a snapshot, call this once after a batch of move() or moveBatch().
+	void updateWide();
+
+	/// queryFiltered() on the wide tree. The children of a wide node have their bounds in
+	/// SoA lanes, so a single SIMD compare tests all of them.
+	void queryWide(
+	    Box aabb,
+	    uint32_t maskBits,
+	    TreeQueryCallback callback,
+	    void *context) const;
+
+	/// raycast() on the wide tree.
+	void raycastWide(
+	    const RayCast *input,
+	    uint32_t maskBits,
+	    TreeRaycastCallback callback,
+	    void *context) const;
+
 
 private:
 	Node *m_nodes;
@@ -193,6 +256,24 @@ private:
 	int32_t m_freeList;
 	int32_t m_proxyCount;
 
+	// Node of the wide tree, up to 4 children of the binary tree.
+	struct WideNode
+	{
+		float lx[4], ly[4], ux[4], uy[4]; // empty lanes never overlap
+		uint32_t categoryBits[4];
+		int32_t child[4]; // wide node index, or proxy id for the lanes in leafMask
+		int32_t source[4]; // binary node of each lane, the bounds are refit from it
+		int32_t leafMask;
+	};
+
+	WideNode *m_wideNodes;
+	int32_t m_wideCount;
+	int32_t m_wideCapacity;
+	bool m_wideDirty; // the topology changed since updateWide()
+	bool m_wideStale; // bounds were refit in place since updateWide()
+
+	int32_t m_rebuildCursor; // next node checked by rebuildIncremental()
+
 private:
 	struct TreeBin
 	{
@@ -217,12 +298,13 @@ private:
 	int32_t computeHeight() const;
 	void validateStructure(int32_t index) const;
 	void validateMetrics(int32_t index) const;
-	int32_t binSortBoxes(
+	int32_t buildSAH(
 	    int32_t parentIndex,
-	    Node *leaves,
+	    int32_t *items,
 	    int32_t count,
-	    TreeBin *bins,
-	    TreePlane *planes);
+	    const int32_t *pool,
+	    TaskScheduler *ts);
+	void rebuildSubtree(int32_t nodeId, int32_t cutHeight);
 };
 
 inline BVH::Node::Node()
@@ -255,6 +337,155 @@ BVH::testEnd(const Node *node)
 	return node->child1 == BVH_NullIndex;
 }
 
+template <typename Visitor>
+void
+BVH::query(Box aabb, uint32_t maskBits, Visitor &&visitor) const
+{
+	int32_t stack[QUERY_STACK_SIZE];
+	int32_t stackCount = 0;
+	stack[stackCount++] = m_root;
+
+	while (stackCount > 0)
+	{
+		int32_t nodeId = stack[--stackCount];
+		if (nodeId == BVH_NullIndex) { continue; }
+
+		const Node *node = m_nodes + nodeId;
+
+		if (node->aabb.overlaps(aabb) && (node->categoryBits & maskBits) != 0)
+		{
+			if (testEnd(node))
+			{
+				if (!visitor(nodeId, node->userData)) return;
+			}
+			else
+			{
+				assert(stackCount <= QUERY_STACK_SIZE - 2);
+				if (stackCount <= QUERY_STACK_SIZE - 2)
+				{
+					stack[stackCount++] = node->child1;
+					stack[stackCount++] = node->child2;
+				}
+			}
+		}
+	}
+}
+
+inline int32_t
+BVH::queryIds(Box aabb, uint32_t maskBits, int32_t *ids, int32_t capacity) const
+{
+	int32_t count = 0;
+	if (capacity <= 0) { return 0; }
+
+	query(aabb, maskBits, [&](int32_t proxyId, void *) {
+		ids[count++] = proxyId;
+		return count < capacity;
+	});
+	return count;
+}
+
+inline bool
+BVH::queryAny(Box aabb, uint32_t maskBits) const
+{
+	bool found = false;
+	query(aabb, maskBits, [&](int32_t, void *) {
+		found = true;
+		return false;
+	});
+	return found;
+}
+
+template <typename Visitor>
+void
+BVH::raycast(const RayCast &input, uint32_t maskBits, Visitor &&visitor) const
+{
+	glm::vec2 p1 = input.p1;
+	glm::vec2 p2 = input.p2;
+	glm::vec2 extension = {input.radius, input.radius};
+
+	glm::vec2 r = m::normv(m::subv(p2, p1));
+
+	// v is perpendicular to the segment.
+	glm::vec2 v = m::crosssv(1.0f, r);
+	glm::vec2 abs_v = m::absv(v);
+
+	// Separating axis for segment (Gino, p80).
+	// |dot(v, p1 - c)| > dot(|v|, h)
+
+	float maxFraction = input.maxFraction;
+
+	// Build a bounding box for the segment.
+	Box segmentAABB;
+	{
+		// t is the endpoint of the ray
+		glm::vec2 t = m::muladdv(p1, maxFraction, m::subv(p2, p1));
+
+		// Add radius extension
+		segmentAABB.l = m::subv(m::minv(p1, t), extension);
+		segmentAABB.u = m::addv(m::maxv(p1, t), extension);
+	}
+
+	int32_t stack[QUERY_STACK_SIZE];
+	int32_t stackCount = 0;
+	stack[stackCount++] = m_root;
+
+	while (stackCount > 0)
+	{
+		int32_t nodeId = stack[--stackCount];
+		if (nodeId == BVH_NullIndex) { continue; }
+
+		const Node *node = m_nodes + nodeId;
+		if (!node->aabb.overlaps(segmentAABB) || (node->categoryBits & maskBits) == 0)
+		{
+			continue;
+		}
+
+		// Separating axis for segment (Gino, p80).
+		// |dot(v, p1 - c)| > dot(|v|, h)
+		// radius extension is added to the node in this case
+		glm::vec2 c = node->aabb.center();
+		glm::vec2 h = m::addv(node->aabb.extents(), extension);
+		float term1 = m::abs(m::dotv(v, m::subv(p1, c)));
+		float term2 = m::dotv(abs_v, h);
+		if (term2 < term1) { continue; }
+
+		if (testEnd(node))
+		{
+			RayCast subInput;
+			subInput.p1 = input.p1;
+			subInput.p2 = input.p2;
+			subInput.maxFraction = maxFraction;
+
+			float value = visitor(subInput, nodeId, node->userData);
+			assert(value >= 0.0f);
+
+			if (value == 0.0f)
+			{
+				// The client has terminated the ray cast.
+				return;
+			}
+
+			if (value < maxFraction)
+			{
+				// Update segment bounding box.
+				maxFraction = value;
+				glm::vec2 t = m::muladdv(p1, maxFraction, m::subv(p2, p1));
+				segmentAABB.l = m::subv(m::minv(p1, t), extension);
+				segmentAABB.u = m::addv(m::maxv(p1, t), extension);
+			}
+		}
+		else
+		{
+			assert(stackCount <= QUERY_STACK_SIZE - 2);
+			if (stackCount <= QUERY_STACK_SIZE - 2)
+			{
+				stack[stackCount++] = node->child1;
+				stack[stackCount++] = node->child2;
+			}
+		}
+	}
+}
+
 //! @}
 
 } // namespace candybox
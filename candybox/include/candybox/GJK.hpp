@@ -6,6 +6,9 @@
 #include <candybox/linear.hpp>
 
 namespace candybox {
+
+class TaskScheduler;
+
 namespace gjk {
 
 const int MAX_POLY_VERTS = 8;
@@ -307,8 +310,9 @@ Xf2d GetSweepTransform(const Sweep *sweep, float time);
 /// Compute the upper bound on time before two shapes penetrate. Time is represented as
 /// a fraction between [0,tMax]. This uses a swept separating axis and may miss some intermediate,
 /// non-tunneling collisions. If you change the time interval, you should call this function
-/// again.
-TOIOutput TimeOfImpact(const TOIInput *input);
+/// again. The cache, if any, warm starts the first distance query and receives the last
+/// simplex, as in ShapeDistance().
+TOIOutput TimeOfImpact(const TOIInput *input, DistanceCache *cache = nullptr);
 
 /// Test a point in local space
 bool PointInCircle(glm::vec2 point, const Circle *shape);
@@ -383,6 +387,34 @@ Manifold GJK_Polygons(const Polygon* A, Xf2d xfA, const Polygon* B, Xf2d xfB, fl
 Manifold GJK_Seg2Poly(const Segment* A, Xf2d xfA, const Polygon* B, Xf2d xfB, float maxd, DistanceCache* cache);
 // clang-format on
 
+/// Shape types of a ManifoldPair.
+enum class ShapeType : uint8_t { kCircle, kCapsule, kSegment, kPolygon };
+
+/// Two shapes of the batched narrow phase. The types are those of the GJK_ functions above,
+/// e.g. a polygon A with a circle B but not the reverse. The cache is only used by the pairs
+/// that involve a capsule or a polygon and may be null for the others.
+struct ManifoldPair {
+  const void *shapeA;
+  const void *shapeB;
+  Xf2d xfA;
+  Xf2d xfB;
+  DistanceCache *cache;
+  ShapeType typeA;
+  ShapeType typeB;
+};
+
+/// Compute the manifold of one pair with the GJK_ function of its types.
+Manifold GJK_Collide(const ManifoldPair *pair, float maxd);
+
+/// Compute manifolds[i] = GJK_Collide(&pairs[i], maxd) for count pairs. Sort the pairs by
+/// type: each run of the same types goes through one kernel, the circles 4 pairs at a time
+/// in SIMD lanes. With a scheduler the pairs are split between the task threads.
+void GJK_Batch(const ManifoldPair *pairs,
+               int32_t count,
+               float maxd,
+               Manifold *manifolds,
+               TaskScheduler *ts = nullptr);
+
 /// SAT.
 bool ShapeIntersect(const glm::vec2 *a,
                     uint32_t na,
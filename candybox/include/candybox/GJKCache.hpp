@@ -0,0 +1,72 @@
+#ifndef CANDYBOX_GJK_CACHE_HPP__
+#define CANDYBOX_GJK_CACHE_HPP__
+
+#include <cfloat>
+#include <cstdint>
+#include "candybox/GJK.hpp"
+#include "candybox/Robinhood.hpp"
+
+namespace candybox {
+namespace gjk {
+
+//! \addtogroup GJK
+//! @{
+
+/// Simplex caches of the pairs queried every frame, i.e. proximity sensors or the time of
+/// impact of persistent pairs, so that GJK starts from the last simplex instead of from
+/// scratch. A pair is keyed by the ids of its shapes in order: (idA, idB) and (idB, idA)
+/// are two pairs, as the cache indexes the vertices of A then B.
+/// The pairs not queried for a few frames are evicted by nextFrame(). Not thread safe.
+class DistanceCacheTable
+{
+public:
+	struct Entry
+	{
+		DistanceCache cache;
+		glm::vec2 axis{0.f, 0.f}; ///< last separating axis, from A to B in world space
+		uint32_t frame{0};        ///< last frame the pair was queried
+	};
+
+	/// ShapeDistance() warm started with the cache of the pair, which is updated. The axis
+	/// is updated if the shapes are apart. If the shapes are further than maxDistance apart
+	/// along the last axis GJK is skipped: the output then holds that separation, a lower
+	/// bound of the distance, between the support points of the axis, with 0 iterations.
+	DistanceOutput distance(
+	    uint32_t idA, uint32_t idB, const DistanceInput *input, float maxDistance = FLT_MAX);
+
+	/// TimeOfImpact() warm started with the cache of the pair, which is updated.
+	TOIOutput timeOfImpact(uint32_t idA, uint32_t idB, const TOIInput *input);
+
+	/// Starts a new frame and evicts the pairs which were not queried during the last
+	/// maxAge frames.
+	/// \return the number of evicted pairs.
+	uint32_t nextFrame(uint32_t maxAge = 1);
+
+	/// Entry of the pair, nullptr if it is not in the table.
+	const Entry *find(uint32_t idA, uint32_t idB) const;
+
+	/// Forgets the pair, i.e. when one of its shapes changed or was destroyed.
+	void remove(uint32_t idA, uint32_t idB) { m_entries.erase(key(idA, idB)); }
+
+	void clear() { m_entries.clear(); }
+
+	size_t size() const { return m_entries.size(); }
+
+	uint32_t frame() const { return m_frame; }
+
+private:
+	static uint64_t key(uint32_t idA, uint32_t idB) { return (uint64_t)idA << 32 | idB; }
+
+	/// Entry of the pair for a query on this frame, with a cache valid for the proxies.
+	Entry &touch(uint32_t idA, uint32_t idB, const DistanceProxy &proxyA,
+	    const DistanceProxy &proxyB);
+
+	unordered_flat_map<uint64_t, Entry> m_entries;
+	uint32_t m_frame = 0;
+};
+
+//! @}
+} // namespace gjk
+} // namespace candybox
+
+#endif // CANDYBOX_GJK_CACHE_HPP__
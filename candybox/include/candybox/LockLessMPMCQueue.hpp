@@ -0,0 +1,385 @@
+#ifndef CANDYBOX_LOCKLESS_MPMC_QUEUE_HPP__
+#define CANDYBOX_LOCKLESS_MPMC_QUEUE_HPP__
+
+#include <cstdint>
+#include <atomic>
+
+#ifndef assert
+#	include <assert.h>
+#endif
+
+namespace candybox {
+
+// LockLessMPMCQueue - Bounded multiple writer, multiple reader FIFO queue.
+// Unlike LockLessMultiReadPipe any thread can write, so threads outside the task scheduler
+// (asset loading, audio, IO) can hand work over without owning a pipe.
+// Each slot holds a sequence number telling writers and readers which lap of the ring
+// the slot is ready for, see Dmitry Vyukov's bounded MPMC queue:
+// https://www.1024cores.net/home/lock-free-algorithms/queues/bounded-mpmc-queue
+// A thread which is preempted between claiming and publishing a slot delays readers of that
+// slot, so as with LockLessMultiReadPipe this is not strictly lockless.
+// Note: using log2 sizes so we do not need to clamp (multi-operation)
+// T is the contained type
+template <uint8_t cSizeLog2, typename T>
+class LockLessMPMCQueue
+{
+public:
+	LockLessMPMCQueue();
+	~LockLessMPMCQueue() { }
+
+	// TryWriteBack returns false if the queue is full
+	// This is thread safe for all threads
+	bool TryWriteBack(const T& in);
+
+	// TryReadFront returns false if the queue is empty
+	// This is thread safe for all threads
+	bool TryReadFront(T* pOut);
+
+	// IsQueueEmpty() is a utility function, not intended for general use
+	// The result may be out of date by the time it is returned.
+	bool IsQueueEmpty() const
+	{
+		return m_WriteIndex.load(std::memory_order_relaxed) ==
+		       m_ReadIndex.load(std::memory_order_relaxed);
+	}
+
+private:
+	const static uint32_t ms_cSize = (1 << cSizeLog2);
+	const static uint32_t ms_cIndexMask = ms_cSize - 1;
+	const static uint32_t ms_cCacheLineSize = 64;
+
+	struct Slot
+	{
+		std::atomic<uint32_t> sequence;
+		T data;
+	};
+
+	Slot m_Buffer[ms_cSize];
+
+	// writers and readers contend on different indices, so keep them on their own cache lines.
+	char m_Pad0[ms_cCacheLineSize];
+	std::atomic<uint32_t> m_WriteIndex;
+	char m_Pad1[ms_cCacheLineSize - sizeof(std::atomic<uint32_t>)];
+	std::atomic<uint32_t> m_ReadIndex;
+	char m_Pad2[ms_cCacheLineSize - sizeof(std::atomic<uint32_t>)];
+};
+
+template <uint8_t cSizeLog2, typename T>
+inline LockLessMPMCQueue<cSizeLog2, T>::LockLessMPMCQueue() : m_WriteIndex(0), m_ReadIndex(0)
+{
+	static_assert(cSizeLog2 < 31, "sequence differences must fit in an int32_t");
+	for (uint32_t i = 0; i < ms_cSize; ++i)
+	{
+		m_Buffer[i].sequence.store(i, std::memory_order_relaxed);
+	}
+}
+
+template <uint8_t cSizeLog2, typename T>
+inline bool
+LockLessMPMCQueue<cSizeLog2, T>::TryWriteBack(const T& in)
+{
+	Slot* pSlot;
+	uint32_t writeIndex = m_WriteIndex.load(std::memory_order_relaxed);
+	while (true)
+	{
+		pSlot = &m_Buffer[writeIndex & ms_cIndexMask];
+		uint32_t sequence = pSlot->sequence.load(std::memory_order_acquire);
+		int32_t diff = (int32_t)(sequence - writeIndex);
+		if (0 == diff)
+		{
+			// slot is free for this lap, claim it
+			if (m_WriteIndex.compare_exchange_weak(
+			        writeIndex, writeIndex + 1, std::memory_order_relaxed))
+			{
+				break;
+			}
+		}
+		else if (diff < 0)
+		{
+			return false; // slot still holds data of the previous lap, so full
+		}
+		else
+		{
+			writeIndex = m_WriteIndex.load(std::memory_order_relaxed);
+		}
+	}
+
+	pSlot->data = in;
+	pSlot->sequence.store(writeIndex + 1, std::memory_order_release);
+	return true;
+}
+
+template <uint8_t cSizeLog2, typename T>
+inline bool
+LockLessMPMCQueue<cSizeLog2, T>::TryReadFront(T* pOut)
+{
+	Slot* pSlot;
+	uint32_t readIndex = m_ReadIndex.load(std::memory_order_relaxed);
+	while (true)
+	{
+		pSlot = &m_Buffer[readIndex & ms_cIndexMask];
+		uint32_t sequence = pSlot->sequence.load(std::memory_order_acquire);
+		int32_t diff = (int32_t)(sequence - (readIndex + 1));
+		if (0 == diff)
+		{
+			// slot has been written for this lap, claim it
+			if (m_ReadIndex.compare_exchange_weak(
+			        readIndex, readIndex + 1, std::memory_order_relaxed))
+			{
+				break;
+			}
+		}
+		else if (diff < 0)
+		{
+			return false; // slot not written yet, so empty
+		}
+		else
+		{
+			readIndex = m_ReadIndex.load(std::memory_order_relaxed);
+		}
+	}
+
+	*pOut = pSlot->data;
+	// make the slot available for the writers of the next lap
+	pSlot->sequence.store(readIndex + ms_cSize, std::memory_order_release);
+	return true;
+}
+
+
+// LockLessSegmentedQueue - Unbounded multiple writer, multiple reader FIFO queue.
+// Items are written to a linked list of fixed size segments, each slot of a segment is written
+// and read once. A new segment is allocated when the last one is full, and segments are
+// freed once read and no thread is inside a queue function, so under constant use memory is
+// only returned when the queue becomes quiescent.
+// T is the contained type
+template <typename T, uint8_t cSegmentSizeLog2 = 8>
+class LockLessSegmentedQueue
+{
+public:
+	LockLessSegmentedQueue();
+	~LockLessSegmentedQueue();
+
+	// WriteBack always succeeds, allocating a segment if needed
+	// This is thread safe for all threads
+	void WriteBack(const T& in);
+
+	// TryReadFront returns false if the queue is empty
+	// This is thread safe for all threads
+	bool TryReadFront(T* pOut);
+
+	// IsQueueEmpty() is a utility function, not intended for general use
+	// The result may be out of date by the time it is returned.
+	bool IsQueueEmpty() const;
+
+private:
+	LockLessSegmentedQueue(const LockLessSegmentedQueue&) = delete;
+	LockLessSegmentedQueue& operator=(const LockLessSegmentedQueue&) = delete;
+
+	const static uint32_t ms_cSegmentSize = (1 << cSegmentSizeLog2);
+	const static uint32_t ms_cCacheLineSize = 64;
+
+	struct Slot
+	{
+		std::atomic<uint32_t> bWritten;
+		T data;
+	};
+
+	struct Segment
+	{
+		std::atomic<uint32_t> writeIndex;
+		char pad0[ms_cCacheLineSize - sizeof(std::atomic<uint32_t>)];
+		std::atomic<uint32_t> readIndex;
+		char pad1[ms_cCacheLineSize - sizeof(std::atomic<uint32_t>)];
+		std::atomic<Segment*> pNext;
+		Segment* pNextRetired;
+		Slot slots[ms_cSegmentSize];
+
+		Segment() : writeIndex(0), readIndex(0), pNext(nullptr), pNextRetired(nullptr)
+		{
+			for (Slot& slot : slots) { slot.bWritten.store(0, std::memory_order_relaxed); }
+		}
+	};
+
+	// counts the threads inside WriteBack() or TryReadFront(), see ExitOp()
+	void EnterOp() { m_NumActiveOps.fetch_add(1, std::memory_order_seq_cst); }
+	void ExitOp();
+	void Retire(Segment* pSegment_);
+	static void DeleteList(Segment* pSegment_);
+
+	std::atomic<Segment*> m_pHead; // segment being read
+	char m_Pad0[ms_cCacheLineSize - sizeof(std::atomic<Segment*>)];
+	std::atomic<Segment*> m_pTail; // segment being written
+	char m_Pad1[ms_cCacheLineSize - sizeof(std::atomic<Segment*>)];
+	std::atomic<uint32_t> m_NumActiveOps;
+	std::atomic<Segment*> m_pRetired; // read segments waiting for no thread to use them
+};
+
+template <typename T, uint8_t cSegmentSizeLog2>
+inline LockLessSegmentedQueue<T, cSegmentSizeLog2>::LockLessSegmentedQueue()
+    : m_NumActiveOps(0), m_pRetired(nullptr)
+{
+	Segment* pSegment = new Segment;
+	m_pHead.store(pSegment, std::memory_order_relaxed);
+	m_pTail.store(pSegment, std::memory_order_relaxed);
+}
+
+template <typename T, uint8_t cSegmentSizeLog2>
+inline LockLessSegmentedQueue<T, cSegmentSizeLog2>::~LockLessSegmentedQueue()
+{
+	assert(0 == m_NumActiveOps.load());
+	Segment* pSegment = m_pHead.load();
+	while (pSegment)
+	{
+		Segment* pNext = pSegment->pNext.load();
+		delete pSegment;
+		pSegment = pNext;
+	}
+	DeleteList(m_pRetired.load());
+}
+
+template <typename T, uint8_t cSegmentSizeLog2>
+inline void
+LockLessSegmentedQueue<T, cSegmentSizeLog2>::WriteBack(const T& in)
+{
+	EnterOp();
+	while (true)
+	{
+		Segment* pSegment = m_pTail.load(std::memory_order_seq_cst);
+		// check before the add so a full segment's index does not keep growing
+		if (pSegment->writeIndex.load(std::memory_order_relaxed) < ms_cSegmentSize)
+		{
+			uint32_t writeIndex = pSegment->writeIndex.fetch_add(1, std::memory_order_relaxed);
+			if (writeIndex < ms_cSegmentSize)
+			{
+				Slot& slot = pSegment->slots[writeIndex];
+				slot.data = in;
+				slot.bWritten.store(1, std::memory_order_release);
+				break;
+			}
+		}
+
+		// segment is full, link a new one if no other writer has yet, then move the tail on
+		Segment* pNext = pSegment->pNext.load(std::memory_order_acquire);
+		if (!pNext)
+		{
+			Segment* pNew = new Segment;
+			if (pSegment->pNext.compare_exchange_strong(pNext, pNew, std::memory_order_acq_rel))
+			{
+				pNext = pNew;
+			}
+			else
+			{
+				delete pNew; // pNext holds the segment linked by the other writer
+			}
+		}
+		m_pTail.compare_exchange_strong(pSegment, pNext, std::memory_order_seq_cst);
+	}
+	ExitOp();
+}
+
+template <typename T, uint8_t cSegmentSizeLog2>
+inline bool
+LockLessSegmentedQueue<T, cSegmentSizeLog2>::TryReadFront(T* pOut)
+{
+	bool bRead = false;
+	EnterOp();
+	while (true)
+	{
+		Segment* pSegment = m_pHead.load(std::memory_order_seq_cst);
+		uint32_t readIndex = pSegment->readIndex.load(std::memory_order_acquire);
+		if (readIndex < ms_cSegmentSize)
+		{
+			Slot& slot = pSegment->slots[readIndex];
+			if (!slot.bWritten.load(std::memory_order_acquire))
+			{
+				break; // not written yet, so empty
+			}
+			if (pSegment->readIndex.compare_exchange_weak(
+			        readIndex, readIndex + 1, std::memory_order_acq_rel))
+			{
+				*pOut = slot.data;
+				bRead = true;
+				break;
+			}
+			continue;
+		}
+
+		// segment has been fully read, move on to the next one
+		Segment* pNext = pSegment->pNext.load(std::memory_order_acquire);
+		if (!pNext) { break; } // writer is linking the next segment
+		if (m_pHead.compare_exchange_strong(pSegment, pNext, std::memory_order_seq_cst))
+		{
+			// the tail can lag behind the head while a writer moves it on, so
+			// ensure it no longer references the segment before retiring it.
+			Segment* pTail = pSegment;
+			m_pTail.compare_exchange_strong(pTail, pNext, std::memory_order_seq_cst);
+			Retire(pSegment);
+		}
+	}
+	ExitOp();
+	return bRead;
+}
+
+template <typename T, uint8_t cSegmentSizeLog2>
+inline bool
+LockLessSegmentedQueue<T, cSegmentSizeLog2>::IsQueueEmpty() const
+{
+	// only the head and the segment after it can hold unread items when the
+	// head is fully read, as the head is moved on before reading the next one.
+	Segment* pSegment = m_pHead.load(std::memory_order_acquire);
+	uint32_t readIndex = pSegment->readIndex.load(std::memory_order_relaxed);
+	uint32_t writeIndex = pSegment->writeIndex.load(std::memory_order_relaxed);
+	return readIndex >= writeIndex && !pSegment->pNext.load(std::memory_order_relaxed);
+}
+
+template <typename T, uint8_t cSegmentSizeLog2>
+inline void
+LockLessSegmentedQueue<T, cSegmentSizeLog2>::Retire(Segment* pSegment_)
+{
+	Segment* pRetired = m_pRetired.load(std::memory_order_relaxed);
+	do {
+		pSegment_->pNextRetired = pRetired;
+	} while (!m_pRetired.compare_exchange_weak(pRetired, pSegment_, std::memory_order_seq_cst));
+}
+
+template <typename T, uint8_t cSegmentSizeLog2>
+inline void
+LockLessSegmentedQueue<T, cSegmentSizeLog2>::ExitOp()
+{
+	if (1 != m_NumActiveOps.fetch_sub(1, std::memory_order_seq_cst)) { return; }
+	if (!m_pRetired.load(std::memory_order_relaxed)) { return; }
+
+	// Retired segments are unreachable from m_pHead and m_pTail, so once no thread is
+	// inside a queue function no thread can still reference them. Threads entering after
+	// the count was seen as 0 load the head and tail after the segments were unlinked.
+	Segment* pRetired = m_pRetired.exchange(nullptr, std::memory_order_seq_cst);
+	if (0 == m_NumActiveOps.load(std::memory_order_seq_cst))
+	{
+		DeleteList(pRetired);
+		return;
+	}
+
+	// another thread may be using them, put them back for a later exit to free
+	while (pRetired)
+	{
+		Segment* pNext = pRetired->pNextRetired;
+		Retire(pRetired);
+		pRetired = pNext;
+	}
+}
+
+template <typename T, uint8_t cSegmentSizeLog2>
+inline void
+LockLessSegmentedQueue<T, cSegmentSizeLog2>::DeleteList(Segment* pSegment_)
+{
+	while (pSegment_)
+	{
+		Segment* pNext = pSegment_->pNextRetired;
+		delete pSegment_;
+		pSegment_ = pNext;
+	}
+}
+
+} // namespace candybox
+
+#endif // CANDYBOX_LOCKLESS_MPMC_QUEUE_HPP__
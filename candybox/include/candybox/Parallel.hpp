@@ -0,0 +1,361 @@
+#ifndef CANDYBOX_PARALLEL_HPP__
+#define CANDYBOX_PARALLEL_HPP__
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <type_traits>
+#include "candybox/TaskScheduler.hpp"
+
+namespace candybox {
+
+//! \defgroup Parallel
+//! Parallel algorithms running on an existing TaskScheduler.
+//! All of them block until the work is done, and like TaskScheduler::AddTaskSetToPipe()
+//! they must be called from the thread which initialized the scheduler or from within a
+//! task. The work is split with the TaskSetPartition/m_MinRange machinery, so the grain
+//! size (minRange or blockSize) should amount to at least ~10k clock cycles of work.
+//! @{
+
+namespace detail {
+// Task set calling func(range, threadNum) for each partition, the functor is not copied.
+template <typename Func>
+class RangeTaskSet : public ITaskSet
+{
+public:
+	RangeTaskSet(uint32_t setSize, uint32_t minRange, Func &func)
+	    : ITaskSet(setSize, minRange), m_func(func)
+	{
+	}
+
+	void ExecuteRange(TaskSetPartition range, uint32_t threadNum) override
+	{
+		m_func(range, threadNum);
+	}
+
+private:
+	Func &m_func;
+};
+
+static inline uint32_t
+NumBlocks(uint32_t count, uint32_t blockSize)
+{
+	return (count + blockSize - 1) / blockSize;
+}
+} // namespace detail
+
+/// Call func(TaskSetPartition range, uint32_t threadNum) on ranges covering [0, count).
+/// threadNum can be used to index per-thread buckets, see ITaskSet::ExecuteRange().
+/// Runs on the calling thread if count <= minRange.
+template <typename Func>
+void
+parallel_for_range(TaskScheduler &ts, uint32_t count, Func &&func, uint32_t minRange = 1)
+{
+	if (count == 0) return;
+	if (count <= minRange || ts.GetNumTaskThreads() <= 1)
+	{
+		TaskSetPartition range = {0, count};
+		func(range, ts.GetThreadNum());
+		return;
+	}
+
+	detail::RangeTaskSet<typename std::remove_reference<Func>::type> task(count, minRange, func);
+	ts.AddTaskSetToPipe(&task);
+	ts.WaitforTask(&task);
+}
+
+/// parallel_for_range() with an optional scheduler, i.e. the TaskScheduler* argument of the
+/// build functions. Without one the whole range runs on the calling thread as thread 0.
+template <typename Func>
+void
+parallel_for_range(TaskScheduler *ts, uint32_t count, Func &&func, uint32_t minRange = 1)
+{
+	if (!ts)
+	{
+		if (count > 0) func(TaskSetPartition{0, count}, 0u);
+		return;
+	}
+	parallel_for_range(*ts, count, std::forward<Func>(func), minRange);
+}
+
+/// Call func(uint32_t i) for every i in [begin, end).
+template <typename Func>
+void
+parallel_for(TaskScheduler &ts, uint32_t begin, uint32_t end, Func &&func, uint32_t minRange = 1)
+{
+	if (end <= begin) return;
+	parallel_for_range(
+	    ts, end - begin,
+	    [&](TaskSetPartition range, uint32_t) {
+		    for (uint32_t i = begin + range.start; i < begin + range.end; ++i) func(i);
+	    },
+	    minRange);
+}
+
+/// Reduce map(i) for every i in [begin, end) with reduce(T, T) -> T.
+/// Blocks of blockSize items are reduced on their own and then combined in order, so the
+/// result only depends on blockSize, not on the number of threads. This keeps the result
+/// deterministic when reduce is not associative (i.e. floating point sums).
+template <typename T, typename Map, typename Reduce>
+T
+parallel_reduce(
+    TaskScheduler &ts,
+    uint32_t begin,
+    uint32_t end,
+    T identity,
+    Map &&map,
+    Reduce &&reduce,
+    uint32_t blockSize = 1024)
+{
+	if (end <= begin) return identity;
+	uint32_t numBlocks = detail::NumBlocks(end - begin, blockSize);
+	std::vector<T> partials(numBlocks, identity);
+
+	parallel_for_range(ts, numBlocks, [&](TaskSetPartition range, uint32_t) {
+		for (uint32_t block = range.start; block < range.end; ++block)
+		{
+			uint32_t first = begin + block * blockSize;
+			uint32_t last = std::min(first + blockSize, end);
+			T acc = identity;
+			for (uint32_t i = first; i < last; ++i) acc = reduce(acc, map(i));
+			partials[block] = acc;
+		}
+	});
+
+	T result = identity;
+	for (uint32_t block = 0; block < numBlocks; ++block)
+		result = reduce(result, partials[block]);
+	return result;
+}
+
+namespace detail {
+template <typename T, typename Op>
+void
+ParallelScan(
+    TaskScheduler &ts,
+    const T *in,
+    T *out,
+    uint32_t count,
+    T identity,
+    Op &op,
+    uint32_t blockSize,
+    bool inclusive)
+{
+	if (count == 0) return;
+	uint32_t numBlocks = NumBlocks(count, blockSize);
+
+	// 1. reduce each block.
+	std::vector<T> offsets(numBlocks, identity);
+	if (numBlocks > 1)
+	{
+		parallel_for_range(ts, numBlocks, [&](TaskSetPartition range, uint32_t) {
+			for (uint32_t block = range.start; block < range.end; ++block)
+			{
+				uint32_t first = block * blockSize;
+				uint32_t last = std::min(first + blockSize, count);
+				T acc = identity;
+				for (uint32_t i = first; i < last; ++i) acc = op(acc, in[i]);
+				offsets[block] = acc;
+			}
+		});
+	}
+
+	// 2. exclusive scan of the block sums gives the start value of each block.
+	T acc = identity;
+	for (uint32_t block = 0; block < numBlocks; ++block)
+	{
+		T sum = offsets[block];
+		offsets[block] = acc;
+		acc = op(acc, sum);
+	}
+
+	// 3. scan each block starting from its offset, every item is read before it is written
+	// so in and out can be the same array.
+	parallel_for_range(ts, numBlocks, [&](TaskSetPartition range, uint32_t) {
+		for (uint32_t block = range.start; block < range.end; ++block)
+		{
+			uint32_t first = block * blockSize;
+			uint32_t last = std::min(first + blockSize, count);
+			T blockAcc = offsets[block];
+			for (uint32_t i = first; i < last; ++i)
+			{
+				T value = in[i];
+				if (!inclusive) out[i] = blockAcc;
+				blockAcc = op(blockAcc, value);
+				if (inclusive) out[i] = blockAcc;
+			}
+		}
+	});
+}
+} // namespace detail
+
+/// Inclusive prefix scan, out[i] = in[0] op in[1] op ... op in[i].
+/// op must be associative, in and out can be the same array.
+template <typename T, typename Op>
+void
+parallel_inclusive_scan(
+    TaskScheduler &ts,
+    const T *in,
+    T *out,
+    uint32_t count,
+    T identity,
+    Op &&op,
+    uint32_t blockSize = 4096)
+{
+	detail::ParallelScan(ts, in, out, count, identity, op, blockSize, true);
+}
+
+/// Exclusive prefix scan, out[0] = identity, out[i] = in[0] op ... op in[i - 1].
+/// op must be associative, in and out can be the same array.
+template <typename T, typename Op>
+void
+parallel_exclusive_scan(
+    TaskScheduler &ts,
+    const T *in,
+    T *out,
+    uint32_t count,
+    T identity,
+    Op &&op,
+    uint32_t blockSize = 4096)
+{
+	detail::ParallelScan(ts, in, out, count, identity, op, blockSize, false);
+}
+
+namespace detail {
+template <typename Key, typename Value>
+void
+RadixSort(
+    TaskScheduler &ts,
+    Key *keys,
+    Value *values,
+    uint32_t count,
+    Key *keysScratch,
+    Value *valuesScratch,
+    uint32_t blockSize)
+{
+	static_assert(
+	    std::is_unsigned<Key>::value && (sizeof(Key) == 4 || sizeof(Key) == 8),
+	    "radix sort only supports 32 or 64 bit unsigned keys");
+	static const uint32_t numDigits = 256;
+	if (count < 2) return;
+
+	std::vector<Key> keysBuffer;
+	std::vector<Value> valuesBuffer;
+	if (!keysScratch)
+	{
+		keysBuffer.resize(count);
+		keysScratch = keysBuffer.data();
+	}
+	if (values && !valuesScratch)
+	{
+		valuesBuffer.resize(count);
+		valuesScratch = valuesBuffer.data();
+	}
+
+	uint32_t numBlocks = NumBlocks(count, blockSize);
+	std::vector<uint32_t> histograms(numBlocks * numDigits);
+	Key *srcKeys = keys, *dstKeys = keysScratch;
+	Value *srcValues = values, *dstValues = valuesScratch;
+
+	for (uint32_t shift = 0; shift < sizeof(Key) * 8; shift += 8)
+	{
+		// count the digits of each block.
+		parallel_for_range(ts, numBlocks, [&](TaskSetPartition range, uint32_t) {
+			for (uint32_t block = range.start; block < range.end; ++block)
+			{
+				uint32_t *histogram = &histograms[block * numDigits];
+				memset(histogram, 0, sizeof(uint32_t) * numDigits);
+				uint32_t last = std::min((block + 1) * blockSize, count);
+				for (uint32_t i = block * blockSize; i < last; ++i)
+					++histogram[(srcKeys[i] >> shift) & 0xFF];
+			}
+		});
+
+		// turn the counts into the write offset of each block, digit-major then block order
+		// keeps the sort stable.
+		uint32_t sum = 0;
+		bool sameDigit = false;
+		for (uint32_t digit = 0; digit < numDigits; ++digit)
+		{
+			uint32_t digitStart = sum;
+			for (uint32_t block = 0; block < numBlocks; ++block)
+			{
+				uint32_t &offset = histograms[block * numDigits + digit];
+				uint32_t digitCount = offset;
+				offset = sum;
+				sum += digitCount;
+			}
+			if (sum - digitStart == count) sameDigit = true;
+		}
+		if (sameDigit) continue; // every key has the same digit, nothing to reorder.
+
+		// scatter.
+		parallel_for_range(ts, numBlocks, [&](TaskSetPartition range, uint32_t) {
+			for (uint32_t block = range.start; block < range.end; ++block)
+			{
+				uint32_t *offsets = &histograms[block * numDigits];
+				uint32_t last = std::min((block + 1) * blockSize, count);
+				for (uint32_t i = block * blockSize; i < last; ++i)
+				{
+					Key key = srcKeys[i];
+					uint32_t dst = offsets[(key >> shift) & 0xFF]++;
+					dstKeys[dst] = key;
+					if (srcValues) dstValues[dst] = srcValues[i];
+				}
+			}
+		});
+		std::swap(srcKeys, dstKeys);
+		std::swap(srcValues, dstValues);
+	}
+
+	// an odd number of passes leaves the result in the scratch buffers.
+	if (srcKeys != keys)
+	{
+		parallel_for_range(ts, numBlocks, [&](TaskSetPartition range, uint32_t) {
+			uint32_t first = range.start * blockSize;
+			uint32_t last = std::min(range.end * blockSize, count);
+			std::copy(srcKeys + first, srcKeys + last, keys + first);
+			if (values) std::copy(srcValues + first, srcValues + last, values + first);
+		});
+	}
+}
+} // namespace detail
+
+/// Stable LSD radix sort of 32 or 64 bit unsigned keys, 8 bits per pass. Passes on which
+/// every key has the same digit are skipped, so small key ranges sort in fewer passes.
+/// values[i] is moved along with keys[i]. The scratch buffers must hold count elements,
+/// they are allocated for the call if not given.
+template <typename Key, typename Value>
+void
+parallel_radix_sort(
+    TaskScheduler &ts,
+    Key *keys,
+    Value *values,
+    uint32_t count,
+    Key *keysScratch = nullptr,
+    Value *valuesScratch = nullptr,
+    uint32_t blockSize = 1 << 14)
+{
+	detail::RadixSort(ts, keys, values, count, keysScratch, valuesScratch, blockSize);
+}
+
+/// Keys only version of parallel_radix_sort.
+template <typename Key>
+void
+parallel_radix_sort(
+    TaskScheduler &ts,
+    Key *keys,
+    uint32_t count,
+    Key *keysScratch = nullptr,
+    uint32_t blockSize = 1 << 14)
+{
+	detail::RadixSort(ts, keys, (Key *)nullptr, count, keysScratch, (Key *)nullptr, blockSize);
+}
+
+//! @}
+
+} // namespace candybox
+
+#endif // CANDYBOX_PARALLEL_HPP__
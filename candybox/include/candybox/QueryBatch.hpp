@@ -0,0 +1,125 @@
+#ifndef CANDYBOX_QUERY_BATCH_HPP__
+#define CANDYBOX_QUERY_BATCH_HPP__
+
+#include <cassert>
+#include <cstdint>
+#include <vector>
+#include "candybox/TaskScheduler.hpp"
+
+namespace candybox {
+
+//! \defgroup QueryBatch
+//! Queries enqueued during a frame and run together on the task threads while the main
+//! thread goes on, i.e. the raycasts and overlaps of the gameplay code run after the physics
+//! step. enqueue() returns a ticket, launch() starts the queries enqueued so far and finish()
+//! waits for them, after which result(ticket) is valid until the next finish(). Requests and
+//! results live in vectors which are reused, so the batch stops allocating once it has seen
+//! the peak number of queries of a frame.
+//! Not thread safe, every method must be called from the thread which owns the batch. The
+//! execute function is called from the task threads and only reads the queried data, which
+//! must not change between launch() and finish().
+//! @{
+
+template <typename Request, typename Result>
+class QueryBatch
+{
+public:
+	using Execute = void (*)(const Request &request, Result *result, void *context);
+
+	QueryBatch(Execute execute, void *context, uint32_t minRange = 16)
+	{
+		m_task.execute = execute;
+		m_task.context = context;
+		m_task.m_MinRange = minRange;
+	}
+
+	~QueryBatch() { assert(!m_launched); }
+
+	QueryBatch(const QueryBatch &) = delete;
+	QueryBatch &operator=(const QueryBatch &) = delete;
+
+	/// Queues a query for the next launch(), the ticket is its index in the results.
+	int32_t enqueue(const Request &request)
+	{
+		m_pending.push_back(request);
+		return (int32_t)m_pending.size() - 1;
+	}
+
+	/// Starts the queries enqueued since the previous launch(), finish() must be called first.
+	void launch(TaskScheduler &ts)
+	{
+		assert(!m_launched);
+		m_task.requests.swap(m_pending);
+		m_pending.clear();
+		m_task.results.resize(m_task.requests.size());
+		m_task.m_SetSize = (uint32_t)m_task.requests.size();
+		m_launched = true;
+		if (m_task.m_SetSize > 0) { ts.AddTaskSetToPipe(&m_task); }
+	}
+
+	/// Waits for the launched queries, the calling thread helps running them. Their results
+	/// replace the ones of the previous batch. Does nothing if nothing was launched.
+	void finish(TaskScheduler &ts)
+	{
+		if (!m_launched) { return; }
+
+		if (m_task.m_SetSize > 0) { ts.WaitforTask(&m_task); }
+		m_results.swap(m_task.results);
+		m_launched = false;
+	}
+
+	/// Waits for the launched queries without taking their results, unlike the other methods
+	/// it can be called from a task, i.e. one which must run after the queries.
+	void wait(TaskScheduler &ts) const
+	{
+		if (m_launched && m_task.m_SetSize > 0) { ts.WaitforTask(&m_task); }
+	}
+
+	bool isLaunched() const { return m_launched; }
+
+	/// The result of a ticket of the last finished batch, nullptr if it had no such query.
+	const Result *result(int32_t ticket) const
+	{
+		if (ticket < 0 || (size_t)ticket >= m_results.size()) { return nullptr; }
+		return &m_results[ticket];
+	}
+
+	const std::vector<Result> &results() const { return m_results; }
+
+	/// Number of queries waiting for the next launch().
+	int32_t pendingCount() const { return (int32_t)m_pending.size(); }
+
+	void reserve(size_t capacity)
+	{
+		m_pending.reserve(capacity);
+		m_task.requests.reserve(capacity);
+		m_task.results.reserve(capacity);
+		m_results.reserve(capacity);
+	}
+
+private:
+	struct Task : public ITaskSet
+	{
+		void ExecuteRange(TaskSetPartition range, uint32_t) override
+		{
+			for (uint32_t i = range.start; i < range.end; ++i)
+				execute(requests[i], &results[i], context);
+		}
+
+		Execute execute = nullptr;
+		void *context = nullptr;
+		std::vector<Request> requests;
+		std::vector<Result> results;
+	};
+
+	Task m_task;
+	std::vector<Request> m_pending;
+	std::vector<Result> m_results;
+	bool m_launched = false;
+};
+
+//! @}
+
+} // namespace candybox
+
+#endif // CANDYBOX_QUERY_BATCH_HPP__
@@ -44,6 +44,11 @@ public:
 	virtual void cleanup() { }
 	virtual void update(float delta) { }
 
+	/// Called before update() in the fixed step mode, see setFixedStep(). Advances the
+	/// simulation by stepCount steps of timeStep, which may be 0 on fast frames or when
+	/// the scene is paused.
+	virtual void fixedUpdate(float timeStep, int32_t stepCount) { }
+
 	virtual void render()
 	{
 #if 0
@@ -89,6 +94,19 @@ public:
 	float getFreq() const { return m_hertz; }
 	void setFreq(float freq) { m_hertz = freq; }
 
+	/// In the fixed step mode, fixedUpdate() advances the simulation by whole steps of
+	/// 1 / m_hertz, so it runs the same whatever the frame rate, and the renderer
+	/// interpolates between the last two steps with getAlpha().
+	bool isFixedStep() const { return m_fixedStep; }
+	void setFixedStep(bool fixedStep)
+	{
+		m_fixedStep = fixedStep;
+		m_accumulator = 0.f;
+	}
+
+	/// Time of the frame past the last fixed step, in steps, from 0 to 1.
+	float getAlpha() const { return m_alpha; }
+
 	int getWinWidth() const { return m_winWidth; }
 	int getWinHeight() const { return m_winHeight; }
 	int getFrameWidth() const { return m_frameWidth; }
@@ -130,6 +148,9 @@ protected:
 	float m_prevTime = 0.f;
 	float m_accumulator = 0.f;
 	float m_hertz = 80.f; // game logic update rate
+	float m_alpha = 0.f;
+	int32_t m_maxFixedSteps = 4; // per frame, slower frames slow the simulation down
+	bool m_fixedStep = false;
 
 	bool m_preloaded = false;
 	bool m_running = false;
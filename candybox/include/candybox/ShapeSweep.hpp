@@ -0,0 +1,72 @@
+#ifndef CANDYBOX_SHAPE_SWEEP_HPP__
+#define CANDYBOX_SHAPE_SWEEP_HPP__
+
+#include <cstdint>
+#include "candybox/BVH.hpp"
+#include "candybox/GJK.hpp"
+
+namespace candybox {
+class TaskScheduler;
+
+namespace gjk {
+
+//! \addtogroup GJK
+//! @{
+
+/// A shape moving through the proxies of a BVH, see ShapeSweep().
+struct SweepInput
+{
+	DistanceProxy proxy; ///< the moving shape, relative to its body origin
+	Sweep sweep;         ///< its motion during the step
+	float tMax;          ///< the sweep covers [0, tMax]
+	uint32_t maskBits;   ///< categories of the proxies to sweep against
+};
+
+/// The earliest hit of a sweep.
+struct SweepHit
+{
+	int32_t proxyId{BVH::BVH_NullIndex}; ///< BVH_NullIndex if nothing is hit
+	TOIState state{TOIState::kSeparated};
+	float t{0.f};               ///< time of impact, the shapes are LINEAR_SLOP apart
+	glm::vec2 point{0.f, 0.f};  ///< closest point on the proxy at t
+	glm::vec2 normal{0.f, 0.f}; ///< from the proxy to the moving shape, zero if overlapped
+};
+
+/// Gives the shape of a proxy of the tree and its motion during the step, c1 == c2 and
+/// a1 == a2 if it does not move. The fat box of a moving proxy must cover its motion.
+/// \return false to skip the proxy.
+using SweepShapeCallback = bool (*)(
+    int32_t proxyId,
+    void *userData,
+    DistanceProxy *proxy,
+    Sweep *sweep,
+    void *context);
+
+/// Sweep a shape through the tree and find the proxy it hits first. The tree is walked as
+/// BVH::raycast() does with the path of the center of mass, extended by the radius of the
+/// shape around it so that rotations are covered. Each candidate runs TimeOfImpact() over
+/// the time left and every hit clips the ray, so the proxies past the earliest hit are not
+/// tested. A shape overlapping a proxy at the start is a hit at t = 0 with the state
+/// kOverlapped.
+SweepHit ShapeSweep(
+    const BVH &tree,
+    const SweepInput *input,
+    SweepShapeCallback shapes,
+    void *context);
+
+/// ShapeSweep() of count inputs into hits, the batch of the projectiles of a frame. With a
+/// scheduler the inputs are split between the task threads and shapes must be thread safe.
+void ShapeSweepBatch(
+    const BVH &tree,
+    const SweepInput *inputs,
+    int32_t count,
+    SweepHit *hits,
+    SweepShapeCallback shapes,
+    void *context,
+    TaskScheduler *ts = nullptr);
+
+//! @}
+} // namespace gjk
+} // namespace candybox
+
+#endif // CANDYBOX_SHAPE_SWEEP_HPP__
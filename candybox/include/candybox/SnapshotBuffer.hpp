@@ -0,0 +1,55 @@
+#ifndef CANDYBOX_SNAPSHOT_BUFFER_HPP__
+#define CANDYBOX_SNAPSHOT_BUFFER_HPP__
+
+#include <cstdint>
+
+namespace candybox {
+
+//! \defgroup SnapshotBuffer
+//! States published by a fixed step simulation and read by the renderer, which interpolates
+//! between the last two of them. The simulation writes the next state into a third slot, so
+//! a step running on a task thread while the frame is rendered never touches the states
+//! being read. Slots are reused, a state holding vectors stops allocating after a few steps.
+//! Not thread safe, publish() is called by the reading thread once the writer is done, i.e.
+//! after waiting for the step task, and back() is only written between two publish().
+//! @{
+
+template <typename T>
+class SnapshotBuffer
+{
+public:
+	/// The state the simulation writes, it holds what was published two publish() ago.
+	T &back() { return m_slots[m_back]; }
+
+	/// The back state becomes the current one and the current one the previous one. After the
+	/// first publish() both are the same state.
+	void publish()
+	{
+		if (m_count++ == 0) { m_previous = m_current = m_back; }
+		else
+		{
+			m_previous = m_current;
+			m_current = m_back;
+		}
+		m_back = (m_current + 1) % 3 == m_previous ? (m_current + 2) % 3 : (m_current + 1) % 3;
+	}
+
+	const T &previous() const { return m_slots[m_previous]; }
+	const T &current() const { return m_slots[m_current]; }
+
+	/// Number of publish() calls.
+	uint32_t count() const { return m_count; }
+
+private:
+	T m_slots[3];
+	uint32_t m_previous = 0;
+	uint32_t m_current = 0;
+	uint32_t m_back = 1;
+	uint32_t m_count = 0;
+};
+
+//! @}
+
+} // namespace candybox
+
+#endif // CANDYBOX_SNAPSHOT_BUFFER_HPP__
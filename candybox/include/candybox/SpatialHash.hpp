@@ -0,0 +1,180 @@
+#ifndef CANDYBOX_SPATIAL_HASH_HPP__
+#define CANDYBOX_SPATIAL_HASH_HPP__
+
+#include <cstdint>
+#include <cmath>
+#include <vector>
+#include <utility>
+#include "candybox/spatial.hpp"
+
+namespace candybox {
+class TaskScheduler;
+
+//! \defgroup SpatialHash
+//! @{
+
+/// Uniform grid for many objects of about the same size, i.e. particles, bullets or
+/// agents, which is rebuilt every frame.
+/// The objects are binned by the cell of their center, the cells are hashed into a table
+/// and the objects counting sorted by bucket, so the objects of a bucket are contiguous
+/// (CSR layout) and a query only reads the few buckets around it, without any tree
+/// traversal. The cell size should be about the size of the objects, or the query radius.
+class SpatialHash
+{
+public:
+	/// tableSize is the number of buckets, rounded up to a power of two. 0 sizes it to
+	/// twice the number of objects on each build().
+	explicit SpatialHash(float cellSize, uint32_t tableSize = 0);
+
+	/// Rebuilds from numItems boxes stored as minx, miny, maxx, maxy. With a scheduler the
+	/// buckets are computed and sorted in parallel, see parallel_radix_sort().
+	void build(const float *boxes, uint32_t numItems, TaskScheduler *ts = nullptr);
+
+	/// Indices of the boxes matching the predicate.
+	/// @see SpatialPredicate for available predicates, i.e. intersects() or within().
+	template <typename Predicate> bool query(const Predicate &predicate) const;
+	template <typename Predicate, typename OutIter>
+	size_t query(const Predicate &predicate, OutIter out_it) const;
+
+	/// Indices of the boxes whose center is within radius of the point.
+	template <typename OutIter>
+	size_t nearest(const glm::vec<2, float> &point, float radius, OutIter out_it) const;
+
+	/// Every pair of boxes whose centers are within radius, as (lower index, higher index).
+	/// With a scheduler the boxes are split into blocks which emit their pairs in
+	/// parallel, pairs is filled in the same order with or without one. Returns the count.
+	size_t pairs(
+	    float radius,
+	    std::vector<std::pair<uint32_t, uint32_t> > &pairs,
+	    TaskScheduler *ts = nullptr) const;
+
+	/// Number of boxes of the last build().
+	uint32_t size() const { return m_numItems; }
+
+	float cellSize() const { return m_cellSize; }
+
+private:
+	/// Cell of the coordinate, clamped to the cells of the boxes.
+	int cellCoord(float value, int axis) const
+	{
+		float cell = std::floor(value * m_invCellSize);
+		if (!(cell > (float)m_cellMin[axis])) return m_cellMin[axis];
+		if (!(cell < (float)m_cellMax[axis])) return m_cellMax[axis];
+		return (int)cell;
+	}
+
+	uint32_t bucket(int x, int y) const
+	{
+		return (((uint32_t)x * 73856093u) ^ ((uint32_t)y * 19349663u)) & (m_numBuckets - 1);
+	}
+
+	/// Calls func(sorted index) for the boxes whose center is in the cells covering
+	/// [minx, maxx] x [miny, maxy].
+	template <typename Func>
+	void forEachInCells(float minx, float miny, float maxx, float maxy, Func &&func) const;
+
+	float m_cellSize;
+	float m_invCellSize;
+	uint32_t m_tableSize; ///< as given, 0 for automatic.
+	uint32_t m_numBuckets = 1;
+	uint32_t m_numItems = 0;
+	float m_maxHalfExtent[2] = {0.0f, 0.0f}; ///< largest half size of the boxes.
+	int m_cellMin[2] = {0, 0}, m_cellMax[2] = {0, 0}; ///< cells of the box centers.
+	std::vector<uint32_t> m_bucketStart; ///< m_numBuckets + 1 offsets into the sorted boxes.
+	std::vector<uint32_t> m_indices; ///< original index of the sorted boxes.
+	std::vector<float> m_boxes; ///< sorted by bucket, minx, miny, maxx, maxy
+	std::vector<int> m_cells; ///< x, y cell of the sorted boxes.
+	std::vector<uint32_t> m_keys; ///< build scratch
+};
+
+template <typename Func>
+void
+SpatialHash::forEachInCells(float minx, float miny, float maxx, float maxy, Func &&func) const
+{
+	if (m_numItems == 0 || !(minx <= maxx) || !(miny <= maxy)) return;
+	const int x0 = cellCoord(minx, 0), y0 = cellCoord(miny, 1);
+	const int x1 = cellCoord(maxx, 0), y1 = cellCoord(maxy, 1);
+
+	// more cells than boxes, scanning them all is cheaper.
+	if ((double)(x1 - x0 + 1) * (y1 - y0 + 1) > m_numItems)
+	{
+		for (uint32_t i = 0; i < m_numItems; ++i)
+		{
+			const int *cell = &m_cells[i * 2];
+			if (cell[0] >= x0 && cell[0] <= x1 && cell[1] >= y0 && cell[1] <= y1) func(i);
+		}
+		return;
+	}
+
+	for (int y = y0; y <= y1; ++y)
+	{
+		for (int x = x0; x <= x1; ++x)
+		{
+			const uint32_t b = bucket(x, y);
+			for (uint32_t i = m_bucketStart[b]; i < m_bucketStart[b + 1]; ++i)
+			{
+				// skips the other cells hashed to the same bucket.
+				if (m_cells[i * 2] == x && m_cells[i * 2 + 1] == y) func(i);
+			}
+		}
+	}
+}
+
+template <typename Predicate>
+bool
+SpatialHash::query(const Predicate &predicate) const
+{
+	return query(predicate, detail::dummy_iterator()) > 0;
+}
+
+template <typename Predicate, typename OutIter>
+size_t
+SpatialHash::query(const Predicate &predicate, OutIter out_it) const
+{
+	// a box matching the predicate box has its center within half its size of it.
+	typedef typename Predicate::box_t box_t;
+	const box_t &bbox = predicate.bbox;
+	size_t foundCount = 0;
+	forEachInCells(
+	    (float)bbox.l[0] - m_maxHalfExtent[0], (float)bbox.l[1] - m_maxHalfExtent[1],
+	    (float)bbox.u[0] + m_maxHalfExtent[0], (float)bbox.u[1] + m_maxHalfExtent[1],
+	    [&](uint32_t i) {
+		    const float *box = &m_boxes[i * 4];
+		    const box_t value(
+		        typename box_t::tvec(box[0], box[1]), typename box_t::tvec(box[2], box[3]));
+		    if (predicate(value))
+		    {
+			    *out_it = m_indices[i];
+			    ++out_it;
+			    ++foundCount;
+		    }
+	    });
+	return foundCount;
+}
+
+template <typename OutIter>
+size_t
+SpatialHash::nearest(const glm::vec<2, float> &point, float radius, OutIter out_it) const
+{
+	const float radiusSq = radius * radius;
+	size_t foundCount = 0;
+	forEachInCells(
+	    point[0] - radius, point[1] - radius, point[0] + radius, point[1] + radius,
+	    [&](uint32_t i) {
+		    const float *box = &m_boxes[i * 4];
+		    float dx = (box[0] + box[2]) * 0.5f - point[0];
+		    float dy = (box[1] + box[3]) * 0.5f - point[1];
+		    if (dx * dx + dy * dy <= radiusSq)
+		    {
+			    *out_it = m_indices[i];
+			    ++out_it;
+			    ++foundCount;
+		    }
+	    });
+	return foundCount;
+}
+
+//! @}
+} // namespace candybox
+
+#endif // CANDYBOX_SPATIAL_HASH_HPP__
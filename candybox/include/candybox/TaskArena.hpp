@@ -0,0 +1,86 @@
+#ifndef CANDYBOX_TASK_ARENA_HPP__
+#define CANDYBOX_TASK_ARENA_HPP__
+
+#include <cstdint>
+#include <new>
+#include <vector>
+#include "candybox/TaskScheduler.hpp"
+
+namespace candybox {
+
+//! \defgroup TaskArena
+//! Arena of task objects for code which launches a varying number of tasks per frame,
+//! i.e. the enqueueTask callback of box2d.
+//! Tasks keep their address until reset(), and the arena grows a chunk at a time instead of
+//! running out. Chunks are kept on reset() so once the arena has grown to the peak number of
+//! tasks of a frame it no longer allocates. Each task is on its own cache lines, so threads
+//! completing neighbouring tasks do not false share their m_RunningCount.
+//! Not thread safe, allocate() and reset() must be called from a single thread.
+//! @{
+
+template <typename T, uint32_t CHUNK_SIZE = 256>
+class TaskArena
+{
+public:
+	explicit TaskArena(CustomAllocator allocator = CustomAllocator()) : m_allocator(allocator) { }
+
+	~TaskArena()
+	{
+		for (Slot *chunk : m_chunks)
+		{
+			for (uint32_t i = 0; i < CHUNK_SIZE; ++i) chunk[i].~Slot();
+			m_allocator.free(chunk, sizeof(Slot) * CHUNK_SIZE, m_allocator.userData, __FILE__, __LINE__);
+		}
+	}
+
+	TaskArena(const TaskArena &) = delete;
+	TaskArena &operator=(const TaskArena &) = delete;
+
+	/// Returns the next task of the arena. Tasks are reused after reset(), so members
+	/// set for a previous frame keep their values.
+	T *allocate()
+	{
+		uint32_t chunk = m_size / CHUNK_SIZE;
+		if (chunk == m_chunks.size())
+		{
+			void *memory = m_allocator.alloc(
+			    alignof(Slot), sizeof(Slot) * CHUNK_SIZE, m_allocator.userData, __FILE__, __LINE__);
+			Slot *slots = static_cast<Slot *>(memory);
+			for (uint32_t i = 0; i < CHUNK_SIZE; ++i) new (&slots[i]) Slot();
+			m_chunks.push_back(slots);
+		}
+		return &m_chunks[chunk][m_size++ % CHUNK_SIZE].task;
+	}
+
+	/// Makes every task available again, they must all be complete.
+	void reset()
+	{
+#ifndef NDEBUG
+		for (uint32_t i = 0; i < m_size; ++i)
+			assert(m_chunks[i / CHUNK_SIZE][i % CHUNK_SIZE].task.GetIsComplete());
+#endif
+		m_size = 0;
+	}
+
+	/// Number of tasks allocated since the last reset.
+	uint32_t size() const { return m_size; }
+
+	/// Number of tasks which can be allocated before the arena grows.
+	uint32_t capacity() const { return (uint32_t)m_chunks.size() * CHUNK_SIZE; }
+
+private:
+	struct Slot
+	{
+		alignas(64) T task;
+	};
+
+	std::vector<Slot *> m_chunks;
+	uint32_t m_size = 0;
+	CustomAllocator m_allocator;
+};
+
+//! @}
+
+} // namespace candybox
+
+#endif // CANDYBOX_TASK_ARENA_HPP__
@@ -25,6 +25,8 @@
 #include <functional>
 #include <initializer_list>
 #include <cassert>
+#include <memory>
+#include <vector>
 
 // IE_TS_TASK_PRIORITIES_NUM can be set from 1 to 5.
 // 1 corresponds to effectively no priorities.
@@ -47,6 +49,26 @@
 #	endif
 #endif
 
+// IE_TS_FIBERS_SUPPORTED is 1 where TaskSchedulerConfig::useFibers can be used,
+// which currently requires ucontext (Linux with glibc).
+#ifndef IE_TS_FIBERS_SUPPORTED
+#	if defined(__linux__) && defined(__GLIBC__)
+#		define IE_TS_FIBERS_SUPPORTED 1
+#	else
+#		define IE_TS_FIBERS_SUPPORTED 0
+#	endif
+#endif
+
+// IE_TS_AFFINITY_SUPPORTED is 1 where TaskSchedulerConfig::threadAffinity can be used and
+// GetCpuTopology() reads the topology from /sys (Linux).
+#ifndef IE_TS_AFFINITY_SUPPORTED
+#	if defined(__linux__) && !defined(__ANDROID__)
+#		define IE_TS_AFFINITY_SUPPORTED 1
+#	else
+#		define IE_TS_AFFINITY_SUPPORTED 0
+#	endif
+#endif
+
 // Define IE_CUSTOM_ALLOC_FILE_AND_LINE (at project level) to get file and line report in custom allocators,
 // this is default in Debug - to turn off define IE_CUSTOM_ALLOC_NO_FILE_AND_LINE
 #ifndef IE_CUSTOM_ALLOC_FILE_AND_LINE
@@ -66,15 +88,52 @@ class TaskScheduler;
 class TaskPipe;
 class PinnedTaskList;
 class Dependency;
+class TaskGraph;
 struct ThreadArgs;
 struct ThreadDataStore;
+struct FiberThreadData;
+struct DeadlineQueue;
+struct PartitionCost;
+struct ThreadTelemetryStore;
 struct SubTaskSet;
 struct semaphoreid_t;
 
 static constexpr uint32_t NO_THREAD_NUM = 0xFFFFFFFF;
+static constexpr uint64_t NO_DEADLINE = 0xFFFFFFFFFFFFFFFF;
+static constexpr uint32_t TELEMETRY_HISTOGRAM_BUCKETS = 32;
+static constexpr uint32_t NO_CPU = 0xFFFFFFFF;
 
 IE_TS_API uint32_t GetNumHardwareThreads();
 
+// A logical CPU the process may run on, see GetCpuTopology().
+struct CpuInfo
+{
+	uint32_t cpu; // logical CPU number, as used by the OS
+	uint32_t core; // lowest cpu of the physical core, shared by SMT siblings
+	uint32_t cacheGroup; // lowest cpu sharing the last level cache with this one
+	uint32_t smtIndex; // 0 for the first hardware thread of a core, 1 for its sibling...
+};
+
+// Copies up to maxCpus_ CPUs of the process affinity mask into pCpus_, ordered by cpu, and
+// returns the number of CPUs. pCpus_ can be null to query the number. Returns 0 where
+// IE_TS_AFFINITY_SUPPORTED is 0, or if the topology cannot be read.
+IE_TS_API uint32_t GetCpuTopology(CpuInfo* pCpus_, uint32_t maxCpus_);
+
+// ThreadAffinity - how task threads are pinned to CPUs, see TaskSchedulerConfig::threadAffinity
+enum ThreadAffinity
+{
+	THREAD_AFFINITY_NONE, // the OS places threads
+	THREAD_AFFINITY_CORES, // one thread per physical core grouped by last level cache, then SMT siblings
+	THREAD_AFFINITY_CPU_LIST, // thread n is pinned to pThreadCpus[n % numThreadCpus]
+};
+
+// PartitionPolicy - how a task set is divided into ranges, see ITaskSet::m_PartitionPolicy
+enum PartitionPolicy
+{
+	PARTITION_STATIC, // grain size is m_MinRange
+	PARTITION_ADAPTIVE, // grain size is derived from the measured cost per item
+};
+
 enum TaskPriority
 {
 	TASK_PRIORITY_HIGH = 0,
@@ -130,11 +189,14 @@ protected:
 private:
 	friend class TaskScheduler;
 	friend class Dependency;
+	friend class TaskGraph;
 	std::atomic<int32_t> m_RunningCount = {0};
 	std::atomic<int32_t> m_DependenciesCompletedCount = {0};
 	int32_t m_DependenciesCount = 0;
 	mutable std::atomic<int32_t> m_WaitingForTaskCount = {0};
 	mutable Dependency* m_pDependents = NULL;
+	TaskGraph* m_pGraph = NULL; // graph this task is a node of, see TaskGraph
+	uint32_t m_GraphNode = 0;
 };
 
 // Subclass ITaskSet to create tasks.
@@ -172,6 +234,24 @@ public:
 	// Also known as grain size in literature.
 	uint32_t m_MinRange = 1;
 
+	// Deadline - Time by which the task set should be complete, in TaskScheduler::GetTimeNs() units,
+	// or NO_DEADLINE. Task sets with a deadline are run before task sets of the same priority
+	// without one, earliest deadline first. Misses are reported by TaskScheduler::GetDeadlineStats().
+	// i.e. for a task which must be done within a 12.5ms frame:
+	// task.m_DeadlineNs = TaskScheduler::GetTimeNs() + 12500000;
+	uint64_t m_DeadlineNs = NO_DEADLINE;
+
+	// Partition Policy - With PARTITION_ADAPTIVE the execution time of every range is measured
+	// and the grain size is set to the number of items which take about
+	// TaskSchedulerConfig::adaptivePartitionTargetNs, m_MinRange is only used until the first
+	// measurement. Costs are shared by all task sets with the same m_PartitionTag.
+	PartitionPolicy m_PartitionPolicy = PARTITION_STATIC;
+
+	// Partition Tag - Key of the measured cost per item for PARTITION_ADAPTIVE. Task sets with
+	// the same tag should have a similar cost per item. 0 uses the dynamic type of the task set,
+	// set a tag when one type runs different work, i.e. a pointer to the function it calls.
+	uintptr_t m_PartitionTag = 0;
+
 private:
 	friend class TaskScheduler;
 	void OnDependenciesComplete(TaskScheduler* pTaskScheduler_, uint32_t threadNum_) final;
@@ -256,6 +336,67 @@ private:
 	Dependency* pNext = NULL;
 };
 
+// TaskGraph - a reusable, pre-recorded graph of task sets.
+// Nodes are ITaskSet's, edges are dependencies between them. Build the graph once with
+// AddNode()/AddEdge(), call Compile(), then submit it as many times as needed with
+// TaskScheduler::AddTaskGraphToPipe(). Compile() precomputes the successor lists and
+// the join count of each node, so submitting and running the graph does no allocation
+// and does not walk Dependency links.
+// The graph is itself an ICompletable, so it can be waited on with WaitforTask() and
+// can be used with Dependency like any other task.
+// A task set can only be a node of one graph, and must not use Dependency itself while
+// it is a node. Nodes must outlive the graph (or be removed with Clear()).
+class TaskGraph : public ICompletable
+{
+public:
+	TaskGraph() = default;
+	TaskGraph(const TaskGraph&) = delete;
+	TaskGraph& operator=(const TaskGraph&) = delete;
+	IE_TS_API ~TaskGraph();
+
+	// Adds a task set as a node of the graph, returns the node index used by AddEdge.
+	IE_TS_API uint32_t AddNode(ITaskSet* pTask_);
+
+	// Node to_ will only run once node from_ has completed.
+	// The ITaskSet overload looks up the node indices of already added task sets.
+	IE_TS_API void AddEdge(uint32_t from_, uint32_t to_);
+	IE_TS_API void AddEdge(const ITaskSet* pFrom_, const ITaskSet* pTo_);
+
+	// Builds the successor lists and join counts. Must be called after the graph
+	// has been modified and before it is submitted. Asserts if the graph has a cycle.
+	IE_TS_API void Compile();
+
+	// Removes all nodes and edges. The graph must be complete.
+	IE_TS_API void Clear();
+
+	uint32_t GetNumNodes() const { return (uint32_t)m_Nodes.size(); }
+	bool GetIsCompiled() const { return m_bCompiled; }
+
+protected:
+	void OnDependenciesComplete(TaskScheduler* pTaskScheduler_, uint32_t threadNum_) override;
+
+private:
+	friend class TaskScheduler;
+	struct Edge
+	{
+		uint32_t from;
+		uint32_t to;
+	};
+
+	std::vector<ITaskSet*> m_Nodes;
+	std::vector<Edge> m_Edges;
+
+	// compiled data, successors of node i are
+	// m_Successors[ m_SuccessorOffsets[i] ] to m_Successors[ m_SuccessorOffsets[i+1] ]
+	std::vector<uint32_t> m_SuccessorOffsets;
+	std::vector<uint32_t> m_Successors;
+	std::vector<int32_t> m_JoinCounts; // number of predecessors of each node
+	std::vector<uint32_t> m_Roots; // nodes without predecessors
+	std::unique_ptr<std::atomic<int32_t>[]> m_pJoinCountsRemaining;
+	std::atomic<uint32_t> m_NodesRemaining = {0};
+	bool m_bCompiled = false;
+};
+
 // TaskScheduler implements several callbacks intended for profilers
 typedef void (*ProfilerCallbackFunc)(uint32_t threadnum_);
 struct ProfilerCallbacks
@@ -304,6 +445,77 @@ struct TaskSchedulerConfig
 	ProfilerCallbacks profilerCallbacks = {};
 
 	CustomAllocator customAllocator;
+
+	// useFibers - Advanced use, only available if IE_TS_FIBERS_SUPPORTED, ignored otherwise.
+	// Task threads run tasks on fibers. WaitforTask() called by a task on a task thread
+	// parks the fiber of the waiting task and the thread carries on running other tasks on
+	// a fiber from its pool, rather than running them nested on the stack of the waiting task.
+	// A parked fiber is resumed on the thread it was parked on, once the task it waits for
+	// is complete and that thread is between tasks. When the pool is empty WaitforTask()
+	// falls back to running tasks on the waiting stack. Threads which are not task threads,
+	// such as the thread which initialized the scheduler, always use the default behaviour.
+	// Note that a parked wait runs tasks of any priority, see priorityOfLowestToRun_.
+	bool useFibers = false;
+
+	// numFibersPerThread - Number of fibers in the pool of each task thread, which limits
+	// the number of waits which can be parked at once on a thread.
+	uint32_t numFibersPerThread = 32;
+
+	// enableTelemetry - Count and time the work of each thread, see TaskScheduler::GetTelemetry().
+	// Costs two clock reads per range run, so is off by default.
+	bool enableTelemetry = false;
+
+	// adaptivePartitionTargetNs - Execution time of a range aimed for by task sets using
+	// PARTITION_ADAPTIVE. Smaller ranges balance load better, larger ones are cheaper to schedule.
+	uint32_t adaptivePartitionTargetNs = 20000;
+
+	// fiberStackSize - Size in bytes of each fiber stack, rounded up to the page size.
+	// A guard page is placed below each stack so an overflow faults instead of corrupting memory.
+	uint32_t fiberStackSize = 256 * 1024;
+
+	// threadAffinity - Advanced use, only available if IE_TS_AFFINITY_SUPPORTED, ignored otherwise.
+	// Pins the task threads created by the scheduler to CPUs, so their data stays in the caches
+	// of the CPU they run on. Thread n is assigned the n-th CPU of the order, wrapping around if
+	// there are more threads than CPUs. The thread which initialized the scheduler and external
+	// threads are not pinned, so the CPU of thread 0 is left for the initializing thread.
+	ThreadAffinity threadAffinity = THREAD_AFFINITY_NONE;
+
+	// pThreadCpus, numThreadCpus - CPUs for THREAD_AFFINITY_CPU_LIST, see CpuInfo::cpu.
+	// Only read during Initialize().
+	const uint32_t* pThreadCpus = nullptr;
+	uint32_t numThreadCpus = 0;
+
+	// stealFromSameCacheFirst - Pinned threads look for tasks to steal on the threads pinned
+	// to CPUs sharing their last level cache before the other threads.
+	bool stealFromSameCacheFirst = true;
+};
+
+// Deadline statistics, see ITaskSet::m_DeadlineNs and TaskScheduler::GetDeadlineStats().
+struct DeadlineStats
+{
+	uint64_t numCompleted = 0; // task sets with a deadline which have completed
+	uint64_t numMissed = 0; // task sets which completed after their deadline
+	uint64_t maxLatenessNs = 0; // largest time by which a deadline was missed
+	uint64_t totalLatenessNs = 0; // sum of the times by which deadlines were missed
+};
+
+// Telemetry of a thread, see TaskSchedulerConfig::enableTelemetry and TaskScheduler::GetTelemetry().
+// Values are totals since Initialize(), subtract two snapshots to get the values of a frame.
+struct ThreadTelemetry
+{
+	uint64_t numRangesRun = 0; // calls to ExecuteRange()
+	uint64_t numRangesStolen = 0; // ranges taken from the pipe of another thread
+	uint64_t numSubTasksSplit = 0; // partitions added to this thread's pipes
+	uint64_t numPipeFullRunInline = 0; // partitions run inline as this thread's pipe was full
+	uint64_t busyNs = 0; // time in ExecuteRange()
+	uint64_t suspendedNs = 0; // time suspended on a semaphore, for new tasks or task completion
+	uint64_t waitForTaskNs = 0; // time in WaitforTask(), including tasks run meanwhile and nested waits
+	// rangeDurationHistogram[i] counts the ranges which took [2^i, 2^(i+1)) ns, the last bucket
+	// also counts longer ranges.
+	uint64_t rangeDurationHistogram[TELEMETRY_HISTOGRAM_BUCKETS] = {};
+
+	IE_TS_API ThreadTelemetry& operator+=(const ThreadTelemetry& rhs_);
+	IE_TS_API ThreadTelemetry& operator-=(const ThreadTelemetry& rhs_);
 };
 
 class TaskScheduler
@@ -355,6 +567,11 @@ public:
 	// should only be called from main thread, or within a task
 	IE_TS_API void AddTaskSetToPipe(ITaskSet* pTaskSet_);
 
+	// Runs a compiled TaskGraph, the root nodes are added to the pipe and the other nodes
+	// are added as their predecessors complete. Use WaitforTask( pGraph_ ) to wait for it.
+	// should only be called from main thread, or within a task
+	IE_TS_API void AddTaskGraphToPipe(TaskGraph* pGraph_);
+
 	// Thread 0 is main thread, otherwise use threadNum
 	// Pinned tasks can be added from any thread
 	IE_TS_API void AddPinnedTask(IPinnedTask* pTask_);
@@ -413,6 +630,32 @@ public:
 	// It is guaranteed that GetThreadNum() < GetNumTaskThreads() unless it is NO_THREAD_NUM
 	IE_TS_API uint32_t GetThreadNum() const;
 
+	// Returns a monotonic time in nanoseconds, the time base of ITaskSet::m_DeadlineNs.
+	IE_TS_API static uint64_t GetTimeNs();
+
+	// Returns the deadline statistics of the task sets with a deadline which completed since
+	// Initialize() or ResetDeadlineStats(). Can be called from any thread.
+	IE_TS_API DeadlineStats GetDeadlineStats() const;
+
+	// Resets the deadline statistics, i.e. at the start of a frame.
+	IE_TS_API void ResetDeadlineStats();
+
+	// Returns the measured execution time per item of task sets with the same partition tag
+	// as pTaskSet_, or 0 if it has not run with PARTITION_ADAPTIVE yet.
+	IE_TS_API float GetPartitionCostNsPerItem(const ITaskSet* pTaskSet_) const;
+
+	// Copies the telemetry of threads 0 to numThreads_ - 1 into pTelemetry_, and returns
+	// GetNumTaskThreads(). All zero unless TaskSchedulerConfig::enableTelemetry is set.
+	// Lock free and can be called from any thread, i.e. once a frame for a stats panel.
+	IE_TS_API uint32_t GetTelemetry(ThreadTelemetry* pTelemetry_, uint32_t numThreads_) const;
+
+	// Returns the sum of the telemetry of all threads.
+	IE_TS_API ThreadTelemetry GetTelemetryTotal() const;
+
+	// Returns the CPU thread threadNum_ is pinned to, or NO_CPU if it is not pinned.
+	// See TaskSchedulerConfig::threadAffinity.
+	IE_TS_API uint32_t GetThreadCpu(uint32_t threadNum_) const;
+
 	// Call on a thread to register the thread to use the TaskScheduling API.
 	// This is implicitly done for the thread which initializes the TaskScheduler
 	// Intended for developers who have threads who need to call the TaskScheduler API
@@ -463,7 +706,20 @@ private:
 	friend class ICompletable;
 	friend class ITaskSet;
 	friend class IPinnedTask;
+	friend class TaskGraph;
 	static void TaskingThreadFunction(const ThreadArgs& args_);
+	void TaskingThreadLoop(uint32_t threadNum_);
+	void StartFibers();
+	void StopFibers();
+	void FiberThreadMain(uint32_t threadNum_);
+	static void FiberEntry();
+	void FiberParkUntilComplete(const ICompletable* pCompletable_);
+	void WaitForParkedFibers(uint32_t threadNum_);
+	void AddDeadlineTaskSetInt(ITaskSet* pTaskSet_);
+	bool TryRunDeadlineTask(uint32_t threadNum_, uint32_t priority_);
+	void RecordDeadline(const ITaskSet* pTaskSet_);
+	void ExecuteRangeInt(ITaskSet* pTaskSet_, TaskSetPartition range_, uint32_t threadNum_);
+	PartitionCost* FindPartitionCost(const ITaskSet* pTaskSet_, bool bInsert_) const;
 	bool HaveTasks(uint32_t threadNum_);
 	void WaitForNewTasks(uint32_t threadNum_);
 	void WaitForTaskCompletion(const ICompletable* pCompletable_, uint32_t threadNum_);
@@ -471,6 +727,8 @@ private:
 	bool TryRunTask(uint32_t threadNum_, uint32_t& hintPipeToCheck_io_);
 	bool TryRunTask(uint32_t threadNum_, uint32_t priority_, uint32_t& hintPipeToCheck_io_);
 	void StartThreads();
+	void InitThreadAffinity();
+	void ApplyThreadAffinity(uint32_t threadNum_);
 	void StopThreads(bool bWait_);
 	void SplitAndAddTask(uint32_t threadNum_, SubTaskSet subTask_, uint32_t rangeToSplit_);
 	void WakeThreadsForNewTasks();
@@ -481,6 +739,8 @@ private:
 	TaskComplete(ICompletable* pTask_, bool bWakeThreads_, uint32_t threadNum_);
 	IE_TS_API void AddTaskSetToPipeInt(ITaskSet* pTaskSet_, uint32_t threadNum_);
 	IE_TS_API void AddPinnedTaskInt(IPinnedTask* pTask_);
+	IE_TS_API void AddTaskGraphInt(TaskGraph* pGraph_, uint32_t threadNum_);
+	void TaskGraphNodeComplete(TaskGraph* pGraph_, uint32_t node_, uint32_t threadNum_);
 
 	template <typename T>
 	T* NewArray(size_t num_, const char* file_, int line_);
@@ -499,9 +759,14 @@ private:
 
 	TaskPipe* m_pPipesPerThread[TASK_PRIORITY_NUM];
 	PinnedTaskList* m_pPinnedTaskListPerThread[TASK_PRIORITY_NUM];
+	DeadlineQueue* m_pDeadlineQueues; // one per priority
+	PartitionCost* m_pPartitionCosts; // hash table keyed by partition tag
+	ThreadTelemetryStore* m_pTelemetry; // one per thread, written by that thread only
+	uint32_t* m_pSameCacheThreads; // m_NumThreads per thread, see ThreadDataStore::numSameCacheThreads
 
 	uint32_t m_NumThreads;
 	ThreadDataStore* m_pThreadDataStore;
+	FiberThreadData* m_pFiberThreadData;
 	std::thread* m_pThreads;
 	std::atomic<bool> m_bRunning;
 	std::atomic<bool> m_bShutdownRequested;
@@ -516,6 +781,10 @@ private:
 	bool m_bHaveThreads;
 	TaskSchedulerConfig m_Config;
 	std::atomic<int32_t> m_NumExternalTaskThreadsRegistered;
+	std::atomic<uint64_t> m_DeadlinesCompleted;
+	std::atomic<uint64_t> m_DeadlinesMissed;
+	std::atomic<uint64_t> m_DeadlineMaxLatenessNs;
+	std::atomic<uint64_t> m_DeadlineTotalLatenessNs;
 
 	TaskScheduler(const TaskScheduler& nocopy_);
 	TaskScheduler& operator=(const TaskScheduler& nocopy_);
@@ -544,6 +813,12 @@ IPinnedTask::OnDependenciesComplete(TaskScheduler* pTaskScheduler_, uint32_t thr
 	pTaskScheduler_->AddPinnedTaskInt(this);
 }
 
+inline void
+TaskGraph::OnDependenciesComplete(TaskScheduler* pTaskScheduler_, uint32_t threadNum_)
+{
+	pTaskScheduler_->AddTaskGraphInt(this, threadNum_);
+}
+
 inline ICompletable::~ICompletable()
 {
 	assert(GetIsComplete()); // this task is still waiting to run
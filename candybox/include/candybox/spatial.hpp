@@ -4,10 +4,14 @@
 #include <cstdint>
 #include <vector>
 #include <queue>
+#include <memory>
 #include <algorithm>
 #include "candybox/AABB.hpp"
+#include "candybox/Hilbert.hpp"
 
 namespace candybox {
+class TaskScheduler;
+
 /*███████╗██████╗  █████╗ ████████╗██╗ █████╗ ██╗     */
 /*██╔════╝██╔══██╗██╔══██╗╚══██╔══╝██║██╔══██╗██║     */
 /*███████╗██████╔╝███████║   ██║   ██║███████║██║     */
@@ -20,28 +24,63 @@ namespace candybox {
 
 /// Packed Hilbert R-tree.
 /// You can not add or remove items after initialization, but it is fast to create a new
-/// one.
+/// one, see DynamicSpatial.
 /// https://en.wikipedia.org/wiki/Hilbert_R-tree#Packed_Hilbert_R-trees
 class Spatial
 {
-	explicit Spatial(uint32_t n);
+public:
+	/// Reserves the tree for numItems boxes. nodeSize is the number of children of a node,
+	/// between 2 and 64. Larger nodes make a shallower tree which is faster to build, and
+	/// as search() tests the children of a node with SIMD they are cheap to scan.
+	explicit Spatial(uint32_t numItems, uint32_t nodeSize = 16);
 	~Spatial();
 
+	Spatial(const Spatial &) = delete;
+	Spatial &operator=(const Spatial &) = delete;
+
+	/// Adds a box and returns its index, which is what search() and neighbors() return.
 	uint32_t add(float minx, float miny, float maxx, float maxy);
 
-	void addAll(float *data, uint32_t nFloat);
+	/// Adds nFloat / 4 boxes stored as minx, miny, maxx, maxy.
+	void addAll(const float *data, uint32_t nFloat);
 
-	void finish();
+	/// Builds the tree once all the boxes have been added. The boxes are sorted by the
+	/// Hilbert value of their center and packed into nodes, bottom-up. With a scheduler the
+	/// Hilbert values are computed and radix sorted in parallel, and each level of nodes is
+	/// built in parallel, see parallel_radix_sort().
+	void finish(TaskScheduler *ts = nullptr);
 
-	void
-	search(float minx, float miny, float maxx, float maxy, std::vector<uint32_t> &results);
+	/// Indices of the boxes intersecting the query box, results is cleared first.
+	void search(float minx, float miny, float maxx, float maxy, std::vector<uint32_t> &results)
+	    const;
 
+	/// Indices of up to maxNeighbors boxes within maxDist of (x, y), nearest first.
 	void neighbors(
 	    float x,
 	    float y,
 	    float maxDist,
 	    uint32_t maxNeighbors,
-	    std::vector<uint32_t> &neighbors);
+	    std::vector<uint32_t> &neighbors) const;
+
+	/// Batch version of neighbors() for numPoints points, stored as x, y pairs.
+	/// The results of point i are indices[offsets[i]] to indices[offsets[i + 1] - 1], nearest
+	/// first, ties ordered by index. offsets must hold numPoints + 1 values and indices
+	/// numPoints * maxNeighbors, which is used as scratch before the results are packed.
+	/// Nothing is allocated per point, each thread reuses a heap of maxNeighbors entries.
+	/// With a scheduler the points are spread over its threads. Returns offsets[numPoints].
+	uint32_t neighbors(
+	    const float *points,
+	    uint32_t numPoints,
+	    float maxDist,
+	    uint32_t maxNeighbors,
+	    uint32_t *offsets,
+	    uint32_t *indices,
+	    TaskScheduler *ts = nullptr) const;
+
+	/// Number of boxes the tree was created for.
+	uint32_t size() const { return m_numItems; }
+
+	uint32_t nodeSize() const { return m_nodeSize; }
 
 private:
 	float *m_boxes; ///< minx, miny, maxx, maxy
@@ -50,12 +89,95 @@ private:
 	uint32_t m_numItems; ///< Number of bounding boxes added.
 	uint32_t m_nodeSize;
 	uint32_t m_numNodes;
-	uint32_t m_levelBounds[32]{};
+	uint32_t m_levelBounds[33]{}; ///< end of each level in "boxes", leaves first.
 	uint32_t m_numBounds;
 	uint32_t m_pos;
 	float m_minx, m_maxx, m_miny, m_maxy; ///< Bounding box of all the bboxes added.
 };
 
+/// Dynamic index made of immutable Spatial trees, log-structured merge style.
+/// New boxes go to a small buffer which is scanned linearly. When it is full it is built
+/// into a Spatial run, and runs of similar size are merged into a larger one, so there are
+/// O(log n) runs. Removed boxes are only marked dead (tombstones) and are dropped when their
+/// run is merged, runs with mostly dead boxes are compacted on their own. Queries fan out
+/// over the buffer and every run, so a mostly static world queries at near Spatial speed.
+/// With a scheduler the merges are built by a background task while the old runs keep
+/// serving queries, the merged run replaces them on the next insert(), remove() or
+/// update(). Like TaskScheduler::AddTaskSetToPipe() the non const functions must then be
+/// called from the thread which initialized the scheduler or from a task.
+/// Queries can run concurrently with each other, not with the non const functions.
+class DynamicSpatial
+{
+public:
+	/// bufferSize is the number of boxes kept outside of a tree, nodeSize is the one of the
+	/// Spatial runs.
+	explicit DynamicSpatial(
+	    uint32_t bufferSize = 512, uint32_t nodeSize = 16, TaskScheduler *ts = nullptr);
+	~DynamicSpatial();
+
+	DynamicSpatial(const DynamicSpatial &) = delete;
+	DynamicSpatial &operator=(const DynamicSpatial &) = delete;
+
+	/// Adds a box and returns its id. Ids of removed boxes are reused once their tombstone
+	/// has been merged away.
+	uint32_t insert(float minx, float miny, float maxx, float maxy);
+
+	/// Removes the box, returns false if the id is not in the index.
+	bool remove(uint32_t id);
+
+	/// Installs a finished background merge and starts the next one if needed.
+	void update();
+
+	/// Waits for the background merges, then the runs are in their final shape.
+	void wait();
+
+	/// Ids of the boxes intersecting the query box, results is cleared first.
+	void search(float minx, float miny, float maxx, float maxy, std::vector<uint32_t> &results)
+	    const;
+
+	/// Ids of up to maxNeighbors boxes within maxDist of (x, y), nearest first.
+	void neighbors(
+	    float x,
+	    float y,
+	    float maxDist,
+	    uint32_t maxNeighbors,
+	    std::vector<uint32_t> &neighbors) const;
+
+	/// Number of boxes in the index.
+	uint32_t size() const { return m_numItems; }
+
+	/// Number of Spatial runs the queries fan out to.
+	uint32_t numRuns() const { return (uint32_t)m_runs.size(); }
+
+private:
+	struct Run;
+	struct Merge;
+
+	void flushBuffer();
+	void startMerge();
+	void finishMerge();
+
+	struct Location
+	{
+		uint32_t run; ///< serial of the run, BUFFER or DEAD.
+		uint32_t slot; ///< index in the buffer.
+	};
+	static const uint32_t BUFFER = 0;
+	static const uint32_t DEAD = 0xFFFFFFFF;
+
+	TaskScheduler *m_ts;
+	uint32_t m_bufferSize;
+	uint32_t m_nodeSize;
+	uint32_t m_numItems = 0;
+	uint32_t m_nextSerial = 1;
+	std::vector<float> m_bufferBoxes; ///< minx, miny, maxx, maxy
+	std::vector<uint32_t> m_bufferIds;
+	std::vector<Location> m_locations; ///< by id
+	std::vector<uint32_t> m_freeIds;
+	std::vector<std::unique_ptr<Run> > m_runs; ///< oldest, so largest, first.
+	std::unique_ptr<Merge> m_merge; ///< in flight merge.
+};
+
 //! @}
 } // namespace candybox
 
@@ -133,7 +255,7 @@ template <typename T, int Dimension> struct CheckPredicateHelper<T, Dimension, w
 
 	inline bool operator()(const box_t &predicateBBox, const box_t &valueBBox) const
 	{
-		return predicateBBox.contains(valueBBox.min);
+		return predicateBBox.contains(valueBBox.l);
 	}
 };
 
@@ -1865,6 +1987,339 @@ TREE_QUAL::leaf_iterator::next()
 
 namespace candybox {
 
+/**
+	 \class LooseQuadTree
+	 \brief Loose quadtree for 2D objects which move every frame.
+
+	 The nodes are the cells of a regular quadtree grown by the looseness factor, so an
+	 object whose size is at most (looseness - 1) times the cell size fits into the cell
+	 which contains its center. insert() returns a stable handle which stores the node and
+	 the slot of the object, so update() is O(1) as long as the new box stays within the
+	 loose bounds of its node, and remove() is a swap and pop. The nodes live in a
+	 contiguous pool, the 4 children of a node are created together when an object first
+	 goes down to them, and are only released by clear().
+
+	 @tparam T                type of the space(eg. int, float, etc.)
+	 @tparam ValueType        type of value stored in the tree
+	 @tparam indexable_getter the indexable getter, i.e. the getter for the bounding box
+	 of a value
+	 */
+template <
+    class T,
+    class ValueType,
+    typename indexable_getter = Indexable<typename TBox<T, 2>::tvec, ValueType>>
+class LooseQuadTree
+{
+public:
+	typedef TBox<T, 2> bbox_type;
+	typedef uint32_t handle_type;
+
+	static const handle_type invalid_handle = 0xFFFFFFFF;
+
+	/// maxDepth is the depth of the smallest cells, looseness the factor between the loose
+	/// bounds and the cell of a node, it must be > 1.
+	LooseQuadTree(
+	    const glm::vec<2, T> &min,
+	    const glm::vec<2, T> &max,
+	    int maxDepth = 8,
+	    float looseness = 2.0f,
+	    indexable_getter indexable = indexable_getter());
+
+	/// Adds the value and returns its handle. Handles of removed values are reused.
+	handle_type insert(const ValueType &value);
+	/// Replaces the value, i.e. after it moved. Only moves it to another node if its box
+	/// left the loose bounds of its node.
+	void update(handle_type handle, const ValueType &value);
+	bool remove(handle_type handle);
+
+	ValueType &value(handle_type handle);
+	const ValueType &value(handle_type handle) const;
+
+	/// @see SpatialPredicate for available predicates.
+	template <typename Predicate> bool query(const Predicate &predicate) const;
+	template <typename Predicate, typename OutIter>
+	size_t query(const Predicate &predicate, OutIter out_it) const;
+
+	/// Remove all entries from tree and release the nodes.
+	void clear();
+	/// Count the data elements in this container.
+	size_t count() const { return m_count; }
+	/// Number of nodes in the pool.
+	size_t nodeCount() const { return m_nodes.size(); }
+	/// Returns the bbox of the root cell.
+	bbox_type bbox() const { return m_nodes[0].cell; }
+
+private:
+	struct Entry
+	{
+		bbox_type box;
+		handle_type handle;
+	};
+
+	struct Node
+	{
+		bbox_type cell;
+		bbox_type loose; ///< cell grown by the looseness
+		uint32_t children; ///< index of the first of the 4 children, 0 for a leaf
+		int depth;
+		std::vector<Entry> entries;
+	};
+
+	struct Item
+	{
+		ValueType value;
+		uint32_t node; ///< invalid_handle once removed
+		uint32_t slot; ///< index in the entries of the node
+	};
+
+	void initNode(Node &node, const bbox_type &cell, int depth) const;
+	uint32_t findNode(const bbox_type &box);
+	void addEntry(uint32_t node, handle_type handle, const bbox_type &box);
+	void removeEntry(uint32_t node, uint32_t slot);
+
+	indexable_getter m_indexable;
+	int m_maxDepth;
+	float m_looseness;
+	size_t m_count;
+	std::vector<Node> m_nodes; ///< root first
+	std::vector<Item> m_items; ///< by handle
+	std::vector<handle_type> m_freeHandles;
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#define TREE_TEMPLATE template <class T, class ValueType, typename indexable_getter>
+#define TREE_QUAL     LooseQuadTree<T, ValueType, indexable_getter>
+
+TREE_TEMPLATE
+TREE_QUAL::LooseQuadTree(
+    const glm::vec<2, T> &min,
+    const glm::vec<2, T> &max,
+    int maxDepth /*= 8*/,
+    float looseness /*= 2.0f*/,
+    indexable_getter indexable /*= indexable_getter()*/)
+    : m_indexable(indexable), m_maxDepth(maxDepth), m_looseness(looseness), m_count(0)
+{
+	assert(looseness > 1.0f);
+	assert(maxDepth >= 0 && maxDepth < 30);
+	m_nodes.emplace_back();
+	initNode(m_nodes[0], bbox_type(min, max), 0);
+}
+
+TREE_TEMPLATE
+typename TREE_QUAL::handle_type
+TREE_QUAL::insert(const ValueType &value)
+{
+	handle_type handle;
+	if (!m_freeHandles.empty())
+	{
+		handle = m_freeHandles.back();
+		m_freeHandles.pop_back();
+	}
+	else
+	{
+		handle = (handle_type)m_items.size();
+		m_items.emplace_back();
+	}
+
+	const bbox_type box(m_indexable.min(value), m_indexable.max(value));
+	m_items[handle].value = value;
+	addEntry(findNode(box), handle, box);
+	++m_count;
+	return handle;
+}
+
+TREE_TEMPLATE
+void
+TREE_QUAL::update(handle_type handle, const ValueType &value)
+{
+	Item &item = m_items[handle];
+	assert(item.node != invalid_handle);
+	item.value = value;
+
+	const bbox_type box(m_indexable.min(value), m_indexable.max(value));
+	if (m_nodes[item.node].loose.contains(box))
+	{
+		m_nodes[item.node].entries[item.slot].box = box;
+		return;
+	}
+	removeEntry(item.node, item.slot);
+	addEntry(findNode(box), handle, box);
+}
+
+TREE_TEMPLATE
+bool
+TREE_QUAL::remove(handle_type handle)
+{
+	if (handle >= m_items.size() || m_items[handle].node == invalid_handle) return false;
+
+	Item &item = m_items[handle];
+	removeEntry(item.node, item.slot);
+	item.node = invalid_handle;
+	m_freeHandles.push_back(handle);
+	--m_count;
+	return true;
+}
+
+TREE_TEMPLATE
+ValueType &
+TREE_QUAL::value(handle_type handle)
+{
+	assert(m_items[handle].node != invalid_handle);
+	return m_items[handle].value;
+}
+
+TREE_TEMPLATE
+const ValueType &
+TREE_QUAL::value(handle_type handle) const
+{
+	assert(m_items[handle].node != invalid_handle);
+	return m_items[handle].value;
+}
+
+TREE_TEMPLATE
+template <typename Predicate>
+bool
+TREE_QUAL::query(const Predicate &predicate) const
+{
+	return query(predicate, detail::dummy_iterator()) > 0;
+}
+
+TREE_TEMPLATE
+template <typename Predicate, typename OutIter>
+size_t
+TREE_QUAL::query(const Predicate &predicate, OutIter out_it) const
+{
+	size_t foundCount = 0;
+	// at most 3 siblings per level are waiting on the stack.
+	uint32_t stack[3 * 30 + 1];
+	int tos = 0;
+	stack[tos++] = 0;
+	while (tos > 0)
+	{
+		const Node &node = m_nodes[stack[--tos]];
+		for (const Entry &entry : node.entries)
+		{
+			if (predicate(entry.box))
+			{
+				*out_it = m_items[entry.handle].value;
+				++out_it;
+				++foundCount;
+			}
+		}
+
+		if (!node.children) continue;
+		for (uint32_t i = node.children; i < node.children + 4; ++i)
+		{
+			if (predicate.bbox.overlaps(m_nodes[i].loose)) stack[tos++] = i;
+		}
+	}
+	return foundCount;
+}
+
+TREE_TEMPLATE
+void
+TREE_QUAL::clear()
+{
+	bbox_type cell = m_nodes[0].cell;
+	m_nodes.clear();
+	m_nodes.emplace_back();
+	initNode(m_nodes[0], cell, 0);
+	m_items.clear();
+	m_freeHandles.clear();
+	m_count = 0;
+}
+
+TREE_TEMPLATE
+void
+TREE_QUAL::initNode(Node &node, const bbox_type &cell, int depth) const
+{
+	node.cell = cell;
+	node.loose = cell;
+	node.children = 0;
+	node.depth = depth;
+	for (int i = 0; i < 2; ++i)
+	{
+		// rounded outwards, a larger loose bound is always safe.
+		float grow = (float)(cell.u[i] - cell.l[i]) * (m_looseness - 1.0f) * 0.5f;
+		node.loose.l[i] = cell.l[i] - (T)std::ceil(grow);
+		node.loose.u[i] = cell.u[i] + (T)std::ceil(grow);
+	}
+}
+
+// Goes down the cells containing the center of the box, to the depth at which the box is
+// not larger than (looseness - 1) cells. Boxes which do not fit stay in the parent, the
+// root takes anything.
+TREE_TEMPLATE
+uint32_t
+TREE_QUAL::findNode(const bbox_type &box)
+{
+	const float size = (float)std::max(box.u[0] - box.l[0], box.u[1] - box.l[1]);
+	const float centerX = ((float)box.l[0] + (float)box.u[0]) * 0.5f;
+	const float centerY = ((float)box.l[1] + (float)box.u[1]) * 0.5f;
+
+	uint32_t index = 0;
+	while (m_nodes[index].depth < m_maxDepth)
+	{
+		const bbox_type cell = m_nodes[index].cell;
+		const float halfW = (float)(cell.u[0] - cell.l[0]) * 0.5f;
+		const float halfH = (float)(cell.u[1] - cell.l[1]) * 0.5f;
+		if (size > std::min(halfW, halfH) * (m_looseness - 1.0f)) break;
+
+		if (!m_nodes[index].children)
+		{
+			const int depth = m_nodes[index].depth + 1;
+			const uint32_t children = (uint32_t)m_nodes.size();
+			m_nodes.resize(children + 4); // invalidates the node references.
+			m_nodes[index].children = children;
+			for (int i = 0; i < 4; ++i)
+			{
+				const bbox_type quad = cell.quad2d(static_cast<detail::RegionType>(i));
+				initNode(m_nodes[children + i], quad, depth);
+			}
+		}
+
+		// quad2d() order: NW, NE, SW, SE, the north is at the max y.
+		const bool east = centerX >= (float)cell.l[0] + halfW;
+		const bool north = centerY >= (float)cell.l[1] + halfH;
+		const uint32_t child = m_nodes[index].children + (north ? 0 : 2) + (east ? 1 : 0);
+		if (!m_nodes[child].loose.contains(box)) break;
+		index = child;
+	}
+	return index;
+}
+
+TREE_TEMPLATE
+void
+TREE_QUAL::addEntry(uint32_t node, handle_type handle, const bbox_type &box)
+{
+	std::vector<Entry> &entries = m_nodes[node].entries;
+	Item &item = m_items[handle];
+	item.node = node;
+	item.slot = (uint32_t)entries.size();
+	entries.push_back({box, handle});
+}
+
+TREE_TEMPLATE
+void
+TREE_QUAL::removeEntry(uint32_t node, uint32_t slot)
+{
+	std::vector<Entry> &entries = m_nodes[node].entries;
+	if (slot + 1 != entries.size())
+	{
+		entries[slot] = entries.back();
+		m_items[entries[slot].handle].slot = slot;
+	}
+	entries.pop_back();
+}
+
+#undef TREE_TEMPLATE
+#undef TREE_QUAL
+
+} // namespace candybox
+
+namespace candybox {
+
 namespace rtree {
 // Type of element that allows fractional and large values such as float or
 // double, for use in volume calculations.
@@ -1879,6 +2334,14 @@ template <> struct RealType<double>
 };
 } // namespace rtree
 
+namespace detail {
+enum BulkLoadMode
+{
+	eSortTileRecursive = 0, // Tiles the centers into slabs, one dimension after the other
+	eHilbertSort // Orders the centers along a Hilbert curve, 2D only
+};
+} // namespace detail
+
 /**
 	 @class RTree
 	 @brief Implementation of a custom RTree tree based on the version
@@ -2051,6 +2514,16 @@ public:
 	    Iter last, //
 	    indexable_getter indexable = indexable_getter(), //
 	    const allocator_type &allocator = allocator_type());
+	/// Bulk loads the values bottom-up into full nodes, which is much faster than inserting
+	/// them one by one and packs the nodes tighter, so queries visit fewer of them.
+	/// eHilbertSort falls back to eSortTileRecursive if Dimension is not 2.
+	template <typename Iter>
+	RTree(
+	    Iter first,
+	    Iter last,
+	    detail::BulkLoadMode mode, //
+	    indexable_getter indexable = indexable_getter(), //
+	    const allocator_type &allocator = allocator_type());
 	RTree(const RTree &src);
 #ifdef SPATIAL_TREE_USE_CPP11
 	RTree(RTree &&src);
@@ -2232,6 +2705,20 @@ private:
 	    int level);
 	void copyRec(const node_ptr_type src, node_ptr_type dst);
 
+	void bulkLoad(std::vector<branch_type> &branches, detail::BulkLoadMode mode);
+	void sortTileRecursive(
+	    branch_type *branches,
+	    size_t count,
+	    int dimension,
+	    int level,
+	    std::vector<branch_type> &parents);
+	void hilbertSort(branch_type *branches, size_t count) const;
+	void packNodes(
+	    const branch_type *branches,
+	    size_t count,
+	    int level,
+	    std::vector<branch_type> &parents);
+
 	count_type pickBranch(const bbox_type &bbox, const node_type &node) const;
 	void getBranches(const node_type &node, const branch_type &branch, BranchVars &branchVars)
 	    const;
@@ -2367,10 +2854,35 @@ TREE_QUAL::RTree(
 	static_assert(min_child_items > 0, "Invalid child size!");
 
 	m_root = detail::allocate(m_allocator, 0);
-	// TODO: use packing algorithm
+	// inserts one by one, see the BulkLoadMode constructor for packing.
 	insert(first, last);
 }
 
+TREE_TEMPLATE
+template <typename Iter>
+TREE_QUAL::RTree(
+    Iter first,
+    Iter last,
+    detail::BulkLoadMode mode,
+    indexable_getter indexable /*= indexable_getter()*/,
+    const allocator_type &allocator /*= allocator_type()*/)
+    : m_indexable(indexable), m_allocator(allocator), m_count(0), m_queryTargetLevel(0)
+{
+	static_assert(max_child_items > min_child_items, "Invalid child size!");
+	static_assert(min_child_items > 0, "Invalid child size!");
+
+	std::vector<branch_type> branches;
+	for (Iter it = first; it != last; ++it)
+	{
+		branch_type branch;
+		branch.value = *it;
+		branch.child = NULL;
+		branch.bbox.set(m_indexable.min(*it), m_indexable.max(*it));
+		branches.push_back(branch);
+	}
+	bulkLoad(branches, mode);
+}
+
 TREE_TEMPLATE
 TREE_QUAL::RTree(const RTree &src)
     : m_indexable(src.m_indexable),
@@ -2796,6 +3308,130 @@ TREE_QUAL::clearRec(const node_ptr_type node)
 	detail::deallocate(m_allocator, node);
 }
 
+// Builds the tree bottom-up, each level is ordered so that neighbouring branches are close
+// and packed into nodes which become the branches of the next level.
+TREE_TEMPLATE
+void
+TREE_QUAL::bulkLoad(std::vector<branch_type> &branches, detail::BulkLoadMode mode)
+{
+	if (Dimension != 2) mode = detail::eSortTileRecursive;
+	m_count = branches.size();
+
+	int level = 0;
+	std::vector<branch_type> parents;
+	while (branches.size() > max_child_items)
+	{
+		parents.clear();
+		if (mode == detail::eSortTileRecursive)
+		{
+			sortTileRecursive(branches.data(), branches.size(), 0, level, parents);
+		}
+		else
+		{
+			// the parents of Hilbert ordered nodes are already in Hilbert order.
+			if (level == 0) hilbertSort(branches.data(), branches.size());
+			packNodes(branches.data(), branches.size(), level, parents);
+		}
+		branches.swap(parents);
+		++level;
+	}
+
+	m_root = detail::allocate(m_allocator, level);
+	for (const branch_type &branch : branches) m_root->addBranch(branch);
+}
+
+// Sorts the branches by the center along the dimension and cuts them into
+// ceil(numNodes^(1/remaining dimensions)) slabs, which are tiled the same way along the
+// next dimension. Along the last one they are packed into nodes.
+TREE_TEMPLATE
+void
+TREE_QUAL::sortTileRecursive(
+    branch_type *branches,
+    size_t count,
+    int dimension,
+    int level,
+    std::vector<branch_type> &parents)
+{
+	std::sort(branches, branches + count, [dimension](const branch_type &a, const branch_type &b) {
+		return (real_type)a.bbox.l[dimension] + a.bbox.u[dimension] <
+		       (real_type)b.bbox.l[dimension] + b.bbox.u[dimension];
+	});
+
+	const size_t numNodes = (count + max_child_items - 1) / max_child_items;
+	if (dimension == Dimension - 1 || numNodes == 1)
+	{
+		packNodes(branches, count, level, parents);
+		return;
+	}
+
+	// balanced slabs, so that the last one is not left with a few branches.
+	const size_t numSlabs =
+	    (size_t)std::ceil(std::pow((double)numNodes, 1.0 / (Dimension - dimension)));
+	const size_t slabSize = ((numNodes + numSlabs - 1) / numSlabs) * max_child_items;
+	const size_t numUsedSlabs = (count + slabSize - 1) / slabSize;
+	size_t start = 0;
+	for (size_t slab = 0; slab < numUsedSlabs; ++slab)
+	{
+		size_t size = count / numUsedSlabs + (slab < count % numUsedSlabs ? 1 : 0);
+		sortTileRecursive(branches + start, size, dimension + 1, level, parents);
+		start += size;
+	}
+}
+
+TREE_TEMPLATE
+void
+TREE_QUAL::hilbertSort(branch_type *branches, size_t count) const
+{
+	bbox_type bounds(0);
+	for (size_t index = 0; index < count; ++index) bounds.extend(branches[index].bbox);
+	const real_type width = std::max((real_type)bounds.u[0] - bounds.l[0], (real_type)1e-9);
+	const real_type height = std::max((real_type)bounds.u[1] - bounds.l[1], (real_type)1e-9);
+	const real_type hilbertMax = (real_type)((1 << 16) - 1);
+
+	std::vector<std::pair<uint32_t, size_t>> order(count);
+	for (size_t index = 0; index < count; ++index)
+	{
+		const bbox_type &bbox = branches[index].bbox;
+		real_type x = ((real_type)bbox.l[0] + bbox.u[0]) / 2 - bounds.l[0];
+		real_type y = ((real_type)bbox.l[1] + bbox.u[1]) / 2 - bounds.l[1];
+		order[index].first = hilbert::HilbertXYToIndex(
+		    16, (uint32_t)(hilbertMax * x / width), (uint32_t)(hilbertMax * y / height));
+		order[index].second = index;
+	}
+	std::sort(order.begin(), order.end());
+
+	std::vector<branch_type> sorted(count);
+	for (size_t index = 0; index < count; ++index) sorted[index] = branches[order[index].second];
+	std::copy(sorted.begin(), sorted.end(), branches);
+}
+
+// Cuts the branches into ceil(count / max_child_items) nodes of balanced size, so none is
+// below min_child_items unless they all fit into a single node.
+TREE_TEMPLATE
+void
+TREE_QUAL::packNodes(
+    const branch_type *branches,
+    size_t count,
+    int level,
+    std::vector<branch_type> &parents)
+{
+	const size_t numNodes = (count + max_child_items - 1) / max_child_items;
+	size_t start = 0;
+	for (size_t index = 0; index < numNodes; ++index)
+	{
+		size_t size = count / numNodes + (index < count % numNodes ? 1 : 0);
+		node_ptr_type node = detail::allocate(m_allocator, level);
+		for (size_t branch = start; branch < start + size; ++branch)
+			node->addBranch(branches[branch]);
+		start += size;
+
+		branch_type parent;
+		parent.child = node;
+		parent.bbox = node->cover();
+		parents.push_back(parent);
+	}
+}
+
 // Inserts a new data rectangle into the index structure.
 // Recursively descends tree, propagates splits back up.
 // Returns 0 if node was not split.  Old node updated.
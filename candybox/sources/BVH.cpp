@@ -1,10 +1,13 @@
 #include <cstring>
 #include <cfloat>
+#include <chrono>
 
 #include "candybox/AABB.hpp"
 #include "candybox/Memory.hpp"
 #include "candybox/BVH.hpp"
 #include "candybox/Linear.hpp"
+#include "candybox/Parallel.hpp"
+#include "x86/sse2.h" // simde
 
 #ifdef __GNUC__
 #	pragma GCC diagnostic push
@@ -33,9 +36,21 @@ BVH::BVH()
 	m_freeList = 0;
 
 	m_proxyCount = 0;
+
+	m_wideNodes = nullptr;
+	m_wideCount = 0;
+	m_wideCapacity = 0;
+	m_wideDirty = true;
+	m_wideStale = false;
+
+	m_rebuildCursor = 0;
 }
 
-BVH::~BVH() { _free(m_nodes); }
+BVH::~BVH()
+{
+	_free(m_nodes);
+	_free(m_wideNodes);
+}
 
 // Allocate a node from the pool. Grow the pool if necessary.
 int32_t
@@ -233,6 +248,7 @@ BVH::balanceLeaf(int32_t iA)
 void
 BVH::insertLeaf(int32_t leaf)
 {
+	m_wideDirty = true;
 	if (m_root == BVH_NullIndex)
 	{
 		m_root = leaf;
@@ -356,6 +372,7 @@ BVH::insertLeaf(int32_t leaf)
 void
 BVH::removeLeaf(int32_t leaf)
 {
+	m_wideDirty = true;
 	if (leaf == m_root)
 	{
 		m_root = BVH_NullIndex;
@@ -498,6 +515,141 @@ BVH::move(int32_t proxyId, Box aabb)
 	return true;
 }
 
+int32_t
+BVH::moveBatch(const int32_t* proxyIds, const Box* aabbs, int32_t count, TaskScheduler* ts)
+{
+	if (count <= 0) { return 0; }
+
+	enum : uint8_t
+	{
+		Keep,
+		Refit,
+		Reinsert
+	};
+
+	// Classify the proxies like move() does. The leaves refit in place get their new fat
+	// Box right away, no other proxy of the batch reads them.
+	auto* actions = (uint8_t*)_malloc(count * sizeof(uint8_t));
+	glm::vec2 r = {AABB_EXTENSION, AABB_EXTENSION};
+	parallel_for_range(
+	    ts, (uint32_t)count,
+	    [&](TaskSetPartition range, uint32_t) {
+		    for (int32_t i = (int32_t)range.start; i < (int32_t)range.end; ++i)
+		    {
+			    const Box& aabb = aabbs[i];
+			    assert(-HUGE_NUMBER < aabb.l.x && aabb.l.x < HUGE_NUMBER);
+			    assert(-HUGE_NUMBER < aabb.l.y && aabb.l.y < HUGE_NUMBER);
+			    assert(-HUGE_NUMBER < aabb.u.x && aabb.u.x < HUGE_NUMBER);
+			    assert(-HUGE_NUMBER < aabb.u.y && aabb.u.y < HUGE_NUMBER);
+
+			    int32_t proxyId = proxyIds[i];
+			    assert(0 <= proxyId && proxyId < m_nodeCapacity);
+			    assert(testEnd(m_nodes + proxyId));
+
+			    Box fatAABB;
+			    fatAABB.l = m::subv(aabb.l, r);
+			    fatAABB.u = m::addv(aabb.u, r);
+
+			    Box hugeAABB;
+			    hugeAABB.l = m::muladdv(fatAABB.l, -4.0f, r);
+			    hugeAABB.u = m::muladdv(fatAABB.u, 4.0f, r);
+
+			    Box& treeAABB = m_nodes[proxyId].aabb;
+			    if (treeAABB.contains(aabb) && hugeAABB.contains(treeAABB))
+			    {
+				    actions[i] = Keep;
+			    }
+			    else if (treeAABB.overlaps(fatAABB))
+			    {
+				    actions[i] = Refit;
+				    treeAABB = fatAABB;
+			    }
+			    else { actions[i] = Reinsert; }
+		    }
+	    },
+	    256);
+
+	// Collect the ancestors of the refit leaves once, sorted by height so that the children
+	// of a level are refit before it.
+	auto* marked = (uint8_t*)_malloc(m_nodeCapacity * sizeof(uint8_t));
+	memset(marked, 0, m_nodeCapacity * sizeof(uint8_t));
+	auto* ancestors = (int32_t*)_malloc(m_nodeCount * sizeof(int32_t));
+	int32_t ancestorCount = 0;
+	int32_t movedCount = 0;
+	for (int32_t i = 0; i < count; ++i)
+	{
+		if (actions[i] == Keep) { continue; }
+
+		Node* leaf = m_nodes + proxyIds[i];
+		if (!leaf->moved) { ++movedCount; }
+		leaf->moved = true;
+		if (actions[i] != Refit) { continue; }
+
+		m_wideStale = true; // the wide tree still has the old bounds
+		for (int32_t index = leaf->parent; index != BVH_NullIndex && !marked[index];
+		     index = m_nodes[index].parent)
+		{
+			marked[index] = 1;
+			ancestors[ancestorCount++] = index;
+		}
+	}
+
+	int32_t height = getHeight();
+	auto* levelStart = (int32_t*)_malloc((height + 2) * sizeof(int32_t));
+	memset(levelStart, 0, (height + 2) * sizeof(int32_t));
+	for (int32_t i = 0; i < ancestorCount; ++i)
+	{
+		++levelStart[m_nodes[ancestors[i]].height + 1];
+	}
+	for (int32_t level = 0; level <= height; ++level)
+	{
+		levelStart[level + 1] += levelStart[level];
+	}
+	auto* sorted = (int32_t*)_malloc((ancestorCount + 1) * sizeof(int32_t));
+	for (int32_t i = 0; i < ancestorCount; ++i)
+	{
+		sorted[levelStart[m_nodes[ancestors[i]].height]++] = ancestors[i];
+	}
+
+	// levelStart now holds the end of each level.
+	int32_t begin = 0;
+	for (int32_t level = 1; level <= height; ++level)
+	{
+		int32_t end = levelStart[level];
+		parallel_for_range(
+		    ts, (uint32_t)(end - begin),
+		    [&](TaskSetPartition range, uint32_t) {
+			    for (uint32_t i = range.start; i < range.end; ++i)
+			    {
+				    Node* node = m_nodes + sorted[begin + i];
+				    const Box& aabb1 = m_nodes[node->child1].aabb;
+				    node->aabb = aabb1.combine(m_nodes[node->child2].aabb);
+			    }
+		    },
+		    256);
+		begin = end;
+	}
+
+	// The rest moved too far, re-insert them.
+	for (int32_t i = 0; i < count; ++i)
+	{
+		if (actions[i] != Reinsert) { continue; }
+
+		int32_t proxyId = proxyIds[i];
+		removeLeaf(proxyId);
+		m_nodes[proxyId].aabb.l = m::subv(aabbs[i].l, r);
+		m_nodes[proxyId].aabb.u = m::addv(aabbs[i].u, r);
+		insertLeaf(proxyId);
+	}
+
+	_free(sorted);
+	_free(levelStart);
+	_free(ancestors);
+	_free(marked);
+	_free(actions);
+	return movedCount;
+}
+
 int32_t
 BVH::getHeight() const
 {
@@ -547,6 +699,8 @@ BVH::computeSubTreeHeight(int32_t nodeId) const
 int32_t
 BVH::computeHeight() const
 {
+	if (m_root == BVH_NullIndex) { return 0; }
+
 	int32_t height = computeSubTreeHeight(m_root);
 	return height;
 }
@@ -667,6 +821,7 @@ BVH::getMaxBalance() const
 void
 BVH::rebuildBottomUp()
 {
+	m_wideDirty = true;
 	auto* nodes = (int32_t*)_malloc(m_nodeCount * sizeof(int32_t));
 	int32_t count = 0;
 
@@ -750,14 +905,22 @@ BVH::shiftOrigin(glm::vec2 newOrigin)
 		n->aabb.u.x -= newOrigin.x;
 		n->aabb.u.y -= newOrigin.y;
 	}
+	m_wideStale = true;
 }
 
-#define STACK_SIZE 256
-
 void
 BVH::queryFiltered(Box aabb, uint32_t maskBits, TreeQueryCallback callback, void* context)
 {
-	int32_t stack[STACK_SIZE];
+	query(aabb, maskBits, [=](int32_t proxyId, void* userData) {
+		// callback to user code with proxy id
+		return callback(proxyId, userData, context);
+	});
+}
+
+void
+BVH::query(Box aabb, TreeQueryCallback callback, void* context)
+{
+	int32_t stack[QUERY_STACK_SIZE];
 	int32_t stackCount = 0;
 	stack[stackCount++] = m_root;
 
@@ -768,7 +931,7 @@ BVH::queryFiltered(Box aabb, uint32_t maskBits, TreeQueryCallback callback, void
 
 		const Node* node = m_nodes + nodeId;
 
-		if (node->aabb.overlaps(aabb) && (node->categoryBits & maskBits) != 0)
+		if (node->aabb.overlaps(aabb))
 		{
 			if (testEnd(node))
 			{
@@ -778,10 +941,10 @@ BVH::queryFiltered(Box aabb, uint32_t maskBits, TreeQueryCallback callback, void
 			}
 			else
 			{
-				assert(stackCount <= STACK_SIZE - 2);
+				assert(stackCount <= QUERY_STACK_SIZE - 2);
 				// TODO log this?
 
-				if (stackCount <= STACK_SIZE - 2)
+				if (stackCount <= QUERY_STACK_SIZE - 2)
 				{
 					stack[stackCount++] = node->child1;
 					stack[stackCount++] = node->child2;
@@ -792,49 +955,218 @@ BVH::queryFiltered(Box aabb, uint32_t maskBits, TreeQueryCallback callback, void
 }
 
 void
-BVH::query(Box aabb, TreeQueryCallback callback, void* context)
+BVH::raycast(
+    const RayCast* input,
+    uint32_t maskBits,
+    TreeRaycastCallback callback,
+    void* context)
 {
-	int32_t stack[STACK_SIZE];
+	raycast(*input, maskBits, [=](const RayCast& subInput, int32_t proxyId, void* userData) {
+		return callback(&subInput, proxyId, userData, context);
+	});
+}
+
+void
+BVH::updateWide()
+{
+	m_wideStale = false;
+	if (!m_wideDirty)
+	{
+		// Same topology, only the bounds and categories of the lanes may have changed.
+		for (int32_t i = 0; i < m_wideCount; ++i)
+		{
+			WideNode* wide = m_wideNodes + i;
+			for (int32_t lane = 0; lane < 4; ++lane)
+			{
+				int32_t source = wide->source[lane];
+				if (source == BVH_NullIndex) { continue; }
+
+				const Node* node = m_nodes + source;
+				wide->lx[lane] = node->aabb.l.x;
+				wide->ly[lane] = node->aabb.l.y;
+				wide->ux[lane] = node->aabb.u.x;
+				wide->uy[lane] = node->aabb.u.y;
+				wide->categoryBits[lane] = node->categoryBits;
+			}
+		}
+		return;
+	}
+
+	m_wideDirty = false;
+	m_wideCount = 0;
+	if (m_root == BVH_NullIndex) { return; }
+
+	// A wide node per internal node at most, or one for a leaf root.
+	if (m_wideCapacity < m_nodeCount)
+	{
+		_free(m_wideNodes);
+		m_wideCapacity = m_nodeCapacity;
+		m_wideNodes = (WideNode*)_malloc(m_wideCapacity * sizeof(WideNode));
+	}
+
+	// Breadth first, so the wide node of an internal lane is the next one queued and the
+	// root is the first.
+	auto* queue = (int32_t*)_malloc(m_wideCapacity * sizeof(int32_t));
+	int32_t queueCount = 0;
+	queue[queueCount++] = m_root;
+
+	for (int32_t i = 0; i < queueCount; ++i)
+	{
+		const Node* node = m_nodes + queue[i];
+		int32_t lanes[4];
+		int32_t laneCount = 0;
+		if (testEnd(node)) { lanes[laneCount++] = queue[i]; }
+		else
+		{
+			lanes[laneCount++] = node->child1;
+			lanes[laneCount++] = node->child2;
+
+			// Open the largest internal child until the node is full.
+			while (laneCount < 4)
+			{
+				int32_t best = -1;
+				float bestArea = -1.0f;
+				for (int32_t lane = 0; lane < laneCount; ++lane)
+				{
+					const Node* child = m_nodes + lanes[lane];
+					if (!testEnd(child) && child->aabb.perimeter() > bestArea)
+					{
+						best = lane;
+						bestArea = child->aabb.perimeter();
+					}
+				}
+				if (best < 0) { break; }
+
+				const Node* open = m_nodes + lanes[best];
+				lanes[best] = open->child1;
+				lanes[laneCount++] = open->child2;
+			}
+		}
+
+		WideNode* wide = m_wideNodes + i;
+		wide->leafMask = 0;
+		for (int32_t lane = 0; lane < 4; ++lane)
+		{
+			if (lane >= laneCount)
+			{
+				wide->lx[lane] = FLT_MAX;
+				wide->ly[lane] = FLT_MAX;
+				wide->ux[lane] = -FLT_MAX;
+				wide->uy[lane] = -FLT_MAX;
+				wide->categoryBits[lane] = 0;
+				wide->child[lane] = BVH_NullIndex;
+				wide->source[lane] = BVH_NullIndex;
+				continue;
+			}
+
+			const Node* child = m_nodes + lanes[lane];
+			wide->lx[lane] = child->aabb.l.x;
+			wide->ly[lane] = child->aabb.l.y;
+			wide->ux[lane] = child->aabb.u.x;
+			wide->uy[lane] = child->aabb.u.y;
+			wide->categoryBits[lane] = child->categoryBits;
+			wide->source[lane] = lanes[lane];
+			if (testEnd(child))
+			{
+				wide->child[lane] = lanes[lane];
+				wide->leafMask |= 1 << lane;
+			}
+			else
+			{
+				assert(queueCount < m_wideCapacity);
+				wide->child[lane] = queueCount;
+				queue[queueCount++] = lanes[lane];
+			}
+		}
+	}
+
+	m_wideCount = queueCount;
+	_free(queue);
+}
+
+// Lanes of the boxes [lx, ux] x [ly, uy] overlapping the box [qlx, qux] x [qly, quy] and
+// sharing a category with maskBits.
+static inline int32_t
+overlapLanes(
+    const float* lx,
+    const float* ly,
+    const float* ux,
+    const float* uy,
+    const uint32_t* categoryBits,
+    simde__m128 qlx,
+    simde__m128 qly,
+    simde__m128 qux,
+    simde__m128 quy,
+    simde__m128i maskBits)
+{
+	simde__m128 overlap = simde_mm_and_ps(
+	    simde_mm_and_ps(
+	        simde_mm_cmple_ps(simde_mm_loadu_ps(lx), qux),
+	        simde_mm_cmple_ps(simde_mm_loadu_ps(ly), quy)),
+	    simde_mm_and_ps(
+	        simde_mm_cmpge_ps(simde_mm_loadu_ps(ux), qlx),
+	        simde_mm_cmpge_ps(simde_mm_loadu_ps(uy), qly)));
+	simde__m128i filtered = simde_mm_cmpeq_epi32(
+	    simde_mm_and_si128(simde_mm_loadu_si128((const simde__m128i*)categoryBits), maskBits),
+	    simde_mm_setzero_si128());
+	return simde_mm_movemask_ps(overlap) &
+	       ~simde_mm_movemask_ps(simde_mm_castsi128_ps(filtered));
+}
+
+void
+BVH::queryWide(Box aabb, uint32_t maskBits, TreeQueryCallback callback, void* context) const
+{
+	assert(!m_wideDirty && "updateWide() was not called since the tree changed");
+	assert(!m_wideStale && "updateWide() was not called since the bounds were refit");
+	if (m_wideCount == 0) { return; }
+
+	const simde__m128 lx = simde_mm_set1_ps(aabb.l.x);
+	const simde__m128 ly = simde_mm_set1_ps(aabb.l.y);
+	const simde__m128 ux = simde_mm_set1_ps(aabb.u.x);
+	const simde__m128 uy = simde_mm_set1_ps(aabb.u.y);
+	const simde__m128i mask = simde_mm_set1_epi32((int32_t)maskBits);
+
+	int32_t stack[QUERY_STACK_SIZE];
 	int32_t stackCount = 0;
-	stack[stackCount++] = m_root;
+	stack[stackCount++] = 0;
 
 	while (stackCount > 0)
 	{
-		int32_t nodeId = stack[--stackCount];
-		if (nodeId == BVH_NullIndex) { continue; }
+		const WideNode* wide = m_wideNodes + stack[--stackCount];
+		int32_t hits = overlapLanes(
+		    wide->lx, wide->ly, wide->ux, wide->uy, wide->categoryBits, lx, ly, ux, uy, mask);
 
-		const Node* node = m_nodes + nodeId;
-
-		if (node->aabb.overlaps(aabb))
+		for (int32_t lane = 0; lane < 4; ++lane)
 		{
-			if (testEnd(node))
+			if ((hits & (1 << lane)) == 0) { continue; }
+
+			int32_t child = wide->child[lane];
+			if (wide->leafMask & (1 << lane))
 			{
 				// callback to user code with proxy id
-				bool proceed = callback(nodeId, node->userData, context);
+				bool proceed = callback(child, m_nodes[child].userData, context);
 				if (!proceed) return;
 			}
 			else
 			{
-				assert(stackCount <= STACK_SIZE - 2);
-				// TODO log this?
-
-				if (stackCount <= STACK_SIZE - 2)
-				{
-					stack[stackCount++] = node->child1;
-					stack[stackCount++] = node->child2;
-				}
+				assert(stackCount < QUERY_STACK_SIZE);
+				if (stackCount < QUERY_STACK_SIZE) { stack[stackCount++] = child; }
 			}
 		}
 	}
 }
 
 void
-BVH::raycast(
+BVH::raycastWide(
     const RayCast* input,
     uint32_t maskBits,
     TreeRaycastCallback callback,
-    void* context)
+    void* context) const
 {
+	assert(!m_wideDirty && "updateWide() was not called since the tree changed");
+	assert(!m_wideStale && "updateWide() was not called since the bounds were refit");
+	if (m_wideCount == 0) { return; }
+
 	glm::vec2 p1 = input->p1;
 	glm::vec2 p2 = input->p2;
 	glm::vec2 extension = {input->radius, input->radius};
@@ -845,54 +1177,76 @@ BVH::raycast(
 	glm::vec2 v = m::crosssv(1.0f, r);
 	glm::vec2 abs_v = m::absv(v);
 
-	// Separating axis for segment (Gino, p80).
-	// |dot(v, p1 - c)| > dot(|v|, h)
-
 	float maxFraction = input->maxFraction;
 
-	// Build a bounding box for the segment.
-	Box segmentAABB;
-	{
-		// t is the endpoint of the ray
+	// Bounding box of the segment, in lanes.
+	simde__m128 lx, ly, ux, uy;
+	auto clipSegment = [&]() {
 		glm::vec2 t = m::muladdv(p1, maxFraction, m::subv(p2, p1));
-
-		// Add radius extension
-		segmentAABB.l = m::subv(m::minv(p1, t), extension);
-		segmentAABB.u = m::subv(m::maxv(p1, t), extension);
-	}
-
-	int32_t stack[STACK_SIZE];
+		glm::vec2 l = m::subv(m::minv(p1, t), extension);
+		glm::vec2 u = m::addv(m::maxv(p1, t), extension);
+		lx = simde_mm_set1_ps(l.x);
+		ly = simde_mm_set1_ps(l.y);
+		ux = simde_mm_set1_ps(u.x);
+		uy = simde_mm_set1_ps(u.y);
+	};
+	clipSegment();
+	const simde__m128i mask = simde_mm_set1_epi32((int32_t)maskBits);
+
+	const simde__m128 half = simde_mm_set1_ps(0.5f);
+	const simde__m128 signBit = simde_mm_set1_ps(-0.0f);
+	const simde__m128 vx = simde_mm_set1_ps(v.x), vy = simde_mm_set1_ps(v.y);
+	const simde__m128 absvx = simde_mm_set1_ps(abs_v.x), absvy = simde_mm_set1_ps(abs_v.y);
+	const simde__m128 p1x = simde_mm_set1_ps(p1.x), p1y = simde_mm_set1_ps(p1.y);
+	const simde__m128 ext = simde_mm_set1_ps(input->radius);
+
+	int32_t stack[QUERY_STACK_SIZE];
 	int32_t stackCount = 0;
-	stack[stackCount++] = m_root;
+	stack[stackCount++] = 0;
 
 	while (stackCount > 0)
 	{
-		int32_t nodeId = stack[--stackCount];
-		if (nodeId == BVH_NullIndex) { continue; }
-
-		const Node* node = m_nodes + nodeId;
-		if (!node->aabb.overlaps(segmentAABB) || (node->categoryBits & maskBits) == 0)
-		{
-			continue;
-		}
+		const WideNode* wide = m_wideNodes + stack[--stackCount];
 
 		// Separating axis for segment (Gino, p80).
 		// |dot(v, p1 - c)| > dot(|v|, h)
 		// radius extension is added to the node in this case
-		glm::vec2 c = node->aabb.center();
-		glm::vec2 h = m::addv(node->aabb.extents(), extension);
-		float term1 = m::abs(m::dotv(v, m::subv(p1, c)));
-		float term2 = m::dotv(abs_v, h);
-		if (term2 < term1) { continue; }
-
-		if (testEnd(node))
+		simde__m128 nlx = simde_mm_loadu_ps(wide->lx), nly = simde_mm_loadu_ps(wide->ly);
+		simde__m128 nux = simde_mm_loadu_ps(wide->ux), nuy = simde_mm_loadu_ps(wide->uy);
+		simde__m128 cx = simde_mm_mul_ps(simde_mm_add_ps(nlx, nux), half);
+		simde__m128 cy = simde_mm_mul_ps(simde_mm_add_ps(nly, nuy), half);
+		simde__m128 hx = simde_mm_mul_ps(simde_mm_sub_ps(nux, nlx), half);
+		simde__m128 hy = simde_mm_mul_ps(simde_mm_sub_ps(nuy, nly), half);
+		hx = simde_mm_add_ps(hx, ext);
+		hy = simde_mm_add_ps(hy, ext);
+		simde__m128 term1 = simde_mm_andnot_ps(signBit,
+		    simde_mm_add_ps(simde_mm_mul_ps(vx, simde_mm_sub_ps(p1x, cx)),
+		        simde_mm_mul_ps(vy, simde_mm_sub_ps(p1y, cy))));
+		simde__m128 term2 =
+		    simde_mm_add_ps(simde_mm_mul_ps(absvx, hx), simde_mm_mul_ps(absvy, hy));
+		const int32_t separated = simde_mm_movemask_ps(simde_mm_cmplt_ps(term2, term1));
+
+		int32_t hits = overlapLanes(
+		    wide->lx, wide->ly, wide->ux, wide->uy, wide->categoryBits, lx, ly, ux, uy, mask);
+		hits &= ~separated;
+		for (int32_t lane = 0; lane < 4; ++lane)
 		{
+			if ((hits & (1 << lane)) == 0) { continue; }
+
+			int32_t child = wide->child[lane];
+			if ((wide->leafMask & (1 << lane)) == 0)
+			{
+				assert(stackCount < QUERY_STACK_SIZE);
+				if (stackCount < QUERY_STACK_SIZE) { stack[stackCount++] = child; }
+				continue;
+			}
+
 			RayCast subInput;
 			subInput.p1 = input->p1;
 			subInput.p2 = input->p2;
 			subInput.maxFraction = maxFraction;
 
-			float value = callback(&subInput, nodeId, node->userData, context);
+			float value = callback(&subInput, child, m_nodes[child].userData, context);
 			assert(value >= 0.0f);
 
 			if (value == 0.0f)
@@ -903,24 +1257,12 @@ BVH::raycast(
 
 			if (value < maxFraction)
 			{
-				// Update segment bounding box.
+				// Update segment bounding box, the remaining lanes are tested against it.
 				maxFraction = value;
-				glm::vec2 t = m::muladdv(p1, maxFraction, m::subv(p2, p1));
-				segmentAABB.l = m::subv(m::minv(p1, t), extension);
-				segmentAABB.u = m::subv(m::maxv(p1, t), extension);
-			}
-		}
-		else
-		{
-			assert(stackCount <= STACK_SIZE - 2);
-			// TODO log this?
-
-			if (stackCount <= STACK_SIZE - 2)
-			{
-				// TODO just put one node on the stack, continue on a child node
-				// TODO test ordering children by nearest to ray origin
-				stack[stackCount++] = node->child1;
-				stack[stackCount++] = node->child2;
+				clipSegment();
+				hits &= overlapLanes(
+				    wide->lx, wide->ly, wide->ux, wide->uy, wide->categoryBits, lx, ly, ux,
+				    uy, mask);
 			}
 		}
 	}
@@ -928,33 +1270,63 @@ BVH::raycast(
 
 #define BIN_COUNT 32
 
+// Below this many items a node is binned in a single block, and below SAH_TASK_COUNT the
+// two sides of a split are built on the calling thread.
+#define SAH_BLOCK_COUNT 16384
+#define SAH_TASK_COUNT 2048
+
 // "On Fast Construction of SAH-based Bounding Volume Hierarchies" by Ingo Wald
+// Builds a tree over the nodes items[0, count), their subtrees are kept as they are. The
+// internal nodes are the count - 1 nodes of pool: this split takes the first, the left
+// side the next leftCount - 1 and the right side the rest, so the sides can be built in
+// parallel without sharing an allocator.
 int32_t
-BVH::binSortBoxes(
+BVH::buildSAH(
     int32_t parentIndex,
-    Node* leaves,
+    int32_t* items,
     int32_t count,
-    TreeBin* bins,
-    TreePlane* planes)
+    const int32_t* pool,
+    TaskScheduler* ts)
 {
 	if (count == 1)
 	{
-		leaves[0].parent = parentIndex;
-		return (int32_t)(leaves - m_nodes);
+		m_nodes[items[0]].parent = parentIndex;
+		return items[0];
 	}
 
-	Node* nodes = m_nodes;
-
-	glm::vec2 center = leaves[0].aabb.center();
-	Box centroidAABB;
-	centroidAABB.l = center;
-	centroidAABB.u = center;
+	struct Block
+	{
+		Box centroidAABB;
+		TreeBin bins[BIN_COUNT];
+	};
+
+	int32_t blockCount = count >= SAH_BLOCK_COUNT ? count / (SAH_BLOCK_COUNT / 4) : 1;
+	TaskScheduler* blockTs = blockCount > 1 ? ts : nullptr;
+	auto* blocks = (Block*)_malloc(blockCount * sizeof(Block));
+	auto blockBegin = [&](int32_t block) {
+		return (int32_t)((int64_t)count * block / blockCount);
+	};
+
+	parallel_for_range(blockTs, (uint32_t)blockCount, [&](TaskSetPartition range, uint32_t) {
+		for (int32_t block = (int32_t)range.start; block < (int32_t)range.end; ++block)
+		{
+			Box& centroidAABB = blocks[block].centroidAABB;
+			centroidAABB.l = {FLT_MAX, FLT_MAX};
+			centroidAABB.u = {-FLT_MAX, -FLT_MAX};
+			for (int32_t i = blockBegin(block); i < blockBegin(block + 1); ++i)
+			{
+				glm::vec2 center = m_nodes[items[i]].aabb.center();
+				centroidAABB.l = m::minv(centroidAABB.l, center);
+				centroidAABB.u = m::maxv(centroidAABB.u, center);
+			}
+		}
+	});
 
-	for (int32_t i = 1; i < count; ++i)
+	Box centroidAABB = blocks[0].centroidAABB;
+	for (int32_t block = 1; block < blockCount; ++block)
 	{
-		center = leaves[i].aabb.center();
-		centroidAABB.l = m::minv(centroidAABB.l, center);
-		centroidAABB.u = m::maxv(centroidAABB.u, center);
+		centroidAABB.l = m::minv(centroidAABB.l, blocks[block].centroidAABB.l);
+		centroidAABB.u = m::maxv(centroidAABB.u, blocks[block].centroidAABB.u);
 	}
 
 	glm::vec2 d = m::subv(centroidAABB.u, centroidAABB.l);
@@ -974,27 +1346,46 @@ BVH::binSortBoxes(
 
 	invD = invD > 0.0f ? 1.0f / invD : 0.0f;
 
-	for (int32_t i = 0; i < BIN_COUNT; ++i)
-	{
-		bins[i].aabb.l = {FLT_MAX, FLT_MAX};
-		bins[i].aabb.u = {-FLT_MAX, -FLT_MAX};
-		bins[i].count = 0;
-	}
-
 	float binCount = BIN_COUNT;
 	float lArray[2] = {centroidAABB.l.x, centroidAABB.l.y};
 	float minC = lArray[axisIndex];
-	for (int32_t i = 0; i < count; ++i)
-	{
-		glm::vec2 c = leaves[i].aabb.center();
+	auto binOf = [&](int32_t item) {
+		glm::vec2 c = m_nodes[item].aabb.center();
 		float cArray[2] = {c.x, c.y};
 		auto binIndex = (int32_t)(binCount * (cArray[axisIndex] - minC) * invD);
-		binIndex = m::clamp(binIndex, 0, BIN_COUNT - 1);
-		leaves[i].next = binIndex;
-		bins[binIndex].count += 1;
-		bins[binIndex].aabb = bins[binIndex].aabb.combine(leaves[i].aabb);
+		return m::clamp(binIndex, 0, BIN_COUNT - 1);
+	};
+
+	parallel_for_range(blockTs, (uint32_t)blockCount, [&](TaskSetPartition range, uint32_t) {
+		for (int32_t block = (int32_t)range.start; block < (int32_t)range.end; ++block)
+		{
+			TreeBin* bins = blocks[block].bins;
+			for (int32_t i = 0; i < BIN_COUNT; ++i)
+			{
+				bins[i].aabb.l = {FLT_MAX, FLT_MAX};
+				bins[i].aabb.u = {-FLT_MAX, -FLT_MAX};
+				bins[i].count = 0;
+			}
+			for (int32_t i = blockBegin(block); i < blockBegin(block + 1); ++i)
+			{
+				int32_t binIndex = binOf(items[i]);
+				bins[binIndex].count += 1 << m_nodes[items[i]].height;
+				bins[binIndex].aabb = bins[binIndex].aabb.combine(m_nodes[items[i]].aabb);
+			}
+		}
+	});
+
+	TreeBin* bins = blocks[0].bins;
+	for (int32_t block = 1; block < blockCount; ++block)
+	{
+		for (int32_t i = 0; i < BIN_COUNT; ++i)
+		{
+			bins[i].count += blocks[block].bins[i].count;
+			bins[i].aabb = bins[i].aabb.combine(blocks[block].bins[i].aabb);
+		}
 	}
 
+	TreePlane planes[BIN_COUNT - 1];
 	int32_t planeCount = BIN_COUNT - 1;
 
 	planes[0].leftCount = bins[0].count;
@@ -1013,6 +1404,8 @@ BVH::binSortBoxes(
 		planes[i].rightAABB = planes[i + 1].rightAABB.combine(bins[i + 1].aabb);
 	}
 
+	_free(blocks);
+
 	float minCost = FLT_MAX;
 	int32_t bestPlane = 0;
 	for (int32_t i = 0; i < planeCount; ++i)
@@ -1030,28 +1423,18 @@ BVH::binSortBoxes(
 		}
 	}
 
-	assert(m_nodeCount < m_nodeCapacity);
-	int32_t nodeIndex = m_nodeCount;
-	Node* node = nodes + nodeIndex;
+	int32_t nodeIndex = pool[0];
+	Node* node = m_nodes + nodeIndex;
 	node->setDefault();
 	node->aabb = planes[bestPlane].leftAABB.combine(planes[bestPlane].rightAABB);
 	node->parent = parentIndex;
-	m_nodeCount += 1;
 
-	int32_t i1 = -1;
-	for (int32_t i2 = 0; i2 < count; ++i2)
+	int32_t leftCount = 0;
+	for (int32_t i = 0; i < count; ++i)
 	{
-		int32_t binIndex = leaves[i2].next;
-		if (binIndex <= bestPlane)
-		{
-			++i1;
-			Node temp = leaves[i1];
-			leaves[i1] = leaves[i2];
-			leaves[i2] = temp;
-		}
+		if (binOf(items[i]) <= bestPlane) { std::swap(items[leftCount++], items[i]); }
 	}
 
-	int32_t leftCount = i1 + 1;
 	int32_t rightCount = count - leftCount;
 
 	if (leftCount == 0)
@@ -1065,12 +1448,36 @@ BVH::binSortBoxes(
 		rightCount = 1;
 	}
 
-	// Recurse
-	node->child1 = binSortBoxes(nodeIndex, leaves, leftCount, bins, planes);
-	node->child2 = binSortBoxes(nodeIndex, leaves + leftCount, rightCount, bins, planes);
+	// Recurse, the sides of large nodes in parallel.
+	int32_t children[2];
+	auto buildSide = [&](int32_t side) {
+		if (side == 0)
+		{
+			children[0] = buildSAH(nodeIndex, items, leftCount, pool + 1, ts);
+		}
+		else
+		{
+			children[1] =
+			    buildSAH(nodeIndex, items + leftCount, rightCount, pool + leftCount, ts);
+		}
+	};
+	if (ts && count >= SAH_TASK_COUNT)
+	{
+		parallel_for_range(*ts, 2, [&](TaskSetPartition range, uint32_t) {
+			for (uint32_t side = range.start; side < range.end; ++side) buildSide(side);
+		});
+	}
+	else
+	{
+		buildSide(0);
+		buildSide(1);
+	}
+
+	node->child1 = children[0];
+	node->child2 = children[1];
 
-	const Node* child1 = nodes + node->child1;
-	const Node* child2 = nodes + node->child2;
+	const Node* child1 = m_nodes + node->child1;
+	const Node* child2 = m_nodes + node->child2;
 
 	node->categoryBits = child1->categoryBits | child2->categoryBits;
 	node->height = 1 + std::max(child1->height, child2->height);
@@ -1078,6 +1485,93 @@ BVH::binSortBoxes(
 	return nodeIndex;
 }
 
+// Rebuild the part of the tree under nodeId down to the nodes of height cutHeight, which
+// keep their subtrees. The internal nodes above them are reused so that no index changes.
+void
+BVH::rebuildSubtree(int32_t nodeId, int32_t cutHeight)
+{
+	assert(m_nodes[nodeId].height > cutHeight);
+
+	auto* items = (int32_t*)_malloc(m_nodeCount * sizeof(int32_t));
+	auto* pool = (int32_t*)_malloc(m_nodeCount * sizeof(int32_t));
+	int32_t itemCount = 0, poolCount = 0;
+
+	int32_t stack[QUERY_STACK_SIZE];
+	int32_t stackCount = 0;
+	stack[stackCount++] = nodeId;
+	while (stackCount > 0)
+	{
+		int32_t index = stack[--stackCount];
+		const Node* node = m_nodes + index;
+		if (node->height <= cutHeight || testEnd(node))
+		{
+			items[itemCount++] = index;
+			continue;
+		}
+
+		pool[poolCount++] = index;
+		assert(stackCount <= QUERY_STACK_SIZE - 2);
+		stack[stackCount++] = node->child1;
+		stack[stackCount++] = node->child2;
+	}
+	assert(poolCount == itemCount - 1);
+
+	int32_t parent = m_nodes[nodeId].parent;
+	int32_t root = buildSAH(parent, items, itemCount, pool, nullptr);
+	if (parent == BVH_NullIndex) { m_root = root; }
+	else if (m_nodes[parent].child1 == nodeId) { m_nodes[parent].child1 = root; }
+	else { m_nodes[parent].child2 = root; }
+
+	// The bounds are the same, the heights may not.
+	for (int32_t index = parent; index != BVH_NullIndex; index = m_nodes[index].parent)
+	{
+		const Node* node = m_nodes + index;
+		m_nodes[index]
+		    .height = 1 + std::max(m_nodes[node->child1].height, m_nodes[node->child2].height);
+	}
+
+	m_wideDirty = true;
+	_free(pool);
+	_free(items);
+}
+
+int32_t
+BVH::rebuildIncremental(float budgetMs, int32_t subtreeHeight)
+{
+	assert(subtreeHeight > 0);
+	auto start = std::chrono::steady_clock::now();
+	int32_t rebuilt = 0;
+
+	// At most one round per call.
+	for (int32_t checked = 0; checked <= m_nodeCapacity && m_root != BVH_NullIndex;)
+	{
+		if (m_rebuildCursor >= m_nodeCapacity)
+		{
+			// End of a round, rebuild the top of the tree over the subtrees.
+			m_rebuildCursor = 0;
+			int32_t rootHeight = m_nodes[m_root].height;
+			if (rootHeight < 2) { continue; }
+
+			rebuildSubtree(m_root, rootHeight > subtreeHeight ? subtreeHeight : 0);
+		}
+		else
+		{
+			int32_t index = m_rebuildCursor++;
+			++checked;
+			if (m_nodes[index].height != subtreeHeight) { continue; }
+
+			rebuildSubtree(index, 0);
+		}
+
+		++rebuilt;
+		std::chrono::duration<float, std::milli> elapsed =
+		    std::chrono::steady_clock::now() - start;
+		if (elapsed.count() >= budgetMs) { break; }
+	}
+
+	return rebuilt;
+}
+
 int32_t
 BVH::getProxyCount() const
 {
@@ -1085,12 +1579,13 @@ BVH::getProxyCount() const
 }
 
 void
-BVH::rebuildTopDownSAH(ProxyMap* mapArray, int32_t mapCount)
+BVH::rebuildTopDownSAH(ProxyMap* mapArray, int32_t mapCount, TaskScheduler* ts)
 {
 	(void)mapCount;
 	assert(mapCount == m_proxyCount);
 
 	// need a way to map proxies
+	m_wideDirty = true;
 
 	int32_t proxyCount = m_proxyCount;
 	int32_t initialCapacity = m_nodeCapacity;
@@ -1128,13 +1623,23 @@ BVH::rebuildTopDownSAH(ProxyMap* mapArray, int32_t mapCount)
 	}
 
 	assert(nodeCount == proxyCount);
-	m_nodeCount = nodeCount;
-
-	TreeBin bins[BIN_COUNT];
-	TreePlane planes[BIN_COUNT - 1];
-	m_root = binSortBoxes(BVH_NullIndex, nodes, nodeCount, bins, planes);
 
-	nodeCount = m_nodeCount;
+	// The leaves are followed by the proxyCount - 1 internal nodes.
+	m_root = BVH_NullIndex;
+	if (proxyCount > 0)
+	{
+		auto* items = (int32_t*)_malloc(2 * proxyCount * sizeof(int32_t));
+		int32_t* pool = items + proxyCount;
+		for (int32_t i = 0; i < proxyCount; ++i)
+		{
+			items[i] = i;
+			pool[i] = proxyCount + i;
+		}
+		m_root = buildSAH(BVH_NullIndex, items, proxyCount, pool, ts);
+		nodeCount = 2 * proxyCount - 1;
+		_free(items);
+	}
+	m_nodeCount = nodeCount;
 
 	// Create a map for proxy nodes so the uses can get the new index
 	for (int32_t i = 0; i < proxyCount; ++i)
@@ -147,6 +147,7 @@ start:
 	m_frameTime = 0.f;
 	m_prevTime = 0.f;
 	m_accumulator = 0.f;
+	m_alpha = 0.f;
 	m_frame = 0;
 	glfwSwapInterval(0);
 	glfwSetTime(0);
@@ -284,6 +285,26 @@ Scene::mainLoop()
 	// Calculate pixel ration for hi-dpi devices.
 	m_devicePixelRatio = (float)m_frameWidth / (float)m_winWidth;
 
+	if (m_fixedStep)
+	{
+		// the time left over is carried to the next frame, and rendered by interpolation
+		const float timeStep = 1.f / m_hertz;
+		int32_t stepCount = 0;
+		if (m_running) // a paused scene keeps its time and its alpha
+		{
+			m_accumulator += m_frameTime;
+			while (m_accumulator >= timeStep && stepCount < m_maxFixedSteps)
+			{
+				m_accumulator -= timeStep;
+				++stepCount;
+			}
+			// drop the time the simulation could not keep up with, rather than spiral
+			if (m_accumulator >= timeStep) { m_accumulator = 0.f; }
+		}
+		m_alpha = m_accumulator / timeStep;
+		fixedUpdate(timeStep, stepCount);
+	}
+
 	update(m_frameTime);
 	render();
 
@@ -0,0 +1,168 @@
+#include <cstring>
+#include <cassert>
+#include <algorithm>
+#include "candybox/SpatialHash.hpp"
+#include "candybox/Parallel.hpp"
+using namespace candybox;
+
+static uint32_t
+nextPowerOfTwo(uint32_t value)
+{
+	uint32_t result = 1;
+	while (result < value && result < (1u << 31)) result <<= 1;
+	return result;
+}
+
+SpatialHash::SpatialHash(float cellSize, uint32_t tableSize)
+    : m_cellSize(cellSize), m_invCellSize(1.0f / cellSize), m_tableSize(tableSize)
+{
+	assert(cellSize > 0.0f);
+}
+
+void
+SpatialHash::build(const float *boxes, uint32_t numItems, TaskScheduler *ts)
+{
+	m_numItems = numItems;
+	m_numBuckets = nextPowerOfTwo(m_tableSize ? m_tableSize : m::max(numItems * 2, 1u));
+	m_bucketStart.resize(m_numBuckets + 1);
+	m_indices.resize(numItems);
+	m_boxes.resize(numItems * 4);
+	m_cells.resize(numItems * 2);
+	m_keys.resize(numItems);
+	m_maxHalfExtent[0] = m_maxHalfExtent[1] = 0.0f;
+	if (numItems == 0)
+	{
+		std::fill(m_bucketStart.begin(), m_bucketStart.end(), 0u);
+		return;
+	}
+
+	// cells and buckets of the centers, the cells are kept in m_cells until sorted.
+	struct Bounds
+	{
+		int cellMin[2], cellMax[2];
+		float halfExtent[2];
+	};
+	const uint32_t blockSize = 1 << 14;
+	const uint32_t numBlocks = (numItems + blockSize - 1) / blockSize;
+	std::vector<Bounds> blockBounds(numBlocks);
+	std::vector<int> cells(numItems * 2);
+	parallel_for_range(ts, numBlocks, [&](TaskSetPartition range, uint32_t) {
+		for (uint32_t block = range.start; block < range.end; block++)
+		{
+			Bounds bounds = {{INT32_MAX, INT32_MAX}, {INT32_MIN, INT32_MIN}, {0.0f, 0.0f}};
+			uint32_t last = m::min((block + 1) * blockSize, numItems);
+			for (uint32_t i = block * blockSize; i < last; i++)
+			{
+				const float *box = &boxes[i * 4];
+				for (int axis = 0; axis < 2; axis++)
+				{
+					float halfExtent = (box[axis + 2] - box[axis]) * 0.5f;
+					int cell = (int)std::floor((box[axis] + halfExtent) * m_invCellSize);
+					cells[i * 2 + axis] = cell;
+					bounds.cellMin[axis] = m::min(bounds.cellMin[axis], cell);
+					bounds.cellMax[axis] = m::max(bounds.cellMax[axis], cell);
+					bounds.halfExtent[axis] = m::max(bounds.halfExtent[axis], halfExtent);
+				}
+				m_keys[i] = bucket(cells[i * 2], cells[i * 2 + 1]);
+				m_indices[i] = i;
+			}
+			blockBounds[block] = bounds;
+		}
+	});
+	for (int axis = 0; axis < 2; axis++)
+	{
+		m_cellMin[axis] = INT32_MAX;
+		m_cellMax[axis] = INT32_MIN;
+		for (const Bounds &bounds : blockBounds)
+		{
+			m_cellMin[axis] = m::min(m_cellMin[axis], bounds.cellMin[axis]);
+			m_cellMax[axis] = m::max(m_cellMax[axis], bounds.cellMax[axis]);
+			m_maxHalfExtent[axis] = m::max(m_maxHalfExtent[axis], bounds.halfExtent[axis]);
+		}
+	}
+
+	// counting sort by bucket, the radix sort is a sequence of them which skips the digits
+	// above the table size. Both are stable, so the order does not depend on the threads.
+	if (ts)
+	{
+		parallel_radix_sort(*ts, m_keys.data(), m_indices.data(), numItems);
+	}
+	else
+	{
+		std::vector<uint32_t> offsets(m_numBuckets + 1, 0);
+		for (uint32_t i = 0; i < numItems; i++) offsets[m_keys[i] + 1]++;
+		for (uint32_t b = 0; b < m_numBuckets; b++) offsets[b + 1] += offsets[b];
+		std::vector<uint32_t> keys(numItems);
+		for (uint32_t i = 0; i < numItems; i++)
+		{
+			uint32_t dst = offsets[m_keys[i]]++;
+			keys[dst] = m_keys[i];
+			m_indices[dst] = i;
+		}
+		m_keys.swap(keys);
+	}
+
+	// bucket offsets from the boundaries of the sorted keys, and the boxes in sorted order.
+	parallel_for_range(
+	    ts, numItems,
+	    [&](TaskSetPartition range, uint32_t) {
+		    for (uint32_t i = range.start; i < range.end; i++)
+		    {
+			    uint32_t first = i == 0 ? 0 : m_keys[i - 1] + 1;
+			    for (uint32_t b = first; b <= m_keys[i]; b++) m_bucketStart[b] = i;
+			    if (i == numItems - 1)
+			    {
+				    for (uint32_t b = m_keys[i] + 1; b <= m_numBuckets; b++)
+					    m_bucketStart[b] = numItems;
+			    }
+
+			    uint32_t index = m_indices[i];
+			    memcpy(&m_boxes[i * 4], &boxes[index * 4], sizeof(float) * 4);
+			    m_cells[i * 2] = cells[index * 2];
+			    m_cells[i * 2 + 1] = cells[index * 2 + 1];
+		    }
+	    },
+	    1 << 12);
+}
+
+size_t
+SpatialHash::pairs(
+    float radius, std::vector<std::pair<uint32_t, uint32_t> > &pairs, TaskScheduler *ts) const
+{
+	pairs.clear();
+	if (m_numItems < 2) return 0;
+
+	// each block of sorted boxes collects its pairs, they are appended in block order.
+	const float radiusSq = radius * radius;
+	const uint32_t blockSize = 1024;
+	std::vector<std::vector<std::pair<uint32_t, uint32_t> > > blockPairs(
+	    (m_numItems + blockSize - 1) / blockSize);
+	parallel_for_range(ts, (uint32_t)blockPairs.size(), [&](TaskSetPartition range, uint32_t) {
+		for (uint32_t block = range.start; block < range.end; block++)
+		{
+			std::vector<std::pair<uint32_t, uint32_t> > &out = blockPairs[block];
+			uint32_t last = m::min((block + 1) * blockSize, m_numItems);
+			for (uint32_t i = block * blockSize; i < last; i++)
+			{
+				const float *box = &m_boxes[i * 4];
+				float x = (box[0] + box[2]) * 0.5f;
+				float y = (box[1] + box[3]) * 0.5f;
+				forEachInCells(x - radius, y - radius, x + radius, y + radius, [&](uint32_t j) {
+					if (j <= i) return; // each pair once
+					const float *other = &m_boxes[j * 4];
+					float dx = (other[0] + other[2]) * 0.5f - x;
+					float dy = (other[1] + other[3]) * 0.5f - y;
+					if (dx * dx + dy * dy > radiusSq) return;
+					uint32_t a = m_indices[i], b = m_indices[j];
+					out.emplace_back(m::min(a, b), m::max(a, b));
+				});
+			}
+		}
+	});
+
+	size_t count = 0;
+	for (const auto &out : blockPairs) count += out.size();
+	pairs.reserve(count);
+	for (const auto &out : blockPairs) pairs.insert(pairs.end(), out.begin(), out.end());
+	return count;
+}
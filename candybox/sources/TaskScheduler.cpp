@@ -20,6 +20,22 @@
 #include "candybox/LockLessMultiReadPipe.hpp"
 
 #include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <typeinfo>
+
+#if IE_TS_FIBERS_SUPPORTED
+#	include <ucontext.h>
+#	include <sys/mman.h>
+#	include <unistd.h>
+#endif
+
+#if IE_TS_AFFINITY_SUPPORTED
+#	include <sched.h>
+#	include <pthread.h>
+#	include <cstdio>
+#	include <cstdlib>
+#endif
 
 #if defined __i386__ || defined __x86_64__
 #	include "x86intrin.h"
@@ -67,6 +83,109 @@ candybox::GetNumHardwareThreads()
 #endif
 }
 
+#if IE_TS_AFFINITY_SUPPORTED
+namespace {
+bool
+ReadSysUInt(const char* path_, uint32_t* pValue_)
+{
+	FILE* pFile = fopen(path_, "r");
+	if (!pFile) { return false; }
+	bool bRead = 1 == fscanf(pFile, "%u", pValue_);
+	fclose(pFile);
+	return bRead;
+}
+
+// Calls func_(cpu) for every cpu of a /sys cpu list such as "0-3,8-11".
+template <typename Func>
+bool
+ReadSysCpuList(const char* path_, Func func_)
+{
+	FILE* pFile = fopen(path_, "r");
+	if (!pFile) { return false; }
+	char buffer[4096];
+	bool bRead = nullptr != fgets(buffer, sizeof(buffer), pFile);
+	fclose(pFile);
+	if (!bRead) { return false; }
+
+	char* pCurr = buffer;
+	while (*pCurr >= '0' && *pCurr <= '9')
+	{
+		uint32_t first = (uint32_t)strtoul(pCurr, &pCurr, 10);
+		uint32_t last = first;
+		if ('-' == *pCurr) { last = (uint32_t)strtoul(pCurr + 1, &pCurr, 10); }
+		for (uint32_t cpu = first; cpu <= last; ++cpu) { func_(cpu); }
+		if (',' == *pCurr) { ++pCurr; }
+	}
+	return true;
+}
+
+void
+ReadCpuInfo(uint32_t cpu_, CpuInfo& info_)
+{
+	char path[256];
+	info_.cpu = cpu_;
+	info_.core = cpu_;
+	info_.cacheGroup = 0;
+	info_.smtIndex = 0;
+
+	// siblings are listed in order, so the first one identifies the core
+	uint32_t numSiblings = 0;
+	snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%u/topology/thread_siblings_list", cpu_);
+	ReadSysCpuList(path, [&](uint32_t sibling_) {
+		if (0 == numSiblings) { info_.core = sibling_; }
+		if (sibling_ < cpu_) { ++info_.smtIndex; }
+		++numSiblings;
+	});
+
+	// the last level cache is the cache with the highest level, fall back to the package
+	uint32_t package = 0;
+	snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%u/topology/physical_package_id", cpu_);
+	if (ReadSysUInt(path, &package)) { info_.cacheGroup = package; }
+	uint32_t maxLevel = 0;
+	for (uint32_t index = 0;; ++index)
+	{
+		uint32_t level = 0;
+		snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%u/cache/index%u/level", cpu_, index);
+		if (!ReadSysUInt(path, &level)) { break; }
+		if (level < maxLevel) { continue; }
+		snprintf(
+		    path, sizeof(path), "/sys/devices/system/cpu/cpu%u/cache/index%u/shared_cpu_list",
+		    cpu_, index);
+		uint32_t first = NO_CPU;
+		ReadSysCpuList(path, [&](uint32_t sharing_) { first = std::min(first, sharing_); });
+		if (NO_CPU != first)
+		{
+			maxLevel = level;
+			info_.cacheGroup = first;
+		}
+	}
+}
+} // namespace
+#endif
+
+uint32_t
+candybox::GetCpuTopology(CpuInfo* pCpus_, uint32_t maxCpus_)
+{
+#if IE_TS_AFFINITY_SUPPORTED
+	cpu_set_t cpuSet;
+	CPU_ZERO(&cpuSet);
+	if (0 != sched_getaffinity(0, sizeof(cpuSet), &cpuSet)) { return 0; }
+
+	uint32_t numCpus = 0;
+	for (uint32_t cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+	{
+		if (!CPU_ISSET(cpu, &cpuSet)) { continue; }
+		if (pCpus_ && numCpus < maxCpus_) { ReadCpuInfo(cpu, pCpus_[numCpus]); }
+		++numCpus;
+	}
+	return numCpus;
+#else
+	(void)pCpus_;
+	(void)maxCpus_;
+	return 0;
+#endif
+}
+
 namespace candybox {
 static constexpr int32_t gc_TaskStartCount = 2;
 static constexpr int32_t gc_TaskAlmostCompleteCount =
@@ -77,6 +196,9 @@ static constexpr uint32_t gc_SpinBackOffMultiplier = 100;
 static constexpr uint32_t gc_MaxNumInitialPartitions = 8;
 static constexpr uint32_t gc_MaxStolenPartitions = 1 << gc_PipeSizeLog2;
 static constexpr uint32_t gc_CacheLineSize = 64;
+static constexpr uint32_t gc_PartitionCostTableSizeLog2 = 8;
+static constexpr uint32_t gc_PartitionCostMaxProbes = 16;
+static constexpr float gc_PartitionCostSmoothing = 0.125f; // weight of a new measurement
 // awaiting std::hardware_constructive_interference_size
 } // namespace candybox
 
@@ -98,6 +220,9 @@ static constexpr uint32_t gc_CacheLineSize = 64;
 // each software thread gets its own copy of gtl_threadNum, so this is safe to use as a static variable
 static IE_THREAD_LOCAL uint32_t gtl_threadNum = candybox::NO_THREAD_NUM;
 
+// non null when the current thread is a task thread running on fibers
+static IE_THREAD_LOCAL candybox::FiberThreadData* gtl_pFiberThreadData = nullptr;
+
 namespace candybox {
 struct SubTaskSet
 {
@@ -135,9 +260,11 @@ struct alignas(candybox::gc_CacheLineSize) ThreadDataStore
 	semaphoreid_t* pWaitNewPinnedTaskSemaphore = nullptr;
 	std::atomic<ThreadState> threadState = {IE_THREAD_STATE_NONE};
 	uint32_t rndSeed = 0;
+	uint32_t cpu = NO_CPU; // set if the thread is pinned, see TaskSchedulerConfig::threadAffinity
+	uint32_t numSameCacheThreads = 0; // pinned threads sharing a last level cache with this one
 	char prevent_false_Share
 	    [candybox::gc_CacheLineSize - sizeof(std::atomic<ThreadState>) - sizeof(semaphoreid_t*) -
-	     sizeof(uint32_t)]; // required to prevent alignment padding warning
+	     3 * sizeof(uint32_t)]; // required to prevent alignment padding warning
 };
 constexpr size_t SIZEOFTHREADDATASTORE = sizeof(ThreadDataStore); // for easier inspection
 static_assert(
@@ -148,6 +275,103 @@ class PinnedTaskList : public LocklessMultiWriteIntrusiveList<IPinnedTask>
 {
 };
 
+struct DeadlineSubTaskSet
+{
+	uint64_t deadlineNs;
+	uint64_t order; // keeps partitions of the same deadline in the order they were added
+	SubTaskSet subTask;
+};
+
+// Min-heap of the partitions of task sets with a deadline, earliest deadline first.
+// Partitions are queued at their final size so they never need to be split again.
+struct alignas(candybox::gc_CacheLineSize) DeadlineQueue
+{
+	std::mutex mutex;
+	std::atomic<uint32_t> size = {0}; // can be read without the lock to skip empty queues
+	uint32_t capacity = 0;
+	uint64_t nextOrder = 0;
+	DeadlineSubTaskSet* pHeap = nullptr;
+};
+
+// Measured cost of the task sets with a given ITaskSet::m_PartitionTag. Updates are plain
+// stores so concurrent measurements may be lost, which is fine for a running average.
+struct PartitionCost
+{
+	std::atomic<uintptr_t> tag = {0}; // 0 for an empty slot
+	std::atomic<float> nsPerItem = {0.0f};
+};
+
+// Written by its own thread only, so counters are updated with a load and a store.
+struct alignas(candybox::gc_CacheLineSize) ThreadTelemetryStore
+{
+	std::atomic<uint64_t> numRangesRun = {0};
+	std::atomic<uint64_t> numRangesStolen = {0};
+	std::atomic<uint64_t> numSubTasksSplit = {0};
+	std::atomic<uint64_t> numPipeFullRunInline = {0};
+	std::atomic<uint64_t> busyNs = {0};
+	std::atomic<uint64_t> suspendedNs = {0};
+	std::atomic<uint64_t> waitForTaskNs = {0};
+	std::atomic<uint64_t> rangeDurationHistogram[TELEMETRY_HISTOGRAM_BUCKETS];
+
+	ThreadTelemetryStore()
+	{
+		for (std::atomic<uint64_t>& count : rangeDurationHistogram) { count = 0; }
+	}
+};
+
+static inline void
+TelemetryAdd(std::atomic<uint64_t>& counter_, uint64_t value_)
+{
+	counter_.store(counter_.load(std::memory_order_relaxed) + value_, std::memory_order_relaxed);
+}
+
+static inline uint32_t
+TelemetryHistogramBucket(uint64_t durationNs_)
+{
+	uint32_t bucket = 0;
+	while (durationNs_ > 1 && bucket < TELEMETRY_HISTOGRAM_BUCKETS - 1)
+	{
+		durationNs_ >>= 1;
+		++bucket;
+	}
+	return bucket;
+}
+
+static inline bool
+IsLaterDeadline(const DeadlineSubTaskSet& lhs_, const DeadlineSubTaskSet& rhs_)
+{
+	return lhs_.deadlineNs != rhs_.deadlineNs ? lhs_.deadlineNs > rhs_.deadlineNs
+	                                          : lhs_.order > rhs_.order;
+}
+
+#if IE_TS_FIBERS_SUPPORTED
+struct Fiber
+{
+	ucontext_t context;
+	char* pMapping = nullptr; // guard page followed by the stack
+	size_t mappingSize = 0;
+	const ICompletable* pWaitingFor = nullptr;
+	Fiber* pNext = nullptr;
+};
+
+// Fibers only ever run on the task thread owning them, so none of this needs to be atomic.
+struct alignas(candybox::gc_CacheLineSize) FiberThreadData
+{
+	ucontext_t threadContext; // the task thread's own stack, returned to on exit
+	TaskScheduler* pTaskScheduler = nullptr;
+	uint32_t threadNum = 0;
+	Fiber* pFibers = nullptr;
+	Fiber* pFree = nullptr; // pool
+	Fiber* pParked = nullptr; // fibers waiting for a task to complete
+	Fiber* pCurrent = nullptr;
+	Fiber* pToRelease = nullptr; // fiber switched away from, released once off its stack
+};
+#else
+struct FiberThreadData
+{
+};
+#endif
+
 semaphoreid_t* SemaphoreCreate();
 void SemaphoreDelete(semaphoreid_t* pSemaphore_);
 void SemaphoreWait(semaphoreid_t& semaphoreid);
@@ -316,15 +540,66 @@ TaskScheduler::TaskingThreadFunction(const ThreadArgs& args_)
 	    .threadState.store(IE_THREAD_STATE_RUNNING, std::memory_order_release);
 	SafeCallback(pTS->m_Config.profilerCallbacks.threadStart, threadNum);
 
+#if IE_TS_FIBERS_SUPPORTED
+	if (pTS->m_pFiberThreadData) { pTS->FiberThreadMain(threadNum); }
+	else
+#endif
+	{
+		pTS->TaskingThreadLoop(threadNum);
+	}
+
+	pTS->m_NumInternalTaskThreadsRunning.fetch_sub(1, std::memory_order_release);
+	pTS->m_pThreadDataStore[threadNum]
+	    .threadState.store(IE_THREAD_STATE_STOPPED, std::memory_order_release);
+	SafeCallback(pTS->m_Config.profilerCallbacks.threadStop, threadNum);
+}
+
+
+void
+TaskScheduler::TaskingThreadLoop(uint32_t threadNum_)
+{
 	uint32_t spinCount = 0;
-	uint32_t hintPipeToCheck_io = threadNum + 1; // does not need to be clamped.
-	while (pTS->GetIsRunning())
+	uint32_t hintPipeToCheck_io = threadNum_ + 1; // does not need to be clamped.
+	while (GetIsRunning())
 	{
-		if (!pTS->TryRunTask(threadNum, hintPipeToCheck_io))
+#if IE_TS_FIBERS_SUPPORTED
+		FiberThreadData* pFiberData = gtl_pFiberThreadData;
+		if (pFiberData && pFiberData->pParked)
+		{
+			// resume a parked fiber whose task has completed, the current fiber is released
+			// to the pool so this does not return.
+			Fiber** ppFiber = &pFiberData->pParked;
+			while (*ppFiber && !(*ppFiber)->pWaitingFor->GetIsComplete())
+			{
+				ppFiber = &(*ppFiber)->pNext;
+			}
+			if (Fiber* pResume = *ppFiber)
+			{
+				*ppFiber = pResume->pNext;
+				pResume->pNext = nullptr;
+				pFiberData->pToRelease = pFiberData->pCurrent;
+				pFiberData->pCurrent = pResume;
+				swapcontext(&pFiberData->pToRelease->context, &pResume->context);
+				assert(false); // released fibers are restarted from FiberEntry
+			}
+		}
+#endif
+
+		if (!TryRunTask(threadNum_, hintPipeToCheck_io))
 		{
 			// no tasks, will spin then wait
 			++spinCount;
-			if (spinCount > gc_SpinCount) { pTS->WaitForNewTasks(threadNum); }
+			if (spinCount > gc_SpinCount)
+			{
+#if IE_TS_FIBERS_SUPPORTED
+				// parked fibers need to be woken on completion of their tasks
+				if (pFiberData && pFiberData->pParked) { WaitForParkedFibers(threadNum_); }
+				else
+#endif
+				{
+					WaitForNewTasks(threadNum_);
+				}
+			}
 			else
 			{
 				uint32_t spinBackoffCount = spinCount * gc_SpinBackOffMultiplier;
@@ -336,14 +611,8 @@ TaskScheduler::TaskingThreadFunction(const ThreadArgs& args_)
 			spinCount = 0; // have run a task so reset spin count.
 		}
 	}
-
-	pTS->m_NumInternalTaskThreadsRunning.fetch_sub(1, std::memory_order_release);
-	pTS->m_pThreadDataStore[threadNum]
-	    .threadState.store(IE_THREAD_STATE_STOPPED, std::memory_order_release);
-	SafeCallback(pTS->m_Config.profilerCallbacks.threadStop, threadNum);
 }
 
-
 void
 TaskScheduler::StartThreads()
 {
@@ -357,6 +626,11 @@ TaskScheduler::StartThreads()
 		m_pPinnedTaskListPerThread[priority] =
 		    NewArray<PinnedTaskList>(m_NumThreads, IE_FILE_AND_LINE);
 	}
+	m_pDeadlineQueues = NewArray<DeadlineQueue>(TASK_PRIORITY_NUM, IE_FILE_AND_LINE);
+	m_pPartitionCosts =
+	    NewArray<PartitionCost>(1 << gc_PartitionCostTableSizeLog2, IE_FILE_AND_LINE);
+	m_pTelemetry = NewArray<ThreadTelemetryStore>(m_NumThreads, IE_FILE_AND_LINE);
+	ResetDeadlineStats();
 
 	m_pNewTaskSemaphore = SemaphoreNew();
 	m_pTaskCompleteSemaphore = SemaphoreNew();
@@ -382,11 +656,17 @@ TaskScheduler::StartThreads()
 	{
 		m_pThreadDataStore[thread].threadState = IE_THREAD_STATE_NOT_LAUNCHED;
 	}
+#if IE_TS_FIBERS_SUPPORTED
+	if (m_Config.useFibers) { StartFibers(); }
+#endif
+	InitThreadAffinity();
+
 	// only launch threads once all thread states are set
 	for (uint32_t thread = m_Config.numExternalTaskThreads + GetNumFirstExternalTaskThread();
 	     thread < m_NumThreads; ++thread)
 	{
 		m_pThreads[thread] = std::thread(TaskingThreadFunction, ThreadArgs{thread, this});
+		ApplyThreadAffinity(thread);
 		++m_NumInternalTaskThreadsRunning;
 	}
 
@@ -523,6 +803,10 @@ TaskScheduler::StopThreads(bool bWait_)
 			m_pThreads[thread].join();
 		}
 
+#if IE_TS_FIBERS_SUPPORTED
+		StopFibers();
+#endif
+
 		// delete any Wait New Pinned Task Semaphores
 		for (uint32_t threadNum = 0; threadNum < m_NumThreads; ++threadNum)
 		{
@@ -551,11 +835,109 @@ TaskScheduler::StopThreads(bool bWait_)
 			m_pPipesPerThread[priority] = NULL;
 			DeleteArray(m_pPinnedTaskListPerThread[priority], m_NumThreads, IE_FILE_AND_LINE);
 			m_pPinnedTaskListPerThread[priority] = NULL;
+
+			DeadlineQueue& queue = m_pDeadlineQueues[priority];
+			if (queue.pHeap) { DeleteArray(queue.pHeap, queue.capacity, IE_FILE_AND_LINE); }
+		}
+		DeleteArray(m_pDeadlineQueues, TASK_PRIORITY_NUM, IE_FILE_AND_LINE);
+		m_pDeadlineQueues = NULL;
+		DeleteArray(m_pPartitionCosts, 1 << gc_PartitionCostTableSizeLog2, IE_FILE_AND_LINE);
+		m_pPartitionCosts = NULL;
+		DeleteArray(m_pTelemetry, m_NumThreads, IE_FILE_AND_LINE);
+		m_pTelemetry = NULL;
+		if (m_pSameCacheThreads)
+		{
+			DeleteArray(m_pSameCacheThreads, m_NumThreads * m_NumThreads, IE_FILE_AND_LINE);
+			m_pSameCacheThreads = NULL;
 		}
 		m_NumThreads = 0;
 	}
 }
 
+void
+TaskScheduler::InitThreadAffinity()
+{
+#if IE_TS_AFFINITY_SUPPORTED
+	if (THREAD_AFFINITY_NONE == m_Config.threadAffinity) { return; }
+
+	uint32_t numCpusAllocated = GetCpuTopology(nullptr, 0);
+	if (0 == numCpusAllocated) { return; }
+	CpuInfo* pCpus = NewArray<CpuInfo>(numCpusAllocated, IE_FILE_AND_LINE);
+	uint32_t numCpus = std::min(numCpusAllocated, GetCpuTopology(pCpus, numCpusAllocated));
+	if (0 == numCpus)
+	{
+		DeleteArray(pCpus, numCpusAllocated, IE_FILE_AND_LINE);
+		return;
+	}
+
+	// threads sharing a last level cache get neighbouring cores, and SMT siblings are
+	// only used once every core has a thread.
+	std::sort(pCpus, pCpus + numCpus, [](const CpuInfo& lhs_, const CpuInfo& rhs_) {
+		if (lhs_.smtIndex != rhs_.smtIndex) { return lhs_.smtIndex < rhs_.smtIndex; }
+		if (lhs_.cacheGroup != rhs_.cacheGroup) { return lhs_.cacheGroup < rhs_.cacheGroup; }
+		return lhs_.cpu < rhs_.cpu;
+	});
+
+	uint32_t* pCacheGroups = NewArray<uint32_t>(m_NumThreads, IE_FILE_AND_LINE);
+	for (uint32_t thread = m_Config.numExternalTaskThreads + GetNumFirstExternalTaskThread();
+	     thread < m_NumThreads; ++thread)
+	{
+		uint32_t cpu = NO_CPU;
+		if (THREAD_AFFINITY_CORES == m_Config.threadAffinity) { cpu = pCpus[thread % numCpus].cpu; }
+		else if (m_Config.pThreadCpus && m_Config.numThreadCpus)
+		{
+			cpu = m_Config.pThreadCpus[thread % m_Config.numThreadCpus];
+		}
+		m_pThreadDataStore[thread].cpu = cpu;
+		pCacheGroups[thread] = NO_CPU;
+		for (uint32_t index = 0; index < numCpus; ++index)
+		{
+			if (pCpus[index].cpu == cpu) { pCacheGroups[thread] = pCpus[index].cacheGroup; }
+		}
+	}
+
+	if (m_Config.stealFromSameCacheFirst)
+	{
+		m_pSameCacheThreads = NewArray<uint32_t>(m_NumThreads * m_NumThreads, IE_FILE_AND_LINE);
+		for (uint32_t thread = m_Config.numExternalTaskThreads + GetNumFirstExternalTaskThread();
+		     thread < m_NumThreads; ++thread)
+		{
+			if (NO_CPU == pCacheGroups[thread]) { continue; }
+			uint32_t& numSameCacheThreads = m_pThreadDataStore[thread].numSameCacheThreads;
+			for (uint32_t other = m_Config.numExternalTaskThreads + GetNumFirstExternalTaskThread();
+			     other < m_NumThreads; ++other)
+			{
+				if (other != thread && pCacheGroups[other] == pCacheGroups[thread])
+				{
+					m_pSameCacheThreads[thread * m_NumThreads + numSameCacheThreads++] = other;
+				}
+			}
+		}
+	}
+
+	DeleteArray(pCacheGroups, m_NumThreads, IE_FILE_AND_LINE);
+	DeleteArray(pCpus, numCpusAllocated, IE_FILE_AND_LINE);
+#endif
+}
+
+void
+TaskScheduler::ApplyThreadAffinity(uint32_t threadNum_)
+{
+#if IE_TS_AFFINITY_SUPPORTED
+	uint32_t cpu = m_pThreadDataStore[threadNum_].cpu;
+	if (NO_CPU == cpu || cpu >= CPU_SETSIZE) { return; }
+	cpu_set_t cpuSet;
+	CPU_ZERO(&cpuSet);
+	CPU_SET(cpu, &cpuSet);
+	int result = pthread_setaffinity_np(
+	    m_pThreads[threadNum_].native_handle(), sizeof(cpuSet), &cpuSet);
+	assert(0 == result); // cpu is not in the process affinity mask
+	(void)result;
+#else
+	(void)threadNum_;
+#endif
+}
+
 bool
 TaskScheduler::TryRunTask(uint32_t threadNum_, uint32_t& hintPipeToCheck_io_)
 {
@@ -608,9 +990,13 @@ TaskScheduler::
 	// Run any tasks for this thread
 	RunPinnedTasks(threadNum_, priority_);
 
+	// task sets with a deadline are run before those without one
+	if (TryRunDeadlineTask(threadNum_, priority_)) { return true; }
+
 	// check for tasks
 	SubTaskSet subTask;
 	bool bHaveTask = m_pPipesPerThread[priority_][threadNum_].WriterTryReadFront(&subTask);
+	bool bStolen = !bHaveTask;
 
 	uint32_t threadToCheckStart = hintPipeToCheck_io_ % m_NumThreads;
 	uint32_t threadToCheck = threadToCheckStart;
@@ -625,6 +1011,16 @@ TaskScheduler::
 			uint32_t& rndSeed = m_pThreadDataStore[threadNum_].rndSeed;
 			++rndSeed;
 			uint32_t threadToCheckOffset = Hash32(rndSeed * threadNum_);
+
+			// threads sharing a last level cache are checked first, as the data of their
+			// tasks is more likely to be in our caches
+			uint32_t numSameCacheThreads = m_pThreadDataStore[threadNum_].numSameCacheThreads;
+			for (uint32_t index = 0; !bHaveTask && index < numSameCacheThreads; ++index)
+			{
+				threadToCheck = m_pSameCacheThreads
+				    [threadNum_ * m_NumThreads + (threadToCheckOffset + index) % numSameCacheThreads];
+				bHaveTask = m_pPipesPerThread[priority_][threadToCheck].ReaderTryReadBack(&subTask);
+			}
 			while (!bHaveTask && checkCount < m_NumThreads)
 			{
 				threadToCheck = (threadToCheckOffset + checkCount) % m_NumThreads;
@@ -642,6 +1038,10 @@ TaskScheduler::
 	{
 		// update hint, will preserve value unless actually got task from another thread.
 		hintPipeToCheck_io_ = threadToCheck;
+		if (bStolen && m_Config.enableTelemetry)
+		{
+			TelemetryAdd(m_pTelemetry[threadNum_].numRangesStolen, 1);
+		}
 
 		uint32_t partitionSize = subTask.partition.end - subTask.partition.start;
 		if (subTask.pTask->m_RangeToRun < partitionSize)
@@ -660,7 +1060,7 @@ TaskScheduler::
 				        gc_MaxStolenPartitions);
 			}
 			SplitAndAddTask(threadNum_, subTask, rangeToSplit);
-			taskToRun.pTask->ExecuteRange(taskToRun.partition, threadNum_);
+			ExecuteRangeInt(taskToRun.pTask, taskToRun.partition, threadNum_);
 			int prevCount =
 			    taskToRun.pTask->m_RunningCount.fetch_sub(1, std::memory_order_acq_rel);
 			if (gc_TaskStartCount == prevCount)
@@ -671,7 +1071,7 @@ TaskScheduler::
 		else
 		{
 			// the task has already been divided up by AddTaskSetToPipe, so just run it
-			subTask.pTask->ExecuteRange(subTask.partition, threadNum_);
+			ExecuteRangeInt(subTask.pTask, subTask.partition, threadNum_);
 			int prevCount =
 			    subTask.pTask->m_RunningCount.fetch_sub(1, std::memory_order_acq_rel);
 			if (gc_TaskStartCount == prevCount)
@@ -695,6 +1095,8 @@ TaskScheduler::TaskComplete(ICompletable* pTask_, bool bWakeThreads_, uint32_t t
 	    bWakeThreads_ && pTask_->m_WaitingForTaskCount.load(std::memory_order_acquire);
 
 	Dependency* pDependent = pTask_->m_pDependents;
+	TaskGraph* pGraph = pTask_->m_pGraph;
+	uint32_t graphNode = pTask_->m_GraphNode;
 
 	// Do not access pTask_ below this line unless we have dependencies.
 	pTask_->m_RunningCount.store(0, std::memory_order_release);
@@ -723,6 +1125,31 @@ TaskScheduler::TaskComplete(ICompletable* pTask_, bool bWakeThreads_, uint32_t t
 			pDependentCurr->pTaskToRunOnCompletion->OnDependenciesComplete(this, threadNum_);
 		}
 	}
+
+	if (pGraph) { TaskGraphNodeComplete(pGraph, graphNode, threadNum_); }
+}
+
+void
+TaskScheduler::TaskGraphNodeComplete(TaskGraph* pGraph_, uint32_t node_, uint32_t threadNum_)
+{
+	// launch the successors which have had all their predecessors completed
+	uint32_t successorsEnd = pGraph_->m_SuccessorOffsets[node_ + 1];
+	for (uint32_t i = pGraph_->m_SuccessorOffsets[node_]; i < successorsEnd; ++i)
+	{
+		uint32_t successor = pGraph_->m_Successors[i];
+		int32_t prevCount = pGraph_->m_pJoinCountsRemaining[successor].fetch_sub(
+		    1, std::memory_order_acq_rel);
+		assert(prevCount > 0);
+		if (1 == prevCount) { AddTaskSetToPipeInt(pGraph_->m_Nodes[successor], threadNum_); }
+	}
+
+	// the graph can not complete before this point as this node has not been counted yet,
+	// do not access pGraph_ after the last node has been counted unless we complete it.
+	if (1 == pGraph_->m_NodesRemaining.fetch_sub(1, std::memory_order_acq_rel))
+	{
+		pGraph_->m_RunningCount.fetch_sub(1, std::memory_order_acq_rel);
+		TaskComplete(pGraph_, true, threadNum_);
+	}
 }
 
 bool
@@ -735,6 +1162,7 @@ TaskScheduler::HaveTasks(uint32_t threadNum_)
 			if (!m_pPipesPerThread[priority][thread].IsPipeEmpty()) { return true; }
 		}
 		if (!m_pPinnedTaskListPerThread[priority][threadNum_].IsListEmpty()) { return true; }
+		if (m_pDeadlineQueues[priority].size.load(std::memory_order_relaxed)) { return true; }
 	}
 	return false;
 }
@@ -765,7 +1193,12 @@ TaskScheduler::WaitForNewTasks(uint32_t threadNum_)
 	else
 	{
 		SafeCallback(m_Config.profilerCallbacks.waitForNewTaskSuspendStart, threadNum_);
+		uint64_t startNs = m_Config.enableTelemetry ? GetTimeNs() : 0;
 		SemaphoreWait(*m_pNewTaskSemaphore);
+		if (m_Config.enableTelemetry)
+		{
+			TelemetryAdd(m_pTelemetry[threadNum_].suspendedNs, GetTimeNs() - startNs);
+		}
 		SafeCallback(m_Config.profilerCallbacks.waitForNewTaskSuspendStop, threadNum_);
 	}
 
@@ -800,7 +1233,12 @@ TaskScheduler::WaitForTaskCompletion(const ICompletable* pCompletable_, uint32_t
 		SafeCallback(m_Config.profilerCallbacks.waitForTaskCompleteSuspendStart, threadNum_);
 		std::atomic_thread_fence(std::memory_order_acquire);
 
+		uint64_t startNs = m_Config.enableTelemetry ? GetTimeNs() : 0;
 		SemaphoreWait(*m_pTaskCompleteSemaphore);
+		if (m_Config.enableTelemetry)
+		{
+			TelemetryAdd(m_pTelemetry[threadNum_].suspendedNs, GetTimeNs() - startNs);
+		}
 		if (!pCompletable_->GetIsComplete())
 		{
 			// This thread which may not the one which was supposed to be awoken
@@ -814,6 +1252,206 @@ TaskScheduler::WaitForTaskCompletion(const ICompletable* pCompletable_, uint32_t
 	pCompletable_->m_WaitingForTaskCount.fetch_sub(1, std::memory_order_acq_rel);
 }
 
+#if IE_TS_FIBERS_SUPPORTED
+void
+TaskScheduler::StartFibers()
+{
+	size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+	size_t stackSize = (m_Config.fiberStackSize + pageSize - 1) / pageSize * pageSize;
+	m_pFiberThreadData = NewArray<FiberThreadData>(m_NumThreads, IE_FILE_AND_LINE);
+	for (uint32_t thread = m_Config.numExternalTaskThreads + GetNumFirstExternalTaskThread();
+	     thread < m_NumThreads; ++thread)
+	{
+		FiberThreadData& data = m_pFiberThreadData[thread];
+		data.pTaskScheduler = this;
+		data.threadNum = thread;
+		data.pFibers = NewArray<Fiber>(m_Config.numFibersPerThread, IE_FILE_AND_LINE);
+		for (uint32_t i = 0; i < m_Config.numFibersPerThread; ++i)
+		{
+			Fiber& fiber = data.pFibers[i];
+			fiber.mappingSize = pageSize + stackSize;
+			void* pMapping = mmap(
+			    nullptr, fiber.mappingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+			    -1, 0);
+			assert(pMapping != MAP_FAILED);
+			if (pMapping == MAP_FAILED) { break; } // thread will have a smaller pool
+			// stacks grow down so the guard page is at the start of the mapping
+			int err = mprotect(pMapping, pageSize, PROT_NONE);
+			assert(err == 0);
+			(void)err;
+			fiber.pMapping = (char*)pMapping;
+			fiber.pNext = data.pFree;
+			data.pFree = &fiber;
+		}
+	}
+}
+
+void
+TaskScheduler::StopFibers()
+{
+	if (!m_pFiberThreadData) { return; }
+	for (uint32_t thread = m_Config.numExternalTaskThreads + GetNumFirstExternalTaskThread();
+	     thread < m_NumThreads; ++thread)
+	{
+		// fibers still parked at this point belong to tasks abandoned by ShutdownNow()
+		FiberThreadData& data = m_pFiberThreadData[thread];
+		for (uint32_t i = 0; i < m_Config.numFibersPerThread; ++i)
+		{
+			Fiber& fiber = data.pFibers[i];
+			if (fiber.pMapping) { munmap(fiber.pMapping, fiber.mappingSize); }
+		}
+		DeleteArray(data.pFibers, m_Config.numFibersPerThread, IE_FILE_AND_LINE);
+	}
+	DeleteArray(m_pFiberThreadData, m_NumThreads, IE_FILE_AND_LINE);
+	m_pFiberThreadData = nullptr;
+}
+
+namespace {
+Fiber*
+AcquireFiber(FiberThreadData* pData_, void (*pEntry_)())
+{
+	Fiber* pFiber = pData_->pFree;
+	if (!pFiber) { return nullptr; }
+	pData_->pFree = pFiber->pNext;
+	pFiber->pNext = nullptr;
+	pFiber->pWaitingFor = nullptr;
+
+	size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+	getcontext(&pFiber->context);
+	pFiber->context.uc_stack.ss_sp = pFiber->pMapping + pageSize;
+	pFiber->context.uc_stack.ss_size = pFiber->mappingSize - pageSize;
+	pFiber->context.uc_link = nullptr; // FiberEntry never returns
+	makecontext(&pFiber->context, pEntry_, 0);
+	return pFiber;
+}
+
+// Called after every switch, returns the fiber switched away from to the pool
+// if it will not be resumed.
+void
+ReleaseSwitchedFromFiber(FiberThreadData* pData_)
+{
+	Fiber* pFiber = pData_->pToRelease;
+	if (pFiber)
+	{
+		pData_->pToRelease = nullptr;
+		pFiber->pNext = pData_->pFree;
+		pData_->pFree = pFiber;
+	}
+}
+} // namespace
+
+void
+TaskScheduler::FiberThreadMain(uint32_t threadNum_)
+{
+	FiberThreadData* pData = &m_pFiberThreadData[threadNum_];
+	gtl_pFiberThreadData = pData;
+	Fiber* pFiber = AcquireFiber(pData, FiberEntry);
+	if (pFiber)
+	{
+		pData->pCurrent = pFiber;
+		swapcontext(&pData->threadContext, &pFiber->context);
+		ReleaseSwitchedFromFiber(pData);
+	}
+	else
+	{
+		TaskingThreadLoop(threadNum_); // no stacks could be allocated
+	}
+	gtl_pFiberThreadData = nullptr;
+}
+
+void
+TaskScheduler::FiberEntry()
+{
+	FiberThreadData* pData = gtl_pFiberThreadData;
+	ReleaseSwitchedFromFiber(pData);
+	pData->pTaskScheduler->TaskingThreadLoop(pData->threadNum);
+
+	// shutting down, return to the thread's own stack
+	pData->pToRelease = pData->pCurrent;
+	pData->pCurrent = nullptr;
+	swapcontext(&pData->pToRelease->context, &pData->threadContext);
+}
+
+void
+TaskScheduler::FiberParkUntilComplete(const ICompletable* pCompletable_)
+{
+	FiberThreadData* pData = gtl_pFiberThreadData;
+	if (!pData->pFree) { return; } // pool is empty, run tasks on this stack instead
+
+	// Incrementing m_WaitingForTaskCount before checking the running count ensures that
+	// TaskComplete() wakes this thread if it is suspended in WaitForParkedFibers().
+	pCompletable_->m_WaitingForTaskCount.fetch_add(1, std::memory_order_acq_rel);
+	if (gc_TaskAlmostCompleteCount < pCompletable_->m_RunningCount.load(std::memory_order_acquire))
+	{
+		Fiber* pParked = pData->pCurrent;
+		pParked->pWaitingFor = pCompletable_;
+		pParked->pNext = pData->pParked;
+		pData->pParked = pParked;
+
+		Fiber* pFiber = AcquireFiber(pData, FiberEntry);
+		pData->pCurrent = pFiber;
+		swapcontext(&pParked->context, &pFiber->context);
+
+		// resumed by TaskingThreadLoop() on this thread once pCompletable_ is complete
+		ReleaseSwitchedFromFiber(pData);
+		assert(pData->pCurrent == pParked);
+	}
+	pCompletable_->m_WaitingForTaskCount.fetch_sub(1, std::memory_order_acq_rel);
+}
+
+void
+TaskScheduler::WaitForParkedFibers(uint32_t threadNum_)
+{
+	// As WaitForTaskCompletion() but waits for any of the tasks the parked fibers wait for.
+	if (WakeSuspendedThreadsWithPinnedTasks(threadNum_)) { return; }
+
+	FiberThreadData* pData = gtl_pFiberThreadData;
+	m_NumThreadsWaitingForTaskCompletion.fetch_add(1, std::memory_order_acq_rel);
+	ThreadState prevThreadState =
+	    m_pThreadDataStore[threadNum_].threadState.load(std::memory_order_relaxed);
+	m_pThreadDataStore[threadNum_]
+	    .threadState.store(IE_THREAD_STATE_WAIT_TASK_COMPLETION, std::memory_order_seq_cst);
+
+	// do not wait on semaphore if any task is in gc_TaskAlmostCompleteCount state.
+	bool bCanResume = false;
+	for (Fiber* pFiber = pData->pParked; pFiber && !bCanResume; pFiber = pFiber->pNext)
+	{
+		bCanResume = gc_TaskAlmostCompleteCount >=
+		             pFiber->pWaitingFor->m_RunningCount.load(std::memory_order_acquire);
+	}
+
+	if (bCanResume || HaveTasks(threadNum_))
+	{
+		m_NumThreadsWaitingForTaskCompletion.fetch_sub(1, std::memory_order_acq_rel);
+	}
+	else
+	{
+		SafeCallback(m_Config.profilerCallbacks.waitForTaskCompleteSuspendStart, threadNum_);
+		std::atomic_thread_fence(std::memory_order_acquire);
+
+		uint64_t startNs = m_Config.enableTelemetry ? GetTimeNs() : 0;
+		SemaphoreWait(*m_pTaskCompleteSemaphore);
+		if (m_Config.enableTelemetry)
+		{
+			TelemetryAdd(m_pTelemetry[threadNum_].suspendedNs, GetTimeNs() - startNs);
+		}
+		for (Fiber* pFiber = pData->pParked; pFiber && !bCanResume; pFiber = pFiber->pNext)
+		{
+			bCanResume = pFiber->pWaitingFor->GetIsComplete();
+		}
+		if (!bCanResume)
+		{
+			// This thread which may not the one which was supposed to be awoken
+			WakeThreadsForTaskCompletion();
+		}
+		SafeCallback(m_Config.profilerCallbacks.waitForTaskCompleteSuspendStop, threadNum_);
+	}
+
+	m_pThreadDataStore[threadNum_]
+	    .threadState.store(prevThreadState, std::memory_order_release);
+}
+#endif
+
 void
 TaskScheduler::WakeThreadsForNewTasks()
 {
@@ -912,10 +1550,15 @@ TaskScheduler::
 				assert(taskToAdd.partition.end <= taskToAdd.pTask->m_SetSize);
 				subTask_.partition.start = taskToAdd.partition.end;
 			}
-			taskToAdd.pTask->ExecuteRange(taskToAdd.partition, threadNum_);
+			ExecuteRangeInt(taskToAdd.pTask, taskToAdd.partition, threadNum_);
 			++numRun;
 		}
 	}
+	if (m_Config.enableTelemetry)
+	{
+		TelemetryAdd(m_pTelemetry[threadNum_].numSubTasksSplit, (uint64_t)numAdded);
+		TelemetryAdd(m_pTelemetry[threadNum_].numPipeFullRunInline, (uint64_t)numRun);
+	}
 	int32_t countToRemove = upperBoundNumToAdd - numAdded;
 	assert(countToRemove > 0);
 	int prevCount =
@@ -946,30 +1589,320 @@ TaskScheduler::AddTaskSetToPipeInt(ITaskSet* pTaskSet_, uint32_t threadNum_)
 	std::atomic_thread_fence(std::memory_order_acquire);
 
 
+	uint32_t minRange = pTaskSet_->m_MinRange;
+	if (PARTITION_ADAPTIVE == pTaskSet_->m_PartitionPolicy)
+	{
+		// grain size which should take adaptivePartitionTargetNs to run
+		const PartitionCost* pCost = FindPartitionCost(pTaskSet_, false);
+		float nsPerItem = pCost ? pCost->nsPerItem.load(std::memory_order_relaxed) : 0.0f;
+		if (nsPerItem > 0.0f)
+		{
+			float range = (float)m_Config.adaptivePartitionTargetNs / nsPerItem;
+			minRange = range < (float)pTaskSet_->m_SetSize ? (uint32_t)range : pTaskSet_->m_SetSize;
+			minRange = std::max(minRange, 1u);
+		}
+	}
+
 	// divide task up and add to pipe
 	pTaskSet_->m_RangeToRun = pTaskSet_->m_SetSize / m_NumPartitions;
-	pTaskSet_->m_RangeToRun = std::max(pTaskSet_->m_RangeToRun, pTaskSet_->m_MinRange);
+	pTaskSet_->m_RangeToRun = std::max(pTaskSet_->m_RangeToRun, minRange);
 	// Note: if m_SetSize is < m_RangeToRun this will be handled by SplitTask and so does not need to be handled here
 
 	uint32_t rangeToSplit = pTaskSet_->m_SetSize / m_NumInitialPartitions;
-	rangeToSplit = std::max(rangeToSplit, pTaskSet_->m_MinRange);
+	rangeToSplit = std::max(rangeToSplit, minRange);
 
-	SubTaskSet subTask;
-	subTask.pTask = pTaskSet_;
-	subTask.partition.start = 0;
-	subTask.partition.end = pTaskSet_->m_SetSize;
-	SplitAndAddTask(threadNum_, subTask, rangeToSplit);
+	if (NO_DEADLINE != pTaskSet_->m_DeadlineNs) { AddDeadlineTaskSetInt(pTaskSet_); }
+	else
+	{
+		SubTaskSet subTask;
+		subTask.pTask = pTaskSet_;
+		subTask.partition.start = 0;
+		subTask.partition.end = pTaskSet_->m_SetSize;
+		SplitAndAddTask(threadNum_, subTask, rangeToSplit);
+	}
 	int prevCount = pTaskSet_->m_RunningCount.fetch_sub(1, std::memory_order_acq_rel);
-	if (gc_TaskStartCount == prevCount) { TaskComplete(pTaskSet_, true, threadNum_); }
+	if (gc_TaskStartCount == prevCount)
+	{
+		RecordDeadline(pTaskSet_);
+		TaskComplete(pTaskSet_, true, threadNum_);
+	}
 
 	m_pThreadDataStore[threadNum_]
 	    .threadState.store(prevThreadState, std::memory_order_release);
 }
 
+void
+TaskScheduler::AddDeadlineTaskSetInt(ITaskSet* pTaskSet_)
+{
+	uint32_t rangeToRun = std::max(pTaskSet_->m_RangeToRun, 1u);
+	uint32_t numPartitions = (pTaskSet_->m_SetSize + rangeToRun - 1) / rangeToRun;
+	if (0 == numPartitions) { return; }
+	pTaskSet_->m_RunningCount.fetch_add((int32_t)numPartitions, std::memory_order_acquire);
+
+	DeadlineQueue& queue = m_pDeadlineQueues[pTaskSet_->m_Priority];
+	{
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		uint32_t size = queue.size.load(std::memory_order_relaxed);
+		if (size + numPartitions > queue.capacity)
+		{
+			uint32_t capacity = std::max(std::max(2 * queue.capacity, size + numPartitions), 64u);
+			DeadlineSubTaskSet* pHeap =
+			    NewArray<DeadlineSubTaskSet>(capacity, IE_FILE_AND_LINE);
+			if (queue.pHeap)
+			{
+				std::copy(queue.pHeap, queue.pHeap + size, pHeap);
+				DeleteArray(queue.pHeap, queue.capacity, IE_FILE_AND_LINE);
+			}
+			queue.pHeap = pHeap;
+			queue.capacity = capacity;
+		}
+
+		DeadlineSubTaskSet entry;
+		entry.deadlineNs = pTaskSet_->m_DeadlineNs;
+		entry.subTask.pTask = pTaskSet_;
+		for (uint32_t start = 0; start < pTaskSet_->m_SetSize; start += rangeToRun)
+		{
+			entry.order = queue.nextOrder++;
+			entry.subTask.partition.start = start;
+			entry.subTask.partition.end = std::min(start + rangeToRun, pTaskSet_->m_SetSize);
+			queue.pHeap[size++] = entry;
+			std::push_heap(queue.pHeap, queue.pHeap + size, IsLaterDeadline);
+		}
+		queue.size.store(size, std::memory_order_release);
+	}
+	WakeThreadsForNewTasks();
+}
+
+bool
+TaskScheduler::TryRunDeadlineTask(uint32_t threadNum_, uint32_t priority_)
+{
+	DeadlineQueue& queue = m_pDeadlineQueues[priority_];
+	if (0 == queue.size.load(std::memory_order_acquire)) { return false; }
+
+	SubTaskSet subTask;
+	{
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		uint32_t size = queue.size.load(std::memory_order_relaxed);
+		if (0 == size) { return false; }
+		std::pop_heap(queue.pHeap, queue.pHeap + size, IsLaterDeadline);
+		subTask = queue.pHeap[--size].subTask;
+		queue.size.store(size, std::memory_order_release);
+	}
+
+	ExecuteRangeInt(subTask.pTask, subTask.partition, threadNum_);
+	int prevCount = subTask.pTask->m_RunningCount.fetch_sub(1, std::memory_order_acq_rel);
+	if (gc_TaskStartCount == prevCount)
+	{
+		RecordDeadline(subTask.pTask);
+		TaskComplete(subTask.pTask, true, threadNum_);
+	}
+	return true;
+}
+
+void
+TaskScheduler::RecordDeadline(const ITaskSet* pTaskSet_)
+{
+	if (NO_DEADLINE == pTaskSet_->m_DeadlineNs) { return; }
+
+	m_DeadlinesCompleted.fetch_add(1, std::memory_order_relaxed);
+	uint64_t timeNs = GetTimeNs();
+	if (timeNs <= pTaskSet_->m_DeadlineNs) { return; }
+
+	uint64_t latenessNs = timeNs - pTaskSet_->m_DeadlineNs;
+	m_DeadlinesMissed.fetch_add(1, std::memory_order_relaxed);
+	m_DeadlineTotalLatenessNs.fetch_add(latenessNs, std::memory_order_relaxed);
+	uint64_t maxLatenessNs = m_DeadlineMaxLatenessNs.load(std::memory_order_relaxed);
+	while (latenessNs > maxLatenessNs &&
+	       !m_DeadlineMaxLatenessNs.compare_exchange_weak(
+	           maxLatenessNs, latenessNs, std::memory_order_relaxed))
+	{
+	}
+}
+
+void
+TaskScheduler::ExecuteRangeInt(ITaskSet* pTaskSet_, TaskSetPartition range_, uint32_t threadNum_)
+{
+	bool bAdaptive = PARTITION_ADAPTIVE == pTaskSet_->m_PartitionPolicy;
+	if (!bAdaptive && !m_Config.enableTelemetry)
+	{
+		pTaskSet_->ExecuteRange(range_, threadNum_);
+		return;
+	}
+
+	PartitionCost* pCost = bAdaptive ? FindPartitionCost(pTaskSet_, true) : nullptr;
+	uint64_t startNs = GetTimeNs();
+	pTaskSet_->ExecuteRange(range_, threadNum_);
+	uint64_t durationNs = GetTimeNs() - startNs;
+
+	if (m_Config.enableTelemetry)
+	{
+		ThreadTelemetryStore& telemetry = m_pTelemetry[threadNum_];
+		TelemetryAdd(telemetry.numRangesRun, 1);
+		TelemetryAdd(telemetry.busyNs, durationNs);
+		TelemetryAdd(telemetry.rangeDurationHistogram[TelemetryHistogramBucket(durationNs)], 1);
+	}
+	if (!pCost) { return; } // not adaptive, or table full so the task set keeps using m_MinRange
+
+	float nsPerItem = (float)durationNs / (float)(range_.end - range_.start);
+	float prevNsPerItem = pCost->nsPerItem.load(std::memory_order_relaxed);
+	if (prevNsPerItem > 0.0f)
+	{
+		nsPerItem = prevNsPerItem + gc_PartitionCostSmoothing * (nsPerItem - prevNsPerItem);
+	}
+	pCost->nsPerItem.store(nsPerItem, std::memory_order_relaxed);
+}
+
+PartitionCost*
+TaskScheduler::FindPartitionCost(const ITaskSet* pTaskSet_, bool bInsert_) const
+{
+	if (!m_pPartitionCosts) { return nullptr; }
+	uintptr_t tag = pTaskSet_->m_PartitionTag;
+	if (0 == tag) { tag = (uintptr_t)typeid(*pTaskSet_).hash_code(); }
+	if (0 == tag) { tag = 1; } // 0 marks empty slots
+
+	// open addressing with linear probing, entries are never removed
+	const uint32_t mask = (1 << gc_PartitionCostTableSizeLog2) - 1;
+	uint32_t slot = Hash32((uint32_t)(tag ^ (tag >> 16 >> 16)));
+	for (uint32_t probe = 0; probe < gc_PartitionCostMaxProbes; ++probe, ++slot)
+	{
+		PartitionCost& cost = m_pPartitionCosts[slot & mask];
+		uintptr_t slotTag = cost.tag.load(std::memory_order_acquire);
+		if (slotTag == tag) { return &cost; }
+		if (0 == slotTag)
+		{
+			if (!bInsert_) { return nullptr; }
+			if (cost.tag.compare_exchange_strong(slotTag, tag, std::memory_order_acq_rel) ||
+			    slotTag == tag)
+			{
+				return &cost;
+			}
+		}
+	}
+	return nullptr;
+}
+
+float
+TaskScheduler::GetPartitionCostNsPerItem(const ITaskSet* pTaskSet_) const
+{
+	const PartitionCost* pCost = FindPartitionCost(pTaskSet_, false);
+	return pCost ? pCost->nsPerItem.load(std::memory_order_relaxed) : 0.0f;
+}
+
+static void
+LoadTelemetry(const ThreadTelemetryStore& store_, ThreadTelemetry& telemetry_)
+{
+	telemetry_.numRangesRun = store_.numRangesRun.load(std::memory_order_relaxed);
+	telemetry_.numRangesStolen = store_.numRangesStolen.load(std::memory_order_relaxed);
+	telemetry_.numSubTasksSplit = store_.numSubTasksSplit.load(std::memory_order_relaxed);
+	telemetry_.numPipeFullRunInline =
+	    store_.numPipeFullRunInline.load(std::memory_order_relaxed);
+	telemetry_.busyNs = store_.busyNs.load(std::memory_order_relaxed);
+	telemetry_.suspendedNs = store_.suspendedNs.load(std::memory_order_relaxed);
+	telemetry_.waitForTaskNs = store_.waitForTaskNs.load(std::memory_order_relaxed);
+	for (uint32_t bucket = 0; bucket < TELEMETRY_HISTOGRAM_BUCKETS; ++bucket)
+	{
+		telemetry_.rangeDurationHistogram[bucket] =
+		    store_.rangeDurationHistogram[bucket].load(std::memory_order_relaxed);
+	}
+}
+
+uint32_t
+TaskScheduler::GetTelemetry(ThreadTelemetry* pTelemetry_, uint32_t numThreads_) const
+{
+	for (uint32_t thread = 0; thread < numThreads_ && thread < m_NumThreads; ++thread)
+	{
+		LoadTelemetry(m_pTelemetry[thread], pTelemetry_[thread]);
+	}
+	return m_NumThreads;
+}
+
+ThreadTelemetry
+TaskScheduler::GetTelemetryTotal() const
+{
+	ThreadTelemetry total;
+	for (uint32_t thread = 0; thread < m_NumThreads; ++thread)
+	{
+		ThreadTelemetry telemetry;
+		LoadTelemetry(m_pTelemetry[thread], telemetry);
+		total += telemetry;
+	}
+	return total;
+}
+
+uint32_t
+TaskScheduler::GetThreadCpu(uint32_t threadNum_) const
+{
+	assert(threadNum_ < m_NumThreads);
+	return m_pThreadDataStore[threadNum_].cpu;
+}
+
+ThreadTelemetry&
+ThreadTelemetry::operator+=(const ThreadTelemetry& rhs_)
+{
+	numRangesRun += rhs_.numRangesRun;
+	numRangesStolen += rhs_.numRangesStolen;
+	numSubTasksSplit += rhs_.numSubTasksSplit;
+	numPipeFullRunInline += rhs_.numPipeFullRunInline;
+	busyNs += rhs_.busyNs;
+	suspendedNs += rhs_.suspendedNs;
+	waitForTaskNs += rhs_.waitForTaskNs;
+	for (uint32_t bucket = 0; bucket < TELEMETRY_HISTOGRAM_BUCKETS; ++bucket)
+	{
+		rangeDurationHistogram[bucket] += rhs_.rangeDurationHistogram[bucket];
+	}
+	return *this;
+}
+
+ThreadTelemetry&
+ThreadTelemetry::operator-=(const ThreadTelemetry& rhs_)
+{
+	numRangesRun -= rhs_.numRangesRun;
+	numRangesStolen -= rhs_.numRangesStolen;
+	numSubTasksSplit -= rhs_.numSubTasksSplit;
+	numPipeFullRunInline -= rhs_.numPipeFullRunInline;
+	busyNs -= rhs_.busyNs;
+	suspendedNs -= rhs_.suspendedNs;
+	waitForTaskNs -= rhs_.waitForTaskNs;
+	for (uint32_t bucket = 0; bucket < TELEMETRY_HISTOGRAM_BUCKETS; ++bucket)
+	{
+		rangeDurationHistogram[bucket] -= rhs_.rangeDurationHistogram[bucket];
+	}
+	return *this;
+}
+
+uint64_t
+TaskScheduler::GetTimeNs()
+{
+	return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+	           std::chrono::steady_clock::now().time_since_epoch())
+	    .count();
+}
+
+DeadlineStats
+TaskScheduler::GetDeadlineStats() const
+{
+	DeadlineStats stats;
+	stats.numCompleted = m_DeadlinesCompleted.load(std::memory_order_relaxed);
+	stats.numMissed = m_DeadlinesMissed.load(std::memory_order_relaxed);
+	stats.maxLatenessNs = m_DeadlineMaxLatenessNs.load(std::memory_order_relaxed);
+	stats.totalLatenessNs = m_DeadlineTotalLatenessNs.load(std::memory_order_relaxed);
+	return stats;
+}
+
+void
+TaskScheduler::ResetDeadlineStats()
+{
+	m_DeadlinesCompleted.store(0, std::memory_order_relaxed);
+	m_DeadlinesMissed.store(0, std::memory_order_relaxed);
+	m_DeadlineMaxLatenessNs.store(0, std::memory_order_relaxed);
+	m_DeadlineTotalLatenessNs.store(0, std::memory_order_relaxed);
+}
+
 void
 TaskScheduler::AddTaskSetToPipe(ITaskSet* pTaskSet_)
 {
 	assert(pTaskSet_->m_RunningCount == 0);
+	assert(NULL == pTaskSet_->m_pGraph); // nodes of a TaskGraph are run by AddTaskGraphToPipe
 	InitDependencies(pTaskSet_);
 	pTaskSet_->m_RunningCount.store(gc_TaskStartCount, std::memory_order_relaxed);
 	AddTaskSetToPipeInt(pTaskSet_, gtl_threadNum);
@@ -999,6 +1932,51 @@ TaskScheduler::AddPinnedTask(IPinnedTask* pTask_)
 	AddPinnedTaskInt(pTask_);
 }
 
+void
+TaskScheduler::AddTaskGraphInt(TaskGraph* pGraph_, uint32_t threadNum_)
+{
+	assert(pGraph_->m_RunningCount == gc_TaskStartCount);
+	assert(pGraph_->m_bCompiled); // call TaskGraph::Compile() after modifying the graph
+	uint32_t numNodes = (uint32_t)pGraph_->m_Nodes.size();
+	if (0 == numNodes)
+	{
+		pGraph_->m_RunningCount.fetch_sub(1, std::memory_order_acq_rel);
+		TaskComplete(pGraph_, true, threadNum_);
+		return;
+	}
+
+	// set all nodes as running before any are launched so they show as not complete,
+	// this replaces InitDependencies() for the nodes.
+	for (uint32_t node = 0; node < numNodes; ++node)
+	{
+		ITaskSet* pTask = pGraph_->m_Nodes[node];
+		assert(pTask->GetIsComplete()); // node is still running from a previous submit
+		pTask->m_RunningCount.store(gc_TaskStartCount, std::memory_order_relaxed);
+		pGraph_->m_pJoinCountsRemaining[node].store(
+		    pGraph_->m_JoinCounts[node], std::memory_order_relaxed);
+	}
+	pGraph_->m_NodesRemaining.store(numNodes, std::memory_order_release);
+
+	// the graph can not complete until the last root has been added,
+	// so take copies to avoid reading the graph afterwards.
+	const uint32_t* pRoots = pGraph_->m_Roots.data();
+	uint32_t numRoots = (uint32_t)pGraph_->m_Roots.size();
+	ITaskSet* const* pNodes = pGraph_->m_Nodes.data();
+	for (uint32_t root = 0; root < numRoots; ++root)
+	{
+		AddTaskSetToPipeInt(pNodes[pRoots[root]], threadNum_);
+	}
+}
+
+void
+TaskScheduler::AddTaskGraphToPipe(TaskGraph* pGraph_)
+{
+	assert(pGraph_->m_RunningCount == 0);
+	InitDependencies(pGraph_);
+	pGraph_->m_RunningCount.store(gc_TaskStartCount, std::memory_order_relaxed);
+	AddTaskGraphInt(pGraph_, gtl_threadNum);
+}
+
 void
 TaskScheduler::InitDependencies(ICompletable* pCompletable_)
 {
@@ -1072,6 +2050,10 @@ TaskScheduler::
 	if (pCompletable_ && !pCompletable_->GetIsComplete())
 	{
 		SafeCallback(m_Config.profilerCallbacks.waitForTaskCompleteStart, threadNum);
+		uint64_t startNs = m_Config.enableTelemetry ? GetTimeNs() : 0;
+#if IE_TS_FIBERS_SUPPORTED
+		if (gtl_pFiberThreadData) { FiberParkUntilComplete(pCompletable_); }
+#endif
 		// We need to ensure that the task we're waiting on can complete even if we're the only thread,
 		// so we clamp the priorityOfLowestToRun_ to no smaller than the task we're waiting for
 		priorityOfLowestToRun_ = std::max(priorityOfLowestToRun_, pCompletable_->m_Priority);
@@ -1098,6 +2080,10 @@ TaskScheduler::
 				SpinWait(spinBackoffCount);
 			}
 		}
+		if (m_Config.enableTelemetry)
+		{
+			TelemetryAdd(m_pTelemetry[threadNum].waitForTaskNs, GetTimeNs() - startNs);
+		}
 		SafeCallback(m_Config.profilerCallbacks.waitForTaskCompleteStop, threadNum);
 	}
 	else if (nullptr == pCompletable_)
@@ -1357,8 +2343,13 @@ TaskScheduler::Free(T* p_, const char* file_, int line_)
 TaskScheduler::TaskScheduler()
     : m_pPipesPerThread(),
       m_pPinnedTaskListPerThread(),
+      m_pDeadlineQueues(NULL),
+      m_pPartitionCosts(NULL),
+      m_pTelemetry(NULL),
+      m_pSameCacheThreads(NULL),
       m_NumThreads(0),
       m_pThreadDataStore(NULL),
+      m_pFiberThreadData(NULL),
       m_pThreads(NULL),
       m_bRunning(false),
       m_NumInternalTaskThreadsRunning(0),
@@ -1369,7 +2360,11 @@ TaskScheduler::TaskScheduler()
       m_pTaskCompleteSemaphore(NULL),
       m_NumInitialPartitions(0),
       m_bHaveThreads(false),
-      m_NumExternalTaskThreadsRegistered(0)
+      m_NumExternalTaskThreadsRegistered(0),
+      m_DeadlinesCompleted(0),
+      m_DeadlinesMissed(0),
+      m_DeadlineMaxLatenessNs(0),
+      m_DeadlineTotalLatenessNs(0)
 {
 }
 
@@ -1637,3 +2632,108 @@ Dependency::ClearDependency()
 	pDependencyTask = NULL;
 	pNext = NULL;
 }
+
+TaskGraph::~TaskGraph() { Clear(); }
+
+uint32_t
+TaskGraph::AddNode(ITaskSet* pTask_)
+{
+	assert(GetIsComplete());
+	assert(pTask_);
+	assert(NULL == pTask_->m_pGraph); // a task set can only be a node of one graph
+	assert(NULL == pTask_->m_pDependents && 0 == pTask_->m_DependenciesCount);
+	uint32_t node = (uint32_t)m_Nodes.size();
+	pTask_->m_pGraph = this;
+	pTask_->m_GraphNode = node;
+	m_Nodes.push_back(pTask_);
+	m_bCompiled = false;
+	return node;
+}
+
+void
+TaskGraph::AddEdge(uint32_t from_, uint32_t to_)
+{
+	assert(GetIsComplete());
+	assert(from_ < m_Nodes.size() && to_ < m_Nodes.size());
+	assert(from_ != to_);
+	Edge edge = {from_, to_};
+	m_Edges.push_back(edge);
+	m_bCompiled = false;
+}
+
+void
+TaskGraph::AddEdge(const ITaskSet* pFrom_, const ITaskSet* pTo_)
+{
+	assert(this == pFrom_->m_pGraph && this == pTo_->m_pGraph);
+	AddEdge(pFrom_->m_GraphNode, pTo_->m_GraphNode);
+}
+
+void
+TaskGraph::Compile()
+{
+	assert(GetIsComplete());
+	uint32_t numNodes = (uint32_t)m_Nodes.size();
+
+	// count successors and predecessors
+	m_SuccessorOffsets.assign(numNodes + 1, 0);
+	m_JoinCounts.assign(numNodes, 0);
+	for (const Edge& edge : m_Edges)
+	{
+		++m_SuccessorOffsets[edge.from + 1];
+		++m_JoinCounts[edge.to];
+	}
+	for (uint32_t node = 0; node < numNodes; ++node)
+	{
+		m_SuccessorOffsets[node + 1] += m_SuccessorOffsets[node];
+	}
+
+	// fill successor lists
+	std::vector<uint32_t> fill(m_SuccessorOffsets.begin(), m_SuccessorOffsets.end() - 1);
+	m_Successors.resize(m_Edges.size());
+	for (const Edge& edge : m_Edges) { m_Successors[fill[edge.from]++] = edge.to; }
+
+	m_Roots.clear();
+	for (uint32_t node = 0; node < numNodes; ++node)
+	{
+		if (0 == m_JoinCounts[node]) { m_Roots.push_back(node); }
+	}
+	m_pJoinCountsRemaining.reset(new std::atomic<int32_t>[numNodes]);
+
+	// check every node can be reached, i.e. there are no cycles
+	std::vector<int32_t> joinCounts(m_JoinCounts);
+	std::vector<uint32_t> ready(m_Roots);
+	uint32_t numVisited = 0;
+	while (!ready.empty())
+	{
+		uint32_t node = ready.back();
+		ready.pop_back();
+		++numVisited;
+		for (uint32_t i = m_SuccessorOffsets[node]; i < m_SuccessorOffsets[node + 1]; ++i)
+		{
+			if (0 == --joinCounts[m_Successors[i]]) { ready.push_back(m_Successors[i]); }
+		}
+	}
+	assert(numVisited == numNodes); // graph has a cycle
+	(void)numVisited;
+
+	m_bCompiled = true;
+}
+
+void
+TaskGraph::Clear()
+{
+	assert(GetIsComplete());
+	for (ITaskSet* pTask : m_Nodes)
+	{
+		pTask->m_pGraph = NULL;
+		pTask->m_GraphNode = 0;
+	}
+	m_Nodes.clear();
+	m_Edges.clear();
+	m_SuccessorOffsets.clear();
+	m_Successors.clear();
+	m_JoinCounts.clear();
+	m_Roots.clear();
+	m_pJoinCountsRemaining.reset();
+	m_bCompiled = false;
+}
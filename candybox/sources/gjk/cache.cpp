@@ -0,0 +1,115 @@
+#include "candybox/GJKCache.hpp"
+using namespace candybox;
+
+namespace {
+
+// the vertex of the proxy furthest along the direction, in the proxy's space
+int32_t
+Support(const gjk::DistanceProxy& proxy, glm::vec2 direction)
+{
+	int32_t best = 0;
+	float bestValue = m::dotv(proxy.vertices[0], direction);
+	for (int32_t i = 1; i < proxy.count; ++i)
+	{
+		float value = m::dotv(proxy.vertices[i], direction);
+		if (value > bestValue)
+		{
+			best = i;
+			bestValue = value;
+		}
+	}
+	return best;
+}
+
+} // namespace
+
+gjk::DistanceCacheTable::Entry&
+gjk::DistanceCacheTable::touch(
+    uint32_t idA,
+    uint32_t idB,
+    const DistanceProxy& proxyA,
+    const DistanceProxy& proxyB)
+{
+	Entry& entry = m_entries[key(idA, idB)];
+	entry.frame = m_frame;
+
+	// A shape may have changed under the same id, start over if the vertices are gone.
+	DistanceCache& cache = entry.cache;
+	for (int32_t i = 0; i < cache.count; ++i)
+	{
+		if (cache.indexA[i] >= proxyA.count || cache.indexB[i] >= proxyB.count)
+		{
+			cache.count = 0;
+			break;
+		}
+	}
+	return entry;
+}
+
+gjk::DistanceOutput
+gjk::DistanceCacheTable::distance(
+    uint32_t idA,
+    uint32_t idB,
+    const DistanceInput* input,
+    float maxDistance)
+{
+	Entry& entry = touch(idA, idB, input->proxyA, input->proxyB);
+
+	// Any axis bounds the distance from below, the last one is the likeliest to separate.
+	if (entry.axis.x != 0.0f || entry.axis.y != 0.0f)
+	{
+		const glm::vec2 axis = entry.axis;
+		const Xf2d& xfA = input->transformA;
+		const Xf2d& xfB = input->transformB;
+		int32_t indexA = Support(input->proxyA, InvRotateVector(xfA.q, axis));
+		int32_t indexB = Support(input->proxyB, InvRotateVector(xfB.q, m::negv(axis)));
+		DistanceOutput output;
+		output.pointA = TransformPoint(xfA, input->proxyA.vertices[indexA]);
+		output.pointB = TransformPoint(xfB, input->proxyB.vertices[indexB]);
+		output.distance = m::dotv(axis, m::subv(output.pointB, output.pointA));
+		if (input->useRadii)
+		{
+			output.distance -= input->proxyA.radius + input->proxyB.radius;
+			output.pointA = m::addv(output.pointA, m::mulsv(input->proxyA.radius, axis));
+			output.pointB = m::subv(output.pointB, m::mulsv(input->proxyB.radius, axis));
+		}
+		if (output.distance > maxDistance) { return output; }
+	}
+
+	DistanceOutput output = ShapeDistance(&entry.cache, input);
+	entry.axis = output.distance > 0.0f
+	                 ? m::normv(m::subv(output.pointB, output.pointA))
+	                 : glm::vec2{0.0f, 0.0f};
+	return output;
+}
+
+gjk::TOIOutput
+gjk::DistanceCacheTable::timeOfImpact(uint32_t idA, uint32_t idB, const TOIInput* input)
+{
+	Entry& entry = touch(idA, idB, input->proxyA, input->proxyB);
+	return TimeOfImpact(input, &entry.cache);
+}
+
+uint32_t
+gjk::DistanceCacheTable::nextFrame(uint32_t maxAge)
+{
+	++m_frame;
+	uint32_t evicted = 0;
+	for (auto it = m_entries.begin(); it != m_entries.end();)
+	{
+		if (m_frame - it->second.frame > maxAge)
+		{
+			it = m_entries.erase(it);
+			++evicted;
+		}
+		else { ++it; }
+	}
+	return evicted;
+}
+
+const gjk::DistanceCacheTable::Entry*
+gjk::DistanceCacheTable::find(uint32_t idA, uint32_t idB) const
+{
+	auto it = m_entries.find(key(idA, idB));
+	return it != m_entries.end() ? &it->second : nullptr;
+}
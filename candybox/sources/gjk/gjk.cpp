@@ -952,7 +952,7 @@ EvaluateSeparation(const SepFunc* f, int32_t indexA, int32_t indexB, float t)
 // CCD via the local separating axis method. This seeks progression
 // by computing the largest time at which separation is maintained.
 gjk::TOIOutput
-candybox::gjk::TimeOfImpact(const TOIInput* input)
+candybox::gjk::TimeOfImpact(const TOIInput* input, DistanceCache* cacheIO)
 {
 	TOIOutput output;
 	output.state = TOIState::kUnknown;
@@ -990,6 +990,7 @@ candybox::gjk::TimeOfImpact(const TOIInput* input)
 
 	// Prepare input for distance query.
 	DistanceCache cache;
+	if (cacheIO) { cache = *cacheIO; }
 	DistanceInput distanceInput;
 	distanceInput.proxyA = input->proxyA;
 	distanceInput.proxyB = input->proxyB;
@@ -1142,6 +1143,7 @@ candybox::gjk::TimeOfImpact(const TOIInput* input)
 		}
 	}
 
+	if (cacheIO) { *cacheIO = cache; }
 	return output;
 }
 
@@ -1,7 +1,12 @@
 ﻿#include "candybox/GJK.hpp"
+#include "candybox/Parallel.hpp"
+#include "x86/sse2.h" // simde
 using namespace candybox;
 
 #define MAKE_ID(A, B) ((uint8_t)(A) << 8 | (uint8_t)(B))
+#define PAIR_KEY(A, B) ((int32_t)(A) << 2 | (int32_t)(B))
+
+static_assert(gjk::MAX_POLY_VERTS % 4 == 0, "the polygon edges are loaded 4 at a time");
 
 gjk::Manifold
 candybox::gjk::GJK_Circles(const Circle* A, Xf2d xfA, const Circle* B, Xf2d xfB, float maxd)
@@ -95,19 +100,36 @@ candybox::gjk::GJK_Poly2Circle(const Polygon* A, Xf2d xfA, const Circle* B, Xf2d
 	glm::vec2 c = InvTransformPoint(xfA, TransformPoint(xfB, B->point));
 	float radius = A->radius + B->radius;
 
-	// Find the min separating edge.
-	int32_t normalIndex = 0;
-	float separation = -FLT_MAX;
+	// Find the min separating edge, the edges are in SIMD lanes 4 at a time.
 	int32_t vertexCount = A->count;
 	const glm::vec2* vertices = A->vertices;
 	const glm::vec2* normals = A->normals;
+	simde__m128 cx = simde_mm_set1_ps(c.x);
+	simde__m128 cy = simde_mm_set1_ps(c.y);
+	float separations[MAX_POLY_VERTS];
+	for (int32_t i = 0; i < vertexCount; i += 4)
+	{
+		simde__m128 n01 = simde_mm_loadu_ps(&normals[i].x);
+		simde__m128 n23 = simde_mm_loadu_ps(&normals[i + 2].x);
+		simde__m128 v01 = simde_mm_loadu_ps(&vertices[i].x);
+		simde__m128 v23 = simde_mm_loadu_ps(&vertices[i + 2].x);
+		simde__m128 nx = simde_mm_shuffle_ps(n01, n23, SIMDE_MM_SHUFFLE(2, 0, 2, 0));
+		simde__m128 ny = simde_mm_shuffle_ps(n01, n23, SIMDE_MM_SHUFFLE(3, 1, 3, 1));
+		simde__m128 vx = simde_mm_shuffle_ps(v01, v23, SIMDE_MM_SHUFFLE(2, 0, 2, 0));
+		simde__m128 vy = simde_mm_shuffle_ps(v01, v23, SIMDE_MM_SHUFFLE(3, 1, 3, 1));
+		simde__m128 s = simde_mm_add_ps(
+		    simde_mm_mul_ps(nx, simde_mm_sub_ps(cx, vx)),
+		    simde_mm_mul_ps(ny, simde_mm_sub_ps(cy, vy)));
+		simde_mm_storeu_ps(separations + i, s);
+	}
 
+	int32_t normalIndex = 0;
+	float separation = -FLT_MAX;
 	for (int32_t i = 0; i < vertexCount; ++i)
 	{
-		float s = m::dotv(normals[i], m::subv(c, vertices[i]));
-		if (s > separation)
+		if (separations[i] > separation)
 		{
-			separation = s;
+			separation = separations[i];
 			normalIndex = i;
 		}
 	}
@@ -363,6 +385,7 @@ PolygonClip(
 }
 
 // Find the max separation between poly1 and poly2 using edge normals from poly1.
+// The edges of poly1 are in SIMD lanes, 4 at a time, the result is the same as one by one.
 static float
 FindMaxSeparation(
     int32_t* edgeIndex,
@@ -378,25 +401,52 @@ FindMaxSeparation(
 	const glm::vec2* v2s = poly2->vertices;
 	gjk::Xf2d xf = InvMulTransforms(xf2, xf1);
 
-	int32_t bestIndex = 0;
-	float maxSeparation = -FLT_MAX;
-	for (int32_t i = 0; i < count1; ++i)
-	{
-		// Get poly1 normal in frame2.
-		glm::vec2 n = RotateVector(xf.q, n1s[i]);
-		glm::vec2 v1 = TransformPoint(xf, v1s[i]);
+	simde__m128 c = simde_mm_set1_ps(xf.q.c);
+	simde__m128 s = simde_mm_set1_ps(xf.q.s);
+	simde__m128 px = simde_mm_set1_ps(xf.p.x);
+	simde__m128 py = simde_mm_set1_ps(xf.p.y);
 
-		// Find deepest point for normal i.
-		float si = FLT_MAX;
+	float separations[gjk::MAX_POLY_VERTS];
+	for (int32_t i = 0; i < count1; i += 4)
+	{
+		// Split the x and y of 4 normals and vertices, the lanes past count1 are unused.
+		simde__m128 n01 = simde_mm_loadu_ps(&n1s[i].x);
+		simde__m128 n23 = simde_mm_loadu_ps(&n1s[i + 2].x);
+		simde__m128 v01 = simde_mm_loadu_ps(&v1s[i].x);
+		simde__m128 v23 = simde_mm_loadu_ps(&v1s[i + 2].x);
+		simde__m128 nx = simde_mm_shuffle_ps(n01, n23, SIMDE_MM_SHUFFLE(2, 0, 2, 0));
+		simde__m128 ny = simde_mm_shuffle_ps(n01, n23, SIMDE_MM_SHUFFLE(3, 1, 3, 1));
+		simde__m128 vx = simde_mm_shuffle_ps(v01, v23, SIMDE_MM_SHUFFLE(2, 0, 2, 0));
+		simde__m128 vy = simde_mm_shuffle_ps(v01, v23, SIMDE_MM_SHUFFLE(3, 1, 3, 1));
+
+		// Get poly1 normals and vertices in frame2.
+		simde__m128 n_x = simde_mm_sub_ps(simde_mm_mul_ps(c, nx), simde_mm_mul_ps(s, ny));
+		simde__m128 n_y = simde_mm_add_ps(simde_mm_mul_ps(s, nx), simde_mm_mul_ps(c, ny));
+		simde__m128 v1x = simde_mm_add_ps(
+		    simde_mm_sub_ps(simde_mm_mul_ps(c, vx), simde_mm_mul_ps(s, vy)), px);
+		simde__m128 v1y = simde_mm_add_ps(
+		    simde_mm_add_ps(simde_mm_mul_ps(s, vx), simde_mm_mul_ps(c, vy)), py);
+
+		// Find deepest point for each normal.
+		simde__m128 si = simde_mm_set1_ps(FLT_MAX);
 		for (int32_t j = 0; j < count2; ++j)
 		{
-			float sij = m::dotv(n, m::subv(v2s[j], v1));
-			if (sij < si) { si = sij; }
+			simde__m128 dx = simde_mm_sub_ps(simde_mm_set1_ps(v2s[j].x), v1x);
+			simde__m128 dy = simde_mm_sub_ps(simde_mm_set1_ps(v2s[j].y), v1y);
+			simde__m128 sij =
+			    simde_mm_add_ps(simde_mm_mul_ps(n_x, dx), simde_mm_mul_ps(n_y, dy));
+			si = simde_mm_min_ps(sij, si);
 		}
+		simde_mm_storeu_ps(separations + i, si);
+	}
 
-		if (si > maxSeparation)
+	int32_t bestIndex = 0;
+	float maxSeparation = -FLT_MAX;
+	for (int32_t i = 0; i < count1; ++i)
+	{
+		if (separations[i] > maxSeparation)
 		{
-			maxSeparation = si;
+			maxSeparation = separations[i];
 			bestIndex = i;
 		}
 	}
@@ -614,3 +664,186 @@ candybox::gjk::GJK_Seg2Poly(
 	Polygon polygonA = MakeCapsule(A->p1, A->p2, 0.0f);
 	return GJK_Polygons(&polygonA, xfA, B, xfB, maxd, cache);
 }
+
+gjk::Manifold
+candybox::gjk::GJK_Collide(const ManifoldPair* pair, float maxd)
+{
+	const void* A = pair->shapeA;
+	const void* B = pair->shapeB;
+	Xf2d xfA = pair->xfA;
+	Xf2d xfB = pair->xfB;
+	DistanceCache* cache = pair->cache;
+
+	switch (PAIR_KEY(pair->typeA, pair->typeB))
+	{
+	case PAIR_KEY(ShapeType::kCircle, ShapeType::kCircle):
+		return GJK_Circles((const Circle*)A, xfA, (const Circle*)B, xfB, maxd);
+	case PAIR_KEY(ShapeType::kCapsule, ShapeType::kCircle):
+		return GJK_Capsule2Circle((const Capsule*)A, xfA, (const Circle*)B, xfB, maxd);
+	case PAIR_KEY(ShapeType::kSegment, ShapeType::kCircle):
+		return GJK_Seg2Circle((const Segment*)A, xfA, (const Circle*)B, xfB, maxd);
+	case PAIR_KEY(ShapeType::kPolygon, ShapeType::kCircle):
+		return GJK_Poly2Circle((const Polygon*)A, xfA, (const Circle*)B, xfB, maxd);
+	case PAIR_KEY(ShapeType::kCapsule, ShapeType::kCapsule):
+		return GJK_Capsules((const Capsule*)A, xfA, (const Capsule*)B, xfB, maxd, cache);
+	case PAIR_KEY(ShapeType::kSegment, ShapeType::kCapsule):
+		return GJK_Seg2Capsule((const Segment*)A, xfA, (const Capsule*)B, xfB, maxd, cache);
+	case PAIR_KEY(ShapeType::kPolygon, ShapeType::kCapsule):
+		return GJK_Poly2Capsule((const Polygon*)A, xfA, (const Capsule*)B, xfB, maxd, cache);
+	case PAIR_KEY(ShapeType::kPolygon, ShapeType::kPolygon):
+		return GJK_Polygons((const Polygon*)A, xfA, (const Polygon*)B, xfB, maxd, cache);
+	case PAIR_KEY(ShapeType::kSegment, ShapeType::kPolygon):
+		return GJK_Seg2Poly((const Segment*)A, xfA, (const Polygon*)B, xfB, maxd, cache);
+	default:
+		assert(false && "no manifold function for these shape types");
+		return Manifold{};
+	}
+}
+
+// The transforms of the shapes of 4 pairs in lanes.
+struct XfLanes
+{
+	simde__m128 px, py, c, s;
+
+	XfLanes(
+	    const gjk::Xf2d& xf0,
+	    const gjk::Xf2d& xf1,
+	    const gjk::Xf2d& xf2,
+	    const gjk::Xf2d& xf3)
+	{
+		px = simde_mm_setr_ps(xf0.p.x, xf1.p.x, xf2.p.x, xf3.p.x);
+		py = simde_mm_setr_ps(xf0.p.y, xf1.p.y, xf2.p.y, xf3.p.y);
+		c = simde_mm_setr_ps(xf0.q.c, xf1.q.c, xf2.q.c, xf3.q.c);
+		s = simde_mm_setr_ps(xf0.q.s, xf1.q.s, xf2.q.s, xf3.q.s);
+	}
+
+	// TransformPoint() of (x, y) in each lane.
+	void transform(simde__m128 x, simde__m128 y, simde__m128& outX, simde__m128& outY) const
+	{
+		outX = simde_mm_add_ps(
+		    simde_mm_sub_ps(simde_mm_mul_ps(c, x), simde_mm_mul_ps(s, y)), px);
+		outY = simde_mm_add_ps(
+		    simde_mm_add_ps(simde_mm_mul_ps(s, x), simde_mm_mul_ps(c, y)), py);
+	}
+};
+
+// GJK_Circles() of 4 pairs at a time. The last group repeats its last pair in the unused
+// lanes.
+static void
+CirclesLanes(
+    const gjk::ManifoldPair* pairs,
+    int32_t count,
+    float maxd,
+    gjk::Manifold* manifolds)
+{
+	const simde__m128 zero = simde_mm_setzero_ps();
+	const simde__m128 half = simde_mm_set1_ps(0.5f);
+	const simde__m128 epsilon = simde_mm_set1_ps(FLT_EPSILON);
+
+	for (int32_t first = 0; first < count; first += 4)
+	{
+		const gjk::ManifoldPair* p[4];
+		const gjk::Circle* A[4];
+		const gjk::Circle* B[4];
+		for (int32_t lane = 0; lane < 4; ++lane)
+		{
+			p[lane] = pairs + m::min(first + lane, count - 1);
+			A[lane] = (const gjk::Circle*)p[lane]->shapeA;
+			B[lane] = (const gjk::Circle*)p[lane]->shapeB;
+		}
+
+		XfLanes xfA(p[0]->xfA, p[1]->xfA, p[2]->xfA, p[3]->xfA);
+		XfLanes xfB(p[0]->xfB, p[1]->xfB, p[2]->xfB, p[3]->xfB);
+		simde__m128 ax, ay, bx, by;
+		xfA.transform(
+		    simde_mm_setr_ps(A[0]->point.x, A[1]->point.x, A[2]->point.x, A[3]->point.x),
+		    simde_mm_setr_ps(A[0]->point.y, A[1]->point.y, A[2]->point.y, A[3]->point.y), ax,
+		    ay);
+		xfB.transform(
+		    simde_mm_setr_ps(B[0]->point.x, B[1]->point.x, B[2]->point.x, B[3]->point.x),
+		    simde_mm_setr_ps(B[0]->point.y, B[1]->point.y, B[2]->point.y, B[3]->point.y), bx,
+		    by);
+		simde__m128 rA =
+		    simde_mm_setr_ps(A[0]->radius, A[1]->radius, A[2]->radius, A[3]->radius);
+		simde__m128 rB =
+		    simde_mm_setr_ps(B[0]->radius, B[1]->radius, B[2]->radius, B[3]->radius);
+
+		// normv(), the normal is zero when the centers coincide.
+		simde__m128 dx = simde_mm_sub_ps(bx, ax);
+		simde__m128 dy = simde_mm_sub_ps(by, ay);
+		simde__m128 distance = simde_mm_sqrt_ps(
+		    simde_mm_add_ps(simde_mm_mul_ps(dx, dx), simde_mm_mul_ps(dy, dy)));
+		simde__m128 invLength = simde_mm_and_ps(
+		    simde_mm_div_ps(simde_mm_set1_ps(1.0f), distance),
+		    simde_mm_cmpge_ps(distance, epsilon));
+		simde__m128 nx = simde_mm_mul_ps(invLength, dx);
+		simde__m128 ny = simde_mm_mul_ps(invLength, dy);
+
+		simde__m128 separation = simde_mm_sub_ps(simde_mm_sub_ps(distance, rA), rB);
+		simde__m128 negRB = simde_mm_sub_ps(zero, rB);
+		simde__m128 cAx = simde_mm_add_ps(ax, simde_mm_mul_ps(rA, nx));
+		simde__m128 cAy = simde_mm_add_ps(ay, simde_mm_mul_ps(rA, ny));
+		simde__m128 cBx = simde_mm_add_ps(bx, simde_mm_mul_ps(negRB, nx));
+		simde__m128 cBy = simde_mm_add_ps(by, simde_mm_mul_ps(negRB, ny));
+		simde__m128 pointX =
+		    simde_mm_add_ps(cAx, simde_mm_mul_ps(half, simde_mm_sub_ps(cBx, cAx)));
+		simde__m128 pointY =
+		    simde_mm_add_ps(cAy, simde_mm_mul_ps(half, simde_mm_sub_ps(cBy, cAy)));
+		int32_t touching =
+		    simde_mm_movemask_ps(simde_mm_cmple_ps(separation, simde_mm_set1_ps(maxd)));
+
+		float lanes[5][4];
+		simde_mm_storeu_ps(lanes[0], nx);
+		simde_mm_storeu_ps(lanes[1], ny);
+		simde_mm_storeu_ps(lanes[2], pointX);
+		simde_mm_storeu_ps(lanes[3], pointY);
+		simde_mm_storeu_ps(lanes[4], separation);
+		for (int32_t lane = 0; lane < 4 && first + lane < count; ++lane)
+		{
+			gjk::Manifold& manifold = manifolds[first + lane];
+			manifold = gjk::Manifold{};
+			if (!(touching & (1 << lane))) { continue; }
+
+			manifold.normal = {lanes[0][lane], lanes[1][lane]};
+			manifold.points[0].point = {lanes[2][lane], lanes[3][lane]};
+			manifold.points[0].separation = lanes[4][lane];
+			manifold.points[0].id = 0;
+			manifold.pointCount = 1;
+		}
+	}
+}
+
+void
+candybox::gjk::GJK_Batch(
+    const ManifoldPair* pairs,
+    int32_t count,
+    float maxd,
+    Manifold* manifolds,
+    TaskScheduler* ts)
+{
+	parallel_for_range(
+	    ts, (uint32_t)count,
+	    [&](TaskSetPartition range, uint32_t) {
+		    int32_t begin = (int32_t)range.start, end = (int32_t)range.end;
+		    while (begin < end)
+		    {
+			    // The run of pairs with the same types in this range.
+			    int32_t key = PAIR_KEY(pairs[begin].typeA, pairs[begin].typeB);
+			    int32_t last = begin + 1;
+			    while (last < end && PAIR_KEY(pairs[last].typeA, pairs[last].typeB) == key)
+				    ++last;
+
+			    if (key == PAIR_KEY(ShapeType::kCircle, ShapeType::kCircle))
+			    {
+				    CirclesLanes(pairs + begin, last - begin, maxd, manifolds + begin);
+			    }
+			    else
+			    {
+				    for (int32_t i = begin; i < last; ++i)
+					    manifolds[i] = GJK_Collide(pairs + i, maxd);
+			    }
+			    begin = last;
+		    }
+	    },
+	    64);
+}
@@ -0,0 +1,91 @@
+#include "candybox/ShapeSweep.hpp"
+#include "candybox/Parallel.hpp"
+using namespace candybox;
+
+gjk::SweepHit
+candybox::gjk::ShapeSweep(
+    const BVH& tree,
+    const SweepInput* input,
+    SweepShapeCallback shapes,
+    void* context)
+{
+	SweepHit result;
+	const Sweep& sweep = input->sweep;
+
+	// The shape stays within this radius of its center of mass whatever the rotation.
+	float radius = 0.0f;
+	for (int32_t i = 0; i < input->proxy.count; ++i)
+	{
+		radius = m::max(radius, m::distv(input->proxy.vertices[i], sweep.localCenter));
+	}
+	radius += input->proxy.radius;
+
+	BVH::RayCast ray;
+	ray.p1 = sweep.c1;
+	ray.p2 = sweep.c2;
+	ray.radius = radius;
+	ray.maxFraction = input->tMax;
+
+	TOIInput toiInput;
+	toiInput.proxyA = input->proxy;
+	toiInput.sweepA = sweep;
+	DistanceProxy hitProxy;
+	Sweep hitSweep;
+	auto candidate = [&](const BVH::RayCast& subInput, int32_t proxyId, void* userData) {
+		if (!shapes(proxyId, userData, &toiInput.proxyB, &toiInput.sweepB, context))
+		{
+			return subInput.maxFraction;
+		}
+
+		// The center moves linearly, the fraction of the ray is the time of the sweep.
+		toiInput.tMax = subInput.maxFraction;
+		TOIOutput output = TimeOfImpact(&toiInput);
+		if (output.state == TOIState::kSeparated || output.state == TOIState::kUnknown)
+		{
+			return subInput.maxFraction;
+		}
+
+		result.proxyId = proxyId;
+		result.state = output.state;
+		result.t = output.state == TOIState::kOverlapped ? 0.0f : output.t;
+		hitProxy = toiInput.proxyB;
+		hitSweep = toiInput.sweepB;
+		return result.t;
+	};
+	tree.raycast(ray, input->maskBits, candidate);
+
+	if (result.proxyId == BVH::BVH_NullIndex) { return result; }
+
+	// Contact point and normal at the time of impact.
+	DistanceInput distanceInput;
+	distanceInput.proxyA = input->proxy;
+	distanceInput.proxyB = hitProxy;
+	distanceInput.transformA = GetSweepTransform(&sweep, result.t);
+	distanceInput.transformB = GetSweepTransform(&hitSweep, result.t);
+	distanceInput.useRadii = true;
+
+	DistanceCache cache;
+	DistanceOutput output = ShapeDistance(&cache, &distanceInput);
+	result.point = output.pointB;
+	result.normal = m::normv(m::subv(output.pointA, output.pointB));
+	return result;
+}
+
+void
+candybox::gjk::ShapeSweepBatch(
+    const BVH& tree,
+    const SweepInput* inputs,
+    int32_t count,
+    SweepHit* hits,
+    SweepShapeCallback shapes,
+    void* context,
+    TaskScheduler* ts)
+{
+	parallel_for_range(
+	    ts, (uint32_t)count,
+	    [&](TaskSetPartition range, uint32_t) {
+		    for (uint32_t i = range.start; i < range.end; ++i)
+			    hits[i] = ShapeSweep(tree, inputs + i, shapes, context);
+	    },
+	    16);
+}
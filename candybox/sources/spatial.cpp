@@ -5,9 +5,11 @@
 #include "candybox/Memory.hpp"
 #include "candybox/Hilbert.hpp"
 #include "candybox/Heap.hpp"
+#include "candybox/Parallel.hpp"
+#include "x86/avx.h" // simde
 using namespace candybox;
 
-Spatial::Spatial(uint32_t n)
+Spatial::Spatial(uint32_t n, uint32_t nodeSize)
 {
 	// calculate the total number of nodes in the R-tree to allocate space for
 	// and the index of each tree level (used in search later).
@@ -15,20 +17,24 @@ Spatial::Spatial(uint32_t n)
 	uint32_t numItems = n;
 	uint32_t numNodes = n;
 	int i = 0;
-	m_nodeSize = 16; // TODO: can be changed, between (2, 65535).
+	// search() keeps up to (nodeSize - 1) nodes per level on its stack.
+	assert(nodeSize >= 2 && nodeSize <= 64);
+	m_nodeSize = m::clamp(nodeSize, (uint32_t)2, (uint32_t)64);
 	m_levelBounds[i++] = numNodes * 4;
-	do {
-		n = (uint32_t)m::ceil((float)n / (float)m_nodeSize);
+	while (n > 1 || i == 1)
+	{
+		n = (n + m_nodeSize - 1) / m_nodeSize;
 		numNodes += n;
 		m_levelBounds[i++] = numNodes * 4;
-		assert(i <= (int)(sizeof(m_levelBounds) / sizeof(m_levelBounds[0]))); // TODO
-	} while (n != 1);
+		assert(i < (int)(sizeof(m_levelBounds) / sizeof(m_levelBounds[0])));
+		if (n == 0) break; // no items, no root
+	}
 	m_numBounds = i;
 	m_numNodes = numNodes;
 
 	m_numBoxes = 0;
-	m_boxes = static_cast<float *>(_calloc(1, sizeof(float) * numNodes * 4));
-	m_indices = static_cast<uint32_t *>(_calloc(1, sizeof(uint32_t) * numNodes));
+	m_boxes = static_cast<float *>(_calloc(1, sizeof(float) * m::max(numNodes, 1u) * 4));
+	m_indices = static_cast<uint32_t *>(_calloc(1, sizeof(uint32_t) * m::max(numNodes, 1u)));
 	assert(m_boxes && m_indices);
 	if (!m_boxes || !m_indices)
 	{
@@ -70,76 +76,22 @@ Spatial::add(float minx, float miny, float maxx, float maxy)
 }
 
 void
-Spatial::addAll(float *data, uint32_t nFloat)
+Spatial::addAll(const float *data, uint32_t nFloat)
 {
 	uint32_t i;
 	for (i = 0; i < nFloat; i += 4) { add(data[i], data[i + 1], data[i + 2], data[i + 3]); }
 }
 
-static void
-swap(uint32_t *values, float *boxes, uint32_t *indices, uint32_t i, uint32_t j)
-{
-	uint32_t temp = values[i];
-	values[i] = values[j];
-	values[j] = temp;
-
-	uint32_t k = 4 * i;
-	uint32_t m = 4 * j;
-
-	float a = boxes[k];
-	float b = boxes[k + 1];
-	float c = boxes[k + 2];
-	float d = boxes[k + 3];
-	boxes[k] = boxes[m];
-	boxes[k + 1] = boxes[m + 1];
-	boxes[k + 2] = boxes[m + 2];
-	boxes[k + 3] = boxes[m + 3];
-	boxes[m] = a;
-	boxes[m + 1] = b;
-	boxes[m + 2] = c;
-	boxes[m + 3] = d;
-
-	uint32_t e = indices[i];
-	indices[i] = indices[j];
-	indices[j] = e;
-}
-
-static void
-sort(uint32_t *values,
-     float *boxes,
-     uint32_t *indices,
-     uint32_t left,
-     uint32_t right,
-     uint32_t nodeSize)
-{
-	if (left / nodeSize >= right / nodeSize) return;
-
-	uint32_t pivot = values[(left + right) >> 1];
-	uint32_t i = left - 1;
-	uint32_t j = right + 1;
-
-	for (;;)
-	{
-		do i++;
-		while (values[i] < pivot);
-		do j--;
-		while (values[j] > pivot);
-		if (i >= j) break;
-		swap(values, boxes, indices, i, j);
-	}
-
-	sort(values, boxes, indices, left, j, nodeSize);
-	sort(values, boxes, indices, j + 1, right, nodeSize);
-}
-
 void
-Spatial::finish()
+Spatial::finish(TaskScheduler *ts)
 {
 	assert(m_pos >> 2 == m_numItems);
+	if (m_numItems == 0) return;
 
 	if (m_numItems <= m_nodeSize)
 	{
 		// Only one node, skip sorting and just fill the root box.
+		m_indices[m_pos >> 2] = 0;
 		m_boxes[m_pos++] = m_minx;
 		m_boxes[m_pos++] = m_miny;
 		m_boxes[m_pos++] = m_maxx;
@@ -148,68 +100,102 @@ Spatial::finish()
 		return;
 	}
 
-	float width = m_maxx == -FLT_MAX ? 1 : m_maxx - m_minx;
-	float height = m_maxy == -FLT_MAX ? 1 : m_maxy - m_miny;
+	float width = m_maxx - m_minx > 0.0f ? m_maxx - m_minx : 1.0f;
+	float height = m_maxy - m_miny > 0.0f ? m_maxy - m_miny : 1.0f;
 	auto *hilbertValues = static_cast<uint32_t *>(_malloc(sizeof(uint32_t) * m_numItems));
-	uint32_t hilbertMax = (1 << 16) - 1;
+	auto *order = static_cast<uint32_t *>(_malloc(sizeof(uint32_t) * m_numItems));
+	const float hilbertMax = (float)((1 << 16) - 1);
 
 	// Map item centers into Hilbert coordinate space and calculate Hilbert values.
-	for (uint32_t i = 0, pos = 0; i < m_numItems; i++)
+	parallel_for_range(
+	    ts, m_numItems,
+	    [&](TaskSetPartition range, uint32_t) {
+		    for (uint32_t i = range.start; i < range.end; i++)
+		    {
+			    const float *box = &m_boxes[i * 4];
+			    auto x = (uint32_t)(hilbertMax * ((box[0] + box[2]) * 0.5f - m_minx) / width);
+			    auto y = (uint32_t)(hilbertMax * ((box[1] + box[3]) * 0.5f - m_miny) / height);
+			    hilbertValues[i] = hilbert::HilbertXYToIndex(16, x, y);
+			    order[i] = i;
+		    }
+	    },
+	    1 << 14);
+
+	// sort items by their Hilbert value (for packing later). Both sorts are stable so equal
+	// values keep the order of the items, and the tree is the same with or without ts.
+	if (ts) { parallel_radix_sort(*ts, hilbertValues, order, m_numItems); }
+	else
 	{
-		float minX = m_boxes[pos++];
-		float minY = m_boxes[pos++];
-		float maxX = m_boxes[pos++];
-		float maxY = m_boxes[pos++];
-
-		// TODO
-		uint32_t x, y;
-		x = (uint32_t)floorf(
-		    (float)hilbertMax * ((float)(minX + maxX) / 2 - (float)m_minx) / (float)width);
-		y = (uint32_t)floorf(
-		    (float)hilbertMax * ((float)(minY + maxY) / 2 - (float)m_miny) / (float)height);
-		hilbertValues[i] = hilbert::HilbertXYToIndex(16, x, y);
+		std::stable_sort(order, order + m_numItems, [&](uint32_t a, uint32_t b) {
+			return hilbertValues[a] < hilbertValues[b];
+		});
 	}
 
-	// sort items by their Hilbert value (for packing later).
-	sort(hilbertValues, m_boxes, m_indices, 0, m_numItems - 1, m_nodeSize);
-
-	// generate nodes at each tree level, bottom-up.
-	for (uint32_t i = 0, pos = 0; i < m_numBounds - 1; i++)
+	// move the leaves into sorted order.
+	auto *boxes = static_cast<float *>(_malloc(sizeof(float) * m_numNodes * 4));
+	parallel_for_range(
+	    ts, m_numItems,
+	    [&](TaskSetPartition range, uint32_t) {
+		    for (uint32_t i = range.start; i < range.end; i++)
+		    {
+			    memcpy(&boxes[i * 4], &m_boxes[order[i] * 4], sizeof(float) * 4);
+			    m_indices[i] = order[i];
+		    }
+	    },
+	    1 << 14);
+	_free(m_boxes);
+	_free(order);
+	_free(hilbertValues);
+	m_boxes = boxes;
+
+	// generate nodes at each tree level, bottom-up. The parents of a level only read the
+	// level below, so they are independent of each other.
+	for (uint32_t level = 0; level + 1 < m_numBounds; level++)
 	{
-		uint32_t end = m_levelBounds[i];
+		uint32_t begin = level == 0 ? 0 : m_levelBounds[level - 1];
+		uint32_t end = m_levelBounds[level];
+		uint32_t numParents = (m_levelBounds[level + 1] - end) / 4;
 
 		// generate a parent node for each block of consecutive <nodeSize> nodes.
-		while (pos < end)
-		{
-			uint32_t nodeIndex = pos;
-
-			// calculate bbox for the new node.
-			float nodeMinX = m_boxes[pos++];
-			float nodeMinY = m_boxes[pos++];
-			float nodeMaxX = m_boxes[pos++];
-			float nodeMaxY = m_boxes[pos++];
-
-			for (uint32_t j = 1; j < m_nodeSize && pos < end; j++)
-			{
-				nodeMinX = m::min(nodeMinX, m_boxes[pos++]);
-				nodeMinY = m::min(nodeMinY, m_boxes[pos++]);
-				nodeMaxX = m::max(nodeMaxX, m_boxes[pos++]);
-				nodeMaxY = m::max(nodeMaxY, m_boxes[pos++]);
-			}
-
-			// add the new node to the tree data.
-			m_indices[m_pos >> 2] = nodeIndex;
-			m_boxes[m_pos++] = nodeMinX;
-			m_boxes[m_pos++] = nodeMinY;
-			m_boxes[m_pos++] = nodeMaxX;
-			m_boxes[m_pos++] = nodeMaxY;
-			m_numBoxes += 4;
-		}
+		parallel_for_range(
+		    ts, numParents,
+		    [&](TaskSetPartition range, uint32_t) {
+			    for (uint32_t parent = range.start; parent < range.end; parent++)
+			    {
+				    uint32_t pos = begin + parent * m_nodeSize * 4;
+				    uint32_t nodeIndex = pos;
+				    uint32_t nodeEnd = m::min(pos + m_nodeSize * 4, end);
+
+				    // calculate bbox for the new node.
+				    float nodeMinX = m_boxes[pos++];
+				    float nodeMinY = m_boxes[pos++];
+				    float nodeMaxX = m_boxes[pos++];
+				    float nodeMaxY = m_boxes[pos++];
+				    while (pos < nodeEnd)
+				    {
+					    nodeMinX = m::min(nodeMinX, m_boxes[pos++]);
+					    nodeMinY = m::min(nodeMinY, m_boxes[pos++]);
+					    nodeMaxX = m::max(nodeMaxX, m_boxes[pos++]);
+					    nodeMaxY = m::max(nodeMaxY, m_boxes[pos++]);
+				    }
+
+				    // add the new node to the tree data.
+				    uint32_t parentPos = end + parent * 4;
+				    m_indices[parentPos >> 2] = nodeIndex;
+				    m_boxes[parentPos] = nodeMinX;
+				    m_boxes[parentPos + 1] = nodeMinY;
+				    m_boxes[parentPos + 2] = nodeMaxX;
+				    m_boxes[parentPos + 3] = nodeMaxY;
+			    }
+		    },
+		    (1 << 14) / m_nodeSize);
 	}
+	m_pos = m_numNodes * 4;
+	m_numBoxes = m_numNodes * 4;
 }
 
-uint32_t
-upperBound(uint32_t value, uint32_t n, uint32_t *arr)
+static uint32_t
+upperBound(uint32_t value, uint32_t n, const uint32_t *arr)
 {
 	uint32_t i = 0;
 	uint32_t j = n - 1;
@@ -225,6 +211,7 @@ upperBound(uint32_t value, uint32_t n, uint32_t *arr)
 
 void
 Spatial::search(float minx, float miny, float maxx, float maxy, std::vector<uint32_t> &results)
+    const
 {
 	results.clear();
 	if (m_numBoxes == 0) return;
@@ -233,24 +220,26 @@ Spatial::search(float minx, float miny, float maxx, float maxy, std::vector<uint
 	uint32_t queue[512];
 	uint32_t nQueue = 0;
 
+	// a box intersects the query if (minX, minY, -maxX, -maxY) <= (maxx, maxy, -minx, -miny),
+	// so flipping the sign of the max corner tests a box with a single compare.
+#if defined(SIMDE_X86_AVX_NATIVE)
+	const simde__m256 signs = simde_mm256_setr_ps(0, 0, -0.0f, -0.0f, 0, 0, -0.0f, -0.0f);
+	const simde__m256 query = simde_mm256_setr_ps(maxx, maxy, -minx, -miny, maxx, maxy, -minx, -miny);
+#else
+	const simde__m128 signs = simde_mm_setr_ps(0, 0, -0.0f, -0.0f);
+	const simde__m128 query = simde_mm_setr_ps(maxx, maxy, -minx, -miny);
+#endif
+
 	for (;;)
 	{
 		// Find the end index of the node.
 		uint32_t bound = upperBound(nodeIndex, m_numBounds, m_levelBounds);
 		uint32_t end = m::min(nodeIndex + m_nodeSize * 4, bound);
+		bool isLeafNode = nodeIndex < m_numItems * 4;
 
-		// Search through child nodes.
-		for (uint32_t pos = nodeIndex; pos < end; pos += 4)
-		{
-			// Check if node bbox intersects with query bbox.
-			if (maxx < m_boxes[pos]) continue; // maxX < nodeMinX
-			if (maxy < m_boxes[pos + 1]) continue; // maxY < nodeMinY
-			if (minx > m_boxes[pos + 2]) continue; // minX > nodeMaxX
-			if (miny > m_boxes[pos + 3]) continue; // minY > nodeMaxY
-
-			uint32_t index = m_indices[pos >> 2] | 0;
-
-			if (nodeIndex >= m_numItems * 4)
+		auto visit = [&](uint32_t pos) {
+			uint32_t index = m_indices[pos >> 2];
+			if (!isLeafNode)
 			{
 				queue[nQueue++] = index; // node; add it to the search queue.
 				assert(nQueue <= sizeof(queue) / sizeof(queue[0]));
@@ -259,7 +248,29 @@ Spatial::search(float minx, float miny, float maxx, float maxy, std::vector<uint
 			{
 				results.emplace_back(index); // leaf item.
 			}
+		};
+
+		// Search through child nodes.
+#if defined(SIMDE_X86_AVX_NATIVE)
+		// two children per compare
+		for (uint32_t pos = nodeIndex; pos < end; pos += 8)
+		{
+			simde__m256 boxes;
+			if (pos + 8 <= end) boxes = simde_mm256_loadu_ps(&m_boxes[pos]);
+			else boxes = simde_mm256_setr_ps(m_boxes[pos], m_boxes[pos + 1], m_boxes[pos + 2],
+			    m_boxes[pos + 3], NAN, NAN, NAN, NAN); // odd child count, NaN never compares
+			boxes = simde_mm256_xor_ps(boxes, signs);
+			int mask = simde_mm256_movemask_ps(simde_mm256_cmp_ps(boxes, query, SIMDE_CMP_LE_OQ));
+			if ((mask & 0x0F) == 0x0F) visit(pos);
+			if ((mask & 0xF0) == 0xF0) visit(pos + 4);
 		}
+#else
+		for (uint32_t pos = nodeIndex; pos < end; pos += 4)
+		{
+			simde__m128 box = simde_mm_xor_ps(simde_mm_loadu_ps(&m_boxes[pos]), signs);
+			if (simde_mm_movemask_ps(simde_mm_cmple_ps(box, query)) == 0xF) visit(pos);
+		}
+#endif
 
 		if (nQueue == 0) break;
 		nodeIndex = queue[--nQueue];
@@ -292,7 +303,7 @@ Spatial::neighbors(
     float y,
     float maxDist,
     uint32_t maxNeighbors,
-    std::vector<uint32_t> &neighbors)
+    std::vector<uint32_t> &neighbors) const
 {
 	neighbors.clear();
 	if (m_numBoxes == 0) return;
@@ -364,3 +375,440 @@ Spatial::neighbors(
 end:
 	(void)0;
 }
+
+namespace {
+struct Neighbor
+{
+	float distSq;
+	uint32_t index;
+};
+
+// orders the k nearest as a max-heap, so the farthest one is on top and replaced first.
+struct NearerNeighbor
+{
+	bool operator()(const Neighbor &a, const Neighbor &b) const
+	{
+		return a.distSq < b.distSq || (a.distSq == b.distSq && a.index < b.index);
+	}
+};
+} // namespace
+
+uint32_t
+Spatial::neighbors(
+    const float *points,
+    uint32_t numPoints,
+    float maxDist,
+    uint32_t maxNeighbors,
+    uint32_t *offsets,
+    uint32_t *indices,
+    TaskScheduler *ts) const
+{
+	offsets[0] = 0;
+	if (m_numBoxes == 0 || maxNeighbors == 0)
+	{
+		for (uint32_t i = 0; i < numPoints; i++) offsets[i + 1] = 0;
+		return 0;
+	}
+
+	const float maxDistSq = m::pow2(maxDist);
+	// one heap per task thread, and one for a calling thread the scheduler does not know,
+	// which runs the batch inline as NO_THREAD_NUM.
+	const uint32_t numThreads = ts ? ts->GetNumTaskThreads() : 1;
+	std::vector<Neighbor> heaps((numThreads + 1) * maxNeighbors);
+
+	// depth first, visiting the nearest child first so the heap fills with near boxes early
+	// and prunes the rest. Writes the count of point i to offsets[i + 1].
+	auto query = [&](uint32_t point, Neighbor *heap) {
+		float x = points[point * 2];
+		float y = points[point * 2 + 1];
+		uint32_t nHeap = 0;
+		NearerNeighbor nearer;
+
+		Neighbor stack[512]; // same bound as the queue of search().
+		uint32_t nStack = 0;
+		stack[nStack++] = {0.0f, m_numBoxes - 4};
+		while (nStack)
+		{
+			Neighbor node = stack[--nStack];
+			float bound = nHeap < maxNeighbors ? maxDistSq : heap[0].distSq;
+			if (node.distSq > bound) continue;
+
+			uint32_t nodeIndex = node.index;
+			uint32_t end = m::min(
+			    nodeIndex + m_nodeSize * 4, upperBound(nodeIndex, m_numBounds, m_levelBounds));
+			bool isLeafNode = nodeIndex < m_numItems * 4;
+
+			Neighbor children[64];
+			uint32_t nChildren = 0;
+			for (uint32_t pos = nodeIndex; pos < end; pos += 4)
+			{
+				float dx = axisDist(x, m_boxes[pos], m_boxes[pos + 2]);
+				float dy = axisDist(y, m_boxes[pos + 1], m_boxes[pos + 3]);
+				Neighbor child{dx * dx + dy * dy, m_indices[pos >> 2]};
+				if (child.distSq > bound) continue;
+
+				if (!isLeafNode) { children[nChildren++] = child; }
+				else if (nHeap < maxNeighbors)
+				{
+					heap[nHeap++] = child;
+					std::push_heap(heap, heap + nHeap, nearer);
+					if (nHeap == maxNeighbors) bound = heap[0].distSq;
+				}
+				else if (nearer(child, heap[0]))
+				{
+					std::pop_heap(heap, heap + nHeap, nearer);
+					heap[nHeap - 1] = child;
+					std::push_heap(heap, heap + nHeap, nearer);
+					bound = heap[0].distSq;
+				}
+			}
+
+			// farthest first onto the stack, so the nearest is visited next.
+			std::sort(children, children + nChildren, [](const Neighbor &a, const Neighbor &b) {
+				return a.distSq > b.distSq;
+			});
+			for (uint32_t i = 0; i < nChildren; i++)
+			{
+				stack[nStack++] = children[i];
+				assert(nStack <= sizeof(stack) / sizeof(stack[0]));
+			}
+		}
+
+		std::sort_heap(heap, heap + nHeap, nearer);
+		uint32_t *out = &indices[point * maxNeighbors];
+		for (uint32_t i = 0; i < nHeap; i++) out[i] = heap[i].index;
+		offsets[point + 1] = nHeap;
+	};
+
+	parallel_for_range(
+	    ts, numPoints,
+	    [&](TaskSetPartition range, uint32_t threadNum) {
+		    Neighbor *heap = &heaps[m::min(threadNum, numThreads) * maxNeighbors];
+		    for (uint32_t point = range.start; point < range.end; point++) query(point, heap);
+	    },
+	    64);
+
+	// turn the counts into offsets and pack the results, each block moves to a lower or the
+	// same address and the blocks are moved in order, so none is overwritten before it moves.
+	for (uint32_t point = 0; point < numPoints; point++)
+	{
+		uint32_t count = offsets[point + 1];
+		offsets[point + 1] = offsets[point] + count;
+		if (offsets[point] != point * maxNeighbors)
+		{
+			memmove(&indices[offsets[point]], &indices[point * maxNeighbors], sizeof(uint32_t) * count);
+		}
+	}
+	return offsets[numPoints];
+}
+
+struct DynamicSpatial::Run
+{
+	Run(uint32_t serial_, uint32_t numItems, uint32_t nodeSize)
+	    : serial(serial_), tree(numItems, nodeSize)
+	{
+	}
+
+	uint32_t serial;
+	Spatial tree;
+	std::vector<float> boxes; ///< by tree index, minx, miny, maxx, maxy
+	std::vector<uint32_t> ids; ///< by tree index
+	std::vector<uint8_t> dead; ///< by tree index, frozen while the run is merged.
+	uint32_t numDead = 0;
+	bool merging = false;
+};
+
+// builds the runs [first, last) into a single one, dropping the dead boxes. Only reads the
+// input runs, which the main thread does not modify while they are merged.
+struct DynamicSpatial::Merge : public ITaskSet
+{
+	void ExecuteRange(TaskSetPartition, uint32_t) override { build(); }
+
+	void build()
+	{
+		uint32_t count = 0;
+		for (const Run *input : inputs)
+			for (uint8_t dead : input->dead) count += dead ? 0 : 1;
+
+		output.reset(new Run(serial, count, nodeSize));
+		output->boxes.reserve(count * 4);
+		output->ids.reserve(count);
+		output->dead.assign(count, 0);
+		for (const Run *input : inputs)
+		{
+			for (uint32_t i = 0; i < input->ids.size(); i++)
+			{
+				if (input->dead[i])
+				{
+					freedIds.push_back(input->ids[i]);
+					continue;
+				}
+				output->boxes.insert(
+				    output->boxes.end(), &input->boxes[i * 4], &input->boxes[i * 4 + 4]);
+				output->ids.push_back(input->ids[i]);
+			}
+		}
+		output->tree.addAll(output->boxes.data(), (uint32_t)output->boxes.size());
+		output->tree.finish(ts);
+	}
+
+	std::vector<const Run *> inputs;
+	uint32_t first, last; ///< range of the inputs in m_runs.
+	uint32_t serial;
+	uint32_t nodeSize;
+	TaskScheduler *ts;
+	std::unique_ptr<Run> output;
+	std::vector<uint32_t> freedIds; ///< dead before the merge started.
+};
+
+DynamicSpatial::DynamicSpatial(uint32_t bufferSize, uint32_t nodeSize, TaskScheduler *ts)
+    : m_ts(ts), m_bufferSize(m::max(bufferSize, 1u)), m_nodeSize(nodeSize)
+{
+	m_bufferBoxes.reserve(m_bufferSize * 4);
+	m_bufferIds.reserve(m_bufferSize);
+}
+
+DynamicSpatial::~DynamicSpatial()
+{
+	if (m_merge && m_ts) m_ts->WaitforTask(m_merge.get());
+}
+
+uint32_t
+DynamicSpatial::insert(float minx, float miny, float maxx, float maxy)
+{
+	uint32_t id;
+	if (!m_freeIds.empty())
+	{
+		id = m_freeIds.back();
+		m_freeIds.pop_back();
+	}
+	else
+	{
+		id = (uint32_t)m_locations.size();
+		m_locations.push_back({DEAD, 0});
+	}
+	m_locations[id] = {BUFFER, (uint32_t)m_bufferIds.size()};
+	float box[4] = {minx, miny, maxx, maxy};
+	m_bufferBoxes.insert(m_bufferBoxes.end(), box, box + 4);
+	m_bufferIds.push_back(id);
+	m_numItems++;
+
+	if (m_bufferIds.size() >= m_bufferSize) flushBuffer();
+	update();
+	return id;
+}
+
+bool
+DynamicSpatial::remove(uint32_t id)
+{
+	if (id >= m_locations.size() || m_locations[id].run == DEAD) return false;
+
+	Location location = m_locations[id];
+	if (location.run == BUFFER)
+	{
+		// not in a tree yet, swap with the last one.
+		uint32_t last = (uint32_t)m_bufferIds.size() - 1;
+		uint32_t lastId = m_bufferIds[last];
+		memcpy(&m_bufferBoxes[location.slot * 4], &m_bufferBoxes[last * 4], sizeof(float) * 4);
+		m_bufferIds[location.slot] = lastId;
+		m_locations[lastId].slot = location.slot;
+		m_bufferBoxes.resize(last * 4);
+		m_bufferIds.pop_back();
+		m_freeIds.push_back(id);
+	}
+	else
+	{
+		for (auto &run : m_runs)
+		{
+			if (run->serial != location.run) continue;
+			run->numDead++;
+			if (!run->merging) run->dead[location.slot] = 1;
+			break;
+		}
+	}
+	m_locations[id].run = DEAD;
+	m_numItems--;
+	update();
+	return true;
+}
+
+void
+DynamicSpatial::update()
+{
+	for (;;)
+	{
+		if (m_merge)
+		{
+			if (!m_merge->GetIsComplete()) return;
+			finishMerge();
+		}
+		startMerge();
+		if (!m_merge) return;
+	}
+}
+
+void
+DynamicSpatial::wait()
+{
+	while (m_merge)
+	{
+		if (m_ts) m_ts->WaitforTask(m_merge.get());
+		update();
+	}
+}
+
+void
+DynamicSpatial::flushBuffer()
+{
+	// small enough to build on the calling thread.
+	uint32_t count = (uint32_t)m_bufferIds.size();
+	std::unique_ptr<Run> run(new Run(m_nextSerial++, count, m_nodeSize));
+	run->boxes.swap(m_bufferBoxes);
+	run->ids.swap(m_bufferIds);
+	run->dead.assign(count, 0);
+	run->tree.addAll(run->boxes.data(), count * 4);
+	run->tree.finish();
+	for (uint32_t i = 0; i < count; i++) m_locations[run->ids[i]] = {run->serial, i};
+	m_runs.push_back(std::move(run));
+
+	m_bufferBoxes.reserve(m_bufferSize * 4);
+	m_bufferIds.reserve(m_bufferSize);
+}
+
+void
+DynamicSpatial::startMerge()
+{
+	// merge the newest runs as long as the next older one is at most twice as large as
+	// them together, so the runs grow geometrically and a box is rebuilt O(log n) times.
+	uint32_t numRuns = (uint32_t)m_runs.size();
+	uint32_t first = numRuns, last = numRuns;
+	uint64_t numAlive = 0;
+	while (first > 0)
+	{
+		const Run &run = *m_runs[first - 1];
+		uint32_t runAlive = (uint32_t)run.ids.size() - run.numDead;
+		if (first < numRuns && runAlive > numAlive * 2) break;
+		numAlive += runAlive;
+		first--;
+	}
+	if (last - first < 2)
+	{
+		// or compact a run which is mostly tombstones.
+		for (first = 0; first < numRuns; first++)
+			if (m_runs[first]->numDead * 2 > m_runs[first]->ids.size()) break;
+		last = first + 1;
+		if (first == numRuns) return;
+	}
+
+	m_merge.reset(new Merge);
+	m_merge->first = first;
+	m_merge->last = last;
+	m_merge->serial = m_nextSerial++;
+	m_merge->nodeSize = m_nodeSize;
+	m_merge->ts = m_ts;
+	for (uint32_t i = first; i < last; i++)
+	{
+		m_runs[i]->merging = true;
+		m_merge->inputs.push_back(m_runs[i].get());
+	}
+	// without task threads nothing would run it in the background.
+	if (m_ts && m_ts->GetNumTaskThreads() > 1) m_ts->AddTaskSetToPipe(m_merge.get());
+	else m_merge->build();
+}
+
+void
+DynamicSpatial::finishMerge()
+{
+	std::unique_ptr<Merge> merge = std::move(m_merge);
+	std::unique_ptr<Run> &run = merge->output;
+
+	// boxes removed while merging are still in the new run.
+	for (uint32_t i = 0; i < run->ids.size(); i++)
+	{
+		Location &location = m_locations[run->ids[i]];
+		if (location.run == DEAD)
+		{
+			run->dead[i] = 1;
+			run->numDead++;
+		}
+		else { location = {run->serial, i}; }
+	}
+	// no run refers to them anymore.
+	m_freeIds.insert(m_freeIds.end(), merge->freedIds.begin(), merge->freedIds.end());
+
+	m_runs.erase(m_runs.begin() + merge->first, m_runs.begin() + merge->last);
+	if (!run->ids.empty()) m_runs.insert(m_runs.begin() + merge->first, std::move(run));
+}
+
+void
+DynamicSpatial::search(
+    float minx, float miny, float maxx, float maxy, std::vector<uint32_t> &results) const
+{
+	results.clear();
+	for (uint32_t i = 0; i < m_bufferIds.size(); i++)
+	{
+		const float *box = &m_bufferBoxes[i * 4];
+		if (box[0] <= maxx && box[1] <= maxy && box[2] >= minx && box[3] >= miny)
+			results.push_back(m_bufferIds[i]);
+	}
+
+	std::vector<uint32_t> hits;
+	for (const auto &run : m_runs)
+	{
+		run->tree.search(minx, miny, maxx, maxy, hits);
+		for (uint32_t index : hits)
+		{
+			uint32_t id = run->ids[index];
+			if (m_locations[id].run == run->serial) results.push_back(id);
+		}
+	}
+}
+
+void
+DynamicSpatial::neighbors(
+    float x,
+    float y,
+    float maxDist,
+    uint32_t maxNeighbors,
+    std::vector<uint32_t> &neighbors) const
+{
+	neighbors.clear();
+	if (maxNeighbors == 0) return;
+
+	const float maxDistSq = m::pow2(maxDist);
+	auto distSq = [&](const float *box) {
+		float dx = axisDist(x, box[0], box[2]);
+		float dy = axisDist(y, box[1], box[3]);
+		return dx * dx + dy * dy;
+	};
+
+	std::vector<Neighbor> candidates;
+	for (uint32_t i = 0; i < m_bufferIds.size(); i++)
+	{
+		float d = distSq(&m_bufferBoxes[i * 4]);
+		if (d <= maxDistSq) candidates.push_back({d, m_bufferIds[i]});
+	}
+
+	// asking each run for numDead more than needed leaves maxNeighbors alive ones.
+	const float point[2] = {x, y};
+	uint32_t offsets[2];
+	std::vector<uint32_t> indices;
+	for (const auto &run : m_runs)
+	{
+		uint32_t k = m::min(maxNeighbors + run->numDead, (uint32_t)run->ids.size());
+		indices.resize(k);
+		uint32_t count = run->tree.neighbors(point, 1, maxDist, k, offsets, indices.data());
+		for (uint32_t i = 0; i < count; i++)
+		{
+			uint32_t index = indices[i];
+			uint32_t id = run->ids[index];
+			if (m_locations[id].run == run->serial)
+				candidates.push_back({distSq(&run->boxes[index * 4]), id});
+		}
+	}
+
+	uint32_t count = m::min(maxNeighbors, (uint32_t)candidates.size());
+	std::partial_sort(
+	    candidates.begin(), candidates.begin() + count, candidates.end(), NearerNeighbor());
+	for (uint32_t i = 0; i < count; i++) neighbors.push_back(candidates[i].index);
+}
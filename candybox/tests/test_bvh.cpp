@@ -0,0 +1,392 @@
+#include <vector>
+#include <random>
+#include <algorithm>
+#include "candybox/greatest.h"
+#include "candybox/BVH.hpp"
+#include "candybox/TaskScheduler.hpp"
+
+namespace {
+
+using namespace candybox;
+
+TaskScheduler g_TS;
+
+struct Proxies
+{
+	BVH tree;
+	std::vector<int32_t> ids;
+	std::mt19937 rng{3};
+
+	Box randomBox(float size)
+	{
+		std::uniform_real_distribution<float> position(-500.0f, 500.0f);
+		std::uniform_real_distribution<float> extent(0.1f, size);
+		Box box;
+		box.l = {position(rng), position(rng)};
+		box.u = {box.l.x + extent(rng), box.l.y + extent(rng)};
+		return box;
+	}
+
+	void add(uint32_t count)
+	{
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			uint32_t categoryBits = 1u << (ids.size() % 3);
+			ids.push_back(tree.add(randomBox(10.0f), categoryBits, (void *)(ids.size() + 1)));
+		}
+	}
+};
+
+bool
+CollectQuery(int32_t proxyId_, void *, void *context_)
+{
+	static_cast<std::vector<int32_t> *>(context_)->push_back(proxyId_);
+	return true;
+}
+
+float
+CollectRaycast(const BVH::RayCast *input_, int32_t proxyId_, void *, void *context_)
+{
+	static_cast<std::vector<int32_t> *>(context_)->push_back(proxyId_);
+	return input_->maxFraction;
+}
+
+float
+StopRaycast(const BVH::RayCast *, int32_t proxyId_, void *, void *context_)
+{
+	static_cast<std::vector<int32_t> *>(context_)->push_back(proxyId_);
+	return 0.0f;
+}
+
+// the wide tree finds the same proxies as the binary one.
+enum greatest_test_res
+CheckSameResults(Proxies &proxies_)
+{
+	std::vector<int32_t> expected, results;
+	const uint32_t masks[] = {BVH::BVH_DefaultMask, 1, 6};
+	for (int query = 0; query < 200; ++query)
+	{
+		uint32_t maskBits = masks[query % 3];
+		Box aabb = proxies_.randomBox(100.0f);
+		expected.clear();
+		results.clear();
+		proxies_.tree.queryFiltered(aabb, maskBits, CollectQuery, &expected);
+		proxies_.tree.queryWide(aabb, maskBits, CollectQuery, &results);
+		std::sort(expected.begin(), expected.end());
+		std::sort(results.begin(), results.end());
+		ASSERT(expected == results);
+
+		BVH::RayCast ray;
+		Box ends = proxies_.randomBox(400.0f);
+		ray.p1 = ends.l;
+		ray.p2 = ends.u;
+		ray.radius = query % 2 ? 2.0f : 0.0f;
+		ray.maxFraction = 1.0f;
+		expected.clear();
+		results.clear();
+		proxies_.tree.raycast(&ray, maskBits, CollectRaycast, &expected);
+		proxies_.tree.raycastWide(&ray, maskBits, CollectRaycast, &results);
+		std::sort(expected.begin(), expected.end());
+		std::sort(results.begin(), results.end());
+		ASSERT(expected == results);
+
+		results.clear();
+		proxies_.tree.raycastWide(&ray, maskBits, StopRaycast, &results);
+		ASSERT_EQ(expected.empty() ? 0u : 1u, results.size());
+	}
+	PASS();
+}
+
+// proxies whose fat box overlaps the box, found by brute force and by the tree.
+enum greatest_test_res
+CheckQueries(Proxies &proxies_)
+{
+	std::vector<int32_t> expected, results;
+	for (int query = 0; query < 50; ++query)
+	{
+		Box aabb = proxies_.randomBox(100.0f);
+		expected.clear();
+		results.clear();
+		for (int32_t id : proxies_.ids)
+		{
+			if (proxies_.tree.getFatAABB(id).overlaps(aabb)) expected.push_back(id);
+		}
+		proxies_.tree.queryFiltered(aabb, BVH::BVH_DefaultMask, CollectQuery, &results);
+		std::sort(expected.begin(), expected.end());
+		std::sort(results.begin(), results.end());
+		ASSERT(expected == results);
+	}
+	PASS();
+}
+
+// moveBatch() keeps the tree valid and the fat boxes around the proxies.
+enum greatest_test_res
+CheckMoveBatch(TaskScheduler *ts_)
+{
+	Proxies proxies;
+	proxies.add(5000);
+	std::vector<Box> boxes(proxies.ids.size());
+	for (size_t i = 0; i < boxes.size(); ++i)
+	{
+		boxes[i] = proxies.tree.getFatAABB(proxies.ids[i]);
+		proxies.tree.clearMoved(proxies.ids[i]);
+	}
+
+	std::uniform_real_distribution<float> step(-0.5f, 0.5f);
+	std::vector<int32_t> ids;
+	std::vector<Box> moves;
+	for (int round = 0; round < 10; ++round)
+	{
+		// most proxies drift a little, a few teleport
+		ids.clear();
+		moves.clear();
+		for (size_t i = round % 2; i < proxies.ids.size(); i += 2)
+		{
+			Box box = boxes[i];
+			if (proxies.rng() % 20 == 0) { box = proxies.randomBox(10.0f); }
+			else
+			{
+				glm::vec2 delta = {step(proxies.rng), step(proxies.rng)};
+				box.l = m::addv(box.l, delta);
+				box.u = m::addv(box.u, delta);
+			}
+			boxes[i] = box;
+			ids.push_back(proxies.ids[i]);
+			moves.push_back(box);
+		}
+
+		int32_t moved =
+		    proxies.tree.moveBatch(ids.data(), moves.data(), (int32_t)ids.size(), ts_);
+		proxies.tree.validate();
+
+		int32_t flagged = 0;
+		for (int32_t id : ids) flagged += proxies.tree.wasMoved(id) ? 1 : 0;
+		ASSERT_EQ(flagged, moved);
+		ASSERT(moved > 0);
+		for (size_t i = 0; i < proxies.ids.size(); ++i)
+		{
+			ASSERT(proxies.tree.getFatAABB(proxies.ids[i]).contains(boxes[i]));
+		}
+
+		CHECK_CALL(CheckQueries(proxies));
+		proxies.tree.updateWide(); // takes the refit bounds
+		CHECK_CALL(CheckSameResults(proxies));
+		for (int32_t id : ids) proxies.tree.clearMoved(id);
+	}
+	PASS();
+}
+
+} // namespace
+
+TEST
+test_wide_query()
+{
+	Proxies proxies;
+	proxies.tree.updateWide();
+	std::vector<int32_t> results;
+	proxies.tree.queryWide(proxies.randomBox(1000.0f), ~0u, CollectQuery, &results);
+	ASSERT(results.empty());
+
+	proxies.add(1);
+	proxies.tree.updateWide();
+	CHECK_CALL(CheckSameResults(proxies));
+
+	proxies.add(3000);
+	proxies.tree.updateWide();
+	CHECK_CALL(CheckSameResults(proxies));
+	PASS();
+}
+
+TEST
+test_wide_update()
+{
+	Proxies proxies;
+	proxies.add(2000);
+	proxies.tree.updateWide();
+
+	// moves within the fat boxes keep the topology, the wide tree is only refit.
+	proxies.tree.shiftOrigin({3.0f, -2.0f});
+	proxies.tree.updateWide();
+	CHECK_CALL(CheckSameResults(proxies));
+
+	for (int round = 0; round < 5; ++round)
+	{
+		for (uint32_t i = 0; i < 200; ++i)
+		{
+			int32_t id = proxies.ids[proxies.rng() % proxies.ids.size()];
+			proxies.tree.move(id, proxies.randomBox(10.0f));
+		}
+		for (uint32_t i = 0; i < 100; ++i)
+		{
+			uint32_t at = proxies.rng() % proxies.ids.size();
+			proxies.tree.remove(proxies.ids[at]);
+			proxies.ids[at] = proxies.ids.back();
+			proxies.ids.pop_back();
+		}
+		proxies.add(150);
+		proxies.tree.updateWide();
+		CHECK_CALL(CheckSameResults(proxies));
+	}
+
+	std::vector<BVH::ProxyMap> map(proxies.tree.getProxyCount());
+	proxies.tree.rebuildTopDownSAH(map.data(), (int32_t)map.size());
+	proxies.tree.updateWide();
+	CHECK_CALL(CheckSameResults(proxies));
+	PASS();
+}
+
+TEST
+test_visitor()
+{
+	Proxies proxies;
+	proxies.add(3000);
+	std::vector<int32_t> expected, results;
+	int32_t ids[8];
+	for (int query = 0; query < 200; ++query)
+	{
+		uint32_t maskBits = query % 2 ? (uint32_t)BVH::BVH_DefaultMask : 3u;
+		Box aabb = proxies.randomBox(100.0f);
+		expected.clear();
+		results.clear();
+		proxies.tree.queryFiltered(aabb, maskBits, CollectQuery, &expected);
+		proxies.tree.query(aabb, maskBits, [&](int32_t proxyId, void *userData) {
+			results.push_back(proxyId);
+			return userData != nullptr;
+		});
+		ASSERT(expected == results); // same traversal order
+
+		int32_t count = proxies.tree.queryIds(aabb, maskBits, ids, 8);
+		ASSERT_EQ(std::min<size_t>(expected.size(), 8), (size_t)count);
+		ASSERT(std::equal(ids, ids + count, expected.begin()));
+		ASSERT_EQ(!expected.empty(), proxies.tree.queryAny(aabb, maskBits));
+
+		BVH::RayCast ray;
+		Box ends = proxies.randomBox(400.0f);
+		ray.p1 = ends.l;
+		ray.p2 = ends.u;
+		ray.maxFraction = 1.0f;
+		expected.clear();
+		results.clear();
+		proxies.tree.raycast(&ray, maskBits, CollectRaycast, &expected);
+		auto collect = [&](const BVH::RayCast &input, int32_t proxyId, void *) {
+			results.push_back(proxyId);
+			return input.maxFraction;
+		};
+		proxies.tree.raycast(ray, maskBits, collect);
+		ASSERT(expected == results);
+	}
+
+	// early out
+	int32_t visited = 0;
+	proxies.tree.query(proxies.randomBox(1000.0f), BVH::BVH_DefaultMask, [&](int32_t, void *) {
+		return ++visited < 3;
+	});
+	ASSERT_EQ(3, visited);
+	PASS();
+}
+
+TEST
+test_move_batch()
+{
+	CHECK_CALL(CheckMoveBatch(nullptr));
+	CHECK_CALL(CheckMoveBatch(&g_TS));
+	PASS();
+}
+
+TEST
+test_rebuild()
+{
+	// the same tree with or without threads
+	Proxies serial, parallel;
+	serial.add(20000);
+	parallel.add(20000);
+	std::vector<BVH::ProxyMap> serialMap(20000), parallelMap(20000);
+	float insertedRatio = serial.tree.getAreaRatio();
+	serial.tree.rebuildTopDownSAH(serialMap.data(), 20000);
+	parallel.tree.rebuildTopDownSAH(parallelMap.data(), 20000, &g_TS);
+	ASSERT(serial.tree.getAreaRatio() < insertedRatio);
+	ASSERT_EQ(serial.tree.getAreaRatio(), parallel.tree.getAreaRatio());
+	ASSERT_EQ(serial.tree.getHeight(), parallel.tree.getHeight());
+	for (int32_t i = 0; i < 20000; ++i)
+	{
+		ASSERT_EQ(serialMap[i].userData, parallelMap[i].userData);
+		ASSERT_EQ(serialMap[i].userData, parallel.tree.getUserData(i));
+	}
+
+	Proxies empty;
+	empty.tree.rebuildTopDownSAH(nullptr, 0, &g_TS);
+	ASSERT_EQ(0, empty.tree.getHeight());
+	PASS();
+}
+
+TEST
+test_rebuild_incremental()
+{
+	Proxies proxies;
+	proxies.add(5000);
+	std::vector<void *> userData;
+	for (int32_t id : proxies.ids) userData.push_back(proxies.tree.getUserData(id));
+
+	// refits loosen the tree
+	std::uniform_real_distribution<float> step(-3.0f, 3.0f);
+	std::vector<Box> boxes(proxies.ids.size());
+	for (int frame = 0; frame < 20; ++frame)
+	{
+		for (size_t i = 0; i < boxes.size(); ++i)
+		{
+			Box box = proxies.tree.getFatAABB(proxies.ids[i]);
+			glm::vec2 delta = {step(proxies.rng), step(proxies.rng)};
+			box.l = m::addv(box.l, glm::vec2{0.1f, 0.1f} + delta);
+			box.u = m::addv(box.u, glm::vec2{-0.1f, -0.1f} + delta);
+			boxes[i] = box;
+		}
+		proxies.tree.moveBatch(
+		    proxies.ids.data(), boxes.data(), (int32_t)proxies.ids.size(), &g_TS);
+	}
+	float loose = proxies.tree.getAreaRatio();
+
+	// a few subtrees per call, the ids stay valid
+	int32_t rebuilt = 0;
+	for (int frame = 0; frame < 100; ++frame)
+	{
+		int32_t count = proxies.tree.rebuildIncremental(1000.0f, 4);
+		ASSERT(count > 0);
+		rebuilt += count;
+		proxies.tree.validate();
+	}
+	ASSERT(rebuilt > 0);
+	ASSERT(proxies.tree.getAreaRatio() < loose);
+	for (size_t i = 0; i < proxies.ids.size(); ++i)
+	{
+		ASSERT_EQ(userData[i], proxies.tree.getUserData(proxies.ids[i]));
+	}
+	CHECK_CALL(CheckQueries(proxies));
+
+	// a zero budget still rebuilds one subtree
+	ASSERT_EQ(1, proxies.tree.rebuildIncremental(0.0f));
+	proxies.tree.validate();
+	CHECK_CALL(CheckQueries(proxies));
+	PASS();
+}
+
+SUITE(the_suite)
+{
+	RUN_TEST(test_wide_query);
+	RUN_TEST(test_wide_update);
+	RUN_TEST(test_visitor);
+	RUN_TEST(test_move_batch);
+	RUN_TEST(test_rebuild);
+	RUN_TEST(test_rebuild_incremental);
+}
+
+GREATEST_MAIN_DEFS();
+
+int
+main(int argc, char **argv)
+{
+	GREATEST_MAIN_BEGIN();
+	g_TS.Initialize();
+	RUN_SUITE(the_suite);
+	g_TS.WaitforAllAndShutdown();
+	GREATEST_MAIN_END();
+}
@@ -0,0 +1,188 @@
+#include <vector>
+#include <random>
+#include <algorithm>
+#include "candybox/greatest.h"
+#include "candybox/GJK.hpp"
+#include "candybox/TaskScheduler.hpp"
+
+namespace {
+
+using namespace candybox;
+using namespace candybox::gjk;
+
+TaskScheduler g_TS;
+
+// Shapes of every type scattered over a small area, and the pairs of the types that have a
+// manifold function, sorted by type.
+struct Shapes
+{
+	std::vector<Circle> circles;
+	std::vector<Capsule> capsules;
+	std::vector<Segment> segments;
+	std::vector<Polygon> polygons;
+	std::vector<Xf2d> xfs;
+	std::vector<ManifoldPair> pairs;
+	std::mt19937 rng{5};
+
+	Xf2d randomXf()
+	{
+		std::uniform_real_distribution<float> position(-1.5f, 1.5f);
+		std::uniform_real_distribution<float> angle(-3.14f, 3.14f);
+		return Xf2d({position(rng), position(rng)}, Rot2d(angle(rng)));
+	}
+
+	explicit Shapes(int32_t count_)
+	{
+		std::uniform_real_distribution<float> size(0.2f, 1.0f);
+		std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+		for (int32_t i = 0; i < count_; ++i)
+		{
+			circles.push_back({{unit(rng) * 0.2f, unit(rng) * 0.2f}, size(rng)});
+			capsules.push_back({{-size(rng), 0.0f}, {size(rng), 0.0f}, size(rng) * 0.5f});
+			segments.push_back(Segment({-size(rng), unit(rng)}, {size(rng), unit(rng)}));
+			if (i % 3 == 0) { polygons.push_back(MakeBox(size(rng), size(rng))); }
+			else if (i % 3 == 1)
+			{
+				polygons.push_back(MakeRoundedBox(size(rng), size(rng), 0.1f));
+			}
+			else
+			{
+				// up to MAX_POLY_VERTS points on a circle
+				glm::vec2 points[MAX_POLY_VERTS];
+				int32_t pointCount = 3 + i % (MAX_POLY_VERTS - 2);
+				for (int32_t k = 0; k < pointCount; ++k)
+				{
+					float a = 6.28f * k / pointCount + unit(rng) * 0.2f;
+					points[k] = {m::cos(a) * size(rng), m::sin(a) * size(rng)};
+				}
+				Hull hull = ComputeHull(points, pointCount);
+				polygons.push_back(
+				    hull.count > 0 ? MakePolygon(&hull, 0.0f) : MakeSquare(0.5f));
+			}
+		}
+		for (int32_t i = 0; i < 8 * count_; ++i) xfs.push_back(randomXf());
+
+		const void *shapes[4] = {
+		    circles.data(), capsules.data(), segments.data(), polygons.data()};
+		size_t sizes[4] = {sizeof(Circle), sizeof(Capsule), sizeof(Segment), sizeof(Polygon)};
+		const ShapeType types[9][2] = {
+		    {ShapeType::kCircle, ShapeType::kCircle},
+		    {ShapeType::kCapsule, ShapeType::kCircle},
+		    {ShapeType::kSegment, ShapeType::kCircle},
+		    {ShapeType::kPolygon, ShapeType::kCircle},
+		    {ShapeType::kCapsule, ShapeType::kCapsule},
+		    {ShapeType::kSegment, ShapeType::kCapsule},
+		    {ShapeType::kPolygon, ShapeType::kCapsule},
+		    {ShapeType::kPolygon, ShapeType::kPolygon},
+		    {ShapeType::kSegment, ShapeType::kPolygon}};
+		std::uniform_int_distribution<int32_t> shape(0, count_ - 1);
+		std::uniform_int_distribution<int32_t> xf(0, (int32_t)xfs.size() - 1);
+		for (const auto &type : types)
+		{
+			// odd run lengths to leave unused SIMD lanes
+			for (int32_t i = 0; i < 4 * count_ + 3; ++i)
+			{
+				ManifoldPair pair;
+				pair.typeA = type[0];
+				pair.typeB = type[1];
+				pair.shapeA = (const char *)shapes[(int32_t)type[0]] +
+				              sizes[(int32_t)type[0]] * shape(rng);
+				pair.shapeB = (const char *)shapes[(int32_t)type[1]] +
+				              sizes[(int32_t)type[1]] * shape(rng);
+				pair.xfA = xfs[xf(rng)];
+				pair.xfB = xfs[xf(rng)];
+				pair.cache = nullptr;
+				pairs.push_back(pair);
+			}
+		}
+	}
+};
+
+// The manifolds of GJK_Batch() must be those of GJK_Collide(), every pair with its own cache.
+enum greatest_test_res
+CheckBatch(Shapes &shapes_, TaskScheduler *ts_)
+{
+	std::vector<ManifoldPair> &pairs = shapes_.pairs;
+	std::vector<DistanceCache> caches(pairs.size()), batchCaches(pairs.size());
+	std::vector<Manifold> expected(pairs.size()), manifolds(pairs.size());
+	const float maxd = 4.0f * LINEAR_SLOP;
+
+	for (size_t i = 0; i < pairs.size(); ++i)
+	{
+		pairs[i].cache = &caches[i];
+		expected[i] = GJK_Collide(&pairs[i], maxd);
+		pairs[i].cache = &batchCaches[i];
+	}
+	GJK_Batch(pairs.data(), (int32_t)pairs.size(), maxd, manifolds.data(), ts_);
+
+	int32_t touching = 0;
+	for (size_t i = 0; i < pairs.size(); ++i)
+	{
+		const Manifold &a = expected[i], &b = manifolds[i];
+		ASSERT_EQ(a.pointCount, b.pointCount);
+		touching += a.pointCount > 0 ? 1 : 0;
+		ASSERT_EQ(a.normal.x, b.normal.x);
+		ASSERT_EQ(a.normal.y, b.normal.y);
+		for (int32_t k = 0; k < a.pointCount; ++k)
+		{
+			ASSERT_EQ(a.points[k].point.x, b.points[k].point.x);
+			ASSERT_EQ(a.points[k].point.y, b.points[k].point.y);
+			ASSERT_EQ(a.points[k].separation, b.points[k].separation);
+			ASSERT_EQ(a.points[k].id, b.points[k].id);
+		}
+	}
+	// the scene is dense enough for most branches to be taken
+	ASSERT(touching > (int32_t)pairs.size() / 4);
+	ASSERT(touching < (int32_t)pairs.size());
+	PASS();
+}
+
+TEST
+test_batch()
+{
+	Shapes shapes(200);
+	CHECK_CALL(CheckBatch(shapes, nullptr));
+	CHECK_CALL(CheckBatch(shapes, &g_TS));
+
+	// runs shorter than the SIMD lanes
+	Shapes few(1);
+	CHECK_CALL(CheckBatch(few, nullptr));
+	GJK_Batch(nullptr, 0, 0.0f, nullptr, &g_TS);
+	PASS();
+}
+
+TEST
+test_coincident_circles()
+{
+	// the normal of concentric circles is zero, in the lanes as in GJK_Circles()
+	Circle circle = {{0.0f, 0.0f}, 1.0f};
+	ManifoldPair pair = {&circle, &circle, xf2d_identity, xf2d_identity, nullptr,
+	    ShapeType::kCircle, ShapeType::kCircle};
+	Manifold manifold;
+	GJK_Batch(&pair, 1, 0.0f, &manifold);
+	ASSERT_EQ(1, manifold.pointCount);
+	ASSERT_EQ(0.0f, manifold.normal.x);
+	ASSERT_EQ(0.0f, manifold.normal.y);
+	ASSERT_EQ(-2.0f, manifold.points[0].separation);
+	PASS();
+}
+
+} // namespace
+
+SUITE(the_suite)
+{
+	RUN_TEST(test_batch);
+	RUN_TEST(test_coincident_circles);
+}
+
+GREATEST_MAIN_DEFS();
+
+int
+main(int argc, char **argv)
+{
+	GREATEST_MAIN_BEGIN();
+	g_TS.Initialize();
+	RUN_SUITE(the_suite);
+	g_TS.WaitforAllAndShutdown();
+	GREATEST_MAIN_END();
+}
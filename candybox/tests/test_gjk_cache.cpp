@@ -0,0 +1,189 @@
+#include <cmath>
+#include "candybox/greatest.h"
+#include "candybox/GJKCache.hpp"
+
+namespace {
+
+using namespace candybox;
+using namespace candybox::gjk;
+
+DistanceProxy
+RegularPolygon(int32_t count_, float radius_)
+{
+	glm::vec2 points[MAX_POLY_VERTS];
+	for (int32_t i = 0; i < count_; ++i)
+	{
+		float a = 6.2831853f * i / count_;
+		points[i] = {radius_ * std::cos(a), radius_ * std::sin(a)};
+	}
+	return MakeProxy(points, count_, 0.0f);
+}
+
+DistanceInput
+Input(const DistanceProxy &proxyA_, const DistanceProxy &proxyB_, glm::vec2 pB_, float angle_)
+{
+	DistanceInput input;
+	input.proxyA = proxyA_;
+	input.proxyB = proxyB_;
+	input.transformA = xf2d_identity;
+	input.transformB = Xf2d(pB_, Rot2d(angle_));
+	input.useRadii = false;
+	return input;
+}
+
+TEST
+test_warm_start()
+{
+	DistanceCacheTable table;
+	DistanceProxy proxy = RegularPolygon(8, 1.0f);
+	int32_t coldIterations = 0, warmIterations = 0;
+	for (int32_t frame = 0; frame < 20; ++frame)
+	{
+		DistanceInput input = Input(proxy, proxy, {3.0f, 0.1f * frame}, 0.02f * frame);
+		DistanceCache cache;
+		DistanceOutput cold = ShapeDistance(&cache, &input);
+		DistanceOutput warm = table.distance(1, 2, &input);
+		ASSERT_IN_RANGE(cold.distance, warm.distance, 1e-5f);
+		coldIterations += cold.iterations;
+		warmIterations += warm.iterations;
+
+		// the axis goes from A to B
+		const DistanceCacheTable::Entry *entry = table.find(1, 2);
+		ASSERT(entry != nullptr);
+		ASSERT_IN_RANGE(1.0f, m::lenv(entry->axis), 1e-5f);
+		ASSERT(entry->axis.x > 0.0f);
+		table.nextFrame();
+	}
+	ASSERT(warmIterations < coldIterations);
+	ASSERT_EQ(1u, table.size());
+	ASSERT(table.find(2, 1) == nullptr);
+	PASS();
+}
+
+TEST
+test_early_out()
+{
+	DistanceCacheTable table;
+	DistanceProxy proxy = RegularPolygon(6, 1.0f);
+	DistanceInput input = Input(proxy, proxy, {10.0f, 1.0f}, 0.2f);
+	DistanceCache cache;
+	DistanceOutput exact = ShapeDistance(&cache, &input);
+	ASSERT(table.distance(1, 2, &input, 1.0f).iterations > 0); // no axis yet
+
+	// the shapes moved a bit, the last axis still separates them by more than 1
+	input = Input(proxy, proxy, {10.0f, 1.5f}, 0.4f);
+	cache.count = 0;
+	exact = ShapeDistance(&cache, &input);
+	DistanceOutput bound = table.distance(1, 2, &input, 1.0f);
+	ASSERT_EQ(0, bound.iterations);
+	ASSERT(bound.distance > 1.0f);
+	ASSERT(bound.distance <= exact.distance + 1e-5f);
+	ASSERT_IN_RANGE(bound.distance, m::distv(bound.pointA, bound.pointB), 1.0f);
+
+	// within range GJK runs
+	DistanceOutput full = table.distance(1, 2, &input, 20.0f);
+	ASSERT(full.iterations > 0);
+	ASSERT_IN_RANGE(exact.distance, full.distance, 1e-5f);
+
+	// with the radii, and no early out once the shapes overlap
+	input.useRadii = true;
+	input.proxyA.radius = input.proxyB.radius = 0.25f;
+	bound = table.distance(1, 2, &input, 1.0f);
+	ASSERT_EQ(0, bound.iterations);
+	ASSERT(bound.distance <= exact.distance - 0.5f + 1e-5f);
+	input = Input(proxy, proxy, {1.0f, 0.0f}, 0.0f);
+	ASSERT_EQ(0.0f, table.distance(1, 2, &input, 1.0f).distance);
+	ASSERT_EQ(0.0f, m::lenv(table.find(1, 2)->axis));
+	ASSERT_EQ(0.0f, table.distance(1, 2, &input, -1.0f).distance);
+	PASS();
+}
+
+TEST
+test_eviction()
+{
+	DistanceCacheTable table;
+	DistanceProxy proxy = RegularPolygon(4, 1.0f);
+	DistanceInput input = Input(proxy, proxy, {3.0f, 0.0f}, 0.0f);
+	table.distance(1, 2, &input);
+	table.distance(1, 3, &input);
+	ASSERT_EQ(0u, table.nextFrame(2));
+	table.distance(1, 3, &input);
+	ASSERT_EQ(0u, table.nextFrame(2));
+	ASSERT_EQ(1u, table.nextFrame(2));
+	ASSERT(table.find(1, 2) == nullptr);
+	ASSERT(table.find(1, 3) != nullptr);
+	ASSERT_EQ(1u, table.nextFrame(2));
+	ASSERT_EQ(0u, table.size());
+	ASSERT_EQ(4u, table.frame());
+
+	table.distance(1, 2, &input);
+	table.remove(1, 2);
+	ASSERT_EQ(0u, table.size());
+	PASS();
+}
+
+TEST
+test_changed_shape()
+{
+	// the cache of an octagon does not fit a triangle under the same id
+	DistanceCacheTable table;
+	DistanceProxy octagon = RegularPolygon(8, 1.0f);
+	DistanceProxy triangle = RegularPolygon(3, 1.0f);
+	DistanceInput input = Input(octagon, octagon, {-0.5f, 3.0f}, 0.3f);
+	table.distance(1, 2, &input);
+	ASSERT(table.find(1, 2)->cache.indexB[0] >= 3);
+
+	input = Input(triangle, triangle, {-0.5f, 3.0f}, 0.3f);
+	DistanceCache cache;
+	DistanceOutput cold = ShapeDistance(&cache, &input);
+	DistanceOutput warm = table.distance(1, 2, &input);
+	ASSERT_IN_RANGE(cold.distance, warm.distance, 1e-5f);
+	PASS();
+}
+
+TEST
+test_time_of_impact()
+{
+	DistanceCacheTable table;
+	TOIInput input;
+	input.proxyA = RegularPolygon(6, 0.5f);
+	input.proxyB = RegularPolygon(5, 0.5f);
+	input.sweepA = {{0.0f, 0.0f}, {0.0f, 0.0f}, {0.0f, 0.0f}, 0.0f, 0.0f};
+	input.tMax = 1.0f;
+	for (int32_t frame = 0; frame < 10; ++frame)
+	{
+		// B falls from further away every frame and hits A
+		float y = 2.0f + 0.1f * frame;
+		float angle = 0.1f * frame;
+		input.sweepB = {{0.0f, 0.0f}, {0.2f, y}, {0.2f, -y}, angle, angle + 0.5f};
+		TOIOutput cold = TimeOfImpact(&input);
+		TOIOutput warm = table.timeOfImpact(3, 4, &input);
+		ASSERT_EQ(TOIState::kHit, cold.state);
+		ASSERT_EQ(cold.state, warm.state);
+		ASSERT_IN_RANGE(cold.t, warm.t, 1e-4f);
+		table.nextFrame();
+	}
+	ASSERT(table.find(3, 4)->cache.count > 0);
+	PASS();
+}
+
+} // namespace
+
+SUITE(the_suite)
+{
+	RUN_TEST(test_warm_start);
+	RUN_TEST(test_early_out);
+	RUN_TEST(test_eviction);
+	RUN_TEST(test_changed_shape);
+	RUN_TEST(test_time_of_impact);
+}
+
+GREATEST_MAIN_DEFS();
+
+int
+main(int argc, char **argv)
+{
+	GREATEST_MAIN_BEGIN();
+	RUN_SUITE(the_suite);
+	GREATEST_MAIN_END();
+}
@@ -0,0 +1,129 @@
+#include <thread>
+#include <vector>
+#include "candybox/greatest.h"
+#include "candybox/LockLessMPMCQueue.hpp"
+
+namespace {
+
+using namespace candybox;
+
+const uint32_t cNumThreads = 4;
+const uint32_t cItemsPerWriter = 50000;
+
+// Every writer writes (writer << 24) | i for i in [0, cItemsPerWriter), checks every item
+// is read once and the items of each writer are read in order.
+template <typename Queue, typename Write>
+static enum greatest_test_res
+check_contention(Queue& queue_, Write write_)
+{
+	std::vector<uint8_t> seen(cNumThreads * cItemsPerWriter, 0);
+	std::atomic<uint32_t> numRead = {0};
+	std::atomic<uint32_t> numErrors = {0};
+	std::vector<std::thread> threads;
+	for (uint32_t writer = 0; writer < cNumThreads; ++writer)
+	{
+		threads.emplace_back([&, writer]() {
+			for (uint32_t i = 0; i < cItemsPerWriter; ++i) { write_((writer << 24) | i); }
+		});
+	}
+	for (uint32_t reader = 0; reader < cNumThreads; ++reader)
+	{
+		threads.emplace_back([&]() {
+			std::vector<uint32_t> last(cNumThreads, 0xFFFFFFFF);
+			uint32_t value;
+			while (numRead.load() < cNumThreads * cItemsPerWriter)
+			{
+				if (!queue_.TryReadFront(&value))
+				{
+					std::this_thread::yield();
+					continue;
+				}
+				uint32_t writer = value >> 24;
+				uint32_t i = value & 0xFFFFFF;
+				if (last[writer] != 0xFFFFFFFF && i <= last[writer]) { ++numErrors; }
+				last[writer] = i;
+				seen[writer * cItemsPerWriter + i]++;
+				numRead.fetch_add(1);
+			}
+		});
+	}
+	for (std::thread& thread : threads) { thread.join(); }
+
+	ASSERT_EQ(0, numErrors.load());
+	for (uint8_t count : seen) { ASSERT_EQ(1, count); }
+	ASSERT(queue_.IsQueueEmpty());
+	PASS();
+}
+
+} // namespace
+
+TEST
+test_mpmc_queue()
+{
+	LockLessMPMCQueue<4, uint32_t> queue;
+	uint32_t value;
+	ASSERT(queue.IsQueueEmpty());
+	ASSERT_FALSE(queue.TryReadFront(&value));
+
+	// wrap around the ring a few times
+	for (uint32_t lap = 0; lap < 3; ++lap)
+	{
+		for (uint32_t i = 0; i < 16; ++i) { ASSERT(queue.TryWriteBack(i)); }
+		ASSERT_FALSE(queue.TryWriteBack(16)); // full
+		for (uint32_t i = 0; i < 16; ++i)
+		{
+			ASSERT(queue.TryReadFront(&value));
+			ASSERT_EQ(i, value);
+		}
+		ASSERT_FALSE(queue.TryReadFront(&value));
+	}
+
+	LockLessMPMCQueue<8, uint32_t> contended;
+	CHECK_CALL(check_contention(contended, [&](uint32_t value_) {
+		while (!contended.TryWriteBack(value_)) { std::this_thread::yield(); }
+	}));
+	PASS();
+}
+
+TEST
+test_segmented_queue()
+{
+	LockLessSegmentedQueue<uint32_t, 4> queue;
+	uint32_t value;
+	ASSERT(queue.IsQueueEmpty());
+	ASSERT_FALSE(queue.TryReadFront(&value));
+
+	// spans several segments, and freed segments are replaced
+	for (uint32_t run = 0; run < 3; ++run)
+	{
+		for (uint32_t i = 0; i < 100; ++i) { queue.WriteBack(i); }
+		ASSERT_FALSE(queue.IsQueueEmpty());
+		for (uint32_t i = 0; i < 100; ++i)
+		{
+			ASSERT(queue.TryReadFront(&value));
+			ASSERT_EQ(i, value);
+		}
+		ASSERT_FALSE(queue.TryReadFront(&value));
+		ASSERT(queue.IsQueueEmpty());
+	}
+
+	LockLessSegmentedQueue<uint32_t, 6> contended;
+	CHECK_CALL(check_contention(contended, [&](uint32_t value_) { contended.WriteBack(value_); }));
+	PASS();
+}
+
+SUITE(the_suite)
+{
+	RUN_TEST(test_mpmc_queue);
+	RUN_TEST(test_segmented_queue);
+}
+
+GREATEST_MAIN_DEFS();
+
+int
+main(int argc, char **argv)
+{
+	GREATEST_MAIN_BEGIN();
+	RUN_SUITE(the_suite);
+	GREATEST_MAIN_END();
+}
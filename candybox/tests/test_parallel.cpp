@@ -0,0 +1,133 @@
+#include <vector>
+#include <random>
+#include <algorithm>
+#include "candybox/greatest.h"
+#include "candybox/Parallel.hpp"
+
+namespace {
+
+using namespace candybox;
+
+TaskScheduler g_TS;
+
+} // namespace
+
+TEST
+test_for()
+{
+	std::vector<uint32_t> values(100000, 0);
+	parallel_for(g_TS, 10, (uint32_t)values.size(), [&](uint32_t i) { values[i] = i * 2; }, 256);
+	for (uint32_t i = 0; i < values.size(); ++i) ASSERT_EQ(i < 10 ? 0 : i * 2, values[i]);
+	PASS();
+}
+
+TEST
+test_reduce()
+{
+	uint64_t sum = parallel_reduce(
+	    g_TS, 0, 1000000, (uint64_t)0, [](uint32_t i) { return (uint64_t)i; },
+	    [](uint64_t a, uint64_t b) { return a + b; });
+	ASSERT_EQ((uint64_t)999999 * 1000000 / 2, sum);
+
+	// float results only depend on the block size
+	std::vector<float> values(50000);
+	std::mt19937 rng(7);
+	std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+	for (float &v : values) v = dist(rng);
+	auto map = [&](uint32_t i) { return values[i]; };
+	auto add = [](float a, float b) { return a + b; };
+	float first = parallel_reduce(g_TS, 0, (uint32_t)values.size(), 0.0f, map, add, 512);
+	for (int run = 0; run < 10; ++run)
+	{
+		ASSERT_EQ(first, parallel_reduce(g_TS, 0, (uint32_t)values.size(), 0.0f, map, add, 512));
+	}
+	PASS();
+}
+
+TEST
+test_scan()
+{
+	const uint32_t count = 100003;
+	std::vector<uint32_t> in(count), inclusive(count), exclusive(count);
+	for (uint32_t i = 0; i < count; ++i) in[i] = i % 7;
+	auto add = [](uint32_t a, uint32_t b) { return a + b; };
+	parallel_inclusive_scan(g_TS, in.data(), inclusive.data(), count, 0u, add, 1000);
+	parallel_exclusive_scan(g_TS, in.data(), exclusive.data(), count, 0u, add, 1000);
+
+	uint32_t acc = 0;
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		ASSERT_EQ(acc, exclusive[i]);
+		acc += in[i];
+		ASSERT_EQ(acc, inclusive[i]);
+	}
+
+	// in place
+	parallel_inclusive_scan(g_TS, in.data(), in.data(), count, 0u, add, 1000);
+	ASSERT(in == inclusive);
+	PASS();
+}
+
+template <typename Key>
+static enum greatest_test_res
+check_radix_sort(Key mask)
+{
+	const uint32_t count = 200000;
+	std::mt19937_64 rng(11);
+	std::vector<Key> keys(count);
+	std::vector<uint32_t> values(count);
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		keys[i] = (Key)rng() & mask;
+		values[i] = i;
+	}
+	std::vector<std::pair<Key, uint32_t> > expected(count);
+	for (uint32_t i = 0; i < count; ++i) expected[i] = std::make_pair(keys[i], values[i]);
+	std::stable_sort(
+	    expected.begin(), expected.end(),
+	    [](const std::pair<Key, uint32_t> &a, const std::pair<Key, uint32_t> &b) {
+		    return a.first < b.first;
+	    });
+
+	parallel_radix_sort(g_TS, keys.data(), values.data(), count);
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		ASSERT_EQ(expected[i].first, keys[i]);
+		ASSERT_EQ(expected[i].second, values[i]); // stable
+	}
+
+	std::vector<Key> keysOnly(count);
+	for (uint32_t i = 0; i < count; ++i) keysOnly[i] = (Key)rng() & mask;
+	parallel_radix_sort(g_TS, keysOnly.data(), count);
+	ASSERT(std::is_sorted(keysOnly.begin(), keysOnly.end()));
+	PASS();
+}
+
+TEST
+test_radix_sort()
+{
+	CHECK_CALL(check_radix_sort<uint32_t>(0xFFFFFFFFu));
+	CHECK_CALL(check_radix_sort<uint32_t>(0x00FF0F00u)); // skips passes
+	CHECK_CALL(check_radix_sort<uint64_t>(~(uint64_t)0));
+	PASS();
+}
+
+SUITE(the_suite)
+{
+	RUN_TEST(test_for);
+	RUN_TEST(test_reduce);
+	RUN_TEST(test_scan);
+	RUN_TEST(test_radix_sort);
+}
+
+GREATEST_MAIN_DEFS();
+
+int
+main(int argc, char **argv)
+{
+	GREATEST_MAIN_BEGIN();
+	g_TS.Initialize();
+	RUN_SUITE(the_suite);
+	g_TS.WaitforAllAndShutdown();
+	GREATEST_MAIN_END();
+}
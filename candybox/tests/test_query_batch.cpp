@@ -0,0 +1,128 @@
+#include <vector>
+#include "candybox/greatest.h"
+#include "candybox/QueryBatch.hpp"
+
+namespace {
+
+using namespace candybox;
+
+TaskScheduler g_TS;
+
+// a line of sight style query against a height field shared by the task threads
+struct Ray
+{
+	int32_t from, to;
+};
+
+struct Hit
+{
+	int32_t index = -1;
+};
+
+void
+FirstAbove(const Ray &ray_, Hit *hit_, void *context_)
+{
+	const std::vector<int32_t> &heights = *static_cast<std::vector<int32_t> *>(context_);
+	hit_->index = -1;
+	for (int32_t i = ray_.from; i < ray_.to; ++i)
+	{
+		if (heights[i] > 0)
+		{
+			hit_->index = i;
+			return;
+		}
+	}
+}
+
+} // namespace
+
+TEST
+test_latency()
+{
+	std::vector<int32_t> heights(64, 0);
+	heights[10] = heights[40] = 1;
+	QueryBatch<Ray, Hit> batch(FirstAbove, &heights, 1);
+
+	int32_t first = batch.enqueue({0, 64});
+	int32_t second = batch.enqueue({11, 30});
+	ASSERT_EQ(0, first);
+	ASSERT_EQ(1, second);
+	ASSERT(batch.result(first) == nullptr);
+
+	batch.launch(g_TS);
+	ASSERT(batch.isLaunched());
+	int32_t third = batch.enqueue({20, 64}); // goes to the next batch
+	ASSERT_EQ(0, third);
+	ASSERT(batch.result(first) == nullptr);
+
+	batch.finish(g_TS);
+	ASSERT_EQ(10, batch.result(first)->index);
+	ASSERT_EQ(-1, batch.result(second)->index);
+	ASSERT(batch.result(2) == nullptr);
+
+	// results stay until the next finish(), wait() does not take the new ones
+	batch.launch(g_TS);
+	batch.wait(g_TS);
+	ASSERT_EQ(10, batch.result(first)->index);
+	batch.finish(g_TS);
+	ASSERT_EQ(40, batch.result(third)->index);
+	ASSERT_EQ(1u, batch.results().size());
+
+	// an empty batch clears the results
+	batch.launch(g_TS);
+	batch.finish(g_TS);
+	ASSERT(batch.result(third) == nullptr);
+	batch.finish(g_TS);
+	PASS();
+}
+
+TEST
+test_frames()
+{
+	std::vector<int32_t> heights(4096, 0);
+	for (size_t i = 0; i < heights.size(); i += 7) heights[i] = 1;
+	QueryBatch<Ray, Hit> batch(FirstAbove, &heights);
+
+	const int32_t numQueries = 3000;
+	for (int32_t frame = 0; frame < 10; ++frame)
+	{
+		batch.finish(g_TS);
+		if (frame > 0)
+		{
+			// the queries of the previous frame
+			ASSERT_EQ((size_t)numQueries, batch.results().size());
+			for (int32_t i = 0; i < numQueries; ++i)
+			{
+				int32_t from = (i * 13 + frame - 1) % 4000;
+				int32_t expected = (from + 6) / 7 * 7;
+				ASSERT_EQ(expected, batch.result(i)->index);
+			}
+		}
+
+		for (int32_t i = 0; i < numQueries; ++i)
+			batch.enqueue({(i * 13 + frame) % 4000, (i * 13 + frame) % 4000 + 64});
+		ASSERT_EQ(numQueries, batch.pendingCount());
+		batch.launch(g_TS);
+		ASSERT_EQ(0, batch.pendingCount());
+	}
+	batch.finish(g_TS);
+	PASS();
+}
+
+SUITE(the_suite)
+{
+	RUN_TEST(test_latency);
+	RUN_TEST(test_frames);
+}
+
+GREATEST_MAIN_DEFS();
+
+int
+main(int argc, char **argv)
+{
+	GREATEST_MAIN_BEGIN();
+	g_TS.Initialize();
+	RUN_SUITE(the_suite);
+	g_TS.WaitforAllAndShutdown();
+	GREATEST_MAIN_END();
+}
@@ -0,0 +1,175 @@
+#include <vector>
+#include <random>
+#include "candybox/greatest.h"
+#include "candybox/ShapeSweep.hpp"
+#include "candybox/TaskScheduler.hpp"
+
+namespace {
+
+using namespace candybox;
+using namespace candybox::gjk;
+
+TaskScheduler g_TS;
+
+// Static boxes of random sizes in a BVH, the user data of a proxy is its index + 1.
+struct World
+{
+	BVH tree;
+	std::vector<Polygon> boxes;
+	std::vector<Xf2d> xfs;
+	std::vector<int32_t> ids;
+	std::mt19937 rng{7};
+
+	explicit World(int32_t count_)
+	{
+		std::uniform_real_distribution<float> position(-50.0f, 50.0f);
+		std::uniform_real_distribution<float> size(0.2f, 2.0f);
+		std::uniform_real_distribution<float> angle(-3.14f, 3.14f);
+		for (int32_t i = 0; i < count_; ++i)
+		{
+			boxes.push_back(MakeBox(size(rng), size(rng)));
+			xfs.push_back(Xf2d({position(rng), position(rng)}, Rot2d(angle(rng))));
+			Box aabb = ComputePolygonAABB(&boxes.back(), xfs.back());
+			uint32_t categoryBits = i % 4 == 0 ? 2u : 1u;
+			ids.push_back(tree.add(aabb, categoryBits, (void *)(uintptr_t)(i + 1)));
+		}
+	}
+
+	static bool Shape(int32_t, void *userData_, DistanceProxy *proxy_, Sweep *sweep_,
+	    void *context_)
+	{
+		World *world = static_cast<World *>(context_);
+		size_t index = (uintptr_t)userData_ - 1;
+		const Polygon &box = world->boxes[index];
+		const Xf2d &xf = world->xfs[index];
+		*proxy_ = MakeProxy(box.vertices, box.count, box.radius);
+		sweep_->localCenter = {0.0f, 0.0f};
+		sweep_->c1 = sweep_->c2 = xf.p;
+		sweep_->a1 = sweep_->a2 = xf.q.getAngle();
+		return true;
+	}
+
+	// a small spinning box or a round bullet crossing the world.
+	SweepInput projectile()
+	{
+		std::uniform_real_distribution<float> position(-60.0f, 60.0f);
+		std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+		SweepInput input;
+		if (rng() % 2)
+		{
+			Polygon box = MakeOffsetBox(0.2f, 0.1f, {0.05f, 0.0f}, 0.0f);
+			input.proxy = MakeProxy(box.vertices, box.count, 0.0f);
+		}
+		else
+		{
+			glm::vec2 point = {0.0f, 0.0f};
+			input.proxy = MakeProxy(&point, 1, 0.1f);
+		}
+		input.sweep.localCenter = {0.05f * unit(rng), 0.0f};
+		input.sweep.c1 = {position(rng), position(rng)};
+		input.sweep.c2 = {input.sweep.c1.x + 40.0f * unit(rng),
+		    input.sweep.c1.y + 40.0f * unit(rng)};
+		input.sweep.a1 = 3.0f * unit(rng);
+		input.sweep.a2 = input.sweep.a1 + unit(rng);
+		input.tMax = 1.0f;
+		input.maskBits = 1u;
+		return input;
+	}
+
+	// the earliest time of impact against every box of the mask, -1 if none.
+	float bruteForce(const SweepInput &input_)
+	{
+		float best = -1.0f;
+		for (size_t i = 0; i < boxes.size(); ++i)
+		{
+			if ((i % 4 == 0 ? 2u : 1u) & ~input_.maskBits) { continue; }
+
+			TOIInput toiInput;
+			toiInput.proxyA = input_.proxy;
+			toiInput.sweepA = input_.sweep;
+			void *userData = (void *)(uintptr_t)(i + 1);
+			Shape(ids[i], userData, &toiInput.proxyB, &toiInput.sweepB, this);
+			toiInput.tMax = input_.tMax;
+			TOIOutput output = TimeOfImpact(&toiInput);
+			if (output.state == TOIState::kSeparated) { continue; }
+
+			float t = output.state == TOIState::kOverlapped ? 0.0f : output.t;
+			if (best < 0.0f || t < best) { best = t; }
+		}
+		return best;
+	}
+};
+
+TEST
+test_earliest_hit()
+{
+	World world(500);
+	int32_t numHits = 0;
+	for (int32_t i = 0; i < 200; ++i)
+	{
+		SweepInput input = world.projectile();
+		SweepHit hit = ShapeSweep(world.tree, &input, World::Shape, &world);
+		float expected = world.bruteForce(input);
+		if (expected < 0.0f)
+		{
+			ASSERT_EQ(BVH::BVH_NullIndex, hit.proxyId);
+			continue;
+		}
+
+		++numHits;
+		ASSERT(hit.proxyId != BVH::BVH_NullIndex);
+		ASSERT_IN_RANGE(expected, hit.t, 1e-3f);
+		if (hit.state == TOIState::kHit)
+		{
+			// the normal points from the box to the projectile, whose center is on that side
+			Xf2d xf = GetSweepTransform(&input.sweep, hit.t);
+			glm::vec2 center = TransformPoint(xf, input.sweep.localCenter);
+			ASSERT_IN_RANGE(1.0f, m::lenv(hit.normal), 1e-4f);
+			ASSERT(m::dotv(m::subv(center, hit.point), hit.normal) > 0.0f);
+		}
+	}
+	ASSERT(numHits > 50);
+	PASS();
+}
+
+TEST
+test_batch()
+{
+	World world(500);
+	std::vector<SweepInput> inputs;
+	for (int32_t i = 0; i < 300; ++i) inputs.push_back(world.projectile());
+	std::vector<SweepHit> hits(inputs.size()), parallelHits(inputs.size());
+	ShapeSweepBatch(world.tree, inputs.data(), (int32_t)inputs.size(), hits.data(),
+	    World::Shape, &world);
+	ShapeSweepBatch(world.tree, inputs.data(), (int32_t)inputs.size(), parallelHits.data(),
+	    World::Shape, &world, &g_TS);
+	for (size_t i = 0; i < inputs.size(); ++i)
+	{
+		SweepHit hit = ShapeSweep(world.tree, &inputs[i], World::Shape, &world);
+		ASSERT_EQ(hit.proxyId, hits[i].proxyId);
+		ASSERT_EQ(hit.t, hits[i].t);
+		ASSERT_EQ(hit.proxyId, parallelHits[i].proxyId);
+		ASSERT_EQ(hit.t, parallelHits[i].t);
+	}
+	PASS();
+}
+
+} // namespace
+
+SUITE(the_suite)
+{
+	RUN_TEST(test_earliest_hit);
+	RUN_TEST(test_batch);
+}
+
+GREATEST_MAIN_DEFS();
+
+int
+main(int argc, char **argv)
+{
+	GREATEST_MAIN_BEGIN();
+	g_TS.Initialize();
+	RUN_SUITE(the_suite);
+	g_TS.WaitforAllAndShutdown();
+	GREATEST_MAIN_END();
+}
@@ -0,0 +1,151 @@
+#include <vector>
+#include "candybox/greatest.h"
+#include "candybox/SnapshotBuffer.hpp"
+#include "candybox/TaskScheduler.hpp"
+
+namespace {
+
+using namespace candybox;
+
+TaskScheduler g_TS;
+
+// a fixed step simulation of bodies falling at a constant speed
+struct StepTask : public ITaskSet
+{
+	void ExecuteRange(TaskSetPartition, uint32_t) override
+	{
+		for (int32_t i = 0; i < numSteps; ++i) ++step;
+		std::vector<float> &state = snapshots->back();
+		state.resize(1000);
+		for (size_t i = 0; i < state.size(); ++i) state[i] = (float)(step * (i + 1));
+	}
+
+	SnapshotBuffer<std::vector<float>> *snapshots = nullptr;
+	int32_t numSteps = 0;
+	int32_t step = 0;
+};
+
+// the state before and after the last step of a frame, which the renderer blends by an
+// alpha covering one step
+struct LastStep
+{
+	float before = 0.0f;
+	float after = 0.0f;
+};
+
+struct LastStepTask : public ITaskSet
+{
+	void ExecuteRange(TaskSetPartition, uint32_t) override
+	{
+		LastStep &state = snapshots->back();
+		for (int32_t i = 0; i < numSteps; ++i)
+		{
+			if (i == numSteps - 1) { state.before = position; }
+			position += 0.5f * (float)++step; // accelerates, steps are not alike
+		}
+		if (numSteps > 0) { state.after = position; }
+	}
+
+	SnapshotBuffer<LastStep> *snapshots = nullptr;
+	int32_t numSteps = 0;
+	int32_t step = 0;
+	float position = 0.0f;
+};
+
+} // namespace
+
+TEST
+test_rotation()
+{
+	SnapshotBuffer<int32_t> snapshots;
+	ASSERT_EQ(0u, snapshots.count());
+	snapshots.back() = 1;
+	snapshots.publish();
+	ASSERT_EQ(1, snapshots.previous());
+	ASSERT_EQ(1, snapshots.current());
+	for (int32_t i = 2; i < 10; ++i)
+	{
+		int32_t *back = &snapshots.back();
+		ASSERT(back != &snapshots.previous());
+		ASSERT(back != &snapshots.current());
+		*back = i;
+		snapshots.publish();
+		ASSERT_EQ(i - 1, snapshots.previous());
+		ASSERT_EQ(i, snapshots.current());
+	}
+	ASSERT_EQ(9u, snapshots.count());
+	PASS();
+}
+
+TEST
+test_pipelined_steps()
+{
+	// the main thread reads the last two states while the next step runs on a task thread
+	SnapshotBuffer<std::vector<float>> snapshots;
+	StepTask task;
+	task.snapshots = &snapshots;
+	for (int32_t frame = 0; frame < 100; ++frame)
+	{
+		g_TS.WaitforTask(&task);
+		if (frame > 0) { snapshots.publish(); }
+
+		int32_t lastStep = task.step;
+		task.numSteps = 1 + frame % 3;
+		g_TS.AddTaskSetToPipe(&task);
+
+		if (snapshots.count() < 2) { continue; }
+
+		const std::vector<float> &previous = snapshots.previous();
+		const std::vector<float> &current = snapshots.current();
+		ASSERT_EQ((float)lastStep, current[0]);
+		ASSERT(previous[0] < current[0]);
+		for (size_t i = 0; i < current.size(); ++i)
+			ASSERT_EQ(current[0] * (i + 1), current[i]);
+	}
+	g_TS.WaitforTask(&task);
+	PASS();
+}
+
+TEST
+test_several_steps_per_frame()
+{
+	// frames of 0 to 3 steps, the published pair is always one step apart
+	SnapshotBuffer<LastStep> snapshots;
+	LastStepTask task;
+	task.snapshots = &snapshots;
+	for (int32_t frame = 0; frame < 100; ++frame)
+	{
+		g_TS.WaitforTask(&task);
+		if (task.numSteps > 0) { snapshots.publish(); }
+
+		int32_t lastStep = task.step;
+		task.numSteps = frame % 4;
+		g_TS.AddTaskSetToPipe(&task);
+
+		if (snapshots.count() == 0) { continue; }
+
+		const LastStep &current = snapshots.current();
+		ASSERT_EQ(0.5f * (float)lastStep, current.after - current.before);
+	}
+	g_TS.WaitforTask(&task);
+	PASS();
+}
+
+SUITE(the_suite)
+{
+	RUN_TEST(test_rotation);
+	RUN_TEST(test_pipelined_steps);
+	RUN_TEST(test_several_steps_per_frame);
+}
+
+GREATEST_MAIN_DEFS();
+
+int
+main(int argc, char **argv)
+{
+	GREATEST_MAIN_BEGIN();
+	g_TS.Initialize();
+	RUN_SUITE(the_suite);
+	g_TS.WaitforAllAndShutdown();
+	GREATEST_MAIN_END();
+}
@@ -0,0 +1,134 @@
+#include <memory>
+#include <vector>
+#include "candybox/greatest.h"
+#include "candybox/TaskScheduler.hpp"
+
+#if IE_TS_AFFINITY_SUPPORTED
+#	include <sched.h>
+#endif
+
+namespace {
+
+using namespace candybox;
+
+// records the cpu the thread it is pinned to runs on
+struct CpuPinnedTask : public IPinnedTask
+{
+	CpuPinnedTask(uint32_t threadNum_) : IPinnedTask(threadNum_) { }
+
+	void Execute() override
+	{
+#if IE_TS_AFFINITY_SUPPORTED
+		m_Cpu = (uint32_t)sched_getcpu();
+#endif
+	}
+
+	uint32_t m_Cpu = NO_CPU;
+};
+
+struct SumTask : public ITaskSet
+{
+	SumTask() : ITaskSet(100000, 100) { }
+
+	void ExecuteRange(TaskSetPartition range_, uint32_t threadnum_) override
+	{
+		(void)threadnum_;
+		uint64_t sum = 0;
+		for (uint32_t i = range_.start; i < range_.end; ++i) { sum += i; }
+		m_Sum.fetch_add(sum, std::memory_order_relaxed);
+	}
+
+	std::atomic<uint64_t> m_Sum = {0};
+};
+
+enum greatest_test_res
+check_pinned(const TaskSchedulerConfig& config_)
+{
+	TaskScheduler ts;
+	ts.Initialize(config_);
+	ASSERT_EQ(NO_CPU, ts.GetThreadCpu(0)); // the initializing thread is not pinned
+
+	std::vector<std::unique_ptr<CpuPinnedTask> > tasks;
+	for (uint32_t thread = 0; thread < ts.GetNumTaskThreads(); ++thread)
+	{
+		tasks.emplace_back(new CpuPinnedTask(thread));
+		ts.AddPinnedTask(tasks.back().get());
+	}
+	ts.RunPinnedTasks();
+	for (auto& task : tasks) { ts.WaitforTask(task.get()); }
+	for (uint32_t thread = 1; thread < ts.GetNumTaskThreads(); ++thread)
+	{
+		ASSERT(NO_CPU != ts.GetThreadCpu(thread));
+		ASSERT_EQ(ts.GetThreadCpu(thread), tasks[thread]->m_Cpu);
+	}
+
+	// stealing still finds all the work
+	for (uint32_t run = 0; run < 100; ++run)
+	{
+		SumTask task;
+		ts.AddTaskSetToPipe(&task);
+		ts.WaitforTask(&task);
+		ASSERT_EQ((uint64_t)99999 * 100000 / 2, task.m_Sum.load());
+	}
+	ts.WaitforAllAndShutdown();
+	PASS();
+}
+
+} // namespace
+
+TEST
+test_topology()
+{
+	uint32_t numCpus = GetCpuTopology(nullptr, 0);
+#if IE_TS_AFFINITY_SUPPORTED
+	ASSERT(numCpus > 0);
+#endif
+	std::vector<CpuInfo> cpus(numCpus);
+	ASSERT_EQ(numCpus, GetCpuTopology(cpus.data(), numCpus));
+	for (uint32_t index = 0; index < numCpus; ++index)
+	{
+		const CpuInfo& info = cpus[index];
+		if (index > 0) { ASSERT(cpus[index - 1].cpu < info.cpu); }
+		ASSERT(info.core <= info.cpu);
+		ASSERT_EQ(info.core == info.cpu, 0 == info.smtIndex);
+	}
+	PASS();
+}
+
+TEST
+test_affinity()
+{
+	uint32_t numCpus = GetCpuTopology(nullptr, 0);
+	if (0 == numCpus) { SKIPm("affinity not supported"); }
+
+	TaskSchedulerConfig config;
+	config.numTaskThreadsToCreate = 4; // can be more threads than cpus
+	config.threadAffinity = THREAD_AFFINITY_CORES;
+	CHECK_CALL(check_pinned(config));
+
+	std::vector<CpuInfo> cpus(numCpus);
+	GetCpuTopology(cpus.data(), numCpus);
+	std::vector<uint32_t> threadCpus;
+	for (const CpuInfo& info : cpus) { threadCpus.push_back(info.cpu); }
+	config.threadAffinity = THREAD_AFFINITY_CPU_LIST;
+	config.pThreadCpus = threadCpus.data();
+	config.numThreadCpus = (uint32_t)threadCpus.size();
+	CHECK_CALL(check_pinned(config));
+	PASS();
+}
+
+SUITE(the_suite)
+{
+	RUN_TEST(test_topology);
+	RUN_TEST(test_affinity);
+}
+
+GREATEST_MAIN_DEFS();
+
+int
+main(int argc, char **argv)
+{
+	GREATEST_MAIN_BEGIN();
+	RUN_SUITE(the_suite);
+	GREATEST_MAIN_END();
+}
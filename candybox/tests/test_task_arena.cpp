@@ -0,0 +1,96 @@
+#include <vector>
+#include "candybox/greatest.h"
+#include "candybox/TaskArena.hpp"
+
+namespace {
+
+using namespace candybox;
+
+// a box2d style task, calling a callback on a range of bodies
+struct BodyTask : public ITaskSet
+{
+	void ExecuteRange(TaskSetPartition range_, uint32_t threadnum_) override
+	{
+		(void)threadnum_;
+		for (uint32_t i = range_.start; i < range_.end; ++i) { (*m_pBodies)[m_First + i] += 1; }
+	}
+
+	std::vector<uint32_t>* m_pBodies = nullptr;
+	uint32_t m_First = 0;
+};
+
+TaskScheduler g_TS;
+
+} // namespace
+
+TEST
+test_arena_layout()
+{
+	TaskArena<BodyTask, 4> arena;
+	BodyTask* pFirst = arena.allocate();
+	BodyTask* pSecond = arena.allocate();
+	ASSERT_EQ(0, (uintptr_t)pFirst % 64);
+	ASSERT((char*)pSecond - (char*)pFirst >= 64); // no false sharing
+	for (uint32_t i = 0; i < 10; ++i) { arena.allocate(); }
+	ASSERT_EQ(12, arena.size());
+	ASSERT_EQ(12, arena.capacity());
+
+	// chunks are kept, so tasks are reused in the same order
+	arena.reset();
+	ASSERT_EQ(0, arena.size());
+	ASSERT_EQ(pFirst, arena.allocate());
+	ASSERT_EQ(12, arena.capacity());
+	PASS();
+}
+
+TEST
+test_arena_stress()
+{
+	// 50000 bodies split into many small tasks, far more than the old fixed pool of 1024,
+	// with every task launched before any is waited on, as box2d does within a stage.
+	const uint32_t numBodies = 50000;
+	const uint32_t bodiesPerTask = 16;
+	const uint32_t numSteps = 20;
+	std::vector<uint32_t> bodies(numBodies, 0);
+	TaskArena<BodyTask> arena;
+
+	for (uint32_t step = 0; step < numSteps; ++step)
+	{
+		std::vector<BodyTask*> tasks;
+		for (uint32_t first = 0; first < numBodies; first += bodiesPerTask)
+		{
+			BodyTask* pTask = arena.allocate();
+			pTask->m_SetSize = std::min(bodiesPerTask, numBodies - first);
+			pTask->m_MinRange = 4;
+			pTask->m_pBodies = &bodies;
+			pTask->m_First = first;
+			g_TS.AddTaskSetToPipe(pTask);
+			tasks.push_back(pTask);
+		}
+		for (BodyTask* pTask : tasks) { g_TS.WaitforTask(pTask); }
+		ASSERT_EQ((numBodies + bodiesPerTask - 1) / bodiesPerTask, arena.size());
+		uint32_t capacity = arena.capacity();
+		arena.reset();
+		ASSERT(step == 0 || capacity == arena.capacity()); // no growth after the first step
+	}
+	for (uint32_t count : bodies) { ASSERT_EQ(numSteps, count); }
+	PASS();
+}
+
+SUITE(the_suite)
+{
+	RUN_TEST(test_arena_layout);
+	RUN_TEST(test_arena_stress);
+}
+
+GREATEST_MAIN_DEFS();
+
+int
+main(int argc, char **argv)
+{
+	GREATEST_MAIN_BEGIN();
+	g_TS.Initialize();
+	RUN_SUITE(the_suite);
+	g_TS.WaitforAllAndShutdown();
+	GREATEST_MAIN_END();
+}
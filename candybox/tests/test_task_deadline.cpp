@@ -0,0 +1,102 @@
+#include "candybox/greatest.h"
+#include "candybox/TaskScheduler.hpp"
+
+namespace {
+
+using namespace candybox;
+
+struct OrderTask : public ITaskSet
+{
+	OrderTask() : ITaskSet(16, 4) { }
+
+	void ExecuteRange(TaskSetPartition range_, uint32_t threadnum_) override
+	{
+		(void)range_;
+		(void)threadnum_;
+		m_Order = m_pCounter->fetch_add(1, std::memory_order_relaxed);
+	}
+
+	uint32_t m_Order = 0; // order of the last partition to run
+	std::atomic<uint32_t>* m_pCounter = nullptr;
+};
+
+} // namespace
+
+TEST
+test_earliest_deadline_first()
+{
+	// without task threads nothing runs until the wait, which then runs tasks in deadline order
+	TaskScheduler ts;
+	ts.Initialize(1);
+
+	std::atomic<uint32_t> counter = {0};
+	uint64_t timeNs = TaskScheduler::GetTimeNs();
+	OrderTask tasks[4];
+	for (OrderTask& task : tasks) { task.m_pCounter = &counter; }
+	tasks[0].m_DeadlineNs = timeNs + 3000000000ull;
+	tasks[1].m_DeadlineNs = timeNs + 1000000000ull;
+	tasks[2].m_DeadlineNs = timeNs + 2000000000ull;
+	// tasks[3] has no deadline
+	for (OrderTask& task : tasks) { ts.AddTaskSetToPipe(&task); }
+
+	ts.WaitforAll();
+	for (OrderTask& task : tasks) { ASSERT(task.GetIsComplete()); }
+	ASSERT(tasks[1].m_Order < tasks[2].m_Order);
+	ASSERT(tasks[2].m_Order < tasks[0].m_Order);
+	ASSERT(tasks[0].m_Order < tasks[3].m_Order);
+
+	DeadlineStats stats = ts.GetDeadlineStats();
+	ASSERT_EQ(3, stats.numCompleted);
+	ASSERT_EQ(0, stats.numMissed);
+	ts.WaitforAllAndShutdown();
+	PASS();
+}
+
+TEST
+test_deadline_stats()
+{
+	TaskScheduler ts;
+	TaskSchedulerConfig config;
+	config.numTaskThreadsToCreate = 3;
+	ts.Initialize(config);
+
+	std::atomic<uint32_t> counter = {0};
+	OrderTask missed;
+	missed.m_pCounter = &counter;
+	missed.m_DeadlineNs = TaskScheduler::GetTimeNs() - 1000000; // already passed
+	ts.AddTaskSetToPipe(&missed);
+	ts.WaitforTask(&missed);
+
+	OrderTask met;
+	met.m_pCounter = &counter;
+	met.m_DeadlineNs = TaskScheduler::GetTimeNs() + 60000000000ull;
+	ts.AddTaskSetToPipe(&met);
+	ts.WaitforTask(&met);
+
+	DeadlineStats stats = ts.GetDeadlineStats();
+	ASSERT_EQ(2, stats.numCompleted);
+	ASSERT_EQ(1, stats.numMissed);
+	ASSERT(stats.maxLatenessNs >= 1000000);
+	ASSERT_EQ(stats.maxLatenessNs, stats.totalLatenessNs);
+
+	ts.ResetDeadlineStats();
+	ASSERT_EQ(0, ts.GetDeadlineStats().numCompleted);
+	ts.WaitforAllAndShutdown();
+	PASS();
+}
+
+SUITE(the_suite)
+{
+	RUN_TEST(test_earliest_deadline_first);
+	RUN_TEST(test_deadline_stats);
+}
+
+GREATEST_MAIN_DEFS();
+
+int
+main(int argc, char **argv)
+{
+	GREATEST_MAIN_BEGIN();
+	RUN_SUITE(the_suite);
+	GREATEST_MAIN_END();
+}
@@ -0,0 +1,111 @@
+#include "candybox/greatest.h"
+#include "candybox/TaskScheduler.hpp"
+
+namespace {
+
+using namespace candybox;
+
+// waits for its children from inside a task, which parks the fiber in fiber mode
+struct NestedTask : public ITaskSet
+{
+	NestedTask() : ITaskSet(1) { }
+
+	void ExecuteRange(TaskSetPartition range_, uint32_t threadnum_) override
+	{
+		(void)range_;
+		(void)threadnum_;
+		if (m_Depth == 0)
+		{
+			m_pLeaves->fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+
+		NestedTask children[3];
+		for (NestedTask& child : children)
+		{
+			child.m_pTS = m_pTS;
+			child.m_pLeaves = m_pLeaves;
+			child.m_Depth = m_Depth - 1;
+			m_pTS->AddTaskSetToPipe(&child);
+		}
+		for (NestedTask& child : children)
+		{
+			m_pTS->WaitforTask(&child);
+			if (!child.GetIsComplete()) { m_pLeaves->store(0xFFFFFFFF); }
+		}
+	}
+
+	TaskScheduler* m_pTS = nullptr;
+	std::atomic<uint32_t>* m_pLeaves = nullptr;
+	uint32_t m_Depth = 0;
+};
+
+// starts the tree on a task thread, so the waits happen on a fiber
+struct RootPinnedTask : public IPinnedTask
+{
+	RootPinnedTask(uint32_t threadNum_) : IPinnedTask(threadNum_) { }
+
+	void Execute() override
+	{
+		m_pRoot->m_pTS->AddTaskSetToPipe(m_pRoot);
+		m_pRoot->m_pTS->WaitforTask(m_pRoot);
+	}
+
+	NestedTask* m_pRoot = nullptr;
+};
+
+enum greatest_test_res
+check_nested(bool useFibers_, uint32_t numFibersPerThread_)
+{
+	TaskScheduler ts;
+	TaskSchedulerConfig config;
+	config.numTaskThreadsToCreate = 4;
+	config.useFibers = useFibers_;
+	config.numFibersPerThread = numFibersPerThread_;
+	config.fiberStackSize = 64 * 1024;
+	ts.Initialize(config);
+
+	for (uint32_t run = 0; run < 20; ++run)
+	{
+		std::atomic<uint32_t> leaves = {0};
+		NestedTask root;
+		root.m_pTS = &ts;
+		root.m_pLeaves = &leaves;
+		root.m_Depth = 6;
+		RootPinnedTask pinned(1 + run % config.numTaskThreadsToCreate);
+		pinned.m_pRoot = &root;
+		ts.AddPinnedTask(&pinned);
+		ts.WaitforTask(&pinned);
+		ASSERT(root.GetIsComplete());
+		ASSERT_EQ(729u, leaves.load()); // 3^6
+	}
+	ts.WaitforAllAndShutdown();
+	PASS();
+}
+
+} // namespace
+
+TEST
+test_nested_waits()
+{
+	CHECK_CALL(check_nested(false, 32));
+	CHECK_CALL(check_nested(true, 32));
+	// an exhausted pool falls back to waiting on the current stack
+	CHECK_CALL(check_nested(true, 2));
+	PASS();
+}
+
+SUITE(the_suite)
+{
+	RUN_TEST(test_nested_waits);
+}
+
+GREATEST_MAIN_DEFS();
+
+int
+main(int argc, char **argv)
+{
+	GREATEST_MAIN_BEGIN();
+	RUN_SUITE(the_suite);
+	GREATEST_MAIN_END();
+}
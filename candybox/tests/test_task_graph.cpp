@@ -0,0 +1,115 @@
+#include "candybox/greatest.h"
+#include "candybox/TaskScheduler.hpp"
+
+namespace {
+
+using namespace candybox;
+
+// records the order in which its first and last ranges ran
+struct OrderTask : public ITaskSet
+{
+	OrderTask() : ITaskSet(64, 1) { }
+
+	void ExecuteRange(TaskSetPartition range_, uint32_t threadnum_) override
+	{
+		(void)threadnum_;
+		m_Items.fetch_add(range_.end - range_.start, std::memory_order_relaxed);
+		uint32_t order = m_pCounter->fetch_add(1, std::memory_order_acq_rel);
+		uint32_t first = m_First.load();
+		while (order < first && !m_First.compare_exchange_weak(first, order)) { }
+		uint32_t last = m_Last.load();
+		while (order > last && !m_Last.compare_exchange_weak(last, order)) { }
+	}
+
+	void Reset()
+	{
+		m_First = 0xFFFFFFFF;
+		m_Last = 0;
+	}
+
+	std::atomic<uint32_t> m_Items = {0};
+	std::atomic<uint32_t> m_First = {0xFFFFFFFF};
+	std::atomic<uint32_t> m_Last = {0};
+	std::atomic<uint32_t>* m_pCounter = nullptr;
+};
+
+TaskScheduler g_TS;
+
+} // namespace
+
+TEST
+test_diamond()
+{
+	std::atomic<uint32_t> counter = {0};
+	OrderTask tasks[4];
+	TaskGraph graph;
+	for (OrderTask& task : tasks)
+	{
+		task.m_pCounter = &counter;
+		graph.AddNode(&task);
+	}
+	// 0 -> 1, 0 -> 2, 1 -> 3, 2 -> 3
+	graph.AddEdge(0, 1);
+	graph.AddEdge(0, 2);
+	graph.AddEdge(&tasks[1], &tasks[3]);
+	graph.AddEdge(&tasks[2], &tasks[3]);
+	graph.Compile();
+
+	for (uint32_t run = 1; run <= 100; ++run)
+	{
+		counter = 0;
+		for (OrderTask& task : tasks) { task.Reset(); }
+		g_TS.AddTaskGraphToPipe(&graph);
+		g_TS.WaitforTask(&graph);
+		ASSERT(graph.GetIsComplete());
+
+		for (OrderTask& task : tasks)
+		{
+			ASSERT(task.GetIsComplete());
+			ASSERT_EQ(run * task.m_SetSize, task.m_Items.load());
+		}
+		// every range of a predecessor must have run before any range of a successor.
+		ASSERT(tasks[0].m_Last < tasks[1].m_First);
+		ASSERT(tasks[0].m_Last < tasks[2].m_First);
+		ASSERT(tasks[1].m_Last < tasks[3].m_First);
+		ASSERT(tasks[2].m_Last < tasks[3].m_First);
+	}
+	PASS();
+}
+
+TEST
+test_graph_dependency()
+{
+	// a graph can be the dependency of another task, and can be empty
+	TaskGraph emptyGraph;
+	emptyGraph.Compile();
+
+	std::atomic<uint32_t> counter = {0};
+	OrderTask task;
+	task.m_pCounter = &counter;
+	Dependency dependency(&emptyGraph, &task);
+
+	g_TS.AddTaskGraphToPipe(&emptyGraph);
+	g_TS.WaitforTask(&task);
+	ASSERT(emptyGraph.GetIsComplete());
+	ASSERT_EQ(task.m_SetSize, task.m_Items.load());
+	PASS();
+}
+
+SUITE(the_suite)
+{
+	RUN_TEST(test_diamond);
+	RUN_TEST(test_graph_dependency);
+}
+
+GREATEST_MAIN_DEFS();
+
+int
+main(int argc, char **argv)
+{
+	GREATEST_MAIN_BEGIN();
+	g_TS.Initialize();
+	RUN_SUITE(the_suite);
+	g_TS.WaitforAllAndShutdown();
+	GREATEST_MAIN_END();
+}
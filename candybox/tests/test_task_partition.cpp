@@ -0,0 +1,100 @@
+#include <vector>
+#include "candybox/greatest.h"
+#include "candybox/TaskScheduler.hpp"
+
+namespace {
+
+using namespace candybox;
+
+// counts how often each item ran, items take m_Spin iterations of busy work
+struct CostTask : public ITaskSet
+{
+	CostTask(uint32_t setSize_, uint32_t spin_) : ITaskSet(setSize_, 1), m_Counts(setSize_), m_Spin(spin_)
+	{
+		m_PartitionPolicy = PARTITION_ADAPTIVE;
+		for (std::atomic<uint32_t>& count : m_Counts) { count = 0; }
+	}
+
+	void ExecuteRange(TaskSetPartition range_, uint32_t threadnum_) override
+	{
+		(void)threadnum_;
+		m_NumRanges.fetch_add(1, std::memory_order_relaxed);
+		for (uint32_t i = range_.start; i < range_.end; ++i)
+		{
+			volatile uint32_t work = 0;
+			for (uint32_t j = 0; j < m_Spin; ++j) { work = work + j; }
+			m_Counts[i].fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+
+	std::vector<std::atomic<uint32_t> > m_Counts;
+	std::atomic<uint32_t> m_NumRanges = {0};
+	uint32_t m_Spin;
+};
+
+TaskScheduler g_TS;
+
+} // namespace
+
+TEST
+test_adaptive_partition()
+{
+	CostTask cheap(100000, 1);
+	CostTask expensive(2000, 2000);
+	cheap.m_PartitionTag = 1;
+	expensive.m_PartitionTag = 2;
+	ASSERT_EQ(0.0f, g_TS.GetPartitionCostNsPerItem(&cheap));
+
+	const uint32_t runs = 10;
+	for (uint32_t run = 0; run < runs; ++run)
+	{
+		cheap.m_NumRanges = 0;
+		g_TS.AddTaskSetToPipe(&cheap);
+		g_TS.AddTaskSetToPipe(&expensive);
+		g_TS.WaitforTask(&cheap);
+		g_TS.WaitforTask(&expensive);
+	}
+	for (std::atomic<uint32_t>& count : cheap.m_Counts) { ASSERT_EQ(runs, count.load()); }
+	for (std::atomic<uint32_t>& count : expensive.m_Counts) { ASSERT_EQ(runs, count.load()); }
+
+	float cheapNs = g_TS.GetPartitionCostNsPerItem(&cheap);
+	float expensiveNs = g_TS.GetPartitionCostNsPerItem(&expensive);
+	ASSERT(cheapNs > 0.0f);
+	ASSERT(expensiveNs > cheapNs);
+
+	// with m_MinRange = 1 a static policy would split into many more ranges
+	uint32_t targetNs = g_TS.GetConfig().adaptivePartitionTargetNs;
+	uint32_t expectedMinRange = (uint32_t)(targetNs / cheapNs);
+	if (expectedMinRange > 4) { ASSERT(cheap.m_NumRanges.load() < cheap.m_SetSize / 4); }
+	PASS();
+}
+
+TEST
+test_partition_tag_from_type()
+{
+	// an untagged task set shares the cost of its type
+	CostTask first(1000, 10);
+	CostTask second(1000, 10);
+	g_TS.AddTaskSetToPipe(&first);
+	g_TS.WaitforTask(&first);
+	ASSERT(g_TS.GetPartitionCostNsPerItem(&second) > 0.0f);
+	PASS();
+}
+
+SUITE(the_suite)
+{
+	RUN_TEST(test_adaptive_partition);
+	RUN_TEST(test_partition_tag_from_type);
+}
+
+GREATEST_MAIN_DEFS();
+
+int
+main(int argc, char **argv)
+{
+	GREATEST_MAIN_BEGIN();
+	g_TS.Initialize();
+	RUN_SUITE(the_suite);
+	g_TS.WaitforAllAndShutdown();
+	GREATEST_MAIN_END();
+}
@@ -0,0 +1,91 @@
+#include <vector>
+#include "candybox/greatest.h"
+#include "candybox/TaskScheduler.hpp"
+
+namespace {
+
+using namespace candybox;
+
+struct CountTask : public ITaskSet
+{
+	CountTask() : ITaskSet(10000, 10) { }
+
+	void ExecuteRange(TaskSetPartition range_, uint32_t threadnum_) override
+	{
+		(void)threadnum_;
+		m_Items.fetch_add(range_.end - range_.start, std::memory_order_relaxed);
+	}
+
+	std::atomic<uint32_t> m_Items = {0};
+};
+
+} // namespace
+
+TEST
+test_telemetry_counts()
+{
+	TaskScheduler ts;
+	TaskSchedulerConfig config;
+	config.numTaskThreadsToCreate = 3;
+	config.enableTelemetry = true;
+	ts.Initialize(config);
+
+	CountTask task;
+	ts.AddTaskSetToPipe(&task);
+	ts.WaitforTask(&task);
+	ASSERT_EQ(task.m_SetSize, task.m_Items.load());
+	ts.WaitforAll();
+
+	std::vector<ThreadTelemetry> threads(ts.GetNumTaskThreads());
+	ASSERT_EQ(4, ts.GetTelemetry(threads.data(), (uint32_t)threads.size()));
+
+	ThreadTelemetry total = ts.GetTelemetryTotal();
+	uint64_t numRangesRun = 0;
+	for (const ThreadTelemetry& thread : threads) { numRangesRun += thread.numRangesRun; }
+	ASSERT_EQ(numRangesRun, total.numRangesRun);
+	ASSERT(total.numRangesRun > 0);
+	ASSERT(total.numRangesRun <= task.m_SetSize / task.m_MinRange + 1);
+	ASSERT(total.numSubTasksSplit > 0);
+
+	uint64_t histogramCount = 0;
+	for (uint64_t count : total.rangeDurationHistogram) { histogramCount += count; }
+	ASSERT_EQ(total.numRangesRun, histogramCount);
+
+	// snapshots are cumulative
+	ts.AddTaskSetToPipe(&task);
+	ts.WaitforTask(&task);
+	ThreadTelemetry frame = ts.GetTelemetryTotal();
+	frame -= total;
+	ASSERT(frame.numRangesRun > 0);
+	ts.WaitforAllAndShutdown();
+	PASS();
+}
+
+TEST
+test_telemetry_disabled()
+{
+	TaskScheduler ts;
+	ts.Initialize(2);
+	CountTask task;
+	ts.AddTaskSetToPipe(&task);
+	ts.WaitforTask(&task);
+	ASSERT_EQ(0, ts.GetTelemetryTotal().numRangesRun);
+	ts.WaitforAllAndShutdown();
+	PASS();
+}
+
+SUITE(the_suite)
+{
+	RUN_TEST(test_telemetry_counts);
+	RUN_TEST(test_telemetry_disabled);
+}
+
+GREATEST_MAIN_DEFS();
+
+int
+main(int argc, char **argv)
+{
+	GREATEST_MAIN_BEGIN();
+	RUN_SUITE(the_suite);
+	GREATEST_MAIN_END();
+}
@@ -2,7 +2,14 @@
 #include <iostream>
 #include <numeric>
 #include <array>
+#include <cfloat>
+#include <random>
+#include <tuple>
+#include <functional>
+#include <thread>
 #include "candybox/spatial.hpp"
+#include "candybox/SpatialHash.hpp"
+#include "candybox/TaskScheduler.hpp"
 
 // example of a cache friendly allocator with contiguous memory
 template <class NodeClass, bool IsDebugMode = false, size_t DefaultNodeCount = 100>
@@ -738,6 +745,515 @@ test_spatial_insert()
 
 
 
+// checks the bulk loaded candybox::RTree against one built by insertion
+void
+test_rtree_bulk_load()
+{
+	typedef candybox::RTree<int, Box2<int>, 2, 8> rtree_t;
+	typedef candybox::detail::Node<Box2<int>, rtree_t::bbox_type, 8> node_t;
+	auto less = [](const Box2<int>& a, const Box2<int>& b) {
+		return std::make_tuple(a.l[0], a.l[1], a.u[0], a.u[1]) <
+		       std::make_tuple(b.l[0], b.l[1], b.u[0], b.u[1]);
+	};
+
+	std::mt19937 rng(3);
+	std::uniform_int_distribution<int> position(0, 10000), extent(0, 50);
+	for (size_t count : {0u, 1u, 8u, 9u, 100u, 20000u})
+	{
+		std::vector<Box2<int>> values(count);
+		for (Box2<int>& value : values)
+		{
+			value.l = {position(rng), position(rng)};
+			value.u = {value.l[0] + extent(rng), value.l[1] + extent(rng)};
+		}
+		rtree_t incremental(values.begin(), values.end());
+
+		for (candybox::detail::BulkLoadMode mode :
+		     {candybox::detail::eSortTileRecursive, candybox::detail::eHilbertSort})
+		{
+			rtree_t packed(values.begin(), values.end(), mode);
+			assert(packed.count() == count);
+
+			// leaves all on level 0, every node but the root at least half full
+			std::function<void(const node_t*, bool)> check = [&](const node_t* node, bool root) {
+				assert(root || node->count >= rtree_t::min_items);
+				for (uint32_t i = 0; node->isBranch() && i < node->count; ++i)
+				{
+					assert(node->children[i]->level == node->level - 1);
+					check(node->children[i], false);
+				}
+			};
+			check(candybox::detail::getRootNode(packed), true);
+
+			std::vector<Box2<int>> results, expected;
+			for (int query = 0; query < 50; ++query)
+			{
+				glm::vec<2, int> min{position(rng), position(rng)};
+				glm::vec<2, int> max{min[0] + extent(rng) * 10, min[1] + extent(rng) * 10};
+				results.clear();
+				expected.clear();
+				packed.query(candybox::intersects<2>(min, max), std::back_inserter(results));
+				incremental.query(candybox::intersects<2>(min, max), std::back_inserter(expected));
+				std::sort(results.begin(), results.end(), less);
+				std::sort(expected.begin(), expected.end(), less);
+				assert(results == expected);
+			}
+
+			// still dynamic
+			Box2<int> box{{1, 1}, {2, 2}};
+			packed.insert(box);
+			assert(packed.count() == count + 1);
+			assert(packed.remove(box));
+			if (count > 0) assert(packed.remove(values[0]));
+		}
+	}
+}
+
+// moves objects around a candybox::LooseQuadTree and checks it against brute force
+void
+test_loose_quadtree()
+{
+	typedef candybox::LooseQuadTree<float, Box2<float>> qtree_t;
+	qtree_t qtree({0.0f, 0.0f}, {1024.0f, 1024.0f}, 6);
+	assert(qtree.count() == 0);
+	assert(!qtree.remove(0));
+
+	std::mt19937 rng(5);
+	std::uniform_real_distribution<float> position(-50.0f, 1074.0f); // some outside
+	std::uniform_real_distribution<float> extent(0.0f, 40.0f);
+	std::uniform_real_distribution<float> step(-4.0f, 4.0f);
+	auto randomBox = [&]() {
+		Box2<float> box;
+		box.l = {position(rng), position(rng)};
+		box.u = {box.l[0] + extent(rng), box.l[1] + extent(rng)};
+		if (rng() % 50 == 0) box.u[0] += 600.0f; // a few stay in the root
+		return box;
+	};
+
+	std::vector<qtree_t::handle_type> handles;
+	std::vector<Box2<float>> boxes; // by handle
+	for (int i = 0; i < 2000; ++i)
+	{
+		Box2<float> box = randomBox();
+		qtree_t::handle_type handle = qtree.insert(box);
+		if (handle >= boxes.size()) boxes.resize(handle + 1);
+		boxes[handle] = box;
+		handles.push_back(handle);
+	}
+	assert(qtree.count() == handles.size());
+	assert(qtree.nodeCount() > 1);
+
+	std::vector<Box2<float>> results;
+	for (int frame = 0; frame < 20; ++frame)
+	{
+		for (qtree_t::handle_type handle : handles)
+		{
+			Box2<float>& box = boxes[handle];
+			float dx = step(rng), dy = step(rng);
+			box.l = {box.l[0] + dx, box.l[1] + dy};
+			box.u = {box.u[0] + dx, box.u[1] + dy};
+			qtree.update(handle, box);
+			assert(qtree.value(handle) == box);
+		}
+
+		// removed handles are reused
+		for (int i = 0; i < 50; ++i)
+		{
+			size_t at = rng() % handles.size();
+			assert(qtree.remove(handles[at]));
+			assert(!qtree.remove(handles[at]));
+			handles[at] = handles.back();
+			handles.pop_back();
+		}
+		for (int i = 0; i < 50; ++i)
+		{
+			Box2<float> box = randomBox();
+			qtree_t::handle_type handle = qtree.insert(box);
+			assert(handle < boxes.size());
+			boxes[handle] = box;
+			handles.push_back(handle);
+		}
+		assert(qtree.count() == handles.size());
+
+		for (int query = 0; query < 20; ++query)
+		{
+			glm::vec<2, float> min{position(rng), position(rng)};
+			glm::vec<2, float> max{min[0] + extent(rng) * 5.0f, min[1] + extent(rng) * 5.0f};
+			results.clear();
+			size_t found =
+			    qtree.query(candybox::intersects<2>(min, max), std::back_inserter(results));
+			assert(found == results.size());
+
+			size_t expected = 0;
+			candybox::TBox<float, 2> queryBox(min, max);
+			for (qtree_t::handle_type handle : handles)
+			{
+				if (!queryBox.overlaps(candybox::TBox<float, 2>(boxes[handle].l, boxes[handle].u)))
+					continue;
+				++expected;
+				assert(std::find(results.begin(), results.end(), boxes[handle]) != results.end());
+			}
+			assert(found == expected);
+		}
+	}
+
+	qtree.clear();
+	assert(qtree.count() == 0);
+	assert(qtree.nodeCount() == 1);
+}
+
+// checks candybox::Spatial (packed Hilbert R-tree) against brute force
+void
+test_hilbert_spatial(candybox::TaskScheduler* ts, uint32_t numItems, uint32_t nodeSize)
+{
+	std::mt19937 rng(numItems + nodeSize);
+	std::uniform_real_distribution<float> position(-1000.0f, 1000.0f);
+	std::uniform_real_distribution<float> extent(0.0f, 20.0f);
+	std::vector<float> boxes(numItems * 4);
+	for (uint32_t i = 0; i < numItems; ++i)
+	{
+		boxes[i * 4] = position(rng);
+		boxes[i * 4 + 1] = position(rng);
+		boxes[i * 4 + 2] = boxes[i * 4] + extent(rng);
+		boxes[i * 4 + 3] = boxes[i * 4 + 1] + extent(rng);
+	}
+
+	candybox::Spatial spatial(numItems, nodeSize);
+	spatial.addAll(boxes.data(), (uint32_t)boxes.size());
+	spatial.finish(ts);
+	assert(spatial.size() == numItems);
+	assert(spatial.nodeSize() == nodeSize);
+
+	std::vector<uint32_t> results, expected;
+	for (int query = 0; query < 50; ++query)
+	{
+		float minx = position(rng), miny = position(rng);
+		float maxx = minx + extent(rng) * 10.0f, maxy = miny + extent(rng) * 10.0f;
+		spatial.search(minx, miny, maxx, maxy, results);
+
+		expected.clear();
+		for (uint32_t i = 0; i < numItems; ++i)
+		{
+			const float* box = &boxes[i * 4];
+			if (box[0] <= maxx && box[1] <= maxy && box[2] >= minx && box[3] >= miny)
+				expected.push_back(i);
+		}
+		std::sort(results.begin(), results.end());
+		assert(results == expected);
+	}
+
+	// everything, and touching edges intersect
+	spatial.search(-FLT_MAX, -FLT_MAX, FLT_MAX, FLT_MAX, results);
+	assert(results.size() == numItems);
+	if (numItems > 0)
+	{
+		spatial.search(boxes[2], boxes[3], boxes[2], boxes[3], results);
+		assert(std::find(results.begin(), results.end(), 0u) != results.end());
+
+		// the nearest box contains the query point
+		float x = (boxes[0] + boxes[2]) * 0.5f, y = (boxes[1] + boxes[3]) * 0.5f;
+		spatial.neighbors(x, y, 10.0f, 1, results);
+		assert(results.size() == 1);
+		const float* box = &boxes[results[0] * 4];
+		assert(box[0] <= x && box[1] <= y && box[2] >= x && box[3] >= y);
+	}
+
+	// batch k nearest, against sorting every box by distance
+	const uint32_t numPoints = 200, k = 5;
+	const float maxDist = 50.0f;
+	std::vector<float> points(numPoints * 2);
+	for (float& p : points) p = position(rng);
+	std::vector<uint32_t> offsets(numPoints + 1), indices(numPoints * k);
+	uint32_t total = spatial.neighbors(
+	    points.data(), numPoints, maxDist, k, offsets.data(), indices.data(), ts);
+	assert(total == offsets[numPoints]);
+
+	std::vector<std::pair<float, uint32_t>> nearest;
+	for (uint32_t point = 0; point < numPoints; ++point)
+	{
+		float x = points[point * 2], y = points[point * 2 + 1];
+		nearest.clear();
+		for (uint32_t i = 0; i < numItems; ++i)
+		{
+			const float* box = &boxes[i * 4];
+			float dx = x < box[0] ? box[0] - x : (x > box[2] ? x - box[2] : 0.0f);
+			float dy = y < box[1] ? box[1] - y : (y > box[3] ? y - box[3] : 0.0f);
+			float distSq = dx * dx + dy * dy;
+			if (distSq <= maxDist * maxDist) nearest.emplace_back(distSq, i);
+		}
+		std::sort(nearest.begin(), nearest.end());
+		if (nearest.size() > k) nearest.resize(k);
+
+		assert(offsets[point + 1] - offsets[point] == nearest.size());
+		for (uint32_t i = 0; i < nearest.size(); ++i)
+			assert(indices[offsets[point] + i] == nearest[i].second);
+	}
+
+	// the tree does not depend on the scheduler, even with items of equal Hilbert values
+	if (ts && numItems > 1)
+	{
+		std::vector<float> pairs(boxes);
+		for (uint32_t i = 1; i < numItems; i += 2)
+			std::copy(&pairs[(i - 1) * 4], &pairs[i * 4], &pairs[i * 4]);
+		candybox::Spatial serial(numItems, nodeSize), parallel(numItems, nodeSize);
+		serial.addAll(pairs.data(), (uint32_t)pairs.size());
+		parallel.addAll(pairs.data(), (uint32_t)pairs.size());
+		serial.finish(nullptr);
+		parallel.finish(ts);
+		serial.search(-FLT_MAX, -FLT_MAX, FLT_MAX, FLT_MAX, expected);
+		parallel.search(-FLT_MAX, -FLT_MAX, FLT_MAX, FLT_MAX, results);
+		assert(results == expected);
+	}
+
+	// a small batch from a thread the scheduler does not know runs inline as NO_THREAD_NUM
+	if (ts)
+	{
+		const uint32_t numInline = 64;
+		std::vector<uint32_t> offsets2(numInline + 1), indices2(numInline * k);
+		std::thread([&]() {
+			spatial.neighbors(
+			    points.data(), numInline, maxDist, k, offsets2.data(), indices2.data(), ts);
+		}).join();
+		for (uint32_t point = 0; point < numInline; ++point)
+		{
+			uint32_t count = offsets2[point + 1] - offsets2[point];
+			assert(count == offsets[point + 1] - offsets[point]);
+			for (uint32_t i = 0; i < count; ++i)
+				assert(indices2[offsets2[point] + i] == indices[offsets[point] + i]);
+		}
+	}
+}
+
+void
+test_hilbert_spatial()
+{
+	candybox::TaskScheduler ts;
+	ts.Initialize();
+	for (uint32_t nodeSize : {2u, 5u, 16u, 64u})
+	{
+		for (uint32_t numItems : {0u, 1u, 7u, 16u, 17u, 1000u, 100000u})
+		{
+			test_hilbert_spatial(nullptr, numItems, nodeSize);
+			test_hilbert_spatial(&ts, numItems, nodeSize);
+		}
+	}
+	ts.WaitforAllAndShutdown();
+}
+
+// checks candybox::DynamicSpatial against brute force while inserting and removing
+void
+test_dynamic_spatial(candybox::TaskScheduler* ts, uint32_t bufferSize)
+{
+	std::mt19937 rng(bufferSize);
+	std::uniform_real_distribution<float> position(-1000.0f, 1000.0f);
+	std::uniform_real_distribution<float> extent(0.0f, 20.0f);
+	candybox::DynamicSpatial spatial(bufferSize, 8, ts);
+	std::vector<std::array<float, 4>> boxes; // by id
+	std::vector<uint32_t> alive;
+
+	auto check = [&]() {
+		assert(spatial.size() == alive.size());
+		std::vector<uint32_t> results, expected;
+		for (int query = 0; query < 10; ++query)
+		{
+			float minx = position(rng), miny = position(rng);
+			float maxx = minx + extent(rng) * 20.0f, maxy = miny + extent(rng) * 20.0f;
+			spatial.search(minx, miny, maxx, maxy, results);
+			expected.clear();
+			for (uint32_t id : alive)
+			{
+				const std::array<float, 4>& box = boxes[id];
+				if (box[0] <= maxx && box[1] <= maxy && box[2] >= minx && box[3] >= miny)
+					expected.push_back(id);
+			}
+			std::sort(results.begin(), results.end());
+			std::sort(expected.begin(), expected.end());
+			assert(results == expected);
+
+			float x = position(rng), y = position(rng);
+			spatial.neighbors(x, y, 100.0f, 4, results);
+			std::vector<float> nearest;
+			for (uint32_t id : alive)
+			{
+				const std::array<float, 4>& box = boxes[id];
+				float dx = x < box[0] ? box[0] - x : (x > box[2] ? x - box[2] : 0.0f);
+				float dy = y < box[1] ? box[1] - y : (y > box[3] ? y - box[3] : 0.0f);
+				if (dx * dx + dy * dy <= 100.0f * 100.0f) nearest.push_back(dx * dx + dy * dy);
+			}
+			std::sort(nearest.begin(), nearest.end());
+			if (nearest.size() > 4) nearest.resize(4);
+			assert(results.size() == nearest.size());
+			for (uint32_t i = 0; i < results.size(); ++i)
+			{
+				const std::array<float, 4>& box = boxes[results[i]];
+				float dx = x < box[0] ? box[0] - x : (x > box[2] ? x - box[2] : 0.0f);
+				float dy = y < box[1] ? box[1] - y : (y > box[3] ? y - box[3] : 0.0f);
+				assert(dx * dx + dy * dy == nearest[i]);
+			}
+		}
+	};
+
+	for (int round = 0; round < 20; ++round)
+	{
+		// mostly inserts, then a burst of removals every few rounds
+		uint32_t numInserts = round % 5 == 4 ? 100 : 1000;
+		for (uint32_t i = 0; i < numInserts; ++i)
+		{
+			std::array<float, 4> box;
+			box[0] = position(rng);
+			box[1] = position(rng);
+			box[2] = box[0] + extent(rng);
+			box[3] = box[1] + extent(rng);
+			uint32_t id = spatial.insert(box[0], box[1], box[2], box[3]);
+			assert(std::find(alive.begin(), alive.end(), id) == alive.end());
+			if (id >= boxes.size()) boxes.resize(id + 1);
+			boxes[id] = box;
+			alive.push_back(id);
+		}
+		uint32_t numRemoves = round % 5 == 4 ? (uint32_t)alive.size() * 3 / 4 : 200;
+		for (uint32_t i = 0; i < numRemoves; ++i)
+		{
+			uint32_t at = rng() % alive.size();
+			assert(spatial.remove(alive[at]));
+			assert(!spatial.remove(alive[at]));
+			alive[at] = alive.back();
+			alive.pop_back();
+		}
+		check();
+	}
+
+	// merged down to O(log n) runs
+	spatial.wait();
+	assert(spatial.numRuns() <= 12);
+	check();
+}
+
+void
+test_dynamic_spatial()
+{
+	candybox::TaskScheduler ts;
+	ts.Initialize();
+	for (uint32_t bufferSize : {1u, 64u, 512u})
+	{
+		test_dynamic_spatial(nullptr, bufferSize);
+		test_dynamic_spatial(&ts, bufferSize);
+	}
+	ts.WaitforAllAndShutdown();
+}
+
+void
+test_spatial_hash(candybox::TaskScheduler* ts, uint32_t numItems, float cellSize)
+{
+	typedef candybox::TBox<float, 2> Box;
+	std::mt19937 rng(numItems);
+	std::uniform_real_distribution<float> position(-500.0f, 500.0f);
+	std::uniform_real_distribution<float> extent(0.0f, 10.0f);
+	std::vector<float> boxes(numItems * 4);
+	for (uint32_t i = 0; i < numItems; ++i)
+	{
+		boxes[i * 4] = position(rng);
+		boxes[i * 4 + 1] = position(rng);
+		boxes[i * 4 + 2] = boxes[i * 4] + extent(rng);
+		boxes[i * 4 + 3] = boxes[i * 4 + 1] + extent(rng);
+	}
+	candybox::SpatialHash hash(cellSize);
+	hash.build(boxes.data(), numItems, ts);
+	assert(hash.size() == numItems);
+
+	auto centerDistSq = [&](uint32_t i, float x, float y) {
+		float dx = (boxes[i * 4] + boxes[i * 4 + 2]) * 0.5f - x;
+		float dy = (boxes[i * 4 + 1] + boxes[i * 4 + 3]) * 0.5f - y;
+		return dx * dx + dy * dy;
+	};
+
+	std::vector<uint32_t> results, expected;
+	size_t numWithin = 0;
+	for (int query = 0; query < 50; ++query)
+	{
+		float minx = position(rng), miny = position(rng);
+		Box queryBox({minx, miny}, {minx + extent(rng) * 10.0f, miny + extent(rng) * 10.0f});
+
+		results.clear();
+		expected.clear();
+		hash.query(candybox::intersects(queryBox), std::back_inserter(results));
+		for (uint32_t i = 0; i < numItems; ++i)
+		{
+			Box box({boxes[i * 4], boxes[i * 4 + 1]}, {boxes[i * 4 + 2], boxes[i * 4 + 3]});
+			if (queryBox.overlaps(box)) expected.push_back(i);
+		}
+		std::sort(results.begin(), results.end());
+		assert(results == expected);
+		assert(hash.query(candybox::intersects(queryBox)) == !expected.empty());
+
+		results.clear();
+		expected.clear();
+		hash.query(candybox::within(queryBox), std::back_inserter(results));
+		for (uint32_t i = 0; i < numItems; ++i)
+		{
+			float x = boxes[i * 4], y = boxes[i * 4 + 1];
+			if (x >= queryBox.l[0] && x <= queryBox.u[0] && y >= queryBox.l[1] &&
+			    y <= queryBox.u[1])
+				expected.push_back(i);
+		}
+		std::sort(results.begin(), results.end());
+		assert(results == expected);
+		numWithin += expected.size();
+
+		float x = position(rng), y = position(rng), radius = extent(rng) * 5.0f;
+		results.clear();
+		expected.clear();
+		hash.nearest(glm::vec<2, float>(x, y), radius, std::back_inserter(results));
+		for (uint32_t i = 0; i < numItems; ++i)
+		{
+			if (centerDistSq(i, x, y) <= radius * radius) expected.push_back(i);
+		}
+		std::sort(results.begin(), results.end());
+		assert(results == expected);
+	}
+
+	assert(numWithin > 0 || numItems < 1000);
+
+	const float radius = 8.0f;
+	std::vector<std::pair<uint32_t, uint32_t>> pairs, serialPairs, expectedPairs;
+	hash.pairs(radius, pairs, ts);
+	hash.pairs(radius, serialPairs);
+	assert(pairs == serialPairs); // same order with or without threads
+	for (uint32_t i = 0; i < numItems; ++i)
+	{
+		float x = (boxes[i * 4] + boxes[i * 4 + 2]) * 0.5f;
+		float y = (boxes[i * 4 + 1] + boxes[i * 4 + 3]) * 0.5f;
+		for (uint32_t j = i + 1; j < numItems; ++j)
+		{
+			if (centerDistSq(j, x, y) <= radius * radius) expectedPairs.emplace_back(i, j);
+		}
+	}
+	std::sort(pairs.begin(), pairs.end());
+	assert(pairs == expectedPairs);
+}
+
+void
+test_spatial_hash()
+{
+	candybox::TaskScheduler ts;
+	ts.Initialize();
+	for (uint32_t numItems : {0u, 1u, 100u, 5000u})
+	{
+		test_spatial_hash(nullptr, numItems, 10.0f);
+		test_spatial_hash(&ts, numItems, 10.0f);
+	}
+	test_spatial_hash(&ts, 2000, 1.0f); // more cells than boxes
+	test_spatial_hash(&ts, 2000, 100.0f);
+
+	// fixed table size, the far box shares no cell with the query
+	candybox::SpatialHash hash(4.0f, 64);
+	std::vector<float> boxes = {0, 0, 1, 1, 100, 100, 101, 101, -50, 20, -49, 21};
+	hash.build(boxes.data(), 3);
+	std::vector<uint32_t> results;
+	hash.nearest(glm::vec<2, float>(100.0f, 100.0f), 2.0f, std::back_inserter(results));
+	assert(results.size() == 1 && results[0] == 1);
+	ts.WaitforAllAndShutdown();
+}
+
 void
 test_spatial()
 {
@@ -762,6 +1278,12 @@ test_spatial()
 	test_spatial_count();
 	test_spatial_query();
 	test_spatial_insert();
+
+	test_rtree_bulk_load();
+	test_loose_quadtree();
+	test_hilbert_spatial();
+	test_dynamic_spatial();
+	test_spatial_hash();
 }
 
 int
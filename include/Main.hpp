@@ -2,6 +2,7 @@
 #define CANDYBOX_MAIN_SCENE_HPP__
 
 #include <memory>
+#include <vector>
 #include "World.hpp"
 
 #define SHADER_TEXT(x) "#version 330 core\n" #x
@@ -24,11 +25,27 @@ public:
 		load();
 	}
 
-	void destroy() override { PhysicsWorld::destroy(); }
+	void destroy() override
+	{
+		PhysicsWorld::destroy();
+		m_trackedPolygons.clear();
+	}
 
 	void load();
 
+	/// Draws the tracked bodies of the fixed step mode from the snapshots, as the world
+	/// is being stepped.
+	void renderSnapshot();
+
 private:
+	struct TrackedPolygon
+	{
+		int32_t index; ///< in the snapshots
+		b2Polygon polygon;
+	};
+
+	std::vector<TrackedPolygon> m_trackedPolygons;
+	b2Segment m_groundSegment{};
 	b2BodyId m_attachmentId = b2_nullBodyId;
 	b2BodyId m_platformId = b2_nullBodyId;
 	float m_speed = 0;
@@ -101,6 +118,11 @@ public:
 
 	void update(float delta) override { m_physicsWorld.update(delta); }
 
+	void fixedUpdate(float timeStep, int32_t stepCount) override
+	{
+		m_physicsWorld.fixedUpdate(timeStep, stepCount);
+	}
+
 	void render() override;
 
 	void renderUI() override;
@@ -157,6 +179,7 @@ public:
 
 private:
 	void drawLights();
+	void renderSchedulerUI();
 
 private:
 	bool m_isRightMousePressed = false;
@@ -170,6 +193,9 @@ private:
 
 	// graphics control
 	bool m_enableCRT = false;
+
+	// task scheduler telemetry of the previous frame, to show per frame values
+	std::vector<candybox::ThreadTelemetry> m_prevTelemetry;
 };
 
 #endif // CANDYBOX_MAIN_SCENE_HPP__
@@ -3,6 +3,9 @@
 
 #include "candybox/vg/VG.hpp"
 #include "candybox/TaskScheduler.hpp"
+#include "candybox/TaskArena.hpp"
+#include "candybox/QueryBatch.hpp"
+#include "candybox/SnapshotBuffer.hpp"
 #include "candybox/Scene.hpp"
 #include "DebugDraw.hpp"
 
@@ -14,8 +17,10 @@
 class PhysicsWorld
 {
 public:
-	explicit PhysicsWorld(candybox::Scene* scene) : m_scene(scene), m_debugDraw(scene)
+	explicit PhysicsWorld(candybox::Scene* scene)
+	    : m_queries(executeQuery, this), m_scene(scene), m_debugDraw(scene)
 	{
+		m_stepTask.m_world = this;
 		m_worldDebugDrawConfig = {
 		    handleDrawPolygon,
 		    handleDrawSolidPolygon,
@@ -45,8 +50,12 @@ public:
 	virtual void initialize()
 	{
 		uint32_t maxThreads = std::min(8u, candybox::GetNumHardwareThreads());
-		m_scheduler.Initialize(maxThreads);
-		m_taskCount = 0;
+		candybox::TaskSchedulerConfig config;
+		config.numTaskThreadsToCreate = maxThreads - 1;
+		config.enableTelemetry = true; // shown in the UI
+		m_scheduler.Initialize(config);
+		m_tasks.reset();
+		m_queries.reserve(1024);
 
 		b2WorldDef worldDef = b2DefaultWorldDef();
 		worldDef.workerCount = maxThreads;
@@ -75,19 +84,34 @@ public:
 	virtual void destroy()
 	{
 		// By deleting the world, we delete the bomb, mouse joint, etc.
+		waitForWorld();
+		m_queries.finish(m_scheduler);
 		b2DestroyWorld(m_worldId);
+		m_trackedBodies.clear();
+		m_snapshots = candybox::SnapshotBuffer<StepSnapshot>();
 	}
 
+	const candybox::TaskScheduler& getScheduler() const { return m_scheduler; }
+
+	/// Draws the world while the queries launched by update() run, they only read it. Not
+	/// in the fixed step mode, whose steps change the world while the frame is rendered.
 	void debugRender()
 	{
+		assert(!m_scene->isFixedStep());
 		b2World_Draw(m_worldId, &m_worldDebugDrawConfig);
 		m_debugDraw.flush();
 	}
 
 	virtual void update(float timeStep)
 	{
+		if (m_scene->isFixedStep()) return; // stepped by fixedUpdate()
 		if (!m_scene->isRunning()) timeStep = 0.0f;
 
+		// the queries of the previous frame, and the steps of the fixed step mode if it was
+		// just turned off, use the world which the step changes
+		m_scheduler.WaitforTask(&m_stepTask);
+		m_queries.finish(m_scheduler);
+
 		b2World_EnableSleeping(m_worldId, m_sleeping);
 		b2World_EnableWarmStarting(m_worldId, m_warmStarting);
 		b2World_EnableContinuous(m_worldId, m_continuous);
@@ -95,11 +119,145 @@ public:
 		for (int32_t i = 0; i < 1; ++i)
 		{
 			b2World_Step(m_worldId, timeStep, m_velocityIters, m_relaxIters);
-			m_taskCount = 0; // reset task count after one step of physics world's update
+			m_tasks.reset(); // box2d has finished every task of the step
 		}
 
 		if (timeStep > 0.0f) { ++m_stepCount; }
 
+		m_queries.launch(m_scheduler);
+		trackProfile();
+	}
+
+	/*--------------------------------------------------------------------------------------*/
+	// Fixed step mode, see Scene::setFixedStep(). The steps of a frame run on a task thread
+	// while the frame is rendered, after the queries of the frame, and the transforms of the
+	// tracked bodies before and after the last step are copied to a snapshot. The renderer
+	// draws them with getRenderState(), which interpolates between the two as the alpha of
+	// the scene is a fraction of one step, and so is one frame behind the simulation.
+
+	struct BodyState
+	{
+		b2Vec2 p;
+		float angle;
+	};
+
+	struct StepSnapshot
+	{
+		std::vector<BodyState> before; ///< the tracked bodies before the last step
+		std::vector<BodyState> after;  ///< and after it
+		int32_t stepBefore = 0;
+		int32_t stepAfter = 0;
+	};
+
+	virtual void fixedUpdate(float timeStep, int32_t stepCount)
+	{
+		if (!m_scene->isRunning()) stepCount = 0;
+
+		m_scheduler.WaitforTask(&m_stepTask);
+		// a frame without steps keeps the last snapshot to interpolate over
+		if (m_stepTask.m_stepCount > 0) { m_snapshots.publish(); }
+		m_queries.finish(m_scheduler);
+
+		b2World_EnableSleeping(m_worldId, m_sleeping);
+		b2World_EnableWarmStarting(m_worldId, m_warmStarting);
+		b2World_EnableContinuous(m_worldId, m_continuous);
+
+		m_queries.launch(m_scheduler);
+		m_stepTask.m_timeStep = timeStep;
+		m_stepTask.m_stepCount = stepCount;
+		m_scheduler.AddTaskSetToPipe(&m_stepTask);
+	}
+
+	/// Adds a body to the snapshots of the fixed step mode, returns its index in them.
+	int32_t trackBody(b2BodyId bodyId)
+	{
+		waitForWorld();
+		m_trackedBodies.push_back(bodyId);
+		return (int32_t)m_trackedBodies.size() - 1;
+	}
+
+	/// State of a tracked body interpolated at Scene::getAlpha() over the last step of the
+	/// last snapshot, false if no snapshot has the body yet.
+	bool getRenderState(int32_t index, BodyState* state) const
+	{
+		const StepSnapshot& snapshot = m_snapshots.current();
+		if (index < 0 || (size_t)index >= snapshot.after.size()) return false;
+		// the alpha covers a single step, whatever the number of steps of the frame
+		assert(snapshot.stepAfter - snapshot.stepBefore == 1);
+
+		const BodyState& a = snapshot.before[index];
+		const BodyState& b = snapshot.after[index];
+		const float alpha = m_scene->getAlpha();
+		float da = b.angle - a.angle; // the shortest way round
+		if (da > b2_pi) da -= 2.0f * b2_pi;
+		else if (da < -b2_pi) da += 2.0f * b2_pi;
+		state->p = {a.p.x + alpha * (b.p.x - a.p.x), a.p.y + alpha * (b.p.y - a.p.y)};
+		state->angle = a.angle + alpha * da;
+		return true;
+	}
+
+	/// Called once the frame is rendered, counts the frames which launched steps and those
+	/// whose steps were still running then, i.e. overlapped the rendering.
+	void endRender()
+	{
+		if (!m_scene->isFixedStep() || m_stepTask.m_stepCount == 0) return;
+		++m_steppedFrames;
+		if (!m_stepTask.GetIsComplete()) ++m_overlappedFrames;
+	}
+
+	int32_t getSteppedFrames() const { return m_steppedFrames; }
+	int32_t getOverlappedFrames() const { return m_overlappedFrames; }
+
+	/*--------------------------------------------------------------------------------------*/
+private:
+	class StepTask : public candybox::ITaskSet
+	{
+	public:
+		void ExecuteRange(candybox::TaskSetPartition, uint32_t) override
+		{
+			m_world->runSteps();
+		}
+
+		PhysicsWorld* m_world = nullptr;
+		float m_timeStep = 0.0f;
+		int32_t m_stepCount = 0;
+	};
+
+	// runs on a task thread, nothing else reads or changes the world until it is waited for
+	void runSteps()
+	{
+		m_queries.wait(m_scheduler);
+		StepSnapshot& snapshot = m_snapshots.back();
+		for (int32_t i = 0; i < m_stepTask.m_stepCount; ++i)
+		{
+			if (i == m_stepTask.m_stepCount - 1)
+			{
+				copyTrackedBodies(&snapshot.before);
+				snapshot.stepBefore = m_stepCount;
+			}
+			b2World_Step(m_worldId, m_stepTask.m_timeStep, m_velocityIters, m_relaxIters);
+			m_tasks.reset();
+			++m_stepCount;
+			trackProfile();
+		}
+		if (m_stepTask.m_stepCount == 0) return;
+
+		copyTrackedBodies(&snapshot.after);
+		snapshot.stepAfter = m_stepCount;
+	}
+
+	void copyTrackedBodies(std::vector<BodyState>* states) const
+	{
+		states->resize(m_trackedBodies.size());
+		for (size_t i = 0; i < m_trackedBodies.size(); ++i)
+		{
+			(*states)[i].p = b2Body_GetPosition(m_trackedBodies[i]);
+			(*states)[i].angle = b2Body_GetAngle(m_trackedBodies[i]);
+		}
+	}
+
+	void trackProfile()
+	{
 		// Track maximum profile times
 		using namespace candybox;
 		b2Profile p = b2World_GetProfile(m_worldId);
@@ -122,8 +280,172 @@ public:
 		m_totalProfile.continuous += p.continuous;
 	}
 
+public:
+	/*--------------------------------------------------------------------------------------*/
+	// Scene queries of the gameplay code, i.e. line of sight, ground checks and explosions.
+	// The queries enqueued before update() or fixedUpdate() run on the task threads before
+	// the next step and their results are read with queryResult() after the next update() or
+	// fixedUpdate(), one frame later.
+	// The world must not be changed while they run, call waitForWorld() before creating
+	// or destroying anything outside of update().
+
+	static constexpr int32_t kMaxOverlapShapes = 8;
+
+	struct QueryResult
+	{
+		bool hit = false;
+		b2ShapeId shapeId = b2_nullShapeId; ///< closest shape of a cast, first of an overlap
+		b2Vec2 point = {0.0f, 0.0f};
+		b2Vec2 normal = {0.0f, 0.0f};
+		float fraction = 1.0f;
+		int32_t shapeCount = 0;                ///< shapes overlapping the box
+		b2ShapeId shapes[kMaxOverlapShapes]{}; ///< the first kMaxOverlapShapes of them
+	};
+
+	/// Closest shape along the segment from origin to origin + translation.
+	int32_t enqueueRayCast(
+	    b2Vec2 origin,
+	    b2Vec2 translation,
+	    b2QueryFilter filter = b2_defaultQueryFilter)
+	{
+		SceneQuery query{SceneQuery::kRayCast, filter};
+		query.origin.p = origin;
+		query.translation = translation;
+		return m_queries.enqueue(query);
+	}
+
+	/// Shapes whose bounding box overlaps aabb.
+	int32_t enqueueOverlap(b2AABB aabb, b2QueryFilter filter = b2_defaultQueryFilter)
+	{
+		SceneQuery query{SceneQuery::kOverlap, filter};
+		query.aabb = aabb;
+		return m_queries.enqueue(query);
+	}
+
+	/// Closest shape hit by a circle moving by translation from origin.
+	int32_t enqueueCircleCast(
+	    const b2Circle& circle,
+	    b2Transform origin,
+	    b2Vec2 translation,
+	    b2QueryFilter filter = b2_defaultQueryFilter)
+	{
+		SceneQuery query{SceneQuery::kCircleCast, filter};
+		query.circle = circle;
+		query.origin = origin;
+		query.translation = translation;
+		return m_queries.enqueue(query);
+	}
+
+	/// Closest shape hit by a polygon moving by translation from origin.
+	int32_t enqueuePolygonCast(
+	    const b2Polygon& polygon,
+	    b2Transform origin,
+	    b2Vec2 translation,
+	    b2QueryFilter filter = b2_defaultQueryFilter)
+	{
+		SceneQuery query{SceneQuery::kPolygonCast, filter};
+		query.polygon = polygon;
+		query.origin = origin;
+		query.translation = translation;
+		return m_queries.enqueue(query);
+	}
+
+	/// Result of a query enqueued before the previous update(), nullptr if the ticket was
+	/// not part of it.
+	const QueryResult* queryResult(int32_t ticket) const { return m_queries.result(ticket); }
+
+	/// Waits for the queries and the fixed steps running on the task threads, after which
+	/// the world can be changed until the next update() or fixedUpdate().
+	void waitForWorld()
+	{
+		m_scheduler.WaitforTask(&m_stepTask);
+		m_queries.wait(m_scheduler);
+	}
+
 	/*--------------------------------------------------------------------------------------*/
 private:
+	struct SceneQuery
+	{
+		enum Type : uint8_t
+		{
+			kRayCast,
+			kOverlap,
+			kCircleCast,
+			kPolygonCast,
+		};
+
+		// not an aggregate, SceneQuery{type, filter} would leave the other members without an
+		// initializer, which -Wextra warns about, and the union with none of them zeroed
+		SceneQuery(Type type_, b2QueryFilter filter_)
+		    : type(type_), filter(filter_), origin(), translation(), polygon() { }
+
+		Type type;
+		b2QueryFilter filter;
+		b2Transform origin;
+		b2Vec2 translation;
+		union
+		{
+			b2AABB aabb;
+			b2Circle circle;
+			b2Polygon polygon;
+		};
+	};
+
+	// keeps the closest hit of a ray or shape cast
+	static float castCallback(
+	    b2ShapeId shapeId,
+	    b2Vec2 point,
+	    b2Vec2 normal,
+	    float fraction,
+	    void* context)
+	{
+		auto* result = static_cast<QueryResult*>(context);
+		result->hit = true;
+		result->shapeId = shapeId;
+		result->point = point;
+		result->normal = normal;
+		result->fraction = fraction;
+		return fraction; // clip the cast
+	}
+
+	static bool overlapCallback(b2ShapeId shapeId, void* context)
+	{
+		auto* result = static_cast<QueryResult*>(context);
+		int32_t index = result->shapeCount++;
+		if (index < kMaxOverlapShapes) { result->shapes[index] = shapeId; }
+		if (index == 0) { result->shapeId = shapeId; }
+		result->hit = true;
+		return true;
+	}
+
+	// runs on the task threads, queries only read the world
+	static void executeQuery(const SceneQuery& query, QueryResult* result, void* context)
+	{
+		b2WorldId worldId = static_cast<PhysicsWorld*>(context)->m_worldId;
+		*result = QueryResult();
+		switch (query.type)
+		{
+		case SceneQuery::kRayCast:
+			b2World_RayCast(
+			    worldId, query.origin.p, query.translation, query.filter, castCallback,
+			    result);
+			break;
+		case SceneQuery::kOverlap:
+			b2World_QueryAABB(worldId, overlapCallback, query.aabb, query.filter, result);
+			break;
+		case SceneQuery::kCircleCast:
+			b2World_CircleCast(
+			    worldId, &query.circle, query.origin, query.translation, query.filter,
+			    castCallback, result);
+			break;
+		case SceneQuery::kPolygonCast:
+			b2World_PolygonCast(
+			    worldId, &query.polygon, query.origin, query.translation, query.filter,
+			    castCallback, result);
+			break;
+		}
+	}
+
 	class Task : public candybox::ITaskSet
 	{
 	public:
@@ -146,24 +468,16 @@ private:
 	    void* userContext)
 	{
 		auto* sample = static_cast<PhysicsWorld*>(userContext);
-		if (sample->m_taskCount < maxTasks)
-		{
-			auto& sampleTask = sample->m_tasks[sample->m_taskCount];
-			sampleTask.m_SetSize = itemCount;
-			sampleTask.m_MinRange = minRange;
-			sampleTask.m_task = task;
-			sampleTask.m_taskContext = taskContext;
-			sample->m_scheduler.AddTaskSetToPipe(&sampleTask);
-			++sample->m_taskCount;
-			return &sampleTask;
-		}
-		else
-		{
-			// This is not fatal but the maxTasks should be increased
-			assert(false);
-			task(0, itemCount, 0, taskContext);
-			return nullptr;
-		}
+		Task* sampleTask = sample->m_tasks.allocate();
+		sampleTask->m_SetSize = itemCount;
+		sampleTask->m_MinRange = minRange;
+		// box2d's minRange is a guess, measure the cost of each callback instead
+		sampleTask->m_PartitionPolicy = candybox::PARTITION_ADAPTIVE;
+		sampleTask->m_PartitionTag = (uintptr_t)task;
+		sampleTask->m_task = task;
+		sampleTask->m_taskContext = taskContext;
+		sample->m_scheduler.AddTaskSetToPipe(sampleTask);
+		return sampleTask;
 	}
 
 	static void finishTask(void* taskPtr, void* userContext)
@@ -176,10 +490,14 @@ private:
 		}
 	}
 
-	static constexpr int32_t maxTasks = 1024;
 	candybox::TaskScheduler m_scheduler;
-	Task m_tasks[maxTasks];
-	int32_t m_taskCount = 0;
+	candybox::TaskArena<Task> m_tasks; // reset after every b2World_Step
+	candybox::QueryBatch<SceneQuery, QueryResult> m_queries;
+	StepTask m_stepTask;
+	candybox::SnapshotBuffer<StepSnapshot> m_snapshots;
+	std::vector<b2BodyId> m_trackedBodies;
+	int32_t m_steppedFrames = 0;
+	int32_t m_overlappedFrames = 0;
 
 	/*--------------------------------------------------------------------------------------*/
 
@@ -216,6 +534,7 @@ private:
 public:
 	virtual void onMouseButton(b2Vec2 pw, int button, int action, int mods)
 	{
+		waitForWorld();
 		if (action == GLFW_PRESS)
 		{
 			if (B2_NON_NULL(m_mouseJointId)) return;
@@ -268,6 +587,7 @@ public:
 	{
 		if (B2_NON_NULL(m_mouseJointId))
 		{
+			waitForWorld();
 			b2MouseJoint_SetTarget(m_mouseJointId, pw);
 			b2BodyId bodyIdB = b2Joint_GetBodyB(m_mouseJointId);
 			b2Body_Wake(bodyIdB);
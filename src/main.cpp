@@ -6,6 +6,7 @@
 #include <iostream>
 #include <cstdint>
 #include <cstdlib>
+#include <cfloat>
 
 #include "candybox/Scene.hpp"
 #include "candybox/Color.hpp"
@@ -58,6 +59,7 @@ MainWorld::load()
 		b2Segment segment = {{-20.0f, 0.0f}, {20.0f, 0.0f}};
 		b2ShapeDef shapeDef = b2DefaultShapeDef();
 		b2Body_CreateSegment(groundId, &shapeDef, &segment);
+		m_groundSegment = segment; // the ground body is at the origin
 	}
 
 	// Define attachment
@@ -71,6 +73,7 @@ MainWorld::load()
 		b2ShapeDef shapeDef = b2DefaultShapeDef();
 		shapeDef.density = 1.0f;
 		b2Body_CreatePolygon(m_attachmentId, &shapeDef, &box);
+		m_trackedPolygons.push_back({trackBody(m_attachmentId), box});
 	}
 
 	// Define platform
@@ -86,6 +89,7 @@ MainWorld::load()
 		shapeDef.friction = 0.6f;
 		shapeDef.density = 2.0f;
 		b2Body_CreatePolygon(m_platformId, &shapeDef, &box);
+		m_trackedPolygons.push_back({trackBody(m_platformId), box});
 
 		b2RevoluteJointDef revoluteDef = b2DefaultRevoluteJointDef();
 		b2Vec2 pivot = {0.0f, 5.0f};
@@ -130,9 +134,30 @@ MainWorld::load()
 		shapeDef.density = 2.0f;
 
 		b2Body_CreatePolygon(bodyId, &shapeDef, &box);
+		m_trackedPolygons.push_back({trackBody(bodyId), box});
 	}
 }
 
+void
+MainWorld::renderSnapshot()
+{
+	const b2Color groundColor = {0.5f, 0.9f, 0.5f, 1.0f};
+	const b2Color bodyColor = {0.9f, 0.7f, 0.7f, 1.0f};
+	m_debugDraw.drawSegment(m_groundSegment.point1, m_groundSegment.point2, groundColor);
+	for (const TrackedPolygon &tracked : m_trackedPolygons)
+	{
+		BodyState state;
+		if (!getRenderState(tracked.index, &state)) continue;
+
+		b2Transform xf = {state.p, b2MakeRot(state.angle)};
+		b2Vec2 vertices[b2_maxPolygonVertices];
+		for (int32_t i = 0; i < tracked.polygon.count; ++i)
+			vertices[i] = b2TransformPoint(xf, tracked.polygon.vertices[i]);
+		m_debugDraw.drawSolidPolygon(vertices, tracked.polygon.count, bodyColor);
+	}
+	m_debugDraw.flush();
+}
+
 
 static void
 transformMat4x4(float *mat, float x, float y, float rotate, float scale)
@@ -336,7 +361,9 @@ App::render()
 //		nvgRestore(m_vg);
 //		nvgEndFrame(m_vg);
 
-				m_physicsWorld.debugRender();
+	// the fixed steps run meanwhile, the world is drawn from their snapshots
+	if (isFixedStep()) { m_physicsWorld.renderSnapshot(); }
+	else { m_physicsWorld.debugRender(); }
 
 	m_framebuffer->blit(prevFBO); // blit to prev FBO and rebind it
 
@@ -351,6 +378,8 @@ App::render()
 	}
 
 //	drawLights();
+
+	m_physicsWorld.endRender();
 }
 
 void
@@ -385,10 +414,58 @@ App::renderUI()
 		ImGui::ShowDemoWindow(&showDemoWindow);
 
 		ImGui::Checkbox("enable CRT", &m_enableCRT);
+
+		bool fixedStep = m_fixedStep;
+		if (ImGui::Checkbox("fixed step", &fixedStep)) { setFixedStep(fixedStep); }
+		if (m_fixedStep)
+		{
+			ImGui::Text(
+			    "steps overlapping the render: %d of %d frames",
+			    m_physicsWorld.getOverlappedFrames(), m_physicsWorld.getSteppedFrames());
+		}
+
+		renderSchedulerUI();
 	}
 	ImGui::Render();
 }
 
+void
+App::renderSchedulerUI()
+{
+	const candybox::TaskScheduler &scheduler = m_physicsWorld.getScheduler();
+	std::vector<candybox::ThreadTelemetry> telemetry(scheduler.GetNumTaskThreads());
+	scheduler.GetTelemetry(telemetry.data(), (uint32_t)telemetry.size());
+	if (m_prevTelemetry.size() != telemetry.size()) m_prevTelemetry = telemetry;
+
+	ImGui::Begin("Task Scheduler");
+	const float frameNs = m_frameTime * 1e9f;
+	candybox::ThreadTelemetry frameTotal;
+	for (size_t i = 0; i < telemetry.size(); ++i)
+	{
+		candybox::ThreadTelemetry frame = telemetry[i];
+		frame -= m_prevTelemetry[i];
+		frameTotal += frame;
+		ImGui::Text(
+		    "thread %u: busy %4.1f%% suspended %4.1f%% ranges %llu stolen %llu", (uint32_t)i,
+		    frameNs > 0.f ? 100.f * (float)frame.busyNs / frameNs : 0.f,
+		    frameNs > 0.f ? 100.f * (float)frame.suspendedNs / frameNs : 0.f,
+		    (unsigned long long)frame.numRangesRun, (unsigned long long)frame.numRangesStolen);
+	}
+	ImGui::Text(
+	    "split %llu, pipe full %llu", (unsigned long long)frameTotal.numSubTasksSplit,
+	    (unsigned long long)frameTotal.numPipeFullRunInline);
+
+	float histogram[candybox::TELEMETRY_HISTOGRAM_BUCKETS];
+	for (uint32_t bucket = 0; bucket < candybox::TELEMETRY_HISTOGRAM_BUCKETS; ++bucket)
+		histogram[bucket] = (float)frameTotal.rangeDurationHistogram[bucket];
+	ImGui::PlotHistogram(
+	    "range log2(ns)", histogram, candybox::TELEMETRY_HISTOGRAM_BUCKETS, 0, nullptr, 0.f,
+	    FLT_MAX, ImVec2(0.f, 60.f));
+	ImGui::End();
+
+	m_prevTelemetry = telemetry;
+}
+
 ShaderCRT::ShaderCRT()
     : candybox::Shader(
           "./resources/shaders/crt.vert",
@@ -511,6 +588,7 @@ ShaderShadow::use()
 
 #include "./vg_test/demo.hpp"
 #include "./vg_test/perf.hpp"
+#include "./vg_test/threadpool.h"
 #include "./vg_test/tests.cpp"
 #include "candybox/vg/VG_vtex.hpp"
 
@@ -535,6 +613,10 @@ VgApp::preload()
 		assert(m_vg);
 		nvglDelete(m_vg);
 		m_vg = nvgswCreate(NVG_SRGB);
+		m_scheduler.Initialize();
+		poolInit(&m_scheduler);
+		// has to be set before the framebuffer
+		nvgswSetThreading(m_vg, 2, std::max(numCPUCores() / 2, 1), poolSubmit, poolWait);
 		// have to set pixel format before loading any images
 		nvgswSetFramebuffer(m_vg, nullptr, 800, 800, 0, 8, 16, 24);
 	}
@@ -555,6 +637,8 @@ VgApp::cleanup()
 	{
 		free(m_blitterFB);
 		nvgswuDeleteBlitter(m_blitter);
+		poolInit(nullptr);
+		m_scheduler.WaitforAllAndShutdown();
 	}
 
 	printf("Average Frame Time: %.2f ms\n", getGraphAverage(&m_fps) * 1000.0f);
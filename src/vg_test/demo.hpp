@@ -6,6 +6,7 @@
 #include "perf.hpp"
 #include "candybox/vg/VG_sw_utils.hpp"
 #include "candybox/Scene.hpp"
+#include "candybox/TaskScheduler.hpp"
 
 #ifdef __cplusplus
 extern "C" {
@@ -84,6 +85,9 @@ private:
 
 	void* m_blitterFB = nullptr;
 	NVGSWUblitter* m_blitter = nullptr;
+	// private scheduler of the tile jobs of the software renderer, nothing else runs on it.
+	// poolInit() takes any scheduler, i.e. that of a PhysicsWorld to share its workers.
+	candybox::TaskScheduler m_scheduler;
 
 	DemoData m_data;
 };
@@ -1,28 +1,57 @@
 #include "threadpool.h"
-#include "threadutil.h"
+#include <vector>
+#include "candybox/TaskArena.hpp"
+#include "candybox/TaskScheduler.hpp"
 
-ThreadPool* threadPool = NULL;
-std::vector< std::future<void> > futures;
+namespace {
 
+// a job of poolSubmit() as a task set of one item
+struct PoolTask : public candybox::ITaskSet
+{
+  void ExecuteRange(candybox::TaskSetPartition, uint32_t) override { fn(arg); }
+
+  void (*fn)(void*) = NULL;
+  void* arg = NULL;
+};
+
+candybox::TaskScheduler* taskScheduler = NULL;
+candybox::TaskArena<PoolTask> tasks; // reset by poolWait()
+std::vector<PoolTask*> submitted;
+
+} // namespace
 
 int numCPUCores()
 {
-  return std::thread::hardware_concurrency();
+  return taskScheduler ? (int)taskScheduler->GetNumTaskThreads() : (int)candybox::GetNumHardwareThreads();
 }
 
-void poolInit(int nthreads)
+void poolInit(candybox::TaskScheduler* scheduler)
 {
-  threadPool = new ThreadPool(nthreads);
+  poolWait();
+  taskScheduler = scheduler;
 }
 
 void poolSubmit(void (*fn)(void*), void* arg)
 {
-  futures.push_back(threadPool->enqueue(fn, arg));  //[fn, arg](){ fn(arg); }));
+  if (!taskScheduler)
+  {
+    fn(arg);
+    return;
+  }
+
+  // added right away so workers start on it while the next jobs are submitted
+  PoolTask* task = tasks.allocate();
+  task->fn = fn;
+  task->arg = arg;
+  submitted.push_back(task);
+  taskScheduler->AddTaskSetToPipe(task);
 }
 
 void poolWait(void)
 {
-  for(auto& future : futures)
-    future.wait();
-  futures.clear();
+  // the waiting thread runs tasks too, including those of the simulation
+  for (PoolTask* task : submitted)
+    taskScheduler->WaitforTask(task);
+  submitted.clear();
+  tasks.reset();
 }
@@ -5,13 +5,22 @@
 extern "C" {
 #endif
 
+// poolSubmit() and poolWait() match the callbacks of nvgswSetThreading(). Jobs run as task
+// sets of the scheduler given to poolInit(), so rasterization shares its worker threads.
+// Both must be called from a thread which can use the TaskScheduler API.
 int numCPUCores();
-void poolInit(int nthreads);
 void poolSubmit(void (*fn)(void*), void* arg);
 void poolWait(void);
 
 #ifdef __cplusplus
 }
+
+namespace candybox {
+class TaskScheduler;
+}
+
+// Jobs run on the calling thread until a scheduler is set, pass NULL before shutting it down.
+void poolInit(candybox::TaskScheduler* scheduler);
 #endif
 
 #endif